@@ -0,0 +1,152 @@
+// CullingBenchmark: times FrustumCuller (headers/culling.h) on the stress entities of the
+// application, without a window or GL context, and prints the numbers to compare against the
+// 1 ms budget for a million spheres on one core.
+//
+//   CullingBenchmark [--count N] [--runs N] [--threads N] [--uniform]
+//
+// The entities are made like resizeStressEntities in main.cpp: groups of seven spinning
+// children around an invisible pivot, spread over an 80 m square, seen from the default camera.
+// --uniform scatters single spheres instead, so no batch of 8 is coherent. --threads 0 uses
+// every thread of the pool, the default 1 is the culling on the calling thread alone.
+// A plain read of the same bound arrays is timed as well, the floor for any cull of them.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "headers/scene.h"
+#include "headers/culling.h"
+#include "headers/thread_pool.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+namespace
+{
+    void makeStressEntities(Scene &scene, int count)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-40.0f, 40.0f), speed(-2.0f, 2.0f), size(0.05f, 0.3f);
+        int groupParent = -1;
+        for (int i = 0; i < count; i++)
+        {
+            int e;
+            if (i % 8 == 0)
+            {
+                e = scene.create(glm::vec3(position(rng), position(rng) * 0.25f, position(rng)), glm::vec3(1.0f));
+                groupParent = e;
+            }
+            else
+                e = scene.create(glm::vec3(speed(rng), speed(rng), speed(rng)), glm::vec3(size(rng)), groupParent);
+            scene.setSpin(e, glm::vec3(speed(rng), 1.0f, speed(rng)), speed(rng));
+            if (i % 8 != 0)
+                scene.setRenderable(e, 0, glm::vec3(0.0f), 1.0f);
+        }
+    }
+
+    void makeUniformEntities(Scene &scene, int count)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-40.0f, 40.0f), size(0.05f, 0.3f);
+        for (int i = 0; i < count; i++)
+        {
+            int e = scene.create(glm::vec3(position(rng), position(rng) * 0.25f, position(rng)), glm::vec3(size(rng)));
+            scene.setRenderable(e, 0, glm::vec3(0.0f), 1.0f);
+        }
+    }
+
+    struct Timing
+    {
+        double best = 0.0, median = 0.0;
+    };
+
+    template <typename Fn>
+    Timing measure(int runs, Fn fn)
+    {
+        std::vector<double> ms;
+        for (int run = 0; run < runs; run++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            fn();
+            ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        std::sort(ms.begin(), ms.end());
+        return { ms.front(), ms[ms.size() / 2] };
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int count = 1 << 20;
+    int runs = 200;
+    int threads = 1;
+    bool uniform = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc)
+            count = std::max(8, std::atoi(argv[++i]));
+        else if (arg == "--runs" && i + 1 < argc)
+            runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--uniform")
+            uniform = true;
+        else
+        {
+            std::cout << "usage: CullingBenchmark [--count N] [--runs N] [--threads N] [--uniform]" << std::endl;
+            return 1;
+        }
+    }
+
+    Scene scene;
+    if (uniform)
+        makeUniformEntities(scene, count);
+    else
+        makeStressEntities(scene, count);
+    scene.update(1.0f);
+
+    // the application's default camera and projection
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+    Frustum frustum = Frustum::fromViewProjection(projection * view);
+
+    ThreadPool pool(threads);
+    FrustumCuller culler;
+    std::vector<int> visible;
+    auto cull = [&]()
+    {
+        culler.cull(frustum, scene.worldBoundX.data(), scene.worldBoundY.data(), scene.worldBoundZ.data(),
+                    scene.worldBoundRadius.data(), scene.size(), visible, threads == 1 ? nullptr : &pool);
+    };
+    for (int warmup = 0; warmup < 10; warmup++)
+        cull();
+    Timing culling = measure(runs, cull);
+
+    // keeps the reads from being optimized away
+    volatile float sink = 0.0f;
+    Timing read = measure(runs, [&]()
+    {
+        f4 total = f4Set(0.0f);
+        const float* arrays[4] = { scene.worldBoundX.data(), scene.worldBoundY.data(), scene.worldBoundZ.data(), scene.worldBoundRadius.data() };
+        for (int e = 0; e + 4 <= scene.size(); e += 4)
+            total = f4Add(total, f4Add(f4Add(f4Load(arrays[0] + e), f4Load(arrays[1] + e)), f4Add(f4Load(arrays[2] + e), f4Load(arrays[3] + e))));
+        float lanes[4];
+        f4Store(lanes, total);
+        sink = sink + lanes[0];
+    });
+    double bytes = 4.0 * sizeof(float) * scene.size();
+
+    const FrustumCuller::Stats &stats = culler.last();
+    std::cout << std::fixed << std::setprecision(3)
+              << scene.size() << (uniform ? " uniform" : " stress") << " spheres, " << stats.visible << " visible, "
+              << stats.threads << (stats.threads == 1 ? " thread, " : " threads, ") << (stats.avx2 ? "AVX2" : "4-wide") << " path\n"
+              << "cull:  best " << culling.best << " ms, median " << culling.median << " ms over " << runs << " runs\n"
+              << "read:  best " << read.best << " ms, median " << read.median << " ms ("
+              << std::setprecision(1) << bytes / (read.best * 1e6) << " GB/s)" << std::endl;
+    return 0;
+}
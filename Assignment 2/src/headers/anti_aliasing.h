@@ -0,0 +1,546 @@
+#ifndef ANTI_ALIASING_H
+#define ANTI_ALIASING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "imgui.h"
+
+#include <shader.h>
+
+#include <functional>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// Anti-aliasing of the scene, one of:
+//   FXAA     one pass over the finished image, edges found and blended by their luma
+//   MSAA     the scene drawn into multisampled buffers and resolved with a blit; every
+//            covered sample pays for the depth test, the glass shaders still run once per pixel
+//   TAA      sub-pixel jittered projection, motion vectors from a velocity pass (current and
+//            previous model matrices, see velocity.vert) and a resolve blending the frame into
+//            a reprojected, clipped history (taa.frag)
+//
+// FXAA and TAA work on the finished image, so the scene goes into a target of ours from
+// beginScene() on and endScene() writes the result where it was headed. MSAA has to sit
+// right around the draws, below screen-space reflections which need a resolved image:
+// beginSamples() and resolveSamples(). Like the other passes the targets keep some headroom
+// and only the lower left corner is rendered to.
+//
+// Per frame:  beginScene()  [clear]  ...  beginSamples()  jitter(projection)  [shadows, probes]
+//             beginSceneDraws()  scene draws  resolveSamples()  ...  endScene(view, projection, velocity draws)
+class AntiAliasing
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+    static constexpr int JITTER_SAMPLES = 8;
+
+    enum Mode { OFF = 0, FXAA = 1, MSAA_2X = 2, MSAA_4X = 3, TAA = 4, MODE_COUNT = 5 };
+
+    int mode = TAA;
+    // TAA
+    float blend = 0.1f;             // weight of the new frame in the history
+    float clipGamma = 1.25f;        // history clipped to the mean +- gamma standard deviations
+    float motionRejection = 0.5f;   // extra blend per pixel of motion vector disagreement
+    // FXAA
+    float subpixel = 0.75f;
+    float edgeThreshold = 0.125f;
+
+    // GPU ms, smoothed, per mode: the scene draws and what the anti-aliasing itself adds. The
+    // scene is timed from beginSceneDraws(), the shadow and probe passes before it render into
+    // their own targets and cost the same in every mode
+    struct Cost
+    {
+        float scene = 0.0f;
+        float resolve = 0.0f;       // MSAA blit
+        float velocity = 0.0f;      // TAA velocity pass
+        float pass = 0.0f;          // FXAA or TAA resolve
+        bool measured = false;
+        float overhead() const { return resolve + velocity + pass; }
+    };
+
+    // draws every visible object with the velocity program, see velocity.vert
+    using DrawVelocity = std::function<void()>;
+
+    AntiAliasing()
+        : taaShader("shaders/fullscreen.vert", "shaders/taa.frag"),
+          fxaaShader("shaders/fullscreen.vert", "shaders/fxaa.frag")
+    {
+        glGenVertexArrays(1, &emptyVAO);
+        glGenFramebuffers(1, &sceneFBO);
+        glGenFramebuffers(1, &velocityFBO);
+        glGenFramebuffers(1, &passFBO);
+        glGenFramebuffers(1, &samplesFBO);
+        glGenQueries(FRAMES_IN_FLIGHT * 6, &queries[0][0]);
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    }
+
+    ~AntiAliasing()
+    {
+        release();
+        releaseSamples();
+        glDeleteQueries(FRAMES_IN_FLIGHT * 6, &queries[0][0]);
+        glDeleteFramebuffers(1, &sceneFBO);
+        glDeleteFramebuffers(1, &velocityFBO);
+        glDeleteFramebuffers(1, &passFBO);
+        glDeleteFramebuffers(1, &samplesFBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    AntiAliasing(const AntiAliasing&) = delete;
+    AntiAliasing& operator=(const AntiAliasing&) = delete;
+
+    // whether this frame (from beginScene() on) needs the previous world matrices
+    bool motionVectors() const { return frameMode == TAA; }
+
+    // FXAA and TAA take over from the bound framebuffer here
+    void beginScene()
+    {
+        readTimings();
+        frameMode = mode;
+        if (frameMode != TAA)
+            historyValid = false;
+
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        outputFBO = (GLuint)framebuffer;
+        glGetIntegerv(GL_VIEWPORT, outputViewport);
+        width = std::max(1, (int)outputViewport[2]);
+        height = std::max(1, (int)outputViewport[3]);
+
+        if (frameMode != FXAA && frameMode != TAA)
+            return;
+        reserve(width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glViewport(0, 0, width, height);
+    }
+
+    // MSAA takes over from the bound framebuffer (and its viewport) here, cleared like it
+    void beginSamples()
+    {
+        if (frameMode != MSAA_2X && frameMode != MSAA_4X)
+            return;
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        targetFBO = (GLuint)framebuffer;
+        glGetIntegerv(GL_VIEWPORT, targetViewport);
+        reserveSamples(std::min(frameMode == MSAA_2X ? 2 : 4, std::max(1, maxSamples)), targetViewport[2], targetViewport[3]);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, samplesFBO);
+        glViewport(0, 0, targetViewport[2], targetViewport[3]);
+        GLfloat clearColor[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        const GLfloat noSurface[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat farDepth = 1.0f;
+        glClearBufferfv(GL_COLOR, 0, clearColor);
+        glClearBufferfv(GL_COLOR, 1, noSurface);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    }
+
+    // the camera's draws into the scene start here, what comes before isn't part of its cost
+    void beginSceneDraws()
+    {
+        glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+    }
+
+    // the projection with this frame's sub-pixel offset under TAA, unchanged otherwise
+    glm::mat4 jitter(const glm::mat4 &projection)
+    {
+        if (frameMode != TAA)
+            return projection;
+        // Halton (2, 3), centered on the pixel
+        int index = (int)(frame % JITTER_SAMPLES) + 1;
+        jitterOffset = glm::vec2(halton(index, 2) - 0.5f, halton(index, 3) - 0.5f);
+        glm::mat4 jittered = projection;
+        jittered[2][0] += jitterOffset.x * 2.0f / width;
+        jittered[2][1] += jitterOffset.y * 2.0f / height;
+        return jittered;
+    }
+
+    // resolves the samples into the framebuffer bound at beginSamples()
+    void resolveSamples()
+    {
+        glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+        if (frameMode == MSAA_2X || frameMode == MSAA_4X)
+        {
+            int w = targetViewport[2], h = targetViewport[3];
+            int x = targetViewport[0], y = targetViewport[1];
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, samplesFBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFBO);
+            // a blit writes every draw buffer, so one attachment at a time
+            GLint drawBuffers[2] = { GL_NONE, GL_NONE };
+            glGetIntegerv(GL_DRAW_BUFFER0, &drawBuffers[0]);
+            glGetIntegerv(GL_DRAW_BUFFER1, &drawBuffers[1]);
+            int attachments = targetFBO == 0 ? 1 : 2;
+            for (int i = 0; i < attachments; i++)
+            {
+                if (drawBuffers[i] == GL_NONE)
+                    continue;
+                glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+                if (targetFBO != 0)
+                {
+                    GLenum buffer = (GLenum)drawBuffers[i];
+                    glDrawBuffers(1, &buffer);
+                }
+                glBlitFramebuffer(0, 0, w, h, x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            }
+            if (targetFBO != 0)
+            {
+                GLenum buffers[2] = { (GLenum)drawBuffers[0], (GLenum)drawBuffers[1] };
+                glDrawBuffers(2, buffers);
+            }
+            // the later passes test against (and read) the scene's depth
+            glBlitFramebuffer(0, 0, w, h, x, y, x + w, y + h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+            glViewport(x, y, w, h);
+        }
+        glQueryCounter(queries[slot][2], GL_TIMESTAMP);
+    }
+
+    // view and projection without the jitter; leaves the image in the framebuffer bound at beginScene()
+    void endScene(const glm::mat4 &view, const glm::mat4 &projection, const DrawVelocity &drawVelocity)
+    {
+        GLuint* frameQueries = queries[slot];
+        glQueryCounter(frameQueries[3], GL_TIMESTAMP);
+        glm::mat4 viewProjection = projection * view;
+
+        if (frameMode == TAA)
+        {
+            int current = (int)(frame % 2), previous = 1 - current;
+
+            // --- velocity ---
+            GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+            GLint depthFunc;
+            glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+            glBindFramebuffer(GL_FRAMEBUFFER, velocityFBO);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, velocityTextures[current], 0);
+            glViewport(0, 0, width, height);
+            const GLfloat still[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            const GLfloat farDepth = 1.0f;
+            glClearBufferfv(GL_COLOR, 0, still);
+            glClearBufferfv(GL_DEPTH, 0, &farDepth);
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_LESS);
+            velocityViewProjection = viewProjection;
+            drawVelocity();
+            glDepthFunc(depthFunc);
+            if (!depthTest)
+                glDisable(GL_DEPTH_TEST);
+            glQueryCounter(frameQueries[4], GL_TIMESTAMP);
+
+            // --- resolve ---
+            GLboolean blending = glIsEnabled(GL_BLEND);
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+            glBindVertexArray(emptyVAO);
+            glBindFramebuffer(GL_FRAMEBUFFER, passFBO);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTextures[current], 0);
+            taaShader.use();
+            bind(taaShader, "current", 0, colorTexture);
+            bind(taaShader, "velocityTexture", 1, velocityTextures[current]);
+            bind(taaShader, "depthTexture", 2, depthTexture);
+            bind(taaShader, "history", 3, historyTextures[previous]);
+            bind(taaShader, "previousVelocity", 4, velocityTextures[previous]);
+            taaShader.setIVec2("renderSize", width, height);
+            taaShader.setVec2("textureSize", (float)capacityWidth, (float)capacityHeight);
+            taaShader.setIVec2("previousSize", previousWidth, previousHeight);
+            taaShader.setBool("historyValid", historyValid);
+            taaShader.setFloat("blend", blend);
+            taaShader.setFloat("clipGamma", clipGamma);
+            taaShader.setFloat("motionRejection", motionRejection);
+            taaShader.setMat4("reprojection", previousViewProjection * glm::inverse(viewProjection));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            // the history is the output
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+            glBlitFramebuffer(0, 0, width, height, outputViewport[0], outputViewport[1],
+                              outputViewport[0] + width, outputViewport[1] + height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+            glViewport(outputViewport[0], outputViewport[1], outputViewport[2], outputViewport[3]);
+            restore(depthTest, blending);
+
+            previousWidth = width;
+            previousHeight = height;
+            historyValid = true;
+        }
+        else
+            glQueryCounter(frameQueries[4], GL_TIMESTAMP);
+
+        if (frameMode == FXAA)
+        {
+            GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+            GLboolean blending = glIsEnabled(GL_BLEND);
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+            glBindVertexArray(emptyVAO);
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+            glViewport(outputViewport[0], outputViewport[1], outputViewport[2], outputViewport[3]);
+            fxaaShader.use();
+            bind(fxaaShader, "scene", 0, colorTexture);
+            fxaaShader.setIVec2("renderSize", width, height);
+            fxaaShader.setVec2("textureSize", (float)capacityWidth, (float)capacityHeight);
+            fxaaShader.setIVec2("viewportOrigin", outputViewport[0], outputViewport[1]);
+            fxaaShader.setFloat("subpixel", subpixel);
+            fxaaShader.setFloat("edgeThreshold", edgeThreshold);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            restore(depthTest, blending);
+        }
+
+        glQueryCounter(frameQueries[5], GL_TIMESTAMP);
+        slotMode[slot] = frameMode;
+        if (pending[slot])
+            dropped++;
+        pending[slot] = true;
+        slot = (slot + 1) % FRAMES_IN_FLIGHT;
+
+        previousViewProjection = viewProjection;
+        frame++;
+    }
+
+    // for the velocity program, see velocity.vert
+    void setVelocityUniforms(Shader &program) const
+    {
+        program.setMat4("currentViewProjection", velocityViewProjection);
+        program.setMat4("previousViewProjection", previousViewProjection);
+    }
+
+    const Cost& cost(int m) const { return costs[m]; }
+
+    void drawUI()
+    {
+        ImGui::Combo("Anti-aliasing", &mode, "Off\0FXAA\0MSAA 2x\0MSAA 4x\0TAA\0");
+        if (mode == TAA)
+        {
+            ImGui::SliderFloat("TAA blend", &blend, 0.02f, 0.5f);
+            ImGui::SliderFloat("TAA clip gamma", &clipGamma, 0.5f, 3.0f);
+            ImGui::SliderFloat("TAA motion rejection", &motionRejection, 0.0f, 2.0f);
+        }
+        else if (mode == FXAA)
+        {
+            ImGui::SliderFloat("FXAA subpixel", &subpixel, 0.0f, 1.0f);
+            ImGui::SliderFloat("FXAA edge threshold", &edgeThreshold, 0.063f, 0.333f);
+        }
+        if ((mode == MSAA_2X || mode == MSAA_4X) && maxSamples < (mode == MSAA_2X ? 2 : 4))
+            ImGui::TextDisabled("  only %d samples supported", maxSamples);
+        // every mode that has run so far, to compare
+        static const char* names[MODE_COUNT] = { "Off", "FXAA", "MSAA 2x", "MSAA 4x", "TAA" };
+        for (int m = 0; m < MODE_COUNT; m++)
+        {
+            const Cost &c = costs[m];
+            if (!c.measured)
+                continue;
+            ImGui::Text("  %-8s scene %.3f ms + %.3f ms (resolve %.3f, velocity %.3f, pass %.3f)", names[m], c.scene,
+                        c.overhead(), c.resolve, c.velocity, c.pass);
+        }
+    }
+
+private:
+    Shader taaShader, fxaaShader;
+    unsigned int emptyVAO = 0;
+    unsigned int sceneFBO = 0, velocityFBO = 0, passFBO = 0, samplesFBO = 0;
+    unsigned int colorTexture = 0, depthTexture = 0;
+    unsigned int velocityTextures[2] = { 0, 0 }, historyTextures[2] = { 0, 0 };
+    // scene depth for the velocity pass and the TAA resolve; the scene's own is wherever it is drawn
+    unsigned int sceneDepthRBO = 0;
+    unsigned int sampleBuffers[3] = { 0, 0, 0 };   // color, normal, depth
+    int capacityWidth = 0, capacityHeight = 0;
+    int sampleCount = 0, sampleWidth = 0, sampleHeight = 0;
+    GLenum sampleDepthFormat = GL_NONE;
+    GLint maxSamples = 0;
+    int width = 1, height = 1;
+    int frameMode = OFF;
+    GLuint outputFBO = 0, targetFBO = 0;
+    GLint outputViewport[4] = { 0, 0, 0, 0 };
+    GLint targetViewport[4] = { 0, 0, 0, 0 };
+
+    long frame = 0;
+    glm::vec2 jitterOffset = glm::vec2(0.0f);
+    bool historyValid = false;
+    int previousWidth = 1, previousHeight = 1;
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    glm::mat4 velocityViewProjection = glm::mat4(1.0f);
+
+    GLuint queries[FRAMES_IN_FLIGHT][6] = {};
+    int slotMode[FRAMES_IN_FLIGHT] = {};
+    bool pending[FRAMES_IN_FLIGHT] = {};
+    int slot = 0;
+    long dropped = 0;
+    Cost costs[MODE_COUNT];
+
+    static float halton(int index, int base)
+    {
+        float result = 0.0f, fraction = 1.0f;
+        while (index > 0)
+        {
+            fraction /= base;
+            result += fraction * (index % base);
+            index /= base;
+        }
+        return result;
+    }
+
+    static void bind(Shader &shader, const char* name, int unit, unsigned int texture)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        shader.setInt(name, unit);
+    }
+
+    void restore(GLboolean depthTest, GLboolean blending) const
+    {
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (blending)
+            glEnable(GL_BLEND);
+    }
+
+    static unsigned int createTexture(GLint internalFormat, int w, int h, GLenum format, GLenum type, GLint filter)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    // grows with a quarter of headroom, shrinks only when less than half is used
+    void reserve(int w, int h)
+    {
+        bool fits = w <= capacityWidth && h <= capacityHeight;
+        bool wasteful = w * 2 < capacityWidth && h * 2 < capacityHeight;
+        if (fits && !wasteful)
+            return;
+        release();
+        capacityWidth = w + w / 4;
+        capacityHeight = h + h / 4;
+        historyValid = false;
+
+        colorTexture = createTexture(GL_RGBA8, capacityWidth, capacityHeight, GL_RGBA, GL_UNSIGNED_BYTE, GL_LINEAR);
+        depthTexture = createTexture(GL_DEPTH_COMPONENT24, capacityWidth, capacityHeight, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, GL_NEAREST);
+        for (unsigned int &velocity : velocityTextures)
+            velocity = createTexture(GL_RG16F, capacityWidth, capacityHeight, GL_RG, GL_FLOAT, GL_NEAREST);
+        for (unsigned int &history : historyTextures)
+            history = createTexture(GL_RGBA16F, capacityWidth, capacityHeight, GL_RGBA, GL_FLOAT, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenRenderbuffers(1, &sceneDepthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, sceneDepthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, capacityWidth, capacityHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, sceneDepthRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::ANTI_ALIASING::SCENE_FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, velocityFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, velocityTextures[0], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::ANTI_ALIASING::VELOCITY_FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+    }
+
+    void release()
+    {
+        if (!colorTexture)
+            return;
+        unsigned int textures[] = { colorTexture, depthTexture, velocityTextures[0], velocityTextures[1], historyTextures[0], historyTextures[1] };
+        glDeleteTextures(6, textures);
+        glDeleteRenderbuffers(1, &sceneDepthRBO);
+        colorTexture = depthTexture = sceneDepthRBO = 0;
+        velocityTextures[0] = velocityTextures[1] = historyTextures[0] = historyTextures[1] = 0;
+        capacityWidth = capacityHeight = 0;
+    }
+
+    // the depth format has to be the target's for the depth blit, so it's looked up there
+    void reserveSamples(int samples, int w, int h)
+    {
+        GLint depthBits = 24, stencilBits = 0, depthType = GL_UNSIGNED_NORMALIZED;
+        GLenum depthAttachment = targetFBO == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+        GLenum stencilAttachment = targetFBO == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+        glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+        glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &depthType);
+        GLint stencilType = GL_NONE;
+        glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &stencilType);
+        if (stencilType != GL_NONE)
+            glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+        GLenum depthFormat = stencilBits > 0 ? (depthType == GL_FLOAT ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8)
+                                             : (depthType == GL_FLOAT ? GL_DEPTH_COMPONENT32F : (depthBits > 24 ? GL_DEPTH_COMPONENT32 : GL_DEPTH_COMPONENT24));
+
+        bool fits = w <= sampleWidth && h <= sampleHeight;
+        bool wasteful = w * 2 < sampleWidth && h * 2 < sampleHeight;
+        if (fits && !wasteful && samples == sampleCount && depthFormat == sampleDepthFormat)
+            return;
+        releaseSamples();
+        sampleCount = samples;
+        sampleWidth = w + w / 4;
+        sampleHeight = h + h / 4;
+        sampleDepthFormat = depthFormat;
+
+        const GLenum formats[3] = { GL_RGBA8, GL_RGBA16F, depthFormat };
+        glGenRenderbuffers(3, sampleBuffers);
+        for (int i = 0; i < 3; i++)
+        {
+            glBindRenderbuffer(GL_RENDERBUFFER, sampleBuffers[i]);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, formats[i], sampleWidth, sampleHeight);
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, samplesFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sampleBuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_RENDERBUFFER, sampleBuffers[1]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, stencilBits > 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                                  GL_RENDERBUFFER, sampleBuffers[2]);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::ANTI_ALIASING::MULTISAMPLE_FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    }
+
+    void releaseSamples()
+    {
+        if (!sampleBuffers[0])
+            return;
+        glDeleteRenderbuffers(3, sampleBuffers);
+        sampleBuffers[0] = sampleBuffers[1] = sampleBuffers[2] = 0;
+        sampleWidth = sampleHeight = sampleCount = 0;
+    }
+
+    // oldest first, stops at the first frame the GPU hasn't finished
+    void readTimings()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            int oldest = (slot + i) % FRAMES_IN_FLIGHT;
+            if (!pending[oldest])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[oldest][5], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 stamps[6];
+            for (int q = 0; q < 6; q++)
+                glGetQueryObjectui64v(queries[oldest][q], GL_QUERY_RESULT, &stamps[q]);
+            pending[oldest] = false;
+
+            // 3 -> 4 is the velocity pass under TAA; 2 -> 3 (screen-space reflections) isn't ours
+            Cost &c = costs[slotMode[oldest]];
+            float k = c.measured ? 0.1f : 1.0f;
+            c.scene = glm::mix(c.scene, (float)((stamps[1] - stamps[0]) / 1e6), k);
+            c.resolve = glm::mix(c.resolve, (float)((stamps[2] - stamps[1]) / 1e6), k);
+            c.velocity = glm::mix(c.velocity, (float)((stamps[4] - stamps[3]) / 1e6), k);
+            c.pass = glm::mix(c.pass, (float)((stamps[5] - stamps[4]) / 1e6), k);
+            c.measured = true;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include <gl_extensions.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+// Command line switches of the headless benchmark:
+//   --bench                 run it (nothing below has any effect without it)
+//   --bench-size WxH        offscreen resolution, default 1280x720
+//   --bench-warmup N        frames rendered before measuring, default 60
+//   --bench-frames M        measured frames, default 300
+//   --bench-out NAME        writes NAME.csv (per frame) and NAME.json (summary), default "benchmark"
+//   --software              Mesa llvmpipe; without a display server GLFW's null platform + OSMesa
+struct BenchmarkSettings
+{
+    bool enabled = false;
+    int width = 1280;
+    int height = 720;
+    int warmupFrames = 60;
+    int measuredFrames = 300;
+    bool measuredFramesGiven = false;
+    bool software = false;
+    std::string output = "benchmark";
+
+    static BenchmarkSettings fromArguments(int argc, char** argv)
+    {
+        BenchmarkSettings settings;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--bench")
+                settings.enabled = true;
+            else if (arg == "--software")
+                settings.software = true;
+            else if (arg == "--bench-size" && hasValue)
+            {
+                std::string size = argv[++i];
+                size_t x = size.find('x');
+                if (x != std::string::npos)
+                {
+                    settings.width = std::max(16, std::atoi(size.substr(0, x).c_str()));
+                    settings.height = std::max(16, std::atoi(size.substr(x + 1).c_str()));
+                }
+            }
+            else if (arg == "--bench-warmup" && hasValue)
+                settings.warmupFrames = std::max(0, std::atoi(argv[++i]));
+            else if (arg == "--bench-frames" && hasValue)
+            {
+                settings.measuredFrames = std::max(1, std::atoi(argv[++i]));
+                settings.measuredFramesGiven = true;
+            }
+            else if (arg == "--bench-out" && hasValue)
+                settings.output = argv[++i];
+        }
+        return settings;
+    }
+
+    // before glfwInit()
+    void initHints() const
+    {
+        if (!software)
+            return;
+#ifdef _WIN32
+        _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+#else
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+#endif
+        if (headless())
+            glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
+
+    // after glfwInit(), before the window is created
+    void windowHints() const
+    {
+        if (!enabled)
+            return;
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        if (software && headless())
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    }
+
+    // no X11/Wayland to open a window on
+    static bool headless()
+    {
+#if defined(__linux__)
+        return !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY");
+#else
+        return false;
+#endif
+    }
+};
+
+// Fixed workload runner: renders warmup + measured frames into an offscreen framebuffer with
+// a fixed time step, so every run sees the same animation and camera path no matter how fast
+// it goes. GPU time comes from one GL_TIME_ELAPSED query per measured frame, all read after
+// the run; CPU time is the wall time from one beginFrame() to the next.
+//
+// Per frame:  beginFrame()  render into the bound framebuffer  endFrame(draws)  swap
+class Benchmark
+{
+public:
+    // seconds of animation per frame
+    static constexpr float TIME_STEP = 1.0f / 60.0f;
+
+    explicit Benchmark(const BenchmarkSettings &settings) : settings(settings)
+    {
+        glGenFramebuffers(1, &FBO);
+        glGenTextures(1, &colorTexture);
+        glGenRenderbuffers(1, &depthRBO);
+
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, settings.width, settings.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, settings.width, settings.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::BENCHMARK::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        timers.resize(settings.measuredFrames);
+        glGenQueries((GLsizei)timers.size(), timers.data());
+        gpuMemory = glExt.has("GL_NVX_gpu_memory_info");
+        std::cout << "Benchmark: " << settings.warmupFrames << " warm-up + " << settings.measuredFrames << " measured frames at "
+                  << settings.width << "x" << settings.height << " on " << glExt.renderer << std::endl;
+    }
+
+    ~Benchmark()
+    {
+        glDeleteQueries((GLsizei)timers.size(), timers.data());
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteTextures(1, &colorTexture);
+        glDeleteRenderbuffers(1, &depthRBO);
+    }
+
+    Benchmark(const Benchmark&) = delete;
+    Benchmark& operator=(const Benchmark&) = delete;
+
+    bool done() const { return frame >= settings.warmupFrames + settings.measuredFrames; }
+    // animation time of the current frame
+    float time() const { return frame * TIME_STEP; }
+    // animation time since the first measured frame, 0 during warm-up
+    float measuredTime() const { return std::max(0, frame - settings.warmupFrames) * TIME_STEP; }
+    float aspect() const { return (float)settings.width / (float)settings.height; }
+
+    // the fixed camera path: one orbit around `center` every `period` seconds, bobbing up and down
+    glm::vec3 cameraPosition(const glm::vec3 &center, float radius, float height, float period = 12.0f) const
+    {
+        float angle = time() / period * 6.2831853f;
+        return center + glm::vec3(std::cos(angle) * radius, height + std::sin(angle * 2.0f) * radius * 0.15f, std::sin(angle) * radius);
+    }
+
+    // binds the offscreen target; everything rendered until endFrame() counts
+    void beginFrame()
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        if (measuring())
+            lastStart = now;
+        if (frame > settings.warmupFrames && (size_t)(frame - settings.warmupFrames - 1) < samples.size())
+            samples[frame - settings.warmupFrames - 1].cpuMs = std::chrono::duration<double, std::milli>(now - previousStart).count();
+        previousStart = now;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, settings.width, settings.height);
+        if (measuring())
+            glBeginQuery(GL_TIME_ELAPSED, timers[frame - settings.warmupFrames]);
+    }
+
+    void endFrame(int drawCalls)
+    {
+        if (measuring())
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            Sample sample;
+            sample.drawCalls = drawCalls;
+            sample.residentKB = residentKB();
+            sample.gpuMemoryKB = gpuMemoryUsedKB();
+            samples.push_back(sample);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        frame++;
+    }
+
+    // reads the GPU timers and writes the report; call once done() is true
+    void finish()
+    {
+        if (!samples.empty())
+            samples.back().cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - lastStart).count();
+        glFinish();
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(timers[i], GL_QUERY_RESULT, &ns);
+            samples[i].gpuMs = ns / 1e6;
+        }
+
+        std::ofstream csv(settings.output + ".csv");
+        csv << "frame,cpu_ms,gpu_ms,draw_calls,rss_kb,gpu_memory_kb\n";
+        for (size_t i = 0; i < samples.size(); i++)
+            csv << i << "," << samples[i].cpuMs << "," << samples[i].gpuMs << "," << samples[i].drawCalls << ","
+                << samples[i].residentKB << "," << samples[i].gpuMemoryKB << "\n";
+
+        std::vector<double> cpu, gpu, draws;
+        long peakResident = 0, peakGpuMemory = -1;
+        for (const Sample &sample : samples)
+        {
+            cpu.push_back(sample.cpuMs);
+            gpu.push_back(sample.gpuMs);
+            draws.push_back(sample.drawCalls);
+            peakResident = std::max(peakResident, sample.residentKB);
+            peakGpuMemory = std::max(peakGpuMemory, sample.gpuMemoryKB);
+        }
+        std::ofstream json(settings.output + ".json");
+        json << "{\n"
+             << "  \"app\": \"RealTimeRendering\",\n"
+             << "  \"renderer\": \"" << escaped(glExt.renderer) << "\",\n"
+             << "  \"gl_version\": \"" << glExt.major << "." << glExt.minor << "\",\n"
+             << "  \"width\": " << settings.width << ",\n"
+             << "  \"height\": " << settings.height << ",\n"
+             << "  \"warmup_frames\": " << settings.warmupFrames << ",\n"
+             << "  \"measured_frames\": " << samples.size() << ",\n"
+             << "  \"cpu_ms\": " << statistics(cpu) << ",\n"
+             << "  \"gpu_ms\": " << statistics(gpu) << ",\n"
+             << "  \"draw_calls\": " << statistics(draws) << ",\n"
+             << "  \"peak_rss_kb\": " << peakResident << ",\n"
+             << "  \"peak_gpu_memory_kb\": " << (peakGpuMemory >= 0 ? std::to_string(peakGpuMemory) : "null") << "\n"
+             << "}\n";
+
+        std::sort(cpu.begin(), cpu.end());
+        std::sort(gpu.begin(), gpu.end());
+        std::cout << "Benchmark: CPU ms p50 " << percentile(cpu, 50) << ", p95 " << percentile(cpu, 95) << ", p99 " << percentile(cpu, 99)
+                  << " | GPU ms p50 " << percentile(gpu, 50) << ", p95 " << percentile(gpu, 95) << ", p99 " << percentile(gpu, 99)
+                  << " -> " << settings.output << ".csv/.json" << std::endl;
+    }
+
+private:
+    struct Sample
+    {
+        double cpuMs = 0.0;
+        double gpuMs = 0.0;
+        int drawCalls = 0;
+        long residentKB = 0;
+        long gpuMemoryKB = -1;
+    };
+
+    BenchmarkSettings settings;
+    unsigned int FBO = 0, colorTexture = 0, depthRBO = 0;
+    std::vector<GLuint> timers;
+    std::vector<Sample> samples;
+    int frame = 0;
+    bool gpuMemory = false;
+    std::chrono::high_resolution_clock::time_point previousStart, lastStart;
+
+    bool measuring() const { return frame >= settings.warmupFrames && !done(); }
+
+    // nearest rank on sorted values
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    static std::string statistics(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double v : values)
+            sum += v;
+        double avg = values.empty() ? 0.0 : sum / values.size();
+        return "{ \"min\": " + std::to_string(values.empty() ? 0.0 : values.front()) +
+               ", \"avg\": " + std::to_string(avg) +
+               ", \"p50\": " + std::to_string(percentile(values, 50)) +
+               ", \"p95\": " + std::to_string(percentile(values, 95)) +
+               ", \"p99\": " + std::to_string(percentile(values, 99)) +
+               ", \"max\": " + std::to_string(values.empty() ? 0.0 : values.back()) + " }";
+    }
+
+    static std::string escaped(const std::string &text)
+    {
+        std::string out;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    static long residentKB()
+    {
+#if defined(__linux__)
+        long pages = 0, resident = 0;
+        std::ifstream statm("/proc/self/statm");
+        if (!(statm >> pages >> resident))
+            return 0;
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#elif defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+            return 0;
+        return (long)(info.resident_size / 1024);
+#else
+        return 0;
+#endif
+    }
+
+    // GL_NVX_gpu_memory_info, -1 elsewhere
+    long gpuMemoryUsedKB() const
+    {
+        if (!gpuMemory)
+            return -1;
+        GLint total = 0, available = 0;
+        glGetIntegerv(0x9048, &total);       // GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+        glGetIntegerv(0x9049, &available);   // GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+        return (long)total - (long)available;
+    }
+};
+
+#endif
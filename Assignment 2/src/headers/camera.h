@@ -22,6 +22,15 @@ const float SPEED       =  2.5f;
 const float SENSITIVITY =  0.1f;
 const float ZOOM        =  45.0f;
 
+// The Camera uniform block of the scene shaders, std140 layout. Written once per frame into
+// the frame ring buffer and bound at CAMERA_BLOCK_BINDING.
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 cameraPos;   // w unused
+};
+
 
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
 class Camera
@@ -116,6 +125,24 @@ public:
             Zoom = 45.0f;
     }
 
+    // turns the camera towards a point by recomputing Yaw and Pitch
+    void LookAt(const glm::vec3 &target)
+    {
+        glm::vec3 direction = glm::normalize(target - Position);
+        Yaw   = glm::degrees(atan2(direction.z, direction.x));
+        Pitch = glm::degrees(asin(glm::clamp(direction.y, -1.0f, 1.0f)));
+        updateCameraVectors();
+    }
+
+    // places the camera with explicit Euler angles, e.g. from a recorded path
+    void SetPose(const glm::vec3 &position, float yaw, float pitch)
+    {
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
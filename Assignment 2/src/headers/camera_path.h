@@ -0,0 +1,283 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include <camera.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+// Camera recordings are plain text, one record per line, times in seconds since the start:
+//
+//   C time x y z yaw pitch zoom    camera state at the end of a frame (a keyframe)
+//   K time direction deltaTime     Camera::ProcessKeyboard
+//   M time xoffset yoffset         Camera::ProcessMouseMovement
+//   S time yoffset                 Camera::ProcessMouseScroll
+//
+// '#' starts a comment. A hand written path only needs C lines.
+
+// All camera input goes through here instead of straight to the Camera, so that while
+// recording every call is logged along with the camera state once per frame.
+class CameraRecorder
+{
+public:
+    // `camera` is where the recording starts, before any input
+    bool start(const std::string &path, const Camera &camera)
+    {
+        file.open(path);
+        if (!file)
+        {
+            std::cout << "ERROR::CAMERA_RECORDER::FILE_NOT_WRITABLE " << path << std::endl;
+            return false;
+        }
+        // enough digits that replayed floats come back bit for bit
+        file.precision(9);
+        file << "# camera recording: C time x y z yaw pitch zoom | K time direction deltaTime | M time dx dy | S time dy\n";
+        writeKey(camera);
+        return true;
+    }
+
+    bool recording() const { return file.is_open(); }
+
+    void keyboard(Camera &camera, Camera_Movement direction, float deltaTime)
+    {
+        camera.ProcessKeyboard(direction, deltaTime);
+        if (recording())
+            file << "K " << now << " " << (int)direction << " " << deltaTime << "\n";
+    }
+
+    void mouseMovement(Camera &camera, float xoffset, float yoffset)
+    {
+        camera.ProcessMouseMovement(xoffset, yoffset);
+        if (recording())
+            file << "M " << now << " " << xoffset << " " << yoffset << "\n";
+    }
+
+    void mouseScroll(Camera &camera, float yoffset)
+    {
+        camera.ProcessMouseScroll(yoffset);
+        if (recording())
+            file << "S " << now << " " << yoffset << "\n";
+    }
+
+    // input from here on is stamped with this frame's time
+    void beginFrame(float time)
+    {
+        if (frames++ == 0)
+            origin = time;
+        now = time - origin;
+    }
+
+    // once the frame's input was processed
+    void endFrame(const Camera &camera)
+    {
+        if (recording())
+            writeKey(camera);
+    }
+
+private:
+    std::ofstream file;
+    float origin = 0.0f;
+    float now = 0.0f;   // seconds since the first frame
+    long frames = 0;
+
+    void writeKey(const Camera &camera)
+    {
+        file << "C " << now << " " << camera.Position.x << " " << camera.Position.y << " " << camera.Position.z << " "
+             << camera.Yaw << " " << camera.Pitch << " " << camera.Zoom << "\n";
+    }
+};
+
+// Plays a recording back at whatever time the caller asks for, normally a fixed time step
+// so two runs render exactly the same frames.
+//   INPUT   re-runs the logged input from the starting pose on, keyboard movement with the
+//           recorded deltaTime, so the path is the same no matter the replay frame rate
+//   SPLINE  Catmull-Rom through the keyframes; the only choice for hand written paths,
+//           and immune to changes of camera speed or sensitivity between builds
+class CameraPlayer
+{
+public:
+    enum Mode { INPUT, SPLINE };
+
+    // seconds per frame when the player owns the clock
+    static constexpr float TIME_STEP = 1.0f / 60.0f;
+
+    bool load(const std::string &path, bool forceSpline = false)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            std::cout << "ERROR::CAMERA_PLAYER::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        keys.clear();
+        events.clear();
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line))
+        {
+            lineNumber++;
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream fields(line);
+            char type = 0;
+            fields >> type;
+            bool ok = false;
+            if (type == 'C')
+            {
+                Key key;
+                ok = (bool)(fields >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch >> key.zoom);
+                if (ok)
+                    keys.push_back(key);
+            }
+            else if (type == 'K' || type == 'M' || type == 'S')
+            {
+                Event event;
+                event.type = type;
+                fields >> event.time;
+                if (type == 'K')
+                    ok = (bool)(fields >> event.direction >> event.a);
+                else if (type == 'M')
+                    ok = (bool)(fields >> event.a >> event.b);
+                else
+                    ok = (bool)(fields >> event.a);
+                if (ok)
+                    events.push_back(event);
+            }
+            if (!ok)
+                std::cout << "WARNING::CAMERA_PLAYER::BAD_LINE " << path << ":" << lineNumber << std::endl;
+        }
+        // hand written files need not be in order; equal times keep their file order
+        std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) { return a.time < b.time; });
+        std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.time < b.time; });
+
+        if (keys.empty())
+        {
+            std::cout << "ERROR::CAMERA_PLAYER::NO_KEYFRAMES " << path << std::endl;
+            events.clear();
+            return false;
+        }
+        mode = events.empty() || forceSpline ? SPLINE : INPUT;
+        nextEvent = 0;
+        started = false;
+        std::cout << "Camera path " << path << ": " << keys.size() << " keyframes, " << events.size() << " input events, "
+                  << duration() << " s, " << (mode == INPUT ? "replaying input" : "spline") << std::endl;
+        return true;
+    }
+
+    bool active() const { return !keys.empty(); }
+    Mode playbackMode() const { return mode; }
+
+    float duration() const
+    {
+        float end = keys.empty() ? 0.0f : keys.back().time;
+        if (mode == INPUT && !events.empty())
+            end = std::max(end, events.back().time);
+        return end;
+    }
+
+    // puts the camera where the recording has it at `time`; times must not go backwards.
+    // Returns false once past the end, the camera then stays on the last pose.
+    bool update(Camera &camera, float time)
+    {
+        if (!active())
+            return false;
+        if (mode == SPLINE)
+        {
+            evaluate(camera, time);
+            return time <= duration();
+        }
+
+        if (!started)
+        {
+            apply(camera, keys.front());
+            started = true;
+        }
+        for (; nextEvent < events.size() && events[nextEvent].time <= time; nextEvent++)
+        {
+            const Event &event = events[nextEvent];
+            if (event.type == 'K')
+                camera.ProcessKeyboard((Camera_Movement)event.direction, event.a);
+            else if (event.type == 'M')
+                camera.ProcessMouseMovement(event.a, event.b);
+            else
+                camera.ProcessMouseScroll(event.a);
+        }
+        return time <= duration();
+    }
+
+private:
+    struct Key
+    {
+        float time = 0.0f;
+        glm::vec3 position = glm::vec3(0.0f);
+        float yaw = YAW;
+        float pitch = PITCH;
+        float zoom = ZOOM;
+    };
+    struct Event
+    {
+        char type = 'K';
+        float time = 0.0f;
+        int direction = 0;
+        float a = 0.0f, b = 0.0f;
+    };
+
+    std::vector<Key> keys;
+    std::vector<Event> events;
+    Mode mode = SPLINE;
+    size_t nextEvent = 0;
+    bool started = false;
+
+    static void apply(Camera &camera, const Key &key)
+    {
+        camera.SetPose(key.position, key.yaw, key.pitch);
+        camera.Zoom = key.zoom;
+    }
+
+    template <typename T>
+    static T catmullRom(const T &p0, const T &p1, const T &p2, const T &p3, float t)
+    {
+        float t2 = t * t, t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+    void evaluate(Camera &camera, float time) const
+    {
+        if (keys.size() == 1 || time <= keys.front().time)
+        {
+            apply(camera, keys.front());
+            return;
+        }
+        if (time >= keys.back().time)
+        {
+            apply(camera, keys.back());
+            return;
+        }
+        // segment [i, i + 1] containing time, its neighbours clamped at the ends
+        size_t i = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const Key &key) { return t < key.time; }) - keys.begin() - 1;
+        const Key &k0 = keys[i > 0 ? i - 1 : i];
+        const Key &k1 = keys[i];
+        const Key &k2 = keys[i + 1];
+        const Key &k3 = keys[std::min(i + 2, keys.size() - 1)];
+        float span = k2.time - k1.time;
+        float t = span > 0.0f ? (time - k1.time) / span : 1.0f;
+
+        Key key;
+        key.position = catmullRom(k0.position, k1.position, k2.position, k3.position, t);
+        // no wrapping: recorded yaw is continuous, mouse movement just keeps adding to it
+        glm::vec3 angles = catmullRom(glm::vec3(k0.yaw, k0.pitch, k0.zoom), glm::vec3(k1.yaw, k1.pitch, k1.zoom),
+                                      glm::vec3(k2.yaw, k2.pitch, k2.zoom), glm::vec3(k3.yaw, k3.pitch, k3.zoom), t);
+        key.yaw = angles.x;
+        key.pitch = glm::clamp(angles.y, -89.0f, 89.0f);
+        key.zoom = glm::clamp(angles.z, 1.0f, 45.0f);
+        apply(camera, key);
+    }
+};
+
+#endif
@@ -0,0 +1,479 @@
+#ifndef CASCADED_SHADOWS_H
+#define CASCADED_SHADOWS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "imgui.h"
+
+#include <shader.h>
+#include <camera.h>
+#include <ring_buffer.h>
+
+#include <functional>
+#include <string>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// Shadows of the sun, a directional light, as 2-4 cascades over the first shadowDistance units
+// of the view frustum. Splits are a blend of logarithmic and uniform spacing (splitLambda).
+//
+// Each cascade is the bounding sphere of its slice of the frustum, measured in view space so
+// its size only depends on the projection, and its center is snapped to whole texels in light
+// space (and to coarse steps along the light), which keeps the edges from shimmering.
+//
+// Static casters are cached: every cascade has a second depth layer holding only them. That
+// layer has the cascade's texel size but a border of resolution / 8 texels all around, and its
+// center scrolls in steps of that border, so the cascade's window always lies inside it. Each
+// frame the window is blitted out of the cached layer at its offset and only the dynamic
+// casters are drawn on top. A layer is rendered again only when it scrolls (the camera moved
+// an eighth of the cascade), the cascade's size or the sun changes, or invalidateStatic().
+//
+// Casters are drawn by the caller with a depth-only program reading the Camera block, which
+// render() points at the cascade's light matrices. Receivers get everything through bind().
+class CascadedShadows
+{
+public:
+    static constexpr int MAX_CASCADES = 4;
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    enum Casters { STATIC_CASTERS, DYNAMIC_CASTERS };
+    // draws the casters of one kind for a cascade, returns the number of draw calls
+    using DrawCasters = std::function<int(int cascade, Casters casters)>;
+
+    struct CascadeStats
+    {
+        float splitFar = 0.0f;      // view depth where the cascade ends
+        float texelSize = 0.0f;     // world units per shadow map texel
+        int staticDraws = 0;        // 0 unless the static layer was rendered this frame
+        int dynamicDraws = 0;
+        bool staticRendered = false;
+        float ms = 0.0f;            // GPU, smoothed
+    };
+    struct Stats
+    {
+        CascadeStats cascades[MAX_CASCADES];
+        int rendered = 0;           // cascades rendered last frame, fewer when the ring was full
+        long staticRebuilds = 0;    // cascades whose static layer was rendered, in total
+        long ringFullFrames = 0;    // frames that ran out of ring buffer space for camera blocks
+    };
+
+    bool enabled = true;
+    int cascadeCount = 3;
+    float shadowDistance = 40.0f;
+    float splitLambda = 0.75f;
+    // how far towards the sun a cascade still catches casters outside its sphere
+    float casterMargin = 30.0f;
+    int pcfRadius = 1;              // (2r + 1)^2 hardware filtered taps
+    float slopeBias = 2.0f;         // glPolygonOffset while rendering casters
+    float constantBias = 4.0f;
+    float normalBias = 1.5f;        // receiver offset along the normal, in texels
+    bool cacheStatic = true;
+    // degrees; the sun moves, the static layers follow
+    float sunAzimuth = 35.0f;
+    float sunElevation = 50.0f;
+
+    CascadedShadows(int resolution = 2048) : resolution(resolution), staticBorder(resolution / 8)
+    {
+        glGenFramebuffers(1, &shadowFBO);
+        glGenFramebuffers(1, &staticFBO);
+        for (GLuint framebuffer : { shadowFBO, staticFBO })
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glGenQueries(FRAMES_IN_FLIGHT * (MAX_CASCADES + 1), &queries[0][0]);
+        shadowMap = createLayers(resolution, true);
+    }
+
+    ~CascadedShadows()
+    {
+        glDeleteQueries(FRAMES_IN_FLIGHT * (MAX_CASCADES + 1), &queries[0][0]);
+        glDeleteTextures(1, &shadowMap);
+        if (staticMap)
+            glDeleteTextures(1, &staticMap);
+        glDeleteFramebuffers(1, &shadowFBO);
+        glDeleteFramebuffers(1, &staticFBO);
+    }
+
+    CascadedShadows(const CascadedShadows&) = delete;
+    CascadedShadows& operator=(const CascadedShadows&) = delete;
+
+    // unit vector towards the sun
+    glm::vec3 sunDirection() const
+    {
+        float azimuth = glm::radians(sunAzimuth), elevation = glm::radians(sunElevation);
+        return glm::vec3(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+    }
+
+    // the static casters changed: every cached layer is rendered again
+    void invalidateStatic()
+    {
+        for (Cascade &cascade : cascades)
+            cascade.staticValid = false;
+    }
+
+    // fits the cascades to the camera; near, far and field of view come from the projection
+    void update(const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        readTimings();
+        cascadeCount = glm::clamp(cascadeCount, 2, MAX_CASCADES);
+        if (!enabled)
+            return;
+
+        float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+        float tanY = 1.0f / projection[1][1];
+        float tanX = 1.0f / projection[0][0];
+        float farPlane = std::max(shadowDistance, nearPlane * 2.0f);
+        glm::mat4 inverseView = glm::inverse(view);
+        // a change of the sun moves every static layer
+        glm::vec3 sunNow = sunDirection();
+        if (sunNow != cachedSun)
+        {
+            invalidateStatic();
+            cachedSun = sunNow;
+        }
+
+        glm::vec3 sun = sunDirection();
+        glm::vec3 up = std::abs(sun.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), -sun, up);
+
+        float splitNear = nearPlane;
+        for (int i = 0; i < cascadeCount; i++)
+        {
+            float t = (float)(i + 1) / cascadeCount;
+            float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+            float uniform = nearPlane + (farPlane - nearPlane) * t;
+            float splitFar = glm::mix(uniform, logarithmic, splitLambda);
+
+            // bounding sphere of the slice's eight corners, in view space: the same for every
+            // camera position and orientation
+            glm::vec3 corners[8];
+            glm::vec3 viewCenter(0.0f);
+            for (int c = 0; c < 8; c++)
+            {
+                float z = c < 4 ? splitNear : splitFar;
+                corners[c] = glm::vec3((c & 1 ? 1.0f : -1.0f) * z * tanX, (c & 2 ? 1.0f : -1.0f) * z * tanY, -z);
+                viewCenter += corners[c] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (const glm::vec3 &corner : corners)
+                radius = std::max(radius, glm::length(corner - viewCenter));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+            glm::vec3 center = glm::vec3(inverseView * glm::vec4(viewCenter, 1.0f));
+
+            // snap in light space: whole texels across, quarter radii along the light. The map
+            // reaches a texel past the sphere, snapping moves the center by less than that.
+            float texel = 2.0f * radius / (resolution - 2);
+            float extent = radius + texel;
+            float depthStep = radius * 0.25f;
+            glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+            glm::ivec2 texelCenter((int)std::floor(lightCenter.x / texel), (int)std::floor(lightCenter.y / texel));
+            lightCenter.x = texelCenter.x * texel;
+            lightCenter.y = texelCenter.y * texel;
+            lightCenter.z = std::floor(lightCenter.z / depthStep) * depthStep;
+
+            Cascade &cascade = cascades[i];
+            float towardsSun = radius + casterMargin;
+            cascade.view = glm::translate(glm::mat4(1.0f), -(lightCenter + glm::vec3(0.0f, 0.0f, towardsSun))) * lightRotation;
+            cascade.farPlane = towardsSun + radius + depthStep;
+            cascade.projection = glm::ortho(-extent, extent, -extent, extent, 0.0f, cascade.farPlane);
+            cascade.extent = extent;
+
+            // the static layer: same depth range, centered on the border step below the cascade's
+            // center, so the cascade is offset by 0..staticBorder - 1 texels inside the border
+            glm::ivec2 staticCenter(floorStep(texelCenter.x, staticBorder), floorStep(texelCenter.y, staticBorder));
+            float staticExtent = extent + staticBorder * texel;
+            glm::vec3 staticLightCenter(staticCenter.x * texel, staticCenter.y * texel, lightCenter.z);
+            glm::mat4 staticView = glm::translate(glm::mat4(1.0f), -(staticLightCenter + glm::vec3(0.0f, 0.0f, towardsSun))) * lightRotation;
+            glm::mat4 staticProjection = glm::ortho(-staticExtent, staticExtent, -staticExtent, staticExtent, 0.0f, cascade.farPlane);
+            // these only change in border steps, so they are the cache key
+            if (staticView != cascade.staticView || staticProjection != cascade.staticProjection)
+                cascade.staticValid = false;
+            cascade.staticView = staticView;
+            cascade.staticProjection = staticProjection;
+            cascade.staticExtent = staticExtent;
+            cascade.staticOffset = texelCenter - staticCenter + glm::ivec2(staticBorder);
+            cascade.splitFar = splitFar;
+            cascade.texelSize = texel;
+            splitNear = splitFar;
+
+            stats.cascades[i].splitFar = splitFar;
+            stats.cascades[i].texelSize = texel;
+        }
+    }
+
+    // whether a bounding sphere can throw a shadow into the cascade, or its static layer
+    bool casterVisible(int cascade, Casters casters, const glm::vec3 &center, float radius) const
+    {
+        const Cascade &c = cascades[cascade];
+        bool staticLayer = casters == STATIC_CASTERS && cacheStatic;
+        glm::vec3 p = glm::vec3((staticLayer ? c.staticView : c.view) * glm::vec4(center, 1.0f));
+        float extent = (staticLayer ? c.staticExtent : c.extent) + radius;
+        return std::abs(p.x) <= extent && std::abs(p.y) <= extent && p.z - radius <= 0.0f && p.z + radius >= -c.farPlane;
+    }
+
+    const glm::mat4& cascadeView(int cascade) const { return cascades[cascade].view; }
+    float cascadeFar(int cascade) const { return cascades[cascade].farPlane; }
+
+    // renders every cascade; leaves the framebuffer, viewport and camera block binding to the caller
+    void render(FrameRingBuffer &ring, const DrawCasters &draw)
+    {
+        if (!enabled)
+            return;
+        if (cacheStatic && !staticMap)
+        {
+            staticMap = createLayers(resolution + 2 * staticBorder, false);
+            invalidateStatic();
+        }
+
+        GLint previousFBO = 0, viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(0, 0, resolution, resolution);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(slopeBias, constantBias);
+
+        GLuint* frameQueries = queries[slot];
+        glQueryCounter(frameQueries[0], GL_TIMESTAMP);
+        int rendered = 0;
+        for (int i = 0; i < cascadeCount; i++)
+        {
+            stats.cascades[i].staticDraws = stats.cascades[i].dynamicDraws = 0;
+            stats.cascades[i].staticRendered = false;
+        }
+        for (int i = 0; i < cascadeCount; i++)
+        {
+            Cascade &cascade = cascades[i];
+            CascadeStats &cascadeStats = stats.cascades[i];
+            bool rebuild = cacheStatic && !cascade.staticValid;
+            // one camera block for the cascade, one more for its static layer
+            FrameRingBuffer::Allocation block = ring.allocateUniforms(sizeof(CameraBlock));
+            FrameRingBuffer::Allocation staticBlock;
+            if (block && rebuild)
+                staticBlock = ring.allocateUniforms(sizeof(CameraBlock));
+            if (!block || (rebuild && !staticBlock))
+            {
+                stats.ringFullFrames++;
+                break;
+            }
+            writeCamera(block, cascade.view, cascade.projection);
+            if (rebuild)
+                writeCamera(staticBlock, cascade.staticView, cascade.staticProjection);
+            ring.flush();
+
+            if (cacheStatic)
+            {
+                if (rebuild)
+                {
+                    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ring.buffer(), staticBlock.offset, sizeof(CameraBlock));
+                    int staticSize = resolution + 2 * staticBorder;
+                    attach(staticFBO, staticMap, i);
+                    glViewport(0, 0, staticSize, staticSize);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    cascadeStats.staticDraws = draw(i, STATIC_CASTERS);
+                    cascadeStats.staticRendered = true;
+                    cascade.staticValid = true;
+                    stats.staticRebuilds++;
+                    glViewport(0, 0, resolution, resolution);
+                }
+                // the cascade's window of the cached layer is the starting point, dynamic
+                // casters go on top
+                glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ring.buffer(), block.offset, sizeof(CameraBlock));
+                attach(shadowFBO, shadowMap, i);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+                glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMap, 0, i);
+                glm::ivec2 offset = cascade.staticOffset;
+                glBlitFramebuffer(offset.x, offset.y, offset.x + resolution, offset.y + resolution, 0, 0, resolution, resolution,
+                                  GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, shadowFBO);
+            }
+            else
+            {
+                glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ring.buffer(), block.offset, sizeof(CameraBlock));
+                attach(shadowFBO, shadowMap, i);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                cascadeStats.staticDraws = draw(i, STATIC_CASTERS);
+            }
+            cascadeStats.dynamicDraws = draw(i, DYNAMIC_CASTERS);
+            glQueryCounter(frameQueries[i + 1], GL_TIMESTAMP);
+            rendered++;
+        }
+        // only the timestamps that were issued are read back, none at all when nothing rendered
+        stats.rendered = rendered;
+        if (rendered > 0)
+        {
+            slotCascades[slot] = rendered;
+            if (pending[slot])
+                dropped++;
+            pending[slot] = true;
+            slot = (slot + 1) % FRAMES_IN_FLIGHT;
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFBO);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // shadow uniforms of a receiving program (see sunShadow() in object.frag)
+    void bind(Shader &program, int unit) const
+    {
+        // bound even when disabled, the sampler must not share unit 0 with the environment cube
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap);
+        glActiveTexture(GL_TEXTURE0);
+        program.setInt("shadowMap", unit);
+        program.setInt("shadowCascades", enabled ? cascadeCount : 0);
+        if (!enabled)
+            return;
+        glm::vec4 splits(0.0f), texels(0.0f);
+        // depth [-1, 1] -> [0, 1] and xy to texture coordinates
+        glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        for (int i = 0; i < cascadeCount; i++)
+        {
+            program.setMat4("shadowMatrices[" + std::to_string(i) + "]", bias * cascades[i].projection * cascades[i].view);
+            splits[i] = cascades[i].splitFar;
+            texels[i] = cascades[i].texelSize;
+        }
+        program.setVec4("shadowSplits", splits);
+        program.setVec4("shadowTexelSizes", texels);
+        program.setInt("shadowPcfRadius", pcfRadius);
+        program.setFloat("shadowNormalBias", normalBias);
+    }
+
+    const Stats& last() const { return stats; }
+
+    void drawUI()
+    {
+        ImGui::Checkbox("Sun shadows", &enabled);
+        ImGui::SliderFloat("Sun azimuth", &sunAzimuth, 0.0f, 360.0f);
+        ImGui::SliderFloat("Sun elevation", &sunElevation, 5.0f, 90.0f);
+        if (!enabled)
+            return;
+        ImGui::SliderInt("Cascades", &cascadeCount, 2, MAX_CASCADES);
+        ImGui::SliderFloat("Shadow distance", &shadowDistance, 5.0f, 100.0f);
+        ImGui::SliderFloat("Split log/uniform", &splitLambda, 0.0f, 1.0f);
+        ImGui::SliderInt("PCF radius", &pcfRadius, 0, 2);
+        ImGui::SliderFloat("Slope bias", &slopeBias, 0.0f, 8.0f);
+        ImGui::SliderFloat("Normal bias (texels)", &normalBias, 0.0f, 4.0f);
+        ImGui::Checkbox("Cache static casters", &cacheStatic);
+        float total = 0.0f;
+        for (int i = 0; i < cascadeCount; i++)
+        {
+            const CascadeStats &c = stats.cascades[i];
+            total += c.ms;
+            ImGui::Text("  cascade %d: to %.1f, %.3f/texel, %d dynamic + %d static draws%s, %.3f ms", i, c.splitFar, c.texelSize,
+                        c.dynamicDraws, c.staticDraws, cacheStatic && !c.staticRendered ? " (cached)" : "", c.ms);
+        }
+        ImGui::Text("  %d x %d, %.3f ms GPU, %ld static layer renders", resolution, resolution, total, stats.staticRebuilds);
+        if (stats.ringFullFrames > 0)
+            ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "  ring buffer full in %ld frames, %d of %d cascades last frame",
+                               stats.ringFullFrames, stats.rendered, cascadeCount);
+    }
+
+private:
+    struct Cascade
+    {
+        glm::mat4 view = glm::mat4(1.0f);
+        glm::mat4 projection = glm::mat4(1.0f);
+        float extent = 1.0f;        // half the width of the map in world units
+        float farPlane = 1.0f;
+        float splitFar = 0.0f;
+        float texelSize = 0.0f;
+        // the static layer: its matrices, where the cascade lies in it, whether it is up to date
+        glm::mat4 staticView = glm::mat4(1.0f);
+        glm::mat4 staticProjection = glm::mat4(1.0f);
+        float staticExtent = 1.0f;
+        glm::ivec2 staticOffset = glm::ivec2(0);
+        bool staticValid = false;
+    };
+
+    int resolution;
+    int staticBorder;               // texels the static layers reach past the cascades on each side
+    Cascade cascades[MAX_CASCADES];
+    unsigned int shadowMap = 0, staticMap = 0;
+    unsigned int shadowFBO = 0, staticFBO = 0;
+    glm::vec3 cachedSun = glm::vec3(0.0f);
+
+    GLuint queries[FRAMES_IN_FLIGHT][MAX_CASCADES + 1] = {};
+    int slotCascades[FRAMES_IN_FLIGHT] = {};
+    bool pending[FRAMES_IN_FLIGHT] = {};
+    int slot = 0;
+    long dropped = 0;
+    Stats stats;
+
+    static int floorStep(int value, int step)
+    {
+        return (value >= 0 ? value / step : (value - step + 1) / step) * step;
+    }
+
+    static void writeCamera(const FrameRingBuffer::Allocation &block, const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        CameraBlock* camera = (CameraBlock*)block.data;
+        camera->view = view;
+        camera->projection = projection;
+        camera->cameraPos = glm::inverse(view)[3];
+    }
+
+    // one depth layer per cascade; the shadow map compares, the static cache is only copied from
+    unsigned int createLayers(int size, bool compare) const
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, size, size, MAX_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (compare)
+        {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    void attach(GLuint framebuffer, unsigned int texture, int layer) const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::CASCADED_SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+
+    // oldest first, stops at the first frame the GPU hasn't finished
+    void readTimings()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            int oldest = (slot + i) % FRAMES_IN_FLIGHT;
+            if (!pending[oldest])
+                continue;
+            int count = slotCascades[oldest];
+            GLint available = 0;
+            glGetQueryObjectiv(queries[oldest][count], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 previous = 0;
+            glGetQueryObjectui64v(queries[oldest][0], GL_QUERY_RESULT, &previous);
+            for (int c = 0; c < count; c++)
+            {
+                GLuint64 stamp = 0;
+                glGetQueryObjectui64v(queries[oldest][c + 1], GL_QUERY_RESULT, &stamp);
+                float ms = (float)((stamp - previous) / 1e6);
+                stats.cascades[c].ms += (ms - stats.cascades[c].ms) * 0.1f;
+                previous = stamp;
+            }
+            pending[oldest] = false;
+        }
+    }
+};
+
+#endif
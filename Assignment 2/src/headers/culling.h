@@ -0,0 +1,259 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <simd.h>
+#include <thread_pool.h>
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cfloat>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CULLING_HAS_AVX2_PATH 1
+#endif
+
+// Axis aligned box plus the sphere around it, in the space of whatever it was computed for.
+struct Bounds
+{
+    // empty until the first grow()
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    void grow(const glm::vec3 &p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    // sphere centered on the box, just large enough for the given points
+    template <typename Points>
+    void fitSphere(const Points &points)
+    {
+        center = (min + max) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (const glm::vec3 &p : points)
+        {
+            glm::vec3 d = p - center;
+            radiusSquared = glm::max(radiusSquared, glm::dot(d, d));
+        }
+        radius = glm::sqrt(radiusSquared);
+    }
+};
+
+// The six planes of a view frustum, stored as SoA so 4 or 8 spheres are tested per plane at once.
+// Planes point inwards: a sphere is outside when a * x + b * y + c * z + d < -radius for any plane.
+struct Frustum
+{
+    float a[6], b[6], c[6], d[6];
+
+    // Gribb/Hartmann: the planes are sums/differences of the rows of the view-projection matrix
+    static Frustum fromViewProjection(const glm::mat4 &m)
+    {
+        glm::vec4 row[4];
+        for (int r = 0; r < 4; r++)
+            row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+        const glm::vec4 planes[6] = {
+            row[3] + row[0], row[3] - row[0],   // left, right
+            row[3] + row[1], row[3] - row[1],   // bottom, top
+            row[3] + row[2], row[3] - row[2],   // near, far
+        };
+        Frustum f;
+        for (int i = 0; i < 6; i++)
+        {
+            float length = glm::length(glm::vec3(planes[i]));
+            f.a[i] = planes[i].x / length;
+            f.b[i] = planes[i].y / length;
+            f.c[i] = planes[i].z / length;
+            f.d[i] = planes[i].w / length;
+        }
+        return f;
+    }
+};
+
+#ifdef CULLING_HAS_AVX2_PATH
+// For each 8 bit mask, the lanes that are set packed to the front, one byte each
+struct CullingCompressTable
+{
+    uint64_t lanes[256];
+
+    constexpr CullingCompressTable() : lanes()
+    {
+        for (int mask = 0; mask < 256; mask++)
+        {
+            int n = 0;
+            for (int lane = 0; lane < 8; lane++)
+                if (mask & (1 << lane))
+                    lanes[mask] |= (uint64_t)lane << (8 * n++);
+        }
+    }
+};
+inline constexpr CullingCompressTable cullingCompressTable {};
+#endif
+
+// Culls world space bounding spheres (SoA: x, y, z, radius) against a frustum and writes the
+// indices that survive, in ascending order. Batches of 8 go through AVX2 when the CPU has it
+// (checked at runtime, so no special compiler flags are needed), otherwise 4 at a time
+// through simd.h. The range is split across the thread pool in chunks.
+class FrustumCuller
+{
+public:
+    struct Stats
+    {
+        int tested = 0;
+        int visible = 0;
+        int threads = 1;
+        bool avx2 = false;
+        double ms = 0.0;
+    };
+
+    // entities per job chunk; large enough that the scheduling cost disappears
+    size_t grain = 16384;
+
+    FrustumCuller()
+    {
+#ifdef CULLING_HAS_AVX2_PATH
+        avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+
+    // spheres with a negative radius are never visible (entities without anything to draw)
+    void cull(const Frustum &frustum, const float* x, const float* y, const float* z, const float* radius,
+              int count, std::vector<int> &visible, ThreadPool* pool = nullptr, int maxThreads = 0)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        visible.clear();
+
+        size_t chunks = ((size_t)count + grain - 1) / grain;
+        if (chunkVisible.size() < chunks)
+            chunkVisible.resize(chunks);
+        chunkCount.resize(chunks);
+
+        auto job = [&](size_t begin, size_t end, int)
+        {
+            // only ever grows, shrinking it to the count would mean zero filling it every frame
+            std::vector<int> &out = chunkVisible[begin / grain];
+            if (out.size() < end - begin)
+                out.resize(end - begin);
+            int n;
+#ifdef CULLING_HAS_AVX2_PATH
+            if (avx2)
+                n = cullRangeAVX2(frustum, x, y, z, radius, (int)begin, (int)end, out.data());
+            else
+#endif
+                n = cullRange(frustum, x, y, z, radius, (int)begin, (int)end, out.data());
+            chunkCount[begin / grain] = n;
+        };
+        if (pool)
+            pool->parallelFor(count, grain, job, maxThreads);
+        else
+            for (size_t begin = 0; begin < (size_t)count; begin += grain)
+                job(begin, std::min(begin + grain, (size_t)count), 0);
+
+        for (size_t chunk = 0; chunk < chunks; chunk++)
+            visible.insert(visible.end(), chunkVisible[chunk].begin(), chunkVisible[chunk].begin() + chunkCount[chunk]);
+
+        stats.tested = count;
+        stats.visible = (int)visible.size();
+        stats.threads = pool ? std::min(pool->threads(), maxThreads > 0 ? maxThreads : pool->threads()) : 1;
+        stats.avx2 = avx2;
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    const Stats& last() const { return stats; }
+
+private:
+    bool avx2 = false;
+    std::vector<std::vector<int>> chunkVisible;
+    std::vector<int> chunkCount;
+    Stats stats;
+
+    // 4-wide path (SSE / NEON / scalar through simd.h)
+    static int cullRange(const Frustum &f, const float* x, const float* y, const float* z, const float* r,
+                         int begin, int end, int* out)
+    {
+        int n = 0;
+        int i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            f4 px = f4Load(x + i), py = f4Load(y + i), pz = f4Load(z + i);
+            f4 negR = f4Sub(f4Set(0.0f), f4Load(r + i));
+            int outside = 0;
+            for (int p = 0; p < 6; p++)
+            {
+                f4 dist = f4MulAdd(f4Set(f.a[p]), px, f4MulAdd(f4Set(f.b[p]), py, f4MulAdd(f4Set(f.c[p]), pz, f4Set(f.d[p]))));
+                outside |= f4MaskGreater(negR, dist);
+                if (outside == 0xF)
+                    break;
+            }
+            for (int lane = 0; lane < 4; lane++)
+                if (!(outside & (1 << lane)))
+                    out[n++] = i + lane;
+        }
+        for (; i < end; i++)
+            if (sphereVisible(f, x[i], y[i], z[i], r[i]))
+                out[n++] = i;
+        return n;
+    }
+
+#ifdef CULLING_HAS_AVX2_PATH
+    // The visible indices are packed with a table lookup and one permute and stored 8 at a
+    // time, n only moves by the popcount; branching per lane mispredicts on every mixed batch.
+    // Storing 8 never passes end, n is at most i - begin.
+    __attribute__((target("avx2,fma,popcnt")))
+    static int cullRangeAVX2(const Frustum &f, const float* x, const float* y, const float* z, const float* r,
+                             int begin, int end, int* out)
+    {
+        __m256 pa[6], pb[6], pc[6], pd[6];
+        for (int p = 0; p < 6; p++)
+        {
+            pa[p] = _mm256_set1_ps(f.a[p]);
+            pb[p] = _mm256_set1_ps(f.b[p]);
+            pc[p] = _mm256_set1_ps(f.c[p]);
+            pd[p] = _mm256_set1_ps(f.d[p]);
+        }
+        const __m256i eight = _mm256_set1_epi32(8);
+
+        int n = 0;
+        int i = begin;
+        __m256i indices = _mm256_add_epi32(_mm256_set1_epi32(begin), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+            // outside when the nearest plane is more than r away: one min per plane instead
+            // of a compare and an or
+            __m256 nearest = _mm256_fmadd_ps(pa[0], px, _mm256_fmadd_ps(pb[0], py, _mm256_fmadd_ps(pc[0], pz, pd[0])));
+            // without the pragma -O2 keeps the plane loop
+#pragma GCC unroll 5
+            for (int p = 1; p < 6; p++)
+                nearest = _mm256_min_ps(nearest, _mm256_fmadd_ps(pa[p], px, _mm256_fmadd_ps(pb[p], py, _mm256_fmadd_ps(pc[p], pz, pd[p]))));
+            __m256 inside = _mm256_cmp_ps(_mm256_add_ps(nearest, _mm256_loadu_ps(r + i)), _mm256_setzero_ps(), _CMP_GE_OQ);
+            unsigned mask = (unsigned)_mm256_movemask_ps(inside);
+            __m256i order = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((long long)cullingCompressTable.lanes[mask]));
+            _mm256_storeu_si256((__m256i*)(out + n), _mm256_permutevar8x32_epi32(indices, order));
+            indices = _mm256_add_epi32(indices, eight);
+            n += __builtin_popcount(mask);
+        }
+        for (; i < end; i++)
+            if (sphereVisible(f, x[i], y[i], z[i], r[i]))
+                out[n++] = i;
+        return n;
+    }
+#endif
+
+    static bool sphereVisible(const Frustum &f, float x, float y, float z, float r)
+    {
+        for (int p = 0; p < 6; p++)
+            if (f.a[p] * x + f.b[p] * y + f.c[p] * z + f.d[p] < -r)
+                return false;
+        return true;
+    }
+};
+
+#endif
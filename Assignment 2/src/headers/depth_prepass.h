@@ -0,0 +1,150 @@
+#ifndef DEPTH_PREPASS_H
+#define DEPTH_PREPASS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "imgui.h"
+
+#include <vector>
+#include <algorithm>
+
+// Decides per object whether it goes through the depth prepass (PASS_DEPTH, then its shading
+// in PASS_PREPASSED with GL_EQUAL, see render_queue.h). A prepassed object shades each of its
+// pixels once, but pays for its vertices twice and rasterizes its depth twice.
+//
+// All costs are in units of one environment fetch per pixel, the bulk of object.frag:
+//   benefit  covered pixels * shading cost * fraction of them shaded in vain
+//   cost     vertices * vertexCost + covered pixels * depthPixelCost
+// Coverage is the object's bounding sphere projected to the screen. The fraction shaded in
+// vain comes from the depth complexity of the previous frame (all coverage over the screen
+// area): with n layers, 1 - 1/n of the shading is overdrawn. Front to back sorted objects
+// lose far less to it than that, early depth testing already rejects most of their hidden
+// pixels.
+//
+// Recording is multithreaded, so every draw list keeps its own totals.
+// Per frame:  beginFrame(view, projection, lists)  prepass() per object  endFrame()
+class DepthPrepass
+{
+public:
+    enum Mode { OFF = 0, AUTOMATIC = 1, ALWAYS = 2 };
+
+    struct Stats
+    {
+        int considered = 0;
+        int prepassed = 0;
+        float depthComplexity = 1.0f;
+    };
+
+    int mode = AUTOMATIC;
+    // environment fetches per pixel of each effect in object.frag
+    float effectCost[4] = { 1.0f, 1.0f, 3.0f, 2.0f };
+    float vertexCost = 0.5f;
+    float depthPixelCost = 0.1f;
+    // share of the overdraw front to back sorting leaves to be shaded
+    float frontToBackWaste = 0.25f;
+
+    // reads the viewport the scene is drawn with
+    void beginFrame(const glm::mat4 &view, const glm::mat4 &projection, int listCount)
+    {
+        viewRow = glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        screenPixels = std::max(1.0f, (float)viewport[2] * (float)viewport[3]);
+        // pixels per unit of radius over view depth, on each axis
+        pixelScaleX = projection[0][0] * viewport[2] * 0.5f;
+        pixelScaleY = projection[1][1] * viewport[3] * 0.5f;
+        lists.assign(std::max(1, listCount), ListStats());
+    }
+
+    // whether the object goes through the prepass, from draw list `list`'s recording thread
+    bool prepass(int list, int effectType, const glm::vec3 &center, float radius, int vertexCount, bool frontToBack)
+    {
+        ListStats &stats = lists[list];
+        float pixels = coverage(center, radius);
+        stats.pixels += pixels;
+        stats.considered++;
+
+        bool worth;
+        if (mode == OFF)
+            worth = false;
+        else if (mode == ALWAYS)
+            worth = true;
+        else
+        {
+            float wasted = 1.0f - 1.0f / depthComplexity;
+            if (frontToBack)
+                wasted *= frontToBackWaste;
+            float shading = effectCost[glm::clamp(effectType, 0, 3)];
+            float benefit = pixels * shading * wasted;
+            float cost = vertexCount * vertexCost + pixels * depthPixelCost;
+            worth = benefit > cost;
+        }
+        if (worth)
+            stats.prepassed++;
+        return worth;
+    }
+
+    void endFrame()
+    {
+        Stats frame;
+        double pixels = 0.0;
+        for (const ListStats &stats : lists)
+        {
+            pixels += stats.pixels;
+            frame.considered += stats.considered;
+            frame.prepassed += stats.prepassed;
+        }
+        // smoothed, objects popping in and out of view shouldn't flip every decision at once
+        float complexity = std::max(1.0f, (float)(pixels / screenPixels));
+        depthComplexity += (complexity - depthComplexity) * 0.1f;
+        frame.depthComplexity = depthComplexity;
+        previous = frame;
+    }
+
+    const Stats& last() const { return previous; }
+
+    void drawUI()
+    {
+        ImGui::Text("Depth prepass:");
+        ImGui::RadioButton("Off##prepass", &mode, OFF); ImGui::SameLine();
+        ImGui::RadioButton("Automatic##prepass", &mode, AUTOMATIC); ImGui::SameLine();
+        ImGui::RadioButton("All objects##prepass", &mode, ALWAYS);
+        if (mode == AUTOMATIC)
+        {
+            ImGui::SliderFloat("Prepass vertex cost", &vertexCost, 0.0f, 4.0f);
+            ImGui::SliderFloat("Prepass pixel cost", &depthPixelCost, 0.0f, 1.0f);
+        }
+        ImGui::Text("  %d/%d objects prepassed, depth complexity %.2f", previous.prepassed, previous.considered,
+                    previous.depthComplexity);
+    }
+
+private:
+    struct ListStats
+    {
+        double pixels = 0.0;
+        int considered = 0;
+        int prepassed = 0;
+    };
+
+    std::vector<ListStats> lists = std::vector<ListStats>(1);
+    glm::vec4 viewRow = glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+    float screenPixels = 1.0f;
+    float pixelScaleX = 1.0f, pixelScaleY = 1.0f;
+    float depthComplexity = 1.0f;
+    Stats previous;
+
+    // pixels inside the projected bounding sphere, the whole screen once the camera is inside
+    float coverage(const glm::vec3 &center, float radius) const
+    {
+        float viewDepth = -(viewRow.x * center.x + viewRow.y * center.y + viewRow.z * center.z + viewRow.w);
+        if (viewDepth <= radius)
+            return screenPixels;
+        float rx = radius * pixelScaleX / viewDepth;
+        float ry = radius * pixelScaleY / viewDepth;
+        return std::min(3.14159265f * rx * ry, screenPixels);
+    }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include "imgui.h"
+
+#include <shader.h>
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// Renders the 3D scene into an offscreen target smaller (or larger) than the window and
+// stretches it over the window afterwards, so the fill rate bound glass shaders can keep a
+// GPU time budget. The scale follows the measured GPU time of the scene with a PID
+// controller working on the pixel count, since that is what the cost is proportional to.
+//
+// The target is allocated once for the largest scale and only a corner of it is rendered
+// to, so changing the scale never reallocates. GPU time comes from GL_TIMESTAMP queries read
+// FRAMES_IN_FLIGHT frames later; the controller reacts a few frames late but never stalls.
+//
+// Per frame:  beginScene()  scene draws  endScene()  UI at native resolution
+class DynamicResolution
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    enum Filter { BILINEAR = 0, SHARPEN = 1 };
+
+    bool enabled = true;
+    float targetMs = 8.0f;        // GPU budget of the scene pass
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    int filter = SHARPEN;
+    float sharpness = 0.5f;
+    // PID gains, in velocity form: the output is a change of the pixel count (scale squared)
+    // and the error the relative distance to the target
+    float kp = 0.1f;
+    float ki = 0.05f;
+    float kd = 0.02f;
+    size_t historyLength = 240;
+
+    DynamicResolution() : upscaleShader("shaders/fullscreen.vert", "shaders/upscale.frag")
+    {
+        glGenVertexArrays(1, &emptyVAO);
+        glGenQueries(2 * FRAMES_IN_FLIGHT, &queries[0][0]);
+    }
+
+    ~DynamicResolution()
+    {
+        glDeleteQueries(2 * FRAMES_IN_FLIGHT, &queries[0][0]);
+        glDeleteVertexArrays(1, &emptyVAO);
+        release();
+    }
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    // redirects rendering from the bound framebuffer (and its viewport) into the scaled target
+    void beginScene()
+    {
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        outputFBO = (GLuint)framebuffer;
+        glGetIntegerv(GL_VIEWPORT, outputViewport);
+        readTimings();
+
+        // the UI may switch it off between begin and end, remember what this frame does
+        active = enabled && outputViewport[2] > 0 && outputViewport[3] > 0;
+        if (!active)
+            return;
+
+        minScale = glm::clamp(minScale, 0.25f, 2.0f);
+        maxScale = glm::clamp(maxScale, minScale, 2.0f);
+        scale = glm::clamp(scale, minScale, maxScale);
+        allocate((int)std::ceil(outputViewport[2] * maxScale), (int)std::ceil(outputViewport[3] * maxScale));
+
+        // whole multiples of 8 pixels, so tiny corrections don't make the image swim
+        renderWidth = glm::clamp((int)std::lround(outputViewport[2] * scale / 8.0f) * 8, 8, textureWidth);
+        renderHeight = glm::clamp((int)std::lround(outputViewport[3] * scale / 8.0f) * 8, 8, textureHeight);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, renderWidth, renderHeight);
+        glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+    }
+
+    // upscales into the framebuffer that was bound at beginScene() and restores its viewport
+    void endScene()
+    {
+        if (!active)
+            return;
+        glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+        if (pending[slot])
+            dropped++;
+        pending[slot] = true;
+        slot = (slot + 1) % FRAMES_IN_FLIGHT;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glViewport(outputViewport[0], outputViewport[1], outputViewport[2], outputViewport[3]);
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        upscaleShader.use();
+        upscaleShader.setInt("scene", 0);
+        upscaleShader.setVec2("renderSize", (float)renderWidth, (float)renderHeight);
+        upscaleShader.setVec2("textureSize", (float)textureWidth, (float)textureHeight);
+        upscaleShader.setInt("filterMode", filter);
+        upscaleShader.setFloat("sharpness", sharpness);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (blend)
+            glEnable(GL_BLEND);
+    }
+
+    float currentScale() const { return scale; }
+
+    void drawUI()
+    {
+        ImGui::Checkbox("Dynamic resolution", &enabled);
+        if (!enabled)
+            return;
+        ImGui::SliderFloat("Scene GPU budget (ms)", &targetMs, 1.0f, 33.0f, "%.1f");
+        ImGui::DragFloatRange2("Scale range", &minScale, &maxScale, 0.01f, 0.25f, 2.0f, "min %.2f", "max %.2f");
+        ImGui::Combo("Upscale filter", &filter, "Bilinear\0Sharpened (CAS)\0");
+        if (filter == SHARPEN)
+            ImGui::SliderFloat("Sharpness", &sharpness, 0.0f, 1.0f);
+        ImGui::Text("  scale %.2f: %dx%d -> %dx%d, scene GPU %.2f ms", scale, renderWidth, renderHeight,
+                    outputViewport[2], outputViewport[3], lastGpuMs);
+        if (!gpuHistory.empty())
+        {
+            ImGui::PlotLines("Scene GPU ms", gpuHistory.data(), (int)gpuHistory.size(), 0, nullptr, 0.0f, targetMs * 2.0f, ImVec2(0, 50));
+            ImGui::PlotLines("Scale", scaleHistory.data(), (int)scaleHistory.size(), 0, nullptr, 0.0f, maxScale, ImVec2(0, 50));
+        }
+        if (dropped > 0)
+            ImGui::TextDisabled("  %ld timings lost, results came back too late", dropped);
+    }
+
+private:
+    Shader upscaleShader;
+    unsigned int emptyVAO = 0;
+    unsigned int FBO = 0, colorTexture = 0, depthRBO = 0;
+    int textureWidth = 0, textureHeight = 0;
+    int renderWidth = 0, renderHeight = 0;
+    GLuint outputFBO = 0;
+    GLint outputViewport[4] = { 0, 0, 0, 0 };
+    bool active = false;
+
+    GLuint queries[FRAMES_IN_FLIGHT][2] = {};
+    bool pending[FRAMES_IN_FLIGHT] = {};
+    int slot = 0;
+    long dropped = 0;
+
+    float scale = 1.0f;
+    float previousError = 0.0f, previousError2 = 0.0f;
+    float lastGpuMs = 0.0f;
+    std::vector<float> gpuHistory, scaleHistory;
+
+    void allocate(int width, int height)
+    {
+        if (width == textureWidth && height == textureHeight)
+            return;
+        release();
+        textureWidth = width;
+        textureHeight = height;
+
+        glGenFramebuffers(1, &FBO);
+        glGenTextures(1, &colorTexture);
+        glGenRenderbuffers(1, &depthRBO);
+
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DYNAMIC_RESOLUTION::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+    }
+
+    void release()
+    {
+        if (!FBO)
+            return;
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteTextures(1, &colorTexture);
+        glDeleteRenderbuffers(1, &depthRBO);
+        FBO = colorTexture = depthRBO = 0;
+        textureWidth = textureHeight = 0;
+    }
+
+    // oldest first, stops at the first frame the GPU hasn't finished
+    void readTimings()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            int oldest = (slot + i) % FRAMES_IN_FLIGHT;
+            if (!pending[oldest])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(queries[oldest][0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries[oldest][1], GL_QUERY_RESULT, &end);
+            pending[oldest] = false;
+            control((float)((end - start) / 1e6));
+        }
+    }
+
+    void control(float gpuMs)
+    {
+        lastGpuMs = gpuMs;
+        // > 0: headroom, render more pixels
+        float error = glm::clamp((targetMs - gpuMs) / targetMs, -1.0f, 1.0f);
+        float area = scale * scale
+                   + kp * (error - previousError)
+                   + ki * error
+                   + kd * (error - 2.0f * previousError + previousError2);
+        previousError2 = previousError;
+        previousError = error;
+        scale = glm::clamp(std::sqrt(std::max(area, 0.0f)), minScale, maxScale);
+
+        gpuHistory.push_back(gpuMs);
+        scaleHistory.push_back(scale);
+        if (gpuHistory.size() > historyLength)
+        {
+            gpuHistory.erase(gpuHistory.begin());
+            scaleHistory.erase(scaleHistory.begin());
+        }
+    }
+};
+
+#endif
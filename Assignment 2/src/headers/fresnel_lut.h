@@ -0,0 +1,249 @@
+#ifndef FRESNEL_LUT_H
+#define FRESNEL_LUT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "imgui.h"
+
+#include <shader.h>
+#include <simd.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+// Schlick's Fresnel term as a table over (cos theta, F0), for the FRESNEL_LUT variant of
+// object.frag: one bilinear fetch instead of a pow per fragment. F0 is what object.frag
+// calls reflectivity; for a dielectric it comes from the IOR as ((n - 1) / (n + 1))^2.
+// Schlick is linear in F0 so that axis is exact with linear filtering, all the error comes
+// from the cosine axis and the half float storage.
+//
+// Baked 4-wide through simd.h on the first run and cached on disk after that. The error
+// against the analytic term is measured on the CPU, the cost is the GPU time of the object
+// draws with either variant.
+//
+// Per frame:  bind(program, unit) for the LUT programs,  beginTiming() draws endTiming()
+class FresnelLUT
+{
+public:
+    static constexpr int COSINES = 256;     // cos theta over 0..1
+    static constexpr int F0_STEPS = 16;     // F0 over 0..1
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+    // bumped whenever the baked function or the layout change, older caches are ignored
+    static constexpr uint32_t CACHE_VERSION = 1;
+
+    bool enabled = true;
+
+    struct Stats
+    {
+        bool fromCache = false;
+        double bakeMs = 0.0;        // baking, or reading the cache
+        float maxError = 0.0f;      // against fresnelSchlick, as the GPU filters the stored table
+        float meanError = 0.0f;
+        float analyticMs = 0.0f;    // GPU time of the timed draws, smoothed, per variant
+        float lutMs = 0.0f;
+    };
+
+    explicit FresnelLUT(const std::string &cachePath)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        stats.fromCache = load(cachePath);
+        if (!stats.fromCache)
+        {
+            bake();
+            save(cachePath);
+        }
+        stats.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        measureError();
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, COSINES, F0_STEPS, 0, GL_RED, GL_FLOAT, table.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenQueries(FRAMES_IN_FLIGHT * 2, &queries[0][0]);
+    }
+
+    ~FresnelLUT()
+    {
+        glDeleteQueries(FRAMES_IN_FLIGHT * 2, &queries[0][0]);
+        glDeleteTextures(1, &texture);
+    }
+
+    FresnelLUT(const FresnelLUT&) = delete;
+    FresnelLUT& operator=(const FresnelLUT&) = delete;
+
+    void bind(Shader &program, int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+        program.setInt("fresnelLUT", unit);
+    }
+
+    // around the draws that differ between the variants
+    void beginTiming()
+    {
+        readTimings();
+        glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+    }
+
+    void endTiming()
+    {
+        glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+        slotVariant[slot] = enabled ? 2 : 1;
+        slot = (slot + 1) % FRAMES_IN_FLIGHT;
+    }
+
+    const Stats& last() const { return stats; }
+
+    void drawUI()
+    {
+        ImGui::Checkbox("Fresnel lookup table", &enabled);
+        ImGui::Text("  %s in %.2f ms, error max %.5f mean %.6f", stats.fromCache ? "cached" : "baked", stats.bakeMs,
+                    stats.maxError, stats.meanError);
+        ImGui::Text("  objects %.3f ms with the table, %.3f ms with pow()", stats.lutMs, stats.analyticMs);
+    }
+
+private:
+    std::vector<float> table;   // cos theta fastest
+    GLuint texture = 0;
+    Stats stats;
+
+    GLuint queries[FRAMES_IN_FLIGHT][2] = {};
+    int slotVariant[FRAMES_IN_FLIGHT] = {};     // 0: nothing timed, 1: analytic, 2: table
+    int slot = 0;
+
+    struct CacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t cosines;
+        uint32_t f0Steps;
+    };
+
+    static float schlick(float cosTheta, float f0)
+    {
+        return f0 + (1.0f - f0) * std::pow(1.0f - cosTheta, 5.0f);
+    }
+
+    // what the GPU holds for an R16F texel: 11 significant bits, fixed steps of 2^-24 below
+    // the smallest normal half
+    static float toHalf(float v)
+    {
+        if (std::abs(v) < 6.103515625e-5f)
+            return std::round(v * 16777216.0f) / 16777216.0f;
+        int exponent = 0;
+        float mantissa = std::frexp(v, &exponent);
+        return std::ldexp(std::round(mantissa * 2048.0f) / 2048.0f, exponent);
+    }
+
+    // texel centers on the grid points, so 0 and 1 are hit exactly
+    void bake()
+    {
+        table.assign(COSINES * F0_STEPS, 0.0f);
+        const float step = 1.0f / (COSINES - 1);
+        const float laneOffsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+        const f4 laneOffset = f4Load(laneOffsets);
+        for (int y = 0; y < F0_STEPS; y++)
+        {
+            float f0 = (float)y / (F0_STEPS - 1);
+            float* row = &table[y * COSINES];
+            const f4 vf0 = f4Set(f0), scale = f4Set(1.0f - f0);
+            for (int x = 0; x < COSINES; x += 4)
+            {
+                f4 m = f4Sub(f4Set(1.0f), f4Mul(f4Add(f4Set((float)x), laneOffset), f4Set(step)));
+                m = f4Max(m, f4Set(0.0f));
+                f4 m2 = f4Mul(m, m);
+                f4Store(row + x, f4MulAdd(f4Mul(f4Mul(m2, m2), m), scale, vf0));
+            }
+        }
+    }
+
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        CacheHeader header{};
+        file.read((char*)&header, sizeof(header));
+        if (!file || std::memcmp(header.magic, "FLUT", 4) != 0 || header.version != CACHE_VERSION ||
+            header.cosines != COSINES || header.f0Steps != F0_STEPS)
+            return false;
+        table.resize(COSINES * F0_STEPS);
+        file.read((char*)table.data(), table.size() * sizeof(float));
+        return (bool)file;
+    }
+
+    void save(const std::string &path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::FRESNEL_LUT::CACHE_NOT_WRITTEN: " << path << std::endl;
+            return;
+        }
+        CacheHeader header = { { 'F', 'L', 'U', 'T' }, CACHE_VERSION, COSINES, F0_STEPS };
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)table.data(), table.size() * sizeof(float));
+    }
+
+    // bilinear over the half float texels against the analytic term, same points every run
+    void measureError()
+    {
+        std::mt19937 random(4321);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const int samples = 100000;
+        double maxError = 0.0, sumError = 0.0;
+        for (int s = 0; s < samples; s++)
+        {
+            float cosTheta = unit(random), f0 = unit(random);
+            float px = cosTheta * (COSINES - 1), py = f0 * (F0_STEPS - 1);
+            int x0 = std::min((int)px, COSINES - 1), y0 = std::min((int)py, F0_STEPS - 1);
+            int x1 = std::min(x0 + 1, COSINES - 1), y1 = std::min(y0 + 1, F0_STEPS - 1);
+            float fx = px - x0, fy = py - y0;
+            auto texel = [&](int x, int y) { return toHalf(table[y * COSINES + x]); };
+            float lut = glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), fx), glm::mix(texel(x0, y1), texel(x1, y1), fx), fy);
+            double error = std::abs((double)lut - schlick(cosTheta, f0));
+            maxError = std::max(maxError, error);
+            sumError += error;
+        }
+        stats.maxError = (float)maxError;
+        stats.meanError = (float)(sumError / samples);
+        std::cout << "Fresnel LUT " << (stats.fromCache ? "read from the cache" : "baked") << " in " << stats.bakeMs
+                  << " ms, error max " << stats.maxError << " mean " << stats.meanError << std::endl;
+    }
+
+    // the slot about to be reused is FRAMES_IN_FLIGHT frames old
+    void readTimings()
+    {
+        if (slotVariant[slot] == 0)
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+            float ms = (float)((end - begin) / 1e6);
+            float &smoothed = slotVariant[slot] == 2 ? stats.lutMs : stats.analyticMs;
+            smoothed = smoothed == 0.0f ? ms : glm::mix(smoothed, ms, 0.1f);
+        }
+        slotVariant[slot] = 0;
+    }
+};
+
+#endif
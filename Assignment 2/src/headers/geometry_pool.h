@@ -0,0 +1,88 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Where one mesh lives inside the shared geometry buffers.
+struct GeometryRange
+{
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    GLsizei vertexCount = 0;
+};
+
+// All static mesh data of the application in one set of buffers: tightly packed positions and
+// normals, the full interleaved vertices and one index buffer. Every mesh is a range drawn with
+// a base vertex, so a program needs a single VAO for all of them and a whole pass can go out
+// as one multi-draw.
+//
+// `Vertex` is the full vertex struct of mesh.h; it's a template parameter only so this header
+// doesn't depend on it.
+template <typename Vertex>
+class GeometryPool
+{
+public:
+    unsigned int positionVBO = 0, normalVBO = 0, VBO = 0, EBO = 0;
+
+    GeometryRange add(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+                      const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+    {
+        GeometryRange range;
+        range.baseVertex = (GLint)this->positions.size();
+        range.firstIndex = (GLuint)this->indices.size();
+        range.indexCount = (GLsizei)indices.size();
+        range.vertexCount = (GLsizei)vertices.size();
+
+        this->positions.insert(this->positions.end(), positions.begin(), positions.end());
+        this->normals.insert(this->normals.end(), normals.begin(), normals.end());
+        this->vertices.insert(this->vertices.end(), vertices.begin(), vertices.end());
+        this->indices.insert(this->indices.end(), indices.begin(), indices.end());
+        dirty = true;
+        return range;
+    }
+
+    // pushes everything added since the last call to the GPU. The buffer names never change,
+    // so VAOs made earlier stay valid.
+    void upload()
+    {
+        if (!dirty)
+            return;
+        if (!VBO)
+        {
+            glGenBuffers(1, &positionVBO);
+            glGenBuffers(1, &normalVBO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
+        }
+        fill(positionVBO, positions);
+        fill(normalVBO, normals);
+        fill(VBO, vertices);
+        // the element buffer binding is VAO state, so upload through a neutral target
+        fill(EBO, indices);
+        dirty = false;
+    }
+
+    size_t vertexCount() const { return positions.size(); }
+    size_t indexCount() const { return indices.size(); }
+
+private:
+    std::vector<glm::vec3> positions, normals;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    bool dirty = false;
+
+    template <typename T>
+    static void fill(unsigned int buffer, const std::vector<T> &data)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, data.size() * sizeof(T), data.empty() ? nullptr : data.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+};
+
+#endif
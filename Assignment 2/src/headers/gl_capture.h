@@ -0,0 +1,653 @@
+#ifndef GL_CAPTURE_H
+#define GL_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <gl_extensions.h>
+#include <gl_capture_functions.h>
+
+#include <zlib.h>
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <functional>
+#include <type_traits>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// Records the GL calls of the first N frames into a gzip compressed file that GLReplay
+// (src/replay.cpp) re-issues without the application. Capturing starts right after the
+// context is created, so the file holds everything from shader sources and texture pixels
+// to the last draw, and the replayer needs nothing else.
+//
+// It works by swapping the glad function pointers for hooks that write the call and then
+// forward it, so only the functions hooked in start() are recorded. Every renderer feature
+// that starts using a new GL entry point has to add it here and in the replayer; every other
+// glad function gets a hook that only forwards and warns the first time it is called while
+// recording (WARNING::GL_CAPTURE::UNRECORDED_CALL), so a missing hook shows up at once.
+// Not recorded: getters (except uniform/attribute locations, which the replayer remaps),
+// timer queries and fence waits, which don't change the image, writes through mapped
+// buffers (capture turns the persistent ring buffer off) and ImGui, which loads GL through
+// its own loader.
+//
+// File: header, then per call  u16 id | u32 payload size | payload. Scalars are 4 bytes,
+// GLsizeiptr/GLintptr/pointers/GLsync 8, in native byte order. A CALL_FRAME_END marks the swap.
+// The ids are in the files, so new calls go at the end of the enum.
+enum GLCaptureCall : uint16_t
+{
+    CALL_FRAME_END = 0,
+    CALL_ActiveTexture, CALL_AttachShader, CALL_BeginConditionalRender, CALL_BeginQuery,
+    CALL_BindBuffer, CALL_BindBufferRange, CALL_BindFramebuffer, CALL_BindRenderbuffer,
+    CALL_BindTexture, CALL_BindVertexArray, CALL_BlendEquation, CALL_BlendFunc,
+    CALL_BufferData, CALL_BufferSubData, CALL_Clear, CALL_ClearColor, CALL_ColorMask,
+    CALL_CompileShader, CALL_CreateProgram, CALL_CreateShader, CALL_CullFace,
+    CALL_DeleteBuffers, CALL_DeleteFramebuffers, CALL_DeleteProgram, CALL_DeleteQueries,
+    CALL_DeleteRenderbuffers, CALL_DeleteShader, CALL_DeleteSync, CALL_DeleteTextures,
+    CALL_DeleteVertexArrays, CALL_DepthFunc, CALL_DepthMask, CALL_DetachShader, CALL_Disable,
+    CALL_DrawArrays, CALL_DrawElements, CALL_DrawElementsBaseVertex,
+    CALL_DrawElementsInstancedBaseVertex, CALL_Enable, CALL_EnableVertexAttribArray,
+    CALL_EndConditionalRender, CALL_EndQuery, CALL_FenceSync, CALL_Finish, CALL_Flush,
+    CALL_FramebufferRenderbuffer, CALL_FramebufferTexture2D, CALL_GenBuffers,
+    CALL_GenFramebuffers, CALL_GenQueries, CALL_GenRenderbuffers, CALL_GenTextures,
+    CALL_GenVertexArrays, CALL_GenerateMipmap, CALL_GetAttribLocation, CALL_GetUniformLocation,
+    CALL_LinkProgram, CALL_MultiDrawElementsIndirect, CALL_PixelStorei, CALL_RenderbufferStorage,
+    CALL_ShaderSource, CALL_TexImage2D, CALL_TexParameteri, CALL_Uniform1f, CALL_Uniform1i,
+    CALL_Uniform2f, CALL_Uniform3f, CALL_Uniform4f, CALL_Uniform2fv, CALL_Uniform3fv,
+    CALL_Uniform4fv, CALL_UniformMatrix2fv, CALL_UniformMatrix3fv, CALL_UniformMatrix4fv,
+    CALL_UniformBlockBinding, CALL_UseProgram, CALL_VertexAttribDivisor,
+    CALL_VertexAttribIPointer, CALL_VertexAttribPointer, CALL_Viewport,
+    CALL_ClearBufferfv, CALL_DrawBuffers, CALL_Uniform2i, CALL_BlitFramebuffer, CALL_DrawBuffer,
+    CALL_ReadBuffer, CALL_FramebufferTextureLayer, CALL_PolygonOffset, CALL_TexImage3D,
+    CALL_RenderbufferStorageMultisample, CALL_BlendFuncSeparate, CALL_BlendFunci,
+    CALL_COUNT
+};
+
+struct GLCaptureHeader
+{
+    char magic[8];          // "GLCAPT01"
+    int32_t major, minor;   // context version of the capture
+    int32_t width, height;  // default framebuffer size
+    int32_t frames;
+};
+
+inline const char GL_CAPTURE_MAGIC[8] = { 'G', 'L', 'C', 'A', 'P', 'T', '0', '1' };
+
+// serialization shared by the recorder and the replayer
+template <typename T>
+inline void capturePut(std::vector<unsigned char> &out, T value)
+{
+    if constexpr (std::is_pointer_v<T>)
+        capturePut<uint64_t>(out, (uint64_t)(uintptr_t)value);
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        float v = (float)value;
+        out.insert(out.end(), (unsigned char*)&v, (unsigned char*)&v + 4);
+    }
+    else if constexpr (sizeof(T) <= 4)
+    {
+        uint32_t v = (uint32_t)value;
+        out.insert(out.end(), (unsigned char*)&v, (unsigned char*)&v + 4);
+    }
+    else
+    {
+        uint64_t v = (uint64_t)value;
+        out.insert(out.end(), (unsigned char*)&v, (unsigned char*)&v + 8);
+    }
+}
+
+inline void capturePutBytes(std::vector<unsigned char> &out, const void* data, size_t bytes)
+{
+    capturePut<uint64_t>(out, bytes);
+    if (bytes)
+        out.insert(out.end(), (const unsigned char*)data, (const unsigned char*)data + bytes);
+}
+
+template <typename T>
+inline T captureGet(const unsigned char* &in)
+{
+    if constexpr (std::is_pointer_v<T>)
+        return (T)(uintptr_t)captureGet<uint64_t>(in);
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        float v;
+        std::memcpy(&v, in, 4);
+        in += 4;
+        return (T)v;
+    }
+    else if constexpr (sizeof(T) <= 4)
+    {
+        uint32_t v;
+        std::memcpy(&v, in, 4);
+        in += 4;
+        return (T)v;
+    }
+    else
+    {
+        uint64_t v;
+        std::memcpy(&v, in, 8);
+        in += 8;
+        return (T)v;
+    }
+}
+
+// size of the client pixels glTexImage* reads, with the current unpack alignment
+inline size_t captureImageBytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type)
+{
+    size_t components = format == GL_RED || format == GL_DEPTH_COMPONENT ? 1 : format == GL_RG ? 2
+                       : format == GL_RGB || format == GL_BGR ? 3 : 4;
+    size_t componentSize = type == GL_FLOAT ? 4 : type == GL_HALF_FLOAT || type == GL_UNSIGNED_SHORT ? 2 : 1;
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    size_t row = (width * components * componentSize + alignment - 1) / alignment * alignment;
+    return row * height * depth;
+}
+
+// returns the bytes in place and moves past them
+inline const unsigned char* captureGetBytes(const unsigned char* &in, size_t &bytes)
+{
+    bytes = (size_t)captureGet<uint64_t>(in);
+    const unsigned char* data = in;
+    in += bytes;
+    return data;
+}
+
+class GLCapture
+{
+public:
+    typedef void (*AnyFunction)();
+
+    // hooks the GL functions and starts writing; call right after glExt.load()
+    bool start(const std::string &path, int frames, int width, int height)
+    {
+        file = gzopen(path.c_str(), "wb6");
+        if (!file)
+        {
+            std::cout << "ERROR::GL_CAPTURE::FILE_NOT_OPENED " << path << std::endl;
+            return false;
+        }
+        GLCaptureHeader header;
+        std::memcpy(header.magic, GL_CAPTURE_MAGIC, sizeof(header.magic));
+        header.major = glExt.major;
+        header.minor = glExt.minor;
+        header.width = width;
+        header.height = height;
+        header.frames = frames;
+        gzwrite(file, &header, sizeof(header));
+        this->path = path;
+        framesLeft = frames;
+        calls = 0;
+        installHooks();
+        recording = true;
+        std::cout << "GL capture: recording " << frames << " frames to " << path << std::endl;
+        return true;
+    }
+
+    // after the last GL call of a frame, before the swap
+    void endFrame()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!recording)
+            return;
+        call.clear();
+        writeCall(CALL_FRAME_END);
+        if (--framesLeft == 0)
+            stop();
+    }
+
+    bool active() const { return recording; }
+
+    // from the forwarding hooks of the functions that aren't recorded
+    void unrecorded(const char* name, bool &warned)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!recording || warned)
+            return;
+        warned = true;
+        unrecordedFunctions++;
+        std::cout << "WARNING::GL_CAPTURE::UNRECORDED_CALL " << name << " is not recorded, the replay will differ" << std::endl;
+    }
+
+    // ---- used by the hooks ----
+    template <typename Function>
+    Function original(GLCaptureCall id) const { return (Function)originals[id]; }
+
+    template <typename... Args>
+    void record(GLCaptureCall id, Args... args)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!recording)
+            return;
+        call.clear();
+        (capturePut(call, args), ...);
+        writeCall(id);
+    }
+
+    // for hooks with client memory: fill(payload) appends the call's arguments
+    void recordWith(GLCaptureCall id, const std::function<void(std::vector<unsigned char>&)> &fill)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!recording)
+            return;
+        call.clear();
+        fill(call);
+        writeCall(id);
+    }
+
+private:
+    gzFile file = nullptr;
+    std::string path;
+    std::mutex mutex;
+    std::vector<unsigned char> call;
+    AnyFunction originals[CALL_COUNT] = {};
+    std::vector<std::function<void()>> restore;
+    std::vector<void*> hookedSlots;
+    bool recording = false;
+    int framesLeft = 0;
+    long calls = 0;
+    int unrecordedFunctions = 0;
+
+    void writeCall(GLCaptureCall id)
+    {
+        uint16_t id16 = id;
+        uint32_t size = (uint32_t)call.size();
+        gzwrite(file, &id16, sizeof(id16));
+        gzwrite(file, &size, sizeof(size));
+        if (size)
+            gzwrite(file, call.data(), size);
+        calls++;
+    }
+
+    // with the mutex held
+    void stop()
+    {
+        recording = false;
+        for (auto &undo : restore)
+            undo();
+        restore.clear();
+        z_off_t bytes = gzoffset(file);
+        gzclose(file);
+        file = nullptr;
+        std::cout << "GL capture: " << calls << " calls, " << bytes / (1024 * 1024) << " MB written to " << path << std::endl;
+        if (unrecordedFunctions > 0)
+            std::cout << "WARNING::GL_CAPTURE::INCOMPLETE " << unrecordedFunctions << " GL functions were called but not recorded" << std::endl;
+    }
+
+    template <GLCaptureCall Id, typename R, typename... Args>
+    void hook(R (APIENTRYP &slot)(Args...), R (APIENTRYP replacement)(Args...))
+    {
+        originals[Id] = (AnyFunction)slot;
+        auto previous = slot;
+        slot = replacement;
+        restore.push_back([&slot, previous]() { slot = previous; });
+        hookedSlots.push_back((void*)&slot);
+    }
+
+    template <GLCaptureCall Id, typename R, typename... Args>
+    void hook(R (APIENTRYP &slot)(Args...));
+
+    // the forwarding hook for a glad function that has no recording hook
+    template <auto* Slot>
+    void watch(const char* name);
+
+    void installHooks();
+};
+
+inline GLCapture glCapture;
+
+// ---- hooks ----
+// Scalar arguments only; pointers are recorded as values, which is right for the buffer
+// offsets the renderer passes (indices, attribute offsets, indirect commands).
+template <GLCaptureCall Id, typename R, typename... Args>
+R APIENTRY glCaptureHook(Args... args)
+{
+    typedef R (APIENTRYP Function)(Args...);
+    Function real = glCapture.original<Function>(Id);
+    if constexpr (std::is_void_v<R>)
+    {
+        real(args...);
+        glCapture.record(Id, args...);
+    }
+    else
+    {
+        // the result goes last, so the replayer can map created names (programs, fences)
+        R result = real(args...);
+        glCapture.record(Id, args..., result);
+        return result;
+    }
+}
+
+template <GLCaptureCall Id, typename R, typename... Args>
+void GLCapture::hook(R (APIENTRYP &slot)(Args...))
+{
+    hook<Id, R, Args...>(slot, &glCaptureHook<Id, R, Args...>);
+}
+
+// Forwards a function capture doesn't record and reports it, once per function
+template <auto* Slot, typename Function = std::remove_pointer_t<decltype(Slot)>>
+struct GLCaptureUnrecorded;
+
+template <auto* Slot, typename R, typename... Args>
+struct GLCaptureUnrecorded<Slot, R (APIENTRYP)(Args...)>
+{
+    static inline R (APIENTRYP original)(Args...) = nullptr;
+    static inline const char* name = nullptr;
+    static inline bool warned = false;
+
+    static R APIENTRY call(Args... args)
+    {
+        glCapture.unrecorded(name, warned);
+        return original(args...);
+    }
+};
+
+template <auto* Slot>
+void GLCapture::watch(const char* name)
+{
+    typedef GLCaptureUnrecorded<Slot> Hook;
+    auto &slot = *Slot;
+    if (!slot || std::find(hookedSlots.begin(), hookedSlots.end(), (void*)&slot) != hookedSlots.end())
+        return;
+    // getters, timer queries and fence waits change nothing the replay draws
+    const char* bare = name + 2;
+    if (std::strncmp(bare, "Get", 3) == 0 || std::strncmp(bare, "Is", 2) == 0 || std::strcmp(bare, "CheckFramebufferStatus") == 0 ||
+        std::strcmp(bare, "QueryCounter") == 0 || std::strcmp(bare, "ClientWaitSync") == 0 || std::strcmp(bare, "WaitSync") == 0)
+        return;
+    Hook::original = slot;
+    Hook::name = name;
+    Hook::warned = false;
+    auto previous = slot;
+    slot = &Hook::call;
+    restore.push_back([&slot, previous]() { slot = previous; });
+}
+
+// glGen*: n and the names the driver handed out
+template <GLCaptureCall Id>
+void APIENTRY glCaptureGen(GLsizei n, GLuint* names)
+{
+    glCapture.original<PFNGLGENBUFFERSPROC>(Id)(n, names);
+    glCapture.recordWith(Id, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, n);
+        for (GLsizei i = 0; i < n; i++)
+            capturePut(out, names[i]);
+    });
+}
+
+template <GLCaptureCall Id>
+void APIENTRY glCaptureDelete(GLsizei n, const GLuint* names)
+{
+    glCapture.recordWith(Id, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, n);
+        for (GLsizei i = 0; i < n; i++)
+            capturePut(out, names[i]);
+    });
+    glCapture.original<PFNGLDELETEBUFFERSPROC>(Id)(n, names);
+}
+
+// glUniform{2,3,4}fv
+template <GLCaptureCall Id, int N>
+void APIENTRY glCaptureUniformVector(GLint location, GLsizei count, const GLfloat* value)
+{
+    glCapture.recordWith(Id, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, location);
+        capturePut(out, count);
+        capturePutBytes(out, value, sizeof(GLfloat) * N * count);
+    });
+    glCapture.original<PFNGLUNIFORM4FVPROC>(Id)(location, count, value);
+}
+
+// glUniformMatrix{2,3,4}fv
+template <GLCaptureCall Id, int N>
+void APIENTRY glCaptureUniformMatrix(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+    glCapture.recordWith(Id, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, location);
+        capturePut(out, count);
+        capturePut(out, transpose);
+        capturePutBytes(out, value, sizeof(GLfloat) * N * N * count);
+    });
+    glCapture.original<PFNGLUNIFORMMATRIX4FVPROC>(Id)(location, count, transpose, value);
+}
+
+inline void APIENTRY glCaptureBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+    glCapture.recordWith(CALL_BufferData, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, target);
+        capturePut(out, size);
+        capturePut(out, usage);
+        capturePutBytes(out, data, data ? (size_t)size : 0);
+    });
+    glCapture.original<PFNGLBUFFERDATAPROC>(CALL_BufferData)(target, size, data, usage);
+}
+
+inline void APIENTRY glCaptureBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+    glCapture.recordWith(CALL_BufferSubData, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, target);
+        capturePut(out, offset);
+        capturePutBytes(out, data, (size_t)size);
+    });
+    glCapture.original<PFNGLBUFFERSUBDATAPROC>(CALL_BufferSubData)(target, offset, size, data);
+}
+
+inline void APIENTRY glCaptureTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                                         GLint border, GLenum format, GLenum type, const void* pixels)
+{
+    glCapture.recordWith(CALL_TexImage2D, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, target);
+        capturePut(out, level);
+        capturePut(out, internalformat);
+        capturePut(out, width);
+        capturePut(out, height);
+        capturePut(out, border);
+        capturePut(out, format);
+        capturePut(out, type);
+        capturePutBytes(out, pixels, pixels ? captureImageBytes(width, height, 1, format, type) : 0);
+    });
+    glCapture.original<PFNGLTEXIMAGE2DPROC>(CALL_TexImage2D)(target, level, internalformat, width, height, border, format, type, pixels);
+}
+
+inline void APIENTRY glCaptureTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                                         GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels)
+{
+    glCapture.recordWith(CALL_TexImage3D, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, target);
+        capturePut(out, level);
+        capturePut(out, internalformat);
+        capturePut(out, width);
+        capturePut(out, height);
+        capturePut(out, depth);
+        capturePut(out, border);
+        capturePut(out, format);
+        capturePut(out, type);
+        capturePutBytes(out, pixels, pixels ? captureImageBytes(width, height, depth, format, type) : 0);
+    });
+    glCapture.original<PFNGLTEXIMAGE3DPROC>(CALL_TexImage3D)(target, level, internalformat, width, height, depth, border, format, type, pixels);
+}
+
+// one colour (four values) or the depth
+inline void APIENTRY glCaptureClearBufferfv(GLenum buffer, GLint drawbuffer, const GLfloat* value)
+{
+    glCapture.recordWith(CALL_ClearBufferfv, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, buffer);
+        capturePut(out, drawbuffer);
+        capturePutBytes(out, value, sizeof(GLfloat) * (buffer == GL_COLOR ? 4 : 1));
+    });
+    glCapture.original<PFNGLCLEARBUFFERFVPROC>(CALL_ClearBufferfv)(buffer, drawbuffer, value);
+}
+
+inline void APIENTRY glCaptureDrawBuffers(GLsizei n, const GLenum* buffers)
+{
+    glCapture.recordWith(CALL_DrawBuffers, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, n);
+        for (GLsizei i = 0; i < n; i++)
+            capturePut(out, buffers[i]);
+    });
+    glCapture.original<PFNGLDRAWBUFFERSPROC>(CALL_DrawBuffers)(n, buffers);
+}
+
+inline void APIENTRY glCaptureShaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths)
+{
+    glCapture.recordWith(CALL_ShaderSource, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, shader);
+        capturePut(out, count);
+        for (GLsizei i = 0; i < count; i++)
+        {
+            size_t length = lengths && lengths[i] >= 0 ? (size_t)lengths[i] : std::strlen(strings[i]);
+            capturePutBytes(out, strings[i], length);
+        }
+    });
+    glCapture.original<PFNGLSHADERSOURCEPROC>(CALL_ShaderSource)(shader, count, strings, lengths);
+}
+
+// locations are driver specific, the replayer asks its own driver for the same names
+template <GLCaptureCall Id>
+GLint APIENTRY glCaptureLocation(GLuint program, const GLchar* name)
+{
+    GLint location = glCapture.original<PFNGLGETUNIFORMLOCATIONPROC>(Id)(program, name);
+    glCapture.recordWith(Id, [&](std::vector<unsigned char> &out)
+    {
+        capturePut(out, program);
+        capturePutBytes(out, name, std::strlen(name));
+        capturePut(out, location);
+    });
+    return location;
+}
+
+// block indices are driver specific too, so the block is recorded by name
+inline void APIENTRY glCaptureUniformBlockBinding(GLuint program, GLuint index, GLuint binding)
+{
+    glCapture.recordWith(CALL_UniformBlockBinding, [&](std::vector<unsigned char> &out)
+    {
+        GLchar name[256];
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(program, index, sizeof(name), &length, name);
+        capturePut(out, program);
+        capturePutBytes(out, name, (size_t)length);
+        capturePut(out, binding);
+    });
+    glCapture.original<PFNGLUNIFORMBLOCKBINDINGPROC>(CALL_UniformBlockBinding)(program, index, binding);
+}
+
+inline void GLCapture::installHooks()
+{
+#define GL_CAPTURE_HOOK(name) hook<CALL_##name>(gl##name)
+    GL_CAPTURE_HOOK(ActiveTexture);
+    GL_CAPTURE_HOOK(AttachShader);
+    GL_CAPTURE_HOOK(BeginConditionalRender);
+    GL_CAPTURE_HOOK(BeginQuery);
+    GL_CAPTURE_HOOK(BindBuffer);
+    GL_CAPTURE_HOOK(BindBufferRange);
+    GL_CAPTURE_HOOK(BindFramebuffer);
+    GL_CAPTURE_HOOK(BindRenderbuffer);
+    GL_CAPTURE_HOOK(BindTexture);
+    GL_CAPTURE_HOOK(BindVertexArray);
+    GL_CAPTURE_HOOK(BlendEquation);
+    GL_CAPTURE_HOOK(BlendFunc);
+    GL_CAPTURE_HOOK(BlendFuncSeparate);
+    GL_CAPTURE_HOOK(BlitFramebuffer);
+    GL_CAPTURE_HOOK(Clear);
+    GL_CAPTURE_HOOK(ClearColor);
+    GL_CAPTURE_HOOK(ColorMask);
+    GL_CAPTURE_HOOK(CompileShader);
+    GL_CAPTURE_HOOK(CreateProgram);
+    GL_CAPTURE_HOOK(CreateShader);
+    GL_CAPTURE_HOOK(CullFace);
+    GL_CAPTURE_HOOK(DeleteProgram);
+    GL_CAPTURE_HOOK(DeleteShader);
+    GL_CAPTURE_HOOK(DeleteSync);
+    GL_CAPTURE_HOOK(DepthFunc);
+    GL_CAPTURE_HOOK(DepthMask);
+    GL_CAPTURE_HOOK(DetachShader);
+    GL_CAPTURE_HOOK(Disable);
+    GL_CAPTURE_HOOK(DrawArrays);
+    GL_CAPTURE_HOOK(DrawBuffer);
+    GL_CAPTURE_HOOK(DrawElements);
+    GL_CAPTURE_HOOK(DrawElementsBaseVertex);
+    GL_CAPTURE_HOOK(DrawElementsInstancedBaseVertex);
+    GL_CAPTURE_HOOK(Enable);
+    GL_CAPTURE_HOOK(EnableVertexAttribArray);
+    GL_CAPTURE_HOOK(EndConditionalRender);
+    GL_CAPTURE_HOOK(EndQuery);
+    GL_CAPTURE_HOOK(FenceSync);
+    GL_CAPTURE_HOOK(Finish);
+    GL_CAPTURE_HOOK(Flush);
+    GL_CAPTURE_HOOK(FramebufferRenderbuffer);
+    GL_CAPTURE_HOOK(FramebufferTexture2D);
+    GL_CAPTURE_HOOK(FramebufferTextureLayer);
+    GL_CAPTURE_HOOK(GenerateMipmap);
+    GL_CAPTURE_HOOK(LinkProgram);
+    GL_CAPTURE_HOOK(PixelStorei);
+    GL_CAPTURE_HOOK(PolygonOffset);
+    GL_CAPTURE_HOOK(ReadBuffer);
+    GL_CAPTURE_HOOK(RenderbufferStorage);
+    GL_CAPTURE_HOOK(RenderbufferStorageMultisample);
+    GL_CAPTURE_HOOK(TexParameteri);
+    GL_CAPTURE_HOOK(Uniform1f);
+    GL_CAPTURE_HOOK(Uniform1i);
+    GL_CAPTURE_HOOK(Uniform2f);
+    GL_CAPTURE_HOOK(Uniform2i);
+    GL_CAPTURE_HOOK(Uniform3f);
+    GL_CAPTURE_HOOK(Uniform4f);
+    GL_CAPTURE_HOOK(UseProgram);
+    GL_CAPTURE_HOOK(VertexAttribDivisor);
+    GL_CAPTURE_HOOK(VertexAttribIPointer);
+    GL_CAPTURE_HOOK(VertexAttribPointer);
+    GL_CAPTURE_HOOK(Viewport);
+#undef GL_CAPTURE_HOOK
+
+    hook<CALL_GenBuffers>(glGenBuffers, &glCaptureGen<CALL_GenBuffers>);
+    hook<CALL_GenFramebuffers>(glGenFramebuffers, &glCaptureGen<CALL_GenFramebuffers>);
+    hook<CALL_GenQueries>(glGenQueries, &glCaptureGen<CALL_GenQueries>);
+    hook<CALL_GenRenderbuffers>(glGenRenderbuffers, &glCaptureGen<CALL_GenRenderbuffers>);
+    hook<CALL_GenTextures>(glGenTextures, &glCaptureGen<CALL_GenTextures>);
+    hook<CALL_GenVertexArrays>(glGenVertexArrays, &glCaptureGen<CALL_GenVertexArrays>);
+    hook<CALL_DeleteBuffers>(glDeleteBuffers, &glCaptureDelete<CALL_DeleteBuffers>);
+    hook<CALL_DeleteFramebuffers>(glDeleteFramebuffers, &glCaptureDelete<CALL_DeleteFramebuffers>);
+    hook<CALL_DeleteQueries>(glDeleteQueries, &glCaptureDelete<CALL_DeleteQueries>);
+    hook<CALL_DeleteRenderbuffers>(glDeleteRenderbuffers, &glCaptureDelete<CALL_DeleteRenderbuffers>);
+    hook<CALL_DeleteTextures>(glDeleteTextures, &glCaptureDelete<CALL_DeleteTextures>);
+    hook<CALL_DeleteVertexArrays>(glDeleteVertexArrays, &glCaptureDelete<CALL_DeleteVertexArrays>);
+    hook<CALL_Uniform2fv>(glUniform2fv, &glCaptureUniformVector<CALL_Uniform2fv, 2>);
+    hook<CALL_Uniform3fv>(glUniform3fv, &glCaptureUniformVector<CALL_Uniform3fv, 3>);
+    hook<CALL_Uniform4fv>(glUniform4fv, &glCaptureUniformVector<CALL_Uniform4fv, 4>);
+    hook<CALL_UniformMatrix2fv>(glUniformMatrix2fv, &glCaptureUniformMatrix<CALL_UniformMatrix2fv, 2>);
+    hook<CALL_UniformMatrix3fv>(glUniformMatrix3fv, &glCaptureUniformMatrix<CALL_UniformMatrix3fv, 3>);
+    hook<CALL_UniformMatrix4fv>(glUniformMatrix4fv, &glCaptureUniformMatrix<CALL_UniformMatrix4fv, 4>);
+    hook<CALL_BufferData>(glBufferData, &glCaptureBufferData);
+    hook<CALL_BufferSubData>(glBufferSubData, &glCaptureBufferSubData);
+    hook<CALL_TexImage2D>(glTexImage2D, &glCaptureTexImage2D);
+    hook<CALL_TexImage3D>(glTexImage3D, &glCaptureTexImage3D);
+    hook<CALL_ClearBufferfv>(glClearBufferfv, &glCaptureClearBufferfv);
+    hook<CALL_DrawBuffers>(glDrawBuffers, &glCaptureDrawBuffers);
+    hook<CALL_ShaderSource>(glShaderSource, &glCaptureShaderSource);
+    hook<CALL_GetUniformLocation>(glGetUniformLocation, &glCaptureLocation<CALL_GetUniformLocation>);
+    hook<CALL_GetAttribLocation>(glGetAttribLocation, &glCaptureLocation<CALL_GetAttribLocation>);
+    hook<CALL_UniformBlockBinding>(glUniformBlockBinding, &glCaptureUniformBlockBinding);
+
+    if (glExt.MultiDrawElementsIndirect)
+        hook<CALL_MultiDrawElementsIndirect>(glExt.MultiDrawElementsIndirect);
+    // GL 4.0, absent on 3.3 contexts
+    if (glBlendFunci)
+        hook<CALL_BlendFunci>(glBlendFunci);
+
+    // everything else glad loaded only forwards, and reports being called
+#define GL_CAPTURE_WATCH(name) watch<&glad_gl##name>("gl" #name);
+    GL_CAPTURE_GLAD_FUNCTIONS(GL_CAPTURE_WATCH)
+#undef GL_CAPTURE_WATCH
+}
+
+#endif
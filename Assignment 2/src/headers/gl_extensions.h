@@ -0,0 +1,131 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <cstring>
+
+// glad was generated for plain GL 4.1 core without extensions, so everything newer
+// (or extension only) is declared here and loaded by hand through GLFW.
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+#define GL_ANY_SAMPLES_PASSED_CONSERVATIVE 0x8D6A
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_VERTEX_SHADER_INVOCATIONS_ARB
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#endif
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// one entry of a GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;   // honoured by per-instance attributes, GL 4.2 / ARB_base_instance
+};
+
+// Runtime view of what the current context can do. Filled once after glad is loaded.
+struct GLExtensions
+{
+    int major = 0;
+    int minor = 0;
+    std::string renderer;
+
+    // GL_KHR_parallel_shader_compile (or the ARB twin): compile/link return immediately
+    // and GL_COMPLETION_STATUS_KHR can be polled without blocking
+    bool parallelShaderCompile = false;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreads = nullptr;
+
+    // GL 4.3 / GL_ARB_ES3_compatibility: occlusion queries that may answer early and err
+    // towards visible, otherwise we use the exact GL_ANY_SAMPLES_PASSED
+    bool conservativeOcclusion = false;
+
+    // GL 4.3 / GL_ARB_multi_draw_indirect (+ ARB_base_instance): a whole list of draws from one buffer
+    bool multiDrawIndirect = false;
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect = nullptr;
+
+    // GL 4.4 / GL_ARB_buffer_storage: immutable buffers that can stay mapped while the GPU reads them
+    bool bufferStorage = false;
+    PFNGLBUFFERSTORAGEPROC BufferStorage = nullptr;
+
+    // GL 4.6 / GL_ARB_pipeline_statistics_query: shader invocation counters as queries
+    bool pipelineStatistics = false;
+
+    // GL 4.0: a blend function per draw buffer (glBlendFunci, loaded by glad with 4.x contexts)
+    bool drawBufferBlend = false;
+
+    // must be called with the context current, after gladLoadGLLoader
+    void load()
+    {
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        const GLubyte* name = glGetString(GL_RENDERER);
+        renderer = name ? (const char*)name : "unknown";
+
+        if (has("GL_KHR_parallel_shader_compile"))
+            MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        else if (has("GL_ARB_parallel_shader_compile"))
+            MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+        parallelShaderCompile = MaxShaderCompilerThreads != nullptr;
+
+        conservativeOcclusion = atLeast(4, 3) || has("GL_ARB_ES3_compatibility");
+
+        if (atLeast(4, 3) || (has("GL_ARB_multi_draw_indirect") && (atLeast(4, 2) || has("GL_ARB_base_instance"))))
+            MultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect");
+        multiDrawIndirect = MultiDrawElementsIndirect != nullptr;
+
+        if (atLeast(4, 4) || has("GL_ARB_buffer_storage"))
+            BufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+        bufferStorage = BufferStorage != nullptr;
+
+        pipelineStatistics = atLeast(4, 6) || has("GL_ARB_pipeline_statistics_query");
+
+        drawBufferBlend = atLeast(4, 0) && glBlendFunci != nullptr;
+    }
+
+    bool has(const char* extension) const
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && std::strcmp(ext, extension) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool atLeast(int wantMajor, int wantMinor) const
+    {
+        return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+    }
+};
+
+inline GLExtensions glExt;
+
+#endif
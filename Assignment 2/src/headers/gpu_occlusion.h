@@ -0,0 +1,214 @@
+#ifndef GPU_OCCLUSION_H
+#define GPU_OCCLUSION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <gl_extensions.h>
+
+#include <vector>
+#include <algorithm>
+
+// Hardware occlusion culling in the spirit of CHC++ (Mattausch et al.): every object keeps
+// one query against its bounding box, and the CPU only ever reads results that are already
+// available, so it never waits on the GPU.
+//
+//  - known visible: drawn, its box is queried again every few frames (staggered per object)
+//  - known hidden:  skipped, its box is queried every frame so it reappears a frame later
+//  - result still in flight: drawn inside glBeginConditionalRender on that query, so the GPU
+//    drops it when the box was hidden
+//
+// Boxes are drawn after the scene, with color and depth writes off, by issue().
+class OcclusionQueries
+{
+public:
+    enum Visibility
+    {
+        VISIBLE,
+        HIDDEN,
+        CONDITIONAL   // draw with condition(entity)
+    };
+
+    struct Stats
+    {
+        int tested = 0;
+        int hidden = 0;
+        int conditional = 0;
+        int issued = 0;
+        // frames from issuing a query until its result was picked up
+        double averageLatency = 0.0;
+        int maxLatency = 0;
+    };
+
+    // visible objects are re-checked this often
+    int visibleInterval = 8;
+
+    OcclusionQueries() : boundsShader("shaders/bounds.vert", "shaders/bounds.frag")
+    {
+        target = glExt.conservativeOcclusion ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+
+        // unit cube, 36 vertices
+        const float cube[] = {
+            -1,-1,-1,  1, 1,-1,  1,-1,-1,   1, 1,-1, -1,-1,-1, -1, 1,-1,
+            -1,-1, 1,  1,-1, 1,  1, 1, 1,   1, 1, 1, -1, 1, 1, -1,-1, 1,
+            -1, 1, 1, -1, 1,-1, -1,-1,-1,  -1,-1,-1, -1,-1, 1, -1, 1, 1,
+             1, 1, 1,  1,-1,-1,  1, 1,-1,   1,-1,-1,  1, 1, 1,  1,-1, 1,
+            -1,-1,-1,  1,-1,-1,  1,-1, 1,   1,-1, 1, -1,-1, 1, -1,-1,-1,
+            -1, 1,-1,  1, 1, 1,  1, 1,-1,   1, 1, 1, -1, 1,-1, -1, 1, 1,
+        };
+        glGenVertexArrays(1, &cubeVAO);
+        glGenBuffers(1, &cubeVBO);
+        glBindVertexArray(cubeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    ~OcclusionQueries()
+    {
+        resize(0);
+        glDeleteVertexArrays(1, &cubeVAO);
+        glDeleteBuffers(1, &cubeVBO);
+    }
+
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+    // one slot per entity; queries of dropped entities are deleted
+    void beginFrame(int entityCount)
+    {
+        frame++;
+        resize(entityCount);
+        toQuery.clear();
+        previous = stats;
+        stats = Stats();
+        latencySum = 0;
+        latencyCount = 0;
+    }
+
+    // decides how a frustum-visible entity is drawn this frame, from results that are ready
+    Visibility classify(int e, const glm::vec3 &center, float radius, const glm::vec3 &cameraPos)
+    {
+        State &s = states[e];
+        stats.tested++;
+
+        if (s.pending)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(s.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint result = 0;
+                glGetQueryObjectuiv(s.query, GL_QUERY_RESULT, &result);
+                s.visible = result != 0;
+                s.pending = false;
+                int latency = frame - s.issuedFrame;
+                latencySum += latency;
+                latencyCount++;
+                stats.maxLatency = std::max(stats.maxLatency, latency);
+                stats.averageLatency = (double)latencySum / latencyCount;
+            }
+        }
+
+        // with the camera inside (or right at) the box its faces get clipped away and the query would lie
+        glm::vec3 offset = cameraPos - center;
+        if (glm::dot(offset, offset) < (radius * 1.8f) * (radius * 1.8f) + 0.1f)
+        {
+            s.visible = true;
+            return VISIBLE;
+        }
+
+        if (s.pending)
+        {
+            stats.conditional++;
+            return CONDITIONAL;
+        }
+        if (!s.visible)
+        {
+            toQuery.push_back(e);
+            stats.hidden++;
+            return HIDDEN;
+        }
+        if (s.issuedFrame < 0 || (frame + e) % visibleInterval == 0)
+            toQuery.push_back(e);
+        return VISIBLE;
+    }
+
+    // the query to use with glBeginConditionalRender for CONDITIONAL entities
+    unsigned int condition(int e) const { return states[e].query; }
+
+    // draws the boxes of everything that asked for a query this frame against the current
+    // depth buffer. Call after the scene is drawn. Spheres are SoA world space bounds.
+    void issue(const glm::mat4 &viewProjection, const float* x, const float* y, const float* z, const float* radius)
+    {
+        if (toQuery.empty())
+            return;
+
+        GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+        glDisable(GL_CULL_FACE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+
+        boundsShader.use();
+        boundsShader.setMat4("viewProjection", viewProjection);
+        GLint sphereLocation = boundsShader.uniformLocation("sphere");
+        glBindVertexArray(cubeVAO);
+        for (int e : toQuery)
+        {
+            State &s = states[e];
+            glUniform4f(sphereLocation, x[e], y[e], z[e], radius[e]);
+            glBeginQuery(target, s.query);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glEndQuery(target);
+            s.pending = true;
+            s.issuedFrame = frame;
+        }
+        glBindVertexArray(0);
+        stats.issued = (int)toQuery.size();
+
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        if (cullFace)
+            glEnable(GL_CULL_FACE);
+    }
+
+    // the numbers of the previous complete frame, for display
+    const Stats& last() const { return previous; }
+    bool conservative() const { return target == GL_ANY_SAMPLES_PASSED_CONSERVATIVE; }
+
+private:
+    struct State
+    {
+        unsigned int query = 0;
+        bool visible = true;
+        bool pending = false;
+        int issuedFrame = -1;
+    };
+
+    Shader boundsShader;
+    unsigned int cubeVAO = 0, cubeVBO = 0;
+    GLenum target = GL_ANY_SAMPLES_PASSED;
+    std::vector<State> states;
+    std::vector<int> toQuery;
+    int frame = 0;
+    long latencySum = 0;
+    int latencyCount = 0;
+    Stats stats, previous;
+
+    void resize(int count)
+    {
+        for (size_t e = count; e < states.size(); e++)
+            glDeleteQueries(1, &states[e].query);
+        size_t old = states.size();
+        states.resize(count);
+        for (size_t e = old; e < states.size(); e++)
+            glGenQueries(1, &states[e].query);
+    }
+};
+
+#endif
@@ -7,6 +7,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include <vertex_binding.h>
+#include <culling.h>
+#include <geometry_pool.h>
 
 #include <string>
 #include <vector>
@@ -31,6 +34,17 @@ struct Vertex {
 	float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// per-instance data for instanced draws, streamed in sorted order by the RenderQueue
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    // x: effectType, y: ior, z: dispersion, w: reflectivity
+    glm::vec4 params;
+};
+
+// every mesh's vertices and indices live in these shared buffers, see geometry_pool.h
+inline GeometryPool<Vertex> geometryPool;
+
 struct Texture {
     unsigned int id;
     string type;
@@ -43,7 +57,12 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    // object space box and sphere around all vertices
+    Bounds               bounds;
+    // small unique number, used in render queue sort keys
+    unsigned int         id;
+    // where the vertices and indices sit in geometryPool
+    GeometryRange        range;
 
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
@@ -52,12 +71,32 @@ public:
         this->indices = indices;
         this->textures = textures;
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        static unsigned int nextId = 0;
+        id = nextId++;
+
+        computeBounds();
+        // now that we have all the required data, set the vertex buffers.
         setupMesh();
     }
 
     // render the mesh
     void Draw(Shader &shader) 
+    {
+        bindTextures(shader);
+        
+        // draw mesh, with a VAO that only fetches what this program reads
+        unsigned int vao = vertexArrayFor(shader);
+        glBindVertexArray(vao);
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, indexOffset(), range.baseVertex);
+        glBindVertexArray(0);
+        vertexBindings.countDraw(vao, vertices.size());
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the material textures to the samplers named texture_diffuseN, texture_specularN, ...
+    void bindTextures(Shader &shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -80,67 +119,73 @@ public:
                 number = std::to_string(heightNr++); // transfer unsigned int to string
 
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            glUniform1i(shader.uniformLocation(name + number), i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // the VAO for drawing this mesh with the given program, created on first use. Every mesh
+    // sits in the same pool buffers, so all of them share it. Programs that read per-instance
+    // inputs (see InstanceData) also need the instance buffer.
+    unsigned int vertexArrayFor(const Shader &shader, unsigned int instanceVBO = 0)
+    {
+        geometryPool.upload();
+        return vertexBindings.get(shader, { geometryPool.positionVBO, geometryPool.normalVBO, geometryPool.VBO, instanceVBO },
+                                  geometryPool.EBO, layout(), "scene geometry");
+    }
+
+    // byte offset of the first index in the pool's element buffer, as glDrawElements wants it
+    const void* indexOffset() const
+    {
+        return (const void*)(range.firstIndex * sizeof(unsigned int));
+    }
+
+    // everything a mesh can feed to a vertex shader, by input name. Positions and normals get
+    // their own tightly packed streams since nearly every program reads them (and depth-only
+    // passes only positions); the rest stays interleaved in the full Vertex buffer.
+    static const vector<VertexAttribute>& layout()
+    {
+        static const vector<VertexAttribute> attributes = {
+            { "aPos",       0, 3, GL_FLOAT, sizeof(glm::vec3), 0, 0 },
+            { "aNormal",    1, 3, GL_FLOAT, sizeof(glm::vec3), 0, 0 },
+            { "aTexCoords", 2, 2, GL_FLOAT, sizeof(Vertex), offsetof(Vertex, TexCoords), 0 },
+            { "aTangent",   2, 3, GL_FLOAT, sizeof(Vertex), offsetof(Vertex, Tangent), 0 },
+            { "aBitangent", 2, 3, GL_FLOAT, sizeof(Vertex), offsetof(Vertex, Bitangent), 0 },
+            { "aBoneIDs",   2, 4, GL_INT,   sizeof(Vertex), offsetof(Vertex, m_BoneIDs), 0 },
+            { "aWeights",   2, 4, GL_FLOAT, sizeof(Vertex), offsetof(Vertex, m_Weights), 0 },
+            // per instance
+            { "iModel",        3, 4, GL_FLOAT, sizeof(InstanceData), offsetof(InstanceData, model), 1 },
+            { "iNormalMatrix", 3, 3, GL_FLOAT, sizeof(InstanceData), offsetof(InstanceData, normalMatrix), 1 },
+            { "iParams",       3, 4, GL_FLOAT, sizeof(InstanceData), offsetof(InstanceData, params), 1 },
+        };
+        return attributes;
     }
 
 private:
-    // render data 
-    unsigned int VBO, EBO;
+    void computeBounds()
+    {
+        vector<glm::vec3> positions(vertices.size());
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            positions[i] = vertices[i].Position;
+            bounds.grow(positions[i]);
+        }
+        bounds.fitSphere(positions);
+    }
 
-    // initializes all the buffer objects/arrays
+    // hands the vertex data to the shared geometry pool. Attribute pointers live in the
+    // per-program VAOs handed out by vertexBindings, so nothing is enabled here.
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        vector<glm::vec3> positions(vertices.size());
+        vector<glm::vec3> normals(vertices.size());
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            positions[i] = vertices[i].Position;
+            normals[i] = vertices[i].Normal;
+        }
+        range = geometryPool.add(positions, normals, vertices, indices);
     }
 };
 #endif
\ No newline at end of file
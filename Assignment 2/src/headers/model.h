@@ -31,6 +31,8 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // object space bounds over all meshes
+    Bounds bounds;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -63,6 +65,22 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+
+        computeBounds();
+    }
+
+    // box around every mesh box, sphere around every mesh sphere
+    void computeBounds()
+    {
+        for(const Mesh &mesh : meshes)
+        {
+            bounds.grow(mesh.bounds.min);
+            bounds.grow(mesh.bounds.max);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        bounds.radius = 0.0f;
+        for(const Mesh &mesh : meshes)
+            bounds.radius = glm::max(bounds.radius, glm::length(mesh.bounds.center - bounds.center) + mesh.bounds.radius);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
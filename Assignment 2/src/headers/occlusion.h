@@ -0,0 +1,446 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <simd.h>
+#include <thread_pool.h>
+
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+// Low-poly stand-in for a model that is used to occlude other objects. It has to fit inside
+// the real geometry, otherwise objects behind its silhouette would be culled wrongly.
+struct OccluderMesh
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    // per triangle edge (the one opposite corner k at 3 * triangle + k) the triangle on the
+    // other side, -1 for none; empty treats every edge as an outline
+    std::vector<int> neighbours;
+
+    // UV sphere with its vertices on `radius`, so the whole hull stays inside that sphere
+    static OccluderMesh sphere(glm::vec3 center, float radius, int rings = 6, int segments = 8)
+    {
+        OccluderMesh mesh;
+        for (int r = 0; r <= rings; r++)
+        {
+            float phi = 3.14159265f * r / rings;
+            for (int s = 0; s < segments; s++)
+            {
+                float theta = 6.28318531f * s / segments;
+                mesh.vertices.push_back(center + radius * glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+            }
+        }
+        for (int r = 0; r < rings; r++)
+            for (int s = 0; s < segments; s++)
+            {
+                unsigned int a = r * segments + s, b = r * segments + (s + 1) % segments;
+                unsigned int c = a + segments, d = b + segments;
+                mesh.indices.insert(mesh.indices.end(), { a, c, b, b, c, d });
+            }
+        mesh.findNeighbours();
+        return mesh;
+    }
+
+    // pairs up the triangles that share an edge. Vertices at the same position count as one
+    // (the sphere's poles are a ring of them) and triangles without area take no part.
+    void findNeighbours()
+    {
+        std::vector<unsigned int> welded(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            welded[i] = (unsigned int)i;
+            for (size_t j = 0; j < i; j++)
+                if (vertices[j] == vertices[i])
+                {
+                    welded[i] = welded[j];
+                    break;
+                }
+        }
+
+        neighbours.assign(indices.size(), -1);
+        std::map<std::pair<unsigned int, unsigned int>, int> open;   // edge -> its slot in neighbours
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int v[3] = { welded[indices[i]], welded[indices[i + 1]], welded[indices[i + 2]] };
+            if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                std::pair<unsigned int, unsigned int> edge = std::minmax(v[(k + 1) % 3], v[(k + 2) % 3]);
+                auto other = open.find(edge);
+                if (other == open.end())
+                {
+                    open[edge] = (int)(i + k);
+                    continue;
+                }
+                neighbours[i + k] = other->second / 3;
+                neighbours[other->second] = (int)(i / 3);
+                open.erase(other);
+            }
+        }
+    }
+};
+
+// One occluder placed in the world this frame. Larger scores (projected size) win a slot.
+struct OccluderInstance
+{
+    const OccluderMesh* mesh;
+    glm::mat4 model;
+    float score;
+};
+
+// CPU occlusion culling against a small software depth buffer.
+//
+// The biggest occluders of the frame are rasterized into a 256x128 depth buffer (tiles of 64x64
+// run in parallel, four pixels at a time), which is then reduced into a min/max hierarchical Z
+// pyramid. Pixels on an occluder's silhouette only take its depth when it covers all of them,
+// so nothing the GPU would show partly through them is culled. Every object that survived frustum culling is tested with its screen space rectangle
+// and nearest depth against the level where that rectangle covers at most 2x2 texels.
+class SoftwareOcclusion
+{
+public:
+    static constexpr int WIDTH = 256;
+    static constexpr int HEIGHT = 128;
+    static constexpr int TILE = 64;
+
+    struct Stats
+    {
+        int occluders = 0;
+        int triangles = 0;
+        int tested = 0;
+        int culled = 0;
+        double rasterMs = 0.0;
+        double hizMs = 0.0;
+        double testMs = 0.0;
+        double totalMs() const { return rasterMs + hizMs + testMs; }
+    };
+
+    int maxOccluders = 32;
+
+    SoftwareOcclusion()
+    {
+        int w = WIDTH, h = HEIGHT;
+        while (true)
+        {
+            levels.push_back({ w, h, std::vector<float>(w * h), std::vector<float>(w * h) });
+            if (w == 1 && h == 1)
+                break;
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+    }
+
+    // camera of the frame; depth is stored as NDC z remapped to [0, 1]
+    void begin(const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        this->view = view;
+        this->projection = projection;
+        viewProjection = projection * view;
+        nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    }
+
+    // rasterizes the best `maxOccluders` of the candidates and rebuilds the pyramid
+    void render(std::vector<OccluderInstance> &candidates, ThreadPool* pool = nullptr)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        size_t count = std::min(candidates.size(), (size_t)maxOccluders);
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                          [](const OccluderInstance &a, const OccluderInstance &b) { return a.score > b.score; });
+
+        // transform and set up every triangle once, then bin it to the tiles its box touches
+        triangles.clear();
+        for (std::vector<int> &bin : bins)
+            bin.clear();
+        for (size_t i = 0; i < count; i++)
+            setupTriangles(candidates[i]);
+        stats.occluders = (int)count;
+        stats.triangles = (int)triangles.size();
+
+        auto rasterTile = [this](size_t begin, size_t end, int)
+        {
+            for (size_t tile = begin; tile < end; tile++)
+                rasterizeTile((int)tile);
+        };
+        if (pool)
+            pool->parallelFor(TILES_X * TILES_Y, 1, rasterTile);
+        else
+            rasterTile(0, TILES_X * TILES_Y, 0);
+
+        auto rastered = std::chrono::high_resolution_clock::now();
+        buildPyramid();
+        auto done = std::chrono::high_resolution_clock::now();
+
+        stats.rasterMs = std::chrono::duration<double, std::milli>(rastered - start).count();
+        stats.hizMs = std::chrono::duration<double, std::milli>(done - rastered).count();
+    }
+
+    // drops every index from `visible` whose sphere (SoA, world space) is hidden behind the occluders
+    void filter(const float* x, const float* y, const float* z, const float* radius, std::vector<int> &visible,
+                ThreadPool* pool = nullptr)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        results.resize(visible.size());
+
+        auto test = [&](size_t begin, size_t end, int)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                int e = visible[i];
+                results[i] = !occluded(glm::vec3(x[e], y[e], z[e]), radius[e]);
+            }
+        };
+        if (pool)
+            pool->parallelFor(visible.size(), 4096, test);
+        else
+            test(0, visible.size(), 0);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < visible.size(); i++)
+            if (results[i])
+                visible[kept++] = visible[i];
+        stats.tested = (int)visible.size();
+        stats.culled = (int)(visible.size() - kept);
+        visible.resize(kept);
+
+        stats.testMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    const Stats& last() const { return stats; }
+    // full resolution depth, row 0 at the bottom, for debugging views
+    const std::vector<float>& depth() const { return levels[0].maxDepth; }
+
+private:
+    static constexpr int TILES_X = WIDTH / TILE;
+    static constexpr int TILES_Y = HEIGHT / TILE;
+
+    struct Level
+    {
+        int width, height;
+        std::vector<float> minDepth, maxDepth;
+    };
+    // screen space triangle with edge functions E(x, y) = a * x + b * y + c, >= 0 inside
+    struct Triangle
+    {
+        float a[3], b[3], c[3];
+        // depth plane z(x, y) = zx * x + zy * y + z0
+        float zx, zy, z0;
+        int minX, minY, maxX, maxY;
+    };
+
+    std::vector<Level> levels;
+    std::vector<Triangle> triangles;
+    std::vector<int> bins[TILES_X * TILES_Y];
+    std::vector<char> results;
+    glm::mat4 view = glm::mat4(1.0f), projection = glm::mat4(1.0f), viewProjection = glm::mat4(1.0f);
+    float nearPlane = 0.1f;
+    Stats stats;
+
+    void setupTriangles(const OccluderInstance &occluder)
+    {
+        glm::mat4 mvp = viewProjection * occluder.model;
+        const std::vector<glm::vec3> &vertices = occluder.mesh->vertices;
+        const std::vector<unsigned int> &indices = occluder.mesh->indices;
+        const std::vector<int> &neighbours = occluder.mesh->neighbours;
+
+        // screen x, y and depth; w < 0 marks vertices in front of the near plane
+        std::vector<glm::vec4> screen(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            glm::vec4 v = mvp * glm::vec4(vertices[i], 1.0f);
+            screen[i] = v.w < nearPlane ? glm::vec4(0.0f, 0.0f, 0.0f, -1.0f)
+                                        : glm::vec4((v.x / v.w * 0.5f + 0.5f) * WIDTH, (v.y / v.w * 0.5f + 0.5f) * HEIGHT, v.z / v.w * 0.5f + 0.5f, 1.0f);
+        }
+
+        // twice the signed screen area of every triangle, <= 0 when it isn't drawn
+        size_t triangleCount = indices.size() / 3;
+        std::vector<float> areas(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            const glm::vec4 &s0 = screen[indices[i * 3]], &s1 = screen[indices[i * 3 + 1]], &s2 = screen[indices[i * 3 + 2]];
+            // skipping triangles that cross the near plane only loses occlusion, never adds it;
+            // back facing (counter clockwise is front) or degenerate ones aren't drawn either
+            if (s0.w < 0.0f || s1.w < 0.0f || s2.w < 0.0f)
+                areas[i] = 0.0f;
+            else
+                areas[i] = (s1.x - s0.x) * (s2.y - s0.y) - (s2.x - s0.x) * (s1.y - s0.y);
+        }
+
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            float area = areas[i];
+            if (area <= 0.0f)
+                continue;
+            glm::vec3 s[3];
+            for (int k = 0; k < 3; k++)
+                s[k] = glm::vec3(screen[indices[i * 3 + k]]);
+
+            Triangle t;
+            t.minX = std::max(0, (int)std::floor(std::min({ s[0].x, s[1].x, s[2].x })));
+            t.maxX = std::min(WIDTH - 1, (int)std::ceil(std::max({ s[0].x, s[1].x, s[2].x })));
+            t.minY = std::max(0, (int)std::floor(std::min({ s[0].y, s[1].y, s[2].y })));
+            t.maxY = std::min(HEIGHT - 1, (int)std::ceil(std::max({ s[0].y, s[1].y, s[2].y })));
+            if (t.minX > t.maxX || t.minY > t.maxY)
+                continue;
+
+            for (int k = 0; k < 3; k++)
+            {
+                const glm::vec3 &p = s[(k + 1) % 3], &q = s[(k + 2) % 3];
+                // edge opposite vertex k, normalized so it equals the barycentric weight of k
+                t.a[k] = (p.y - q.y) / area;
+                t.b[k] = (q.x - p.x) / area;
+                t.c[k] = (p.x * q.y - q.x * p.y) / area;
+            }
+            t.zx = t.a[0] * s[0].z + t.a[1] * s[1].z + t.a[2] * s[2].z;
+            t.zy = t.b[0] * s[0].z + t.b[1] * s[1].z + t.b[2] * s[2].z;
+            t.z0 = t.c[0] * s[0].z + t.c[1] * s[1].z + t.c[2] * s[2].z;
+
+            // Coverage is tested at pixel centers. Where the edge is on the silhouette (nothing
+            // drawn on the other side) it moves in by the most it changes from the center to a
+            // corner, so pixels it only partly covers get no depth; edges shared with a drawn
+            // triangle stay put, or the seams would leave every pixel along them open. The depth
+            // is the farthest the plane gets within the pixel.
+            for (int k = 0; k < 3; k++)
+            {
+                int neighbour = neighbours.empty() ? -1 : neighbours[i * 3 + k];
+                if (neighbour < 0 || areas[neighbour] <= 0.0f)
+                    t.c[k] -= 0.5f * (std::abs(t.a[k]) + std::abs(t.b[k]));
+            }
+            t.z0 += 0.5f * (std::abs(t.zx) + std::abs(t.zy));
+
+            int index = (int)triangles.size();
+            triangles.push_back(t);
+            for (int ty = t.minY / TILE; ty <= t.maxY / TILE; ty++)
+                for (int tx = t.minX / TILE; tx <= t.maxX / TILE; tx++)
+                    bins[ty * TILES_X + tx].push_back(index);
+        }
+    }
+
+    void rasterizeTile(int tile)
+    {
+        int tileX = (tile % TILES_X) * TILE, tileY = (tile / TILES_X) * TILE;
+        float* depth = levels[0].maxDepth.data();
+        for (int y = tileY; y < tileY + TILE; y++)
+            std::fill(depth + y * WIDTH + tileX, depth + y * WIDTH + tileX + TILE, 1.0f);
+
+        const f4 laneOffset = f4Load(LANE_OFFSETS);
+        const f4 zero = f4Set(0.0f);
+        for (int index : bins[tile])
+        {
+            const Triangle &t = triangles[index];
+            int x0 = std::max(t.minX, tileX) & ~3, x1 = std::min(t.maxX, tileX + TILE - 1);
+            int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, tileY + TILE - 1);
+
+            for (int y = y0; y <= y1; y++)
+            {
+                float py = y + 0.5f;
+                for (int x = x0; x <= x1; x += 4)
+                {
+                    // pixel centers of four neighbours
+                    f4 px = f4Add(f4Set(x + 0.5f), laneOffset);
+                    f4 w0 = f4MulAdd(f4Set(t.a[0]), px, f4Set(t.b[0] * py + t.c[0]));
+                    f4 w1 = f4MulAdd(f4Set(t.a[1]), px, f4Set(t.b[1] * py + t.c[1]));
+                    f4 w2 = f4MulAdd(f4Set(t.a[2]), px, f4Set(t.b[2] * py + t.c[2]));
+                    f4 inside = f4Min(w0, f4Min(w1, w2));
+                    if (!(f4MaskGreater(inside, f4Set(-1e-7f))))
+                        continue;
+
+                    f4 z = f4MulAdd(f4Set(t.zx), px, f4Set(t.zy * py + t.z0));
+                    f4 old = f4Load(depth + y * WIDTH + x);
+                    f4Store(depth + y * WIDTH + x, f4SelectGreater(zero, inside, old, f4Min(old, z)));
+                }
+            }
+        }
+    }
+
+    // level 0 min == max, every next level keeps both extremes of its 2x2 (or 2x1) footprint
+    void buildPyramid()
+    {
+        levels[0].minDepth = levels[0].maxDepth;
+        for (size_t l = 1; l < levels.size(); l++)
+        {
+            const Level &src = levels[l - 1];
+            Level &dst = levels[l];
+            for (int y = 0; y < dst.height; y++)
+                for (int x = 0; x < dst.width; x++)
+                {
+                    int sx0 = std::min(x * 2, src.width - 1), sx1 = std::min(x * 2 + 1, src.width - 1);
+                    int sy0 = std::min(y * 2, src.height - 1), sy1 = std::min(y * 2 + 1, src.height - 1);
+                    int i[4] = { sy0 * src.width + sx0, sy0 * src.width + sx1, sy1 * src.width + sx0, sy1 * src.width + sx1 };
+                    dst.minDepth[y * dst.width + x] = std::min({ src.minDepth[i[0]], src.minDepth[i[1]], src.minDepth[i[2]], src.minDepth[i[3]] });
+                    dst.maxDepth[y * dst.width + x] = std::max({ src.maxDepth[i[0]], src.maxDepth[i[1]], src.maxDepth[i[2]], src.maxDepth[i[3]] });
+                }
+        }
+    }
+
+    bool occluded(const glm::vec3 &center, float radius) const
+    {
+        if (radius < 0.0f)
+            return false;
+        glm::vec3 c = glm::vec3(view * glm::vec4(center, 1.0f));
+        // nearest point of the sphere; anything touching the near plane counts as visible
+        float nearestZ = c.z + radius;
+        if (-nearestZ < nearPlane)
+            return false;
+
+        // screen rectangle from the view space box around the sphere
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 p = projection * glm::vec4(c.x + (corner & 1 ? radius : -radius),
+                                                 c.y + (corner & 2 ? radius : -radius),
+                                                 c.z + (corner & 4 ? radius : -radius), 1.0f);
+            if (p.w < nearPlane)
+                return false;
+            float sx = (p.x / p.w * 0.5f + 0.5f) * WIDTH, sy = (p.y / p.w * 0.5f + 0.5f) * HEIGHT;
+            minX = std::min(minX, sx); maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy); maxY = std::max(maxY, sy);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= WIDTH || minY >= HEIGHT)
+            return false;
+        int x0 = std::max(0, (int)minX), x1 = std::min(WIDTH - 1, (int)maxX);
+        int y0 = std::max(0, (int)minY), y1 = std::min(HEIGHT - 1, (int)maxY);
+
+        glm::vec4 nearest = projection * glm::vec4(0.0f, 0.0f, nearestZ, 1.0f);
+        float depth = nearest.z / nearest.w * 0.5f + 0.5f;
+
+        // the level where the rectangle spans at most 2x2 texels
+        int level = 0;
+        while (level + 1 < (int)levels.size() && std::max(x1 - x0, y1 - y0) >= 2)
+        {
+            x0 /= 2; x1 /= 2; y0 /= 2; y1 /= 2;
+            level++;
+        }
+        const Level &l = levels[level];
+        x1 = std::min(x1, l.width - 1);
+        y1 = std::min(y1, l.height - 1);
+
+        // quick accept: in front of the nearest occluder anywhere in the coarser footprint
+        if (level + 1 < (int)levels.size())
+        {
+            const Level &coarse = levels[level + 1];
+            float nearestOccluder = 1.0f;
+            for (int y = y0 / 2; y <= std::min(y1 / 2, coarse.height - 1); y++)
+                for (int x = x0 / 2; x <= std::min(x1 / 2, coarse.width - 1); x++)
+                    nearestOccluder = std::min(nearestOccluder, coarse.minDepth[y * coarse.width + x]);
+            if (depth <= nearestOccluder)
+                return false;
+        }
+
+        // hidden only if behind the farthest occluder depth of every covered texel
+        for (int y = y0; y <= y1; y++)
+            for (int x = x0; x <= x1; x++)
+                if (depth <= l.maxDepth[y * l.width + x])
+                    return false;
+        return true;
+    }
+
+    static constexpr float LANE_OFFSETS[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+};
+
+#endif
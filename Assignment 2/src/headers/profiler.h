@@ -0,0 +1,402 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include "imgui.h"
+
+#include <gl_extensions.h>
+
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+
+// Nested CPU + GPU timing scopes per frame, shown as two flame graphs and a table with rolling
+// min/avg/p99 per scope.
+//
+// GPU times come from GL_TIMESTAMP queries at both ends of a scope (GL_TIME_ELAPSED queries
+// can't nest). Every frame owns its own set of queries and a frame is only read back
+// FRAMES_IN_FLIGHT frames later, when the GPU is long done with it, so reading never stalls;
+// a frame whose results still aren't there is skipped and counted. Scopes directly below the
+// frame can also count vertex and fragment shader invocations (ARB_pipeline_statistics_query);
+// those queries can't nest either, hence only one level.
+//
+// Per frame:  beginFrame()  begin("x") ... end()  ...  endFrame()
+class Profiler
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 3;
+
+    // one scope of a finished frame, times in ms since the start of that frame
+    struct Scope
+    {
+        std::string name;
+        std::string path;   // "Frame/Objects", identifies the scope in the history
+        int depth = 0;
+        double cpuStart = 0.0, cpuMs = 0.0;
+        double gpuStart = 0.0, gpuMs = 0.0;
+        bool hasStatistics = false;
+        GLuint64 vertexInvocations = 0, fragmentInvocations = 0;
+    };
+
+    struct Summary
+    {
+        float min = 0.0f;
+        float avg = 0.0f;
+        float p99 = 0.0f;
+    };
+
+    bool enabled = true;
+    // count shader invocations as well, when the context has pipeline statistics
+    bool pipelineStatistics = true;
+    // frames kept per scope for min/avg/p99
+    size_t historyLength = 240;
+
+    Profiler() = default;
+    ~Profiler()
+    {
+        for (Frame &frame : frames)
+        {
+            if (!frame.timestamps.empty())
+                glDeleteQueries((GLsizei)frame.timestamps.size(), frame.timestamps.data());
+            if (!frame.statistics.empty())
+                glDeleteQueries((GLsizei)frame.statistics.size(), frame.statistics.data());
+        }
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // picks up the results of the frame that used this set of queries before, then opens the "Frame" scope
+    void beginFrame()
+    {
+        Frame &frame = current();
+        if (frame.pending)
+            resolve(frame);
+        frame.records.clear();
+        frame.usedTimestamps = frame.usedStatistics = 0;
+        frame.pending = false;
+        open.clear();
+
+        recording = enabled;
+        if (!recording)
+            return;
+        frame.cpuStart = Clock::now();
+        begin("Frame");
+    }
+
+    // `name` has to outlive the frame (string literals)
+    void begin(const char* name)
+    {
+        if (!recording)
+            return;
+        Frame &frame = current();
+        Record record;
+        record.name = name;
+        record.depth = (int)open.size();
+        record.cpuBegin = Clock::now();
+        record.gpuBegin = timestamp(frame);
+        if (record.depth == 1 && pipelineStatistics && glExt.pipelineStatistics)
+        {
+            record.vertexQuery = statisticsQuery(frame);
+            record.fragmentQuery = statisticsQuery(frame);
+            glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, record.vertexQuery);
+            glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, record.fragmentQuery);
+        }
+        open.push_back(frame.records.size());
+        frame.records.push_back(record);
+    }
+
+    void end()
+    {
+        if (!recording || open.empty())
+            return;
+        Frame &frame = current();
+        Record &record = frame.records[open.back()];
+        open.pop_back();
+        if (record.vertexQuery)
+        {
+            glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+            glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+        }
+        record.gpuEnd = timestamp(frame);
+        record.cpuEnd = Clock::now();
+    }
+
+    // closes whatever is still open, the "Frame" scope last
+    void endFrame()
+    {
+        if (!recording)
+            return;
+        while (!open.empty())
+            end();
+        current().pending = true;
+        frameIndex++;
+        recording = false;
+    }
+
+    // the last frame that could be read back, outermost scope first
+    const std::vector<Scope>& lastFrame() const { return resolved; }
+    Summary cpuSummary(const std::string &path) const { return summary(path, false); }
+    Summary gpuSummary(const std::string &path) const { return summary(path, true); }
+
+    // flame graphs and the scope table, for the settings window
+    void drawUI()
+    {
+        ImGui::Checkbox("Profiler", &enabled);
+        if (glExt.pipelineStatistics)
+        {
+            ImGui::SameLine();
+            ImGui::Checkbox("Shader invocations", &pipelineStatistics);
+        }
+        if (!enabled)
+            return;
+        if (resolved.empty())
+        {
+            ImGui::TextDisabled("  waiting for the first GPU results");
+            return;
+        }
+
+        const Scope &frame = resolved[0];
+        ImGui::Text("  frame: CPU %.3f ms, GPU %.3f ms, %d frame(s) skipped waiting for results",
+                    frame.cpuMs, frame.gpuMs, skippedFrames);
+        flameGraph("CPU", false);
+        flameGraph("GPU", true);
+
+        bool statistics = false;
+        for (const Scope &scope : resolved)
+            statistics |= scope.hasStatistics;
+        ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingFixedFit;
+        if (ImGui::BeginTable("profiler scopes", statistics ? 9 : 7, flags))
+        {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("CPU min");
+            ImGui::TableSetupColumn("CPU avg");
+            ImGui::TableSetupColumn("CPU p99");
+            ImGui::TableSetupColumn("GPU min");
+            ImGui::TableSetupColumn("GPU avg");
+            ImGui::TableSetupColumn("GPU p99");
+            if (statistics)
+            {
+                ImGui::TableSetupColumn("VS invocations");
+                ImGui::TableSetupColumn("FS invocations");
+            }
+            ImGui::TableHeadersRow();
+            for (const Scope &scope : resolved)
+            {
+                Summary cpu = cpuSummary(scope.path), gpu = gpuSummary(scope.path);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%*s%s", scope.depth * 2, "", scope.name.c_str());
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", cpu.min);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", cpu.avg);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", cpu.p99);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", gpu.min);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", gpu.avg);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", gpu.p99);
+                if (statistics)
+                {
+                    ImGui::TableNextColumn();
+                    if (scope.hasStatistics)
+                        ImGui::Text("%llu", (unsigned long long)scope.vertexInvocations);
+                    ImGui::TableNextColumn();
+                    if (scope.hasStatistics)
+                        ImGui::Text("%llu", (unsigned long long)scope.fragmentInvocations);
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    // a scope while its frame is in flight
+    struct Record
+    {
+        const char* name = "";
+        int depth = 0;
+        Clock::time_point cpuBegin, cpuEnd;
+        GLuint gpuBegin = 0, gpuEnd = 0;
+        GLuint vertexQuery = 0, fragmentQuery = 0;
+    };
+
+    struct Frame
+    {
+        std::vector<Record> records;
+        // query objects are kept and reused, the vectors only grow
+        std::vector<GLuint> timestamps, statistics;
+        size_t usedTimestamps = 0, usedStatistics = 0;
+        Clock::time_point cpuStart;
+        bool pending = false;
+    };
+
+    // the last historyLength values of one scope, oldest overwritten first
+    struct History
+    {
+        std::vector<float> cpu, gpu;
+        size_t next = 0;
+    };
+
+    Frame frames[FRAMES_IN_FLIGHT];
+    unsigned long frameIndex = 0;
+    bool recording = false;
+    std::vector<size_t> open;   // records of the scopes begun but not ended
+    std::vector<Scope> resolved;
+    std::map<std::string, History> history;
+    int skippedFrames = 0;
+
+    Frame& current() { return frames[frameIndex % FRAMES_IN_FLIGHT]; }
+
+    static GLuint nextQuery(std::vector<GLuint> &pool, size_t &used)
+    {
+        if (used == pool.size())
+        {
+            GLuint query = 0;
+            glGenQueries(1, &query);
+            pool.push_back(query);
+        }
+        return pool[used++];
+    }
+
+    static GLuint timestamp(Frame &frame)
+    {
+        GLuint query = nextQuery(frame.timestamps, frame.usedTimestamps);
+        glQueryCounter(query, GL_TIMESTAMP);
+        return query;
+    }
+
+    static GLuint statisticsQuery(Frame &frame)
+    {
+        return nextQuery(frame.statistics, frame.usedStatistics);
+    }
+
+    static bool available(GLuint query)
+    {
+        GLint ready = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &ready);
+        return ready != 0;
+    }
+
+    static GLuint64 result(GLuint query)
+    {
+        GLuint64 value = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &value);
+        return value;
+    }
+
+    void resolve(Frame &frame)
+    {
+        for (size_t i = 0; i < frame.usedTimestamps; i++)
+            if (!available(frame.timestamps[i]))
+            {
+                skippedFrames++;
+                return;
+            }
+        for (size_t i = 0; i < frame.usedStatistics; i++)
+            if (!available(frame.statistics[i]))
+            {
+                skippedFrames++;
+                return;
+            }
+
+        resolved.clear();
+        std::vector<std::string> paths;
+        GLuint64 gpuStart = 0;
+        for (const Record &record : frame.records)
+        {
+            Scope scope;
+            scope.name = record.name;
+            paths.resize(record.depth);
+            scope.path = paths.empty() ? scope.name : paths.back() + "/" + scope.name;
+            paths.push_back(scope.path);
+            scope.depth = record.depth;
+
+            scope.cpuStart = std::chrono::duration<double, std::milli>(record.cpuBegin - frame.cpuStart).count();
+            scope.cpuMs = std::chrono::duration<double, std::milli>(record.cpuEnd - record.cpuBegin).count();
+            GLuint64 begin = result(record.gpuBegin), end = result(record.gpuEnd);
+            if (resolved.empty())
+                gpuStart = begin;
+            scope.gpuStart = (double)(begin - gpuStart) / 1e6;
+            scope.gpuMs = end > begin ? (double)(end - begin) / 1e6 : 0.0;
+
+            if (record.vertexQuery)
+            {
+                scope.hasStatistics = true;
+                scope.vertexInvocations = result(record.vertexQuery);
+                scope.fragmentInvocations = result(record.fragmentQuery);
+            }
+            remember(history[scope.path], (float)scope.cpuMs, (float)scope.gpuMs);
+            resolved.push_back(scope);
+        }
+    }
+
+    void remember(History &h, float cpuMs, float gpuMs)
+    {
+        if (h.cpu.size() < historyLength)
+        {
+            h.cpu.push_back(cpuMs);
+            h.gpu.push_back(gpuMs);
+            return;
+        }
+        h.cpu[h.next] = cpuMs;
+        h.gpu[h.next] = gpuMs;
+        h.next = (h.next + 1) % h.cpu.size();
+    }
+
+    Summary summary(const std::string &path, bool gpu) const
+    {
+        Summary s;
+        auto it = history.find(path);
+        if (it == history.end() || it->second.cpu.empty())
+            return s;
+        std::vector<float> values = gpu ? it->second.gpu : it->second.cpu;
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (float v : values)
+            sum += v;
+        size_t p99 = (size_t)std::ceil(values.size() * 0.99) - 1;
+        s.min = values.front();
+        s.avg = (float)(sum / values.size());
+        s.p99 = values[std::min(p99, values.size() - 1)];
+        return s;
+    }
+
+    // one row per nesting level, bar widths relative to the whole frame
+    void flameGraph(const char* label, bool gpu)
+    {
+        const Scope &frame = resolved[0];
+        double total = std::max(gpu ? frame.gpuMs : frame.cpuMs, 1e-6);
+        int depths = 1;
+        for (const Scope &scope : resolved)
+            depths = std::max(depths, scope.depth + 1);
+
+        ImGui::TextUnformatted(label);
+        float width = std::max(ImGui::GetContentRegionAvail().x, 50.0f);
+        float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+        for (const Scope &scope : resolved)
+        {
+            double start = gpu ? scope.gpuStart : scope.cpuStart;
+            double ms = gpu ? scope.gpuMs : scope.cpuMs;
+            ImVec2 min(origin.x + (float)(start / total) * width, origin.y + scope.depth * rowHeight);
+            ImVec2 max(std::min(min.x + std::max((float)(ms / total) * width, 1.0f), origin.x + width), min.y + rowHeight - 1.0f);
+
+            float hue = (float)(std::hash<std::string>()(scope.path) % 360) / 360.0f;
+            drawList->AddRectFilled(min, max, ImColor::HSV(hue, 0.45f, 0.85f));
+            if (max.x - min.x > ImGui::CalcTextSize(scope.name.c_str()).x + 4.0f)
+                drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32(0, 0, 0, 255), scope.name.c_str());
+            if (ImGui::IsMouseHoveringRect(min, max))
+                ImGui::SetTooltip("%s\n%s %.3f ms", scope.path.c_str(), label, ms);
+        }
+        ImGui::Dummy(ImVec2(width, depths * rowHeight));
+    }
+};
+
+#endif
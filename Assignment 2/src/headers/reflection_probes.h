@@ -0,0 +1,310 @@
+#ifndef REFLECTION_PROBES_H
+#define REFLECTION_PROBES_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "imgui.h"
+
+#include <camera.h>
+#include <ring_buffer.h>
+
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// Dynamic environment cubemaps, so the glass objects reflect and refract each other and not
+// only the skybox. Every probe renders the scene around its position into a small cubemap
+// with a full mip chain (rough surfaces read blurrier levels).
+//
+// Six faces per probe per frame would cost several times the scene itself, so faces are
+// amortized: each frame renders only as many faces as the GPU budget allows. The budget is a
+// token bucket: every frame adds budgetMs of credit and every face costs what faces measured
+// on the GPU lately (GL_TIMESTAMP queries read FRAMES_IN_FLIGHT frames later). A budget below
+// the cost of one face therefore means a face every few frames, never an overrun on average.
+// Which faces go first: the stalest, either strictly in turn or weighted by how close the
+// probe is to the camera. A probe is used once each of its faces was rendered once.
+//
+// Per frame:  setPosition()...  update(drawScene)  texture(probe) for the materials
+class ReflectionProbes
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    enum Schedule { ROUND_ROBIN = 0, NEAREST_FIRST = 1 };
+
+    bool enabled = true;
+    float budgetMs = 1.0f;
+    int schedule = NEAREST_FIRST;
+    float nearPlane = 0.05f, farPlane = 100.0f;
+
+    struct Stats
+    {
+        int faces = 0;              // rendered this frame
+        float faceMs = 0.0f;        // measured GPU cost of one face, mips included
+        float credit = 0.0f;        // budget left over for the next frames
+        double cpuMs = 0.0;
+        long totalFaces = 0;
+    };
+
+    // the callback draws everything a probe should see; the Camera block, framebuffer and
+    // viewport are already set up for the face
+    using DrawScene = std::function<void(int probe, const glm::mat4 &view, const glm::mat4 &projection)>;
+
+    ReflectionProbes(int count, int resolution = 128) : resolution(resolution)
+    {
+        levels = 1;
+        while ((resolution >> levels) > 0)
+            levels++;
+        // filtering across face edges, the blurry levels would show the seams otherwise
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+        probes.resize(count);
+        for (Probe &probe : probes)
+        {
+            glGenTextures(1, &probe.texture);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, probe.texture);
+            for (int level = 0; level < levels; level++)
+                for (int face = 0; face < 6; face++)
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA8, std::max(1, resolution >> level),
+                                 std::max(1, resolution >> level), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        glGenFramebuffers(1, &FBO);
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, resolution, resolution);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenQueries(2 * FRAMES_IN_FLIGHT, &queries[0][0]);
+    }
+
+    ~ReflectionProbes()
+    {
+        for (Probe &probe : probes)
+            glDeleteTextures(1, &probe.texture);
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteRenderbuffers(1, &depthRBO);
+        glDeleteQueries(2 * FRAMES_IN_FLIGHT, &queries[0][0]);
+    }
+
+    ReflectionProbes(const ReflectionProbes&) = delete;
+    ReflectionProbes& operator=(const ReflectionProbes&) = delete;
+
+    int size() const { return (int)probes.size(); }
+    void setPosition(int probe, const glm::vec3 &position) { probes[probe].position = position; }
+
+    // every face rendered at least once
+    bool ready(int probe) const { return enabled && probes[probe].facesRendered == 6; }
+    unsigned int texture(int probe) const { return probes[probe].texture; }
+    // highest mip level, for roughness
+    int maxLevel() const { return levels - 1; }
+
+    // renders this frame's share of faces, restoring framebuffer and viewport afterwards.
+    // Camera blocks come from the ring; the caller binds its own camera block after this.
+    void update(const glm::vec3 &cameraPosition, FrameRingBuffer &ring, const DrawScene &drawScene)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        long totalFaces = stats.totalFaces;
+        float credit = stats.credit;
+        stats = Stats();
+        stats.totalFaces = totalFaces;
+        frame++;
+        readTimings();
+        stats.faceMs = faceMs;
+        if (!enabled || probes.empty())
+        {
+            stats.credit = 0.0f;
+            return;
+        }
+
+        // at most one frame's worth saved up, a burst after a cheap phase stays small; but
+        // always room for one face, or a face dearer than the cap would never render again and
+        // faceMs would never be measured down. Then one face goes every faceMs / budgetMs frames.
+        credit = std::min(credit + budgetMs, std::max(2.0f * budgetMs, faceMs));
+        std::vector<int> due;
+        while (credit >= faceMs && (int)due.size() < 6 * size())
+        {
+            int next = pickFace(cameraPosition, due);
+            if (next < 0)
+                break;
+            due.push_back(next);
+            credit -= faceMs;
+        }
+        stats.credit = credit;
+        if (due.empty())
+            return;
+
+        GLint previousFBO = 0, viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        glViewport(0, 0, resolution, resolution);
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+
+        std::vector<bool> touched(probes.size(), false);
+        for (int index : due)
+        {
+            int p = index / 6, face = index % 6;
+            Probe &probe = probes[p];
+            glm::mat4 view = faceView(probe.position, face);
+
+            FrameRingBuffer::Allocation block = ring.allocateUniforms(sizeof(CameraBlock));
+            if (!block)
+                break;
+            CameraBlock* camera = (CameraBlock*)block.data;
+            camera->view = view;
+            camera->projection = projection;
+            camera->cameraPos = glm::vec4(probe.position, 1.0f);
+            ring.flush();
+            glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ring.buffer(), block.offset, sizeof(CameraBlock));
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, probe.texture, 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            drawScene(p, view, projection);
+
+            if (probe.lastUpdate[face] == 0)
+                probe.facesRendered++;
+            probe.lastUpdate[face] = frame;
+            touched[p] = true;
+            stats.faces++;
+        }
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, 0);
+
+        for (size_t p = 0; p < probes.size(); p++)
+            if (touched[p])
+            {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, probes[p].texture);
+                glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+            }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+        slotFaces[slot] = stats.faces;
+        slot = (slot + 1) % FRAMES_IN_FLIGHT;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFBO);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        stats.totalFaces += stats.faces;
+        stats.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    const Stats& last() const { return stats; }
+
+    void drawUI()
+    {
+        ImGui::Checkbox("Reflection probes", &enabled);
+        if (!enabled)
+            return;
+        ImGui::SliderFloat("Probe GPU budget (ms)", &budgetMs, 0.05f, 8.0f, "%.2f");
+        ImGui::Combo("Probe faces", &schedule, "Round robin\0Nearest probe first\0");
+        ImGui::Text("  %d probes, %dx%d: %d face(s) this frame, %.3f ms GPU per face, %.3f ms CPU",
+                    size(), resolution, resolution, stats.faces, stats.faceMs, stats.cpuMs);
+    }
+
+private:
+    struct Probe
+    {
+        unsigned int texture = 0;
+        glm::vec3 position = glm::vec3(0.0f);
+        long lastUpdate[6] = { 0, 0, 0, 0, 0, 0 };   // frame, 0: never
+        int facesRendered = 0;
+    };
+
+    std::vector<Probe> probes;
+    int resolution;
+    int levels;
+    unsigned int FBO = 0, depthRBO = 0;
+    long frame = 0;
+    size_t cursor = 0;
+
+    GLuint queries[FRAMES_IN_FLIGHT][2] = {};
+    int slotFaces[FRAMES_IN_FLIGHT] = {};
+    int slot = 0;
+    float faceMs = 0.5f;   // guess until the first measurement
+    bool measured = false;
+    Stats stats;
+
+    static glm::mat4 faceView(const glm::vec3 &position, int face)
+    {
+        // the usual cubemap face orientation, +X -X +Y -Y +Z -Z
+        static const glm::vec3 directions[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+        static const glm::vec3 ups[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+        return glm::lookAt(position, position + directions[face], ups[face]);
+    }
+
+    // index probe * 6 + face of the next face to render, -1 when all are taken
+    int pickFace(const glm::vec3 &cameraPosition, const std::vector<int> &taken)
+    {
+        int count = 6 * size();
+        if (schedule == ROUND_ROBIN)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                int index = (int)(cursor++ % count);
+                if (std::find(taken.begin(), taken.end(), index) == taken.end())
+                    return index;
+            }
+            return -1;
+        }
+
+        // stalest first, a probe close to the camera ages faster
+        int best = -1;
+        float bestPriority = -1.0f;
+        for (int index = 0; index < count; index++)
+        {
+            if (std::find(taken.begin(), taken.end(), index) != taken.end())
+                continue;
+            const Probe &probe = probes[index / 6];
+            long last = probe.lastUpdate[index % 6];
+            float age = last == 0 ? 1e9f : (float)(frame - last);
+            float priority = age * (1.0f + 4.0f / (1.0f + glm::length(probe.position - cameraPosition)));
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                best = index;
+            }
+        }
+        return best;
+    }
+
+    void readTimings()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            int oldest = (slot + i) % FRAMES_IN_FLIGHT;
+            if (slotFaces[oldest] == 0)
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[oldest][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[oldest][1], GL_QUERY_RESULT, &end);
+            float ms = (float)((end - begin) / 1e6) / slotFaces[oldest];
+            // follow quickly at first, then smooth out the noise
+            faceMs = measured ? glm::mix(faceMs, ms, 0.1f) : ms;
+            faceMs = std::max(faceMs, 0.001f);
+            measured = true;
+            slotFaces[oldest] = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,536 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <mesh.h>
+#include <vertex_binding.h>
+#include <gl_extensions.h>
+#include <ring_buffer.h>
+#include <thread_pool.h>
+
+#include <vector>
+#include <map>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// Render passes in submission order. The pass sits in the top bits of every sort key.
+enum RenderPass
+{
+    PASS_DEPTH      = 0,   // depth only, color writes masked; grouped by state, then front to back
+    PASS_PREPASSED  = 1,   // shading of what PASS_DEPTH laid down: GL_EQUAL, no depth writes
+    PASS_OPAQUE     = 2,   // front to back, grouped by state first
+    PASS_REFRACTIVE = 3    // back to front, depth first
+};
+
+// One draw as recorded by the scene code: what to draw, with which program and material,
+// and the per-object data. The queue decides the order and merges equal neighbours.
+struct DrawPacket
+{
+    RenderPass pass;
+    Shader* program;
+    Mesh* mesh;
+    unsigned int material;   // caller defined id, handed back through onMaterial
+    InstanceData instance;
+    unsigned int condition;  // occlusion query for conditional rendering, 0 for none
+};
+
+// Every draw of a frame goes through here: push() records a packet and its 64-bit sort key,
+// sort() orders them with an LSD radix sort and submit() walks the result, touching GL state
+// only when it differs from the previous draw.
+//
+// Recording makes no GL calls and touches no shared state, so worker threads can each fill
+// their own DrawList (see list()); sort() merges them and only submit() needs the context.
+//
+// Key layout (most significant first):
+//   refractive  pass:2 | ~depth:24  | program:10 | material:10 | mesh:18
+//   all others  pass:2 | program:10 | material:10 | mesh:18 | depth:24
+// Packets of PASS_DEPTH have no material, onMaterial isn't called for them. submit() sets the
+// depth and color masks each pass needs and puts them back afterwards.
+// Consecutive packets with the same program, material and mesh become a single instanced
+// draw when the program reads per-instance inputs (see InstanceData). With multi-draw
+// indirect those runs turn into DrawElementsIndirectCommands, and every stretch of them that
+// shares program, material and VAO (all meshes share one, see geometry_pool.h) goes out as
+// one call.
+//
+// With a FrameRingBuffer attached, the sorted instance data and the indirect commands are
+// written straight into it (the instance gather in parallel on the thread pool) instead of
+// going through buffers of the queue's own.
+class RenderQueue
+{
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+public:
+    // draw lists a frame can be recorded into; the merged packet reference has 8 bits for the list
+    static constexpr int MAX_LISTS = 256;
+
+    struct Stats
+    {
+        int packets = 0;
+        int depthPackets = 0;    // of packets, in PASS_DEPTH
+        int draws = 0;
+        int programChanges = 0;
+        int materialChanges = 0;
+        int vertexArrayChanges = 0;
+        int multiDraws = 0;      // glMultiDrawElementsIndirect calls
+        int indirectCommands = 0;
+        int sortPasses = 0;      // radix passes that actually moved data
+        bool ringInstances = false;   // this frame's instance data lives in the ring buffer
+        double sortMs = 0.0;
+        double submitMs = 0.0;
+    };
+
+    // per frame uniforms (camera, ...), called after a program is bound
+    std::function<void(Shader&)> onProgram;
+    // material uniforms, called when the material changes for the bound program. For
+    // non-instanced programs the queue sets model and normalMatrix itself.
+    std::function<void(Shader&, const DrawPacket&)> onMaterial;
+
+    // issue runs of instanced programs through glMultiDrawElementsIndirect when the context
+    // has it, otherwise (and when off) every run is its own instanced draw. Mesa's llvmpipe
+    // has it; MESA_GL_VERSION_OVERRIDE=3.3 MESA_EXTENSION_OVERRIDE=-GL_ARB_multi_draw_indirect
+    // takes it away there to try the fallback
+    bool multiDrawIndirect = true;
+
+    // off for draws blended over the finished scene (order-independent transparency):
+    // depth is still tested, but no pass writes it
+    bool depthWrites = true;
+
+    // per frame storage for instance data and indirect commands; when unset or full the
+    // queue orphans and refills its own buffers
+    FrameRingBuffer* ring = nullptr;
+
+    // packets recorded by one thread
+    class DrawList
+    {
+    public:
+        void push(RenderPass pass, Shader &program, Mesh &mesh, unsigned int material, const InstanceData &instance,
+                  unsigned int condition = 0)
+        {
+            // view space z is negative in front of the camera
+            glm::vec3 position(instance.model[3]);
+            float viewDepth = -(viewRow.x * position.x + viewRow.y * position.y + viewRow.z * position.z + viewRow.w);
+            uint64_t depth = (uint64_t)(std::min(std::max(viewDepth * depthScale, 0.0f), 1.0f) * DEPTH_MAX);
+
+            // GL program names and mesh ids are small and stable, so they go into the key as they are
+            uint64_t state = ((uint64_t)(program.ID & 0x3FF) << 28)
+                           | ((uint64_t)(material & 0x3FF) << 18)
+                           | (uint64_t)(mesh.id & 0x3FFFF);
+            uint64_t key = (uint64_t)pass << 62;
+            if (pass == PASS_REFRACTIVE)
+                key |= ((DEPTH_MAX - depth) << 38) | state;
+            else
+                key |= (state << 24) | depth;
+
+            keys.push_back({ key, (uint32_t)packets.size() });
+            packets.push_back({ pass, &program, &mesh, material, instance, condition });
+        }
+
+        size_t size() const { return packets.size(); }
+
+    private:
+        friend class RenderQueue;
+        std::vector<DrawPacket> packets;
+        std::vector<SortEntry> keys;
+        glm::vec4 viewRow;
+        float depthScale;
+    };
+
+    RenderQueue()
+    {
+        glGenBuffers(1, &instanceVBO);
+        glGenBuffers(1, &indirectBuffer);
+    }
+    ~RenderQueue()
+    {
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteBuffers(1, &indirectBuffer);
+    }
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // view matrix and far plane used to quantize depth for this frame's keys, and how many
+    // draw lists will be recorded into (one per worker thread). At most MAX_LISTS: callers
+    // that hand out worker indices from a larger pool have to limit it to that many threads
+    void begin(const glm::mat4 &view, float farPlane, int listCount = 1)
+    {
+        lists.resize(std::max(1, std::min(listCount, MAX_LISTS)));
+        for (DrawList &list : lists)
+        {
+            list.viewRow = glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+            list.depthScale = 1.0f / farPlane;
+            list.packets.clear();
+            list.keys.clear();
+        }
+        keys.clear();
+    }
+
+    DrawList& list(int index) { return lists[index]; }
+
+    // record on the calling thread
+    void push(RenderPass pass, Shader &program, Mesh &mesh, unsigned int material, const InstanceData &instance,
+              unsigned int condition = 0)
+    {
+        lists[0].push(pass, program, mesh, material, instance, condition);
+    }
+
+    // merges the draw lists, then radix sorts the keys, 8 bits per pass. Passes where every
+    // key has the same byte are skipped, which with few programs/materials is most of the high ones.
+    // Finally the per-instance data is gathered in sorted order, so every run is a contiguous range.
+    void sort(ThreadPool* pool = nullptr, int maxThreads = 0)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        keys.clear();
+        for (size_t l = 0; l < lists.size(); l++)
+            for (const SortEntry &entry : lists[l].keys)
+                keys.push_back({ entry.key, (uint32_t)(l << LIST_SHIFT) | entry.packet });
+        size_t count = keys.size();
+        scratch.resize(count);
+        stats.sortPasses = 0;
+
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t histogram[256] = { 0 };
+            for (const SortEntry &entry : keys)
+                histogram[(entry.key >> shift) & 0xFF]++;
+            if (count == 0 || histogram[(keys[0].key >> shift) & 0xFF] == count)
+                continue;
+
+            size_t offset = 0;
+            for (size_t &bucket : histogram)
+            {
+                size_t n = bucket;
+                bucket = offset;
+                offset += n;
+            }
+            for (const SortEntry &entry : keys)
+                scratch[histogram[(entry.key >> shift) & 0xFF]++] = entry;
+            keys.swap(scratch);
+            stats.sortPasses++;
+        }
+
+        FrameRingBuffer::Allocation allocation;
+        if (ring && count > 0)
+            allocation = ring->allocate(count * sizeof(InstanceData));
+        InstanceData* target;
+        if (allocation)
+        {
+            target = (InstanceData*)allocation.data;
+            instanceBuffer = ring->buffer();
+            instanceBase = allocation.offset;
+        }
+        else
+        {
+            sortedInstances.resize(count);
+            target = sortedInstances.data();
+            instanceBuffer = instanceVBO;
+            instanceBase = 0;
+        }
+        stats.ringInstances = (bool)allocation;
+        auto gather = [&](size_t begin, size_t end, int)
+        {
+            for (size_t i = begin; i < end; i++)
+                target[i] = packet(keys[i]).instance;
+        };
+        if (pool)
+            pool->parallelFor(count, 4096, gather, maxThreads);
+        else
+            gather(0, count, 0);
+
+        stats.sortMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // draws everything in key order. Leaves the last program bound and VAO 0.
+    void submit()
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        stats.packets = (int)keys.size();
+        stats.depthPackets = 0;
+        stats.draws = stats.programChanges = stats.materialChanges = stats.vertexArrayChanges = 0;
+        stats.multiDraws = stats.indirectCommands = 0;
+        bool indirect = multiDrawIndirect && glExt.multiDrawIndirect;
+
+        if (!stats.ringInstances && !sortedInstances.empty())
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            size_t bytes = sortedInstances.size() * sizeof(InstanceData);
+            // orphan the old storage so we don't wait on last frame's draws
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, sortedInstances.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        planRuns(indirect);
+        // the ring's content has to reach the GPU before the first draw reads it
+        if (ring)
+            ring->flush();
+
+        boundProgram = nullptr;
+        boundMaterial = ~0u;
+        boundVAO = 0;
+        texturedMesh = nullptr;
+        GLint depthFunc = GL_LESS;
+        glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+        int boundPass = -1;
+
+        size_t r = 0;
+        while (r < runs.size())
+        {
+            const Run &run = runs[r];
+            const DrawPacket &first = packet(keys[run.begin]);
+            if (first.pass != boundPass)
+            {
+                boundPass = first.pass;
+                setPassState(first.pass, depthFunc);
+            }
+            if (first.pass == PASS_DEPTH)
+                stats.depthPackets += (int)(run.end - run.begin);
+            unsigned int vao = bindState(first);
+            const GeometryRange &range = first.mesh->range;
+
+            if (run.command >= 0)
+            {
+                // one multi-draw for every following run that needs no state change in between
+                size_t last = r + 1;
+                while (last < runs.size() && runs[last].command >= 0 && sameBucket(first, packet(keys[runs[last].begin])))
+                    last++;
+                if (first.pass == PASS_DEPTH)
+                    for (size_t k = r + 1; k < last; k++)
+                        stats.depthPackets += (int)(runs[k].end - runs[k].begin);
+
+                // per-draw data comes through the instanced attributes at baseInstance
+                setInstanceOffset(vao, instanceBase);
+                glExt.MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                                (const void*)(indirectBase + run.command * sizeof(DrawElementsIndirectCommand)),
+                                                (GLsizei)(last - r), 0);
+                for (size_t k = r; k < last; k++)
+                    vertexBindings.countDraw(vao, packet(keys[runs[k].begin]).mesh->range.vertexCount, runs[k].end - runs[k].begin);
+                stats.multiDraws++;
+                stats.indirectCommands += (int)(last - r);
+                stats.draws++;
+                r = last;
+                continue;
+            }
+
+            // the GPU waits for an earlier query here, never the CPU
+            if (first.condition)
+                glBeginConditionalRender(first.condition, GL_QUERY_WAIT);
+            if (run.instanced)
+            {
+                setInstanceOffset(vao, instanceBase + run.begin * sizeof(InstanceData));
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, first.mesh->indexOffset(),
+                                                  (GLsizei)(run.end - run.begin), range.baseVertex);
+                vertexBindings.countDraw(vao, range.vertexCount, run.end - run.begin);
+            }
+            else
+            {
+                boundProgram->setMat4("model", first.instance.model);
+                boundProgram->setMat3("normalMatrix", first.instance.normalMatrix);
+                glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, first.mesh->indexOffset(), range.baseVertex);
+                vertexBindings.countDraw(vao, range.vertexCount);
+            }
+            if (first.condition)
+                glEndConditionalRender();
+            stats.draws++;
+            r++;
+        }
+
+        glBindVertexArray(0);
+        if (!commands.empty())
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+        if (boundPass == PASS_DEPTH || boundPass == PASS_PREPASSED || !depthWrites)
+        {
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_TRUE);
+            glDepthFunc((GLenum)depthFunc);
+        }
+        stats.submitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    const Stats& last() const { return stats; }
+    size_t size() const
+    {
+        size_t count = 0;
+        for (const DrawList &list : lists)
+            count += list.size();
+        return count;
+    }
+
+private:
+    static constexpr uint64_t DEPTH_MAX = (1ull << 24) - 1;
+    // the merged packet reference is list << LIST_SHIFT | index within that list
+    static constexpr int LIST_SHIFT = 24;
+
+    // packets [begin, end) of the sorted keys drawn by one call; command >= 0 for indirect runs
+    struct Run
+    {
+        size_t begin, end;
+        bool instanced;
+        long command;
+    };
+
+    std::vector<DrawList> lists = std::vector<DrawList>(1);
+    std::vector<SortEntry> keys, scratch;
+    std::vector<InstanceData> sortedInstances;
+    std::vector<Run> runs;
+    std::vector<DrawElementsIndirectCommand> commands;
+    unsigned int indirectBuffer = 0;
+    // where this frame's instance data and commands are: the ring or the queue's own buffers
+    unsigned int instanceBuffer = 0;
+    size_t instanceBase = 0, indirectBase = 0;
+
+    // GL state as left by the previous run during submit()
+    Shader* boundProgram = nullptr;
+    bool boundInstanced = false;
+    unsigned int boundMaterial = ~0u;
+    unsigned int boundVAO = 0;
+    Mesh* texturedMesh = nullptr;
+    // where each VAO's instanced attributes currently point into their instance buffer
+    std::map<unsigned int, size_t> instanceOffsets;
+    unsigned int instanceVBO = 0;
+    glm::vec4 viewRow = glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+    float depthScale = 0.01f;
+    Stats stats;
+
+    const DrawPacket& packet(const SortEntry &entry) const
+    {
+        return lists[entry.packet >> LIST_SHIFT].packets[entry.packet & ((1u << LIST_SHIFT) - 1)];
+    }
+
+    static bool isInstanced(const Shader &program)
+    {
+        return program.findAttribute("iModel") != nullptr;
+    }
+
+    // splits the sorted packets into draws and, when indirect, writes one command per
+    // instanced run into the ring or the queue's indirect buffer
+    void planRuns(bool indirect)
+    {
+        runs.clear();
+        commands.clear();
+        size_t i = 0;
+        while (i < keys.size())
+        {
+            const DrawPacket &first = packet(keys[i]);
+            Run run = { i, i + 1, isInstanced(*first.program), -1 };
+            if (run.instanced)
+                while (run.end < keys.size() && sameBatch(first, packet(keys[run.end])))
+                    run.end++;
+            if (indirect && run.instanced && !first.condition)
+            {
+                const GeometryRange &range = first.mesh->range;
+                run.command = (long)commands.size();
+                commands.push_back({ (GLuint)range.indexCount, (GLuint)(run.end - run.begin), range.firstIndex,
+                                     range.baseVertex, (GLuint)run.begin });
+            }
+            runs.push_back(run);
+            i = run.end;
+        }
+
+        // stays bound for the multi-draws, the binding isn't VAO state
+        if (!commands.empty())
+        {
+            size_t bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+            FrameRingBuffer::Allocation allocation;
+            if (ring)
+                allocation = ring->allocate(bytes, 4);
+            if (allocation)
+            {
+                std::memcpy(allocation.data, commands.data(), bytes);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer());
+                indirectBase = allocation.offset;
+            }
+            else
+            {
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+                glBufferData(GL_DRAW_INDIRECT_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+                glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, commands.data());
+                indirectBase = 0;
+            }
+        }
+    }
+
+    // program, material, VAO and textures for a packet, each only when it changed
+    unsigned int bindState(const DrawPacket &packet)
+    {
+        if (packet.program != boundProgram)
+        {
+            boundProgram = packet.program;
+            boundProgram->use();
+            boundInstanced = isInstanced(*boundProgram);
+            boundMaterial = ~0u;
+            texturedMesh = nullptr;
+            if (onProgram)
+                onProgram(*boundProgram);
+            stats.programChanges++;
+        }
+        if (packet.material != boundMaterial && packet.pass != PASS_DEPTH)
+        {
+            boundMaterial = packet.material;
+            if (onMaterial)
+                onMaterial(*boundProgram, packet);
+            stats.materialChanges++;
+        }
+
+        unsigned int vao = packet.mesh->vertexArrayFor(*boundProgram, boundInstanced ? instanceBuffer : 0);
+        if (vao != boundVAO)
+        {
+            glBindVertexArray(vao);
+            boundVAO = vao;
+            stats.vertexArrayChanges++;
+        }
+        if (packet.mesh != texturedMesh && !packet.mesh->textures.empty())
+        {
+            packet.mesh->bindTextures(*boundProgram);
+            texturedMesh = packet.mesh;
+        }
+        return vao;
+    }
+
+    // masks and depth test of a pass; `depthFunc` is the caller's, used by the shaded passes
+    void setPassState(RenderPass pass, GLint depthFunc) const
+    {
+        GLboolean color = pass == PASS_DEPTH ? GL_FALSE : GL_TRUE;
+        glColorMask(color, color, color, color);
+        glDepthMask(pass == PASS_PREPASSED || !depthWrites ? GL_FALSE : GL_TRUE);
+        glDepthFunc(pass == PASS_PREPASSED ? GL_EQUAL : (GLenum)depthFunc);
+    }
+
+    // where the VAO's instanced attributes start in instanceVBO, only touched when it moves
+    void setInstanceOffset(unsigned int vao, size_t offset)
+    {
+        auto based = instanceOffsets.find(vao);
+        if (based == instanceOffsets.end() || based->second != offset)
+        {
+            vertexBindings.rebaseInstances(vao, offset);
+            instanceOffsets[vao] = offset;
+        }
+    }
+
+    // runs that can share one multi-draw: instanced programs read the material from their
+    // instance data, so only program and textures have to match
+    static bool sameBucket(const DrawPacket &a, const DrawPacket &b)
+    {
+        // materials may bind textures (reflection probes)
+        return a.pass == b.pass && a.program == b.program && a.material == b.material && (a.mesh == b.mesh || (a.mesh->textures.empty() && b.mesh->textures.empty()));
+    }
+
+    // conditionally rendered packets are drawn on their own
+    static bool sameBatch(const DrawPacket &a, const DrawPacket &b)
+    {
+        return a.pass == b.pass && a.program == b.program && a.material == b.material && a.mesh == b.mesh && !a.condition && !b.condition;
+    }
+};
+
+#endif
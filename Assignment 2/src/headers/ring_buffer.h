@@ -0,0 +1,217 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <gl_extensions.h>
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+// One GL buffer for everything that is written once per frame and read by that frame's draws:
+// uniform blocks, per-instance data, indirect commands. It is split into one segment per frame
+// in flight; a fence after each frame's last draw tells when its segment may be written again.
+//
+// With GL 4.4 / ARB_buffer_storage the buffer is mapped once, persistently and coherently, and
+// allocate() hands out pointers straight into GPU visible memory. allocate() is a lock free bump
+// of an atomic offset, so worker threads can fill their share of a frame in parallel.
+// Without buffer storage (GL 3.3) allocations land in a CPU copy of one segment which flush()
+// uploads into freshly orphaned storage; the driver does the frame pacing then.
+//
+// Per frame:  beginFrame()  allocate()...  flush()  draws  endFrame()
+class FrameRingBuffer
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 3;
+
+    struct Allocation
+    {
+        void* data = nullptr;   // where to write, nullptr when the frame's segment is full
+        size_t offset = 0;      // byte offset into buffer() for the draws
+        size_t size = 0;
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    struct Stats
+    {
+        bool persistent = false;
+        size_t segmentSize = 0;
+        size_t used = 0;        // bytes handed out this frame
+        int allocations = 0;
+        int failed = 0;         // did not fit; callers fall back to their own buffers
+        int stalls = 0;         // frames whose segment was still read by the GPU
+        double stallMs = 0.0;
+        long totalStalls = 0;
+    };
+
+    explicit FrameRingBuffer(size_t bytesPerFrame = 32u << 20)
+    {
+        GLint uniformAlignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        alignment = std::max<size_t>(16, (size_t)uniformAlignment);
+        segmentSize = (bytesPerFrame + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        if (glExt.bufferStorage)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glExt.BufferStorage(GL_COPY_WRITE_BUFFER, segmentSize * FRAMES_IN_FLIGHT, nullptr, flags);
+            mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, segmentSize * FRAMES_IN_FLIGHT, flags);
+            if (!mapped)
+            {
+                // immutable storage can't be respecified, start over with a plain buffer
+                std::cout << "WARNING::RING_BUFFER::PERSISTENT_MAP_FAILED falling back to orphaning" << std::endl;
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                glDeleteBuffers(1, &ID);
+                glGenBuffers(1, &ID);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            }
+        }
+        if (!mapped)
+        {
+            shadow.resize(segmentSize);
+            glBufferData(GL_COPY_WRITE_BUFFER, segmentSize, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        stats.persistent = previous.persistent = mapped != nullptr;
+        stats.segmentSize = previous.segmentSize = segmentSize;
+    }
+
+    ~FrameRingBuffer()
+    {
+        for (GLsync &fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+        if (mapped)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &ID);
+    }
+
+    FrameRingBuffer(const FrameRingBuffer&) = delete;
+    FrameRingBuffer& operator=(const FrameRingBuffer&) = delete;
+
+    // moves on to the next segment, waiting for the GPU if it still reads it
+    void beginFrame()
+    {
+        long totalStalls = stats.totalStalls;
+        stats = Stats();
+        stats.persistent = mapped != nullptr;
+        stats.segmentSize = segmentSize;
+        stats.totalStalls = totalStalls;
+
+        if (mapped)
+        {
+            segment = (segment + 1) % FRAMES_IN_FLIGHT;
+            GLsync &fence = fences[segment];
+            if (fence)
+            {
+                GLenum status = glClientWaitSync(fence, 0, 0);
+                if (status == GL_TIMEOUT_EXPIRED)
+                {
+                    auto start = std::chrono::high_resolution_clock::now();
+                    do
+                        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                    while (status == GL_TIMEOUT_EXPIRED);
+                    stats.stalls++;
+                    stats.totalStalls++;
+                    stats.stallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                }
+                if (status == GL_WAIT_FAILED)
+                    std::cout << "ERROR::RING_BUFFER::FENCE_WAIT_FAILED" << std::endl;
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        head.store(0, std::memory_order_relaxed);
+        flushed = 0;
+        allocations.store(0, std::memory_order_relaxed);
+        failed.store(0, std::memory_order_relaxed);
+    }
+
+    // thread safe. `align` must be a power of two no larger than the uniform buffer offset alignment.
+    Allocation allocate(size_t bytes, size_t align = 16)
+    {
+        size_t offset = head.load(std::memory_order_relaxed);
+        size_t start;
+        do
+        {
+            start = (offset + align - 1) & ~(align - 1);
+            if (start + bytes > segmentSize)
+            {
+                failed.fetch_add(1, std::memory_order_relaxed);
+                return Allocation();
+            }
+        } while (!head.compare_exchange_weak(offset, start + bytes, std::memory_order_relaxed));
+        allocations.fetch_add(1, std::memory_order_relaxed);
+
+        size_t base = mapped ? segment * segmentSize : 0;
+        Allocation allocation;
+        allocation.data = (mapped ? mapped : shadow.data()) + base + start;
+        allocation.offset = base + start;
+        allocation.size = bytes;
+        return allocation;
+    }
+
+    // room for a uniform block, suitably aligned for glBindBufferRange
+    Allocation allocateUniforms(size_t bytes) { return allocate(bytes, alignment); }
+
+    // makes everything allocated so far visible to the GPU. Free with persistent mapping,
+    // otherwise uploads what was written since the last flush. Call from the context thread
+    // once the writers are done, before the draws that read it.
+    void flush()
+    {
+        size_t used = head.load(std::memory_order_acquire);
+        if (mapped || used == flushed)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        // orphan on the first upload of a frame so we never wait on last frame's draws
+        if (flushed == 0)
+            glBufferData(GL_COPY_WRITE_BUFFER, segmentSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, flushed, used - flushed, shadow.data() + flushed);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        flushed = used;
+    }
+
+    // after the frame's last draw that reads from the buffer
+    void endFrame()
+    {
+        flush();
+        if (mapped)
+            fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stats.used = head.load(std::memory_order_relaxed);
+        stats.allocations = allocations.load(std::memory_order_relaxed);
+        stats.failed = failed.load(std::memory_order_relaxed);
+        previous = stats;
+    }
+
+    unsigned int buffer() const { return ID; }
+
+    // the numbers of the previous complete frame, for display
+    const Stats& last() const { return previous; }
+
+private:
+    unsigned int ID = 0;
+    char* mapped = nullptr;
+    std::vector<char> shadow;
+    size_t segmentSize = 0;
+    size_t alignment = 256;
+    int segment = 0;
+    GLsync fences[FRAMES_IN_FLIGHT] = {};
+
+    std::atomic<size_t> head{ 0 };
+    std::atomic<int> allocations{ 0 };
+    std::atomic<int> failed{ 0 };
+    size_t flushed = 0;
+    Stats stats, previous;
+};
+
+#endif
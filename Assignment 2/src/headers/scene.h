@@ -0,0 +1,305 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <simd.h>
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Scene transforms stored as structure-of-arrays. Entities are plain indices; a parent must
+// be created before its children, so a single front-to-back walk resolves the hierarchy.
+//
+// update() samples the animation time once, then recomputes world and normal matrices only
+// for entities whose transform (or a parent's) changed, four entities per SIMD step.
+class Scene
+{
+public:
+    // local transform
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> rotX, rotY, rotZ, rotW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+    std::vector<int> parent;
+    // spin animation: rotation of spinSpeed * time radians around the (unit) spin axis
+    std::vector<float> spinX, spinY, spinZ, spinSpeed;
+    // 1 when the local transform changed since the last update
+    std::vector<uint8_t> dirty;
+    // object space bounding sphere, a negative radius marks entities with nothing to draw
+    std::vector<float> boundX, boundY, boundZ, boundRadius;
+    // what the entity draws as (an index into the application's table), -1 for none
+    std::vector<int> renderable;
+
+    // results of update()
+    std::vector<glm::mat4> world;
+    std::vector<glm::mat3> normal;
+    // 1 when world/normal of the entity were rewritten by the last update
+    std::vector<uint8_t> changed;
+    // world space bounding spheres, SoA for the culling passes
+    std::vector<float> worldBoundX, worldBoundY, worldBoundZ, worldBoundRadius;
+    // world matrices as of the update before, for motion vectors; only kept while
+    // trackPrevious is set
+    bool trackPrevious = false;
+    std::vector<glm::mat4> previousWorld;
+
+    // cost of the last update()
+    double updateMs = 0.0;
+    int updatedCount = 0;
+
+    int create(glm::vec3 position, glm::vec3 scale = glm::vec3(1.0f), int parentIndex = -1,
+               glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f))
+    {
+        int e = (int)parent.size();
+        posX.push_back(position.x); posY.push_back(position.y); posZ.push_back(position.z);
+        rotX.push_back(rotation.x); rotY.push_back(rotation.y); rotZ.push_back(rotation.z); rotW.push_back(rotation.w);
+        scaleX.push_back(scale.x); scaleY.push_back(scale.y); scaleZ.push_back(scale.z);
+        parent.push_back(parentIndex);
+        spinX.push_back(0.0f); spinY.push_back(1.0f); spinZ.push_back(0.0f); spinSpeed.push_back(0.0f);
+        lastAngle.push_back(0.0f);
+        dirty.push_back(1);
+        boundX.push_back(0.0f); boundY.push_back(0.0f); boundZ.push_back(0.0f); boundRadius.push_back(NO_BOUNDS);
+        renderable.push_back(-1);
+        worldBoundX.push_back(0.0f); worldBoundY.push_back(0.0f); worldBoundZ.push_back(0.0f); worldBoundRadius.push_back(NO_BOUNDS);
+        world.push_back(glm::mat4(1.0f));
+        normal.push_back(glm::mat3(1.0f));
+        localMatrix.push_back(glm::mat4(1.0f));
+        localNormal.push_back(glm::mat3(1.0f));
+        changed.push_back(1);
+        worldDirty.push_back(1);
+        return e;
+    }
+
+    // drop every entity from index `count` on
+    void truncate(int count)
+    {
+        if (count >= size())
+            return;
+        for (std::vector<float>* v : { &posX, &posY, &posZ, &rotX, &rotY, &rotZ, &rotW, &scaleX, &scaleY, &scaleZ,
+                                       &spinX, &spinY, &spinZ, &spinSpeed, &lastAngle,
+                                       &boundX, &boundY, &boundZ, &boundRadius,
+                                       &worldBoundX, &worldBoundY, &worldBoundZ, &worldBoundRadius })
+            v->resize(count);
+        parent.resize(count);
+        renderable.resize(count);
+        dirty.resize(count);
+        world.resize(count);
+        normal.resize(count);
+        localMatrix.resize(count);
+        localNormal.resize(count);
+        changed.resize(count);
+        worldDirty.resize(count);
+        if (previousWorld.size() > (size_t)count)
+            previousWorld.resize(count);
+    }
+
+    int size() const { return (int)parent.size(); }
+
+    void setPosition(int e, glm::vec3 p) { posX[e] = p.x; posY[e] = p.y; posZ[e] = p.z; dirty[e] = 1; }
+    void setScale(int e, glm::vec3 s)    { scaleX[e] = s.x; scaleY[e] = s.y; scaleZ[e] = s.z; dirty[e] = 1; }
+    void setSpin(int e, glm::vec3 axis, float speed)
+    {
+        axis = glm::normalize(axis);
+        spinX[e] = axis.x; spinY[e] = axis.y; spinZ[e] = axis.z;
+        spinSpeed[e] = speed;
+        dirty[e] = 1;
+    }
+
+    // an entity drawn as `what`, with the given object space bounding sphere
+    void setRenderable(int e, int what, glm::vec3 center, float radius)
+    {
+        renderable[e] = what;
+        boundX[e] = center.x; boundY[e] = center.y; boundZ[e] = center.z;
+        boundRadius[e] = radius;
+        dirty[e] = 1;
+    }
+
+    glm::vec3 worldPosition(int e) const { return glm::vec3(world[e][3]); }
+
+    // advance animations to `time` (seconds) and refresh the matrices of everything that moved
+    void update(float time)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        int count = size();
+        updatedCount = 0;
+
+        // only what the last update rewrote differs from its previous matrix
+        if (!trackPrevious)
+            previousWorld.clear();
+        else if (previousWorld.size() != world.size())
+            previousWorld = world;
+        else
+            for (int e = 0; e < count; e++)
+                if (changed[e])
+                    previousWorld[e] = world[e];
+
+        animate(time, count);
+        computeLocal(count);
+
+        // hierarchy: parents come first, so one pass in index order is enough
+        for (int e = 0; e < count; e++)
+        {
+            int p = parent[e];
+            uint8_t needsUpdate = dirty[e] | (p >= 0 ? worldDirty[p] : 0);
+            worldDirty[e] = needsUpdate;
+            changed[e] = needsUpdate;
+            if (!needsUpdate)
+                continue;
+            // roots were written straight to world/normal by computeLocal
+            if (p >= 0)
+            {
+                world[e] = world[p] * localMatrix[e];
+                normal[e] = normal[p] * localNormal[e];
+            }
+            updateWorldBounds(e);
+            dirty[e] = 0;
+            updatedCount++;
+        }
+
+        updateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    static constexpr float NO_BOUNDS = -1e30f;
+
+private:
+    std::vector<float> lastAngle;
+    std::vector<glm::mat4> localMatrix;
+    std::vector<glm::mat3> localNormal;
+    std::vector<uint8_t> worldDirty;
+
+    // sphere center through the world matrix, radius by the largest axis scale
+    void updateWorldBounds(int e)
+    {
+        if (boundRadius[e] < 0.0f)
+            return;
+        const glm::mat4 &m = world[e];
+        glm::vec4 center = m * glm::vec4(boundX[e], boundY[e], boundZ[e], 1.0f);
+        float scaleSquared = glm::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                             glm::max(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])), glm::dot(glm::vec3(m[2]), glm::vec3(m[2]))));
+        worldBoundX[e] = center.x;
+        worldBoundY[e] = center.y;
+        worldBoundZ[e] = center.z;
+        worldBoundRadius[e] = boundRadius[e] * std::sqrt(scaleSquared);
+    }
+
+    // spinning entities get a fresh rotation quaternion from the shared frame time
+    void animate(float time, int count)
+    {
+        f4 t = f4Set(time), half = f4Set(0.5f), zero = f4Set(0.0f);
+        int e = 0;
+        for (; e + 4 <= count; e += 4)
+        {
+            f4 speed = f4Load(&spinSpeed[e]);
+            f4 absSpeed = f4Max(speed, f4Sub(zero, speed));
+            if (!f4MaskGreater(absSpeed, zero))
+                continue;
+            f4 angle = f4Mul(speed, t);
+            f4 s = f4Sin(f4Mul(angle, half));
+            f4 c = f4Cos(f4Mul(angle, half));
+            float angles[4], sn[4], cs[4];
+            f4Store(angles, angle);
+            f4Store(sn, s);
+            f4Store(cs, c);
+            for (int lane = 0; lane < 4; lane++)
+                spinTo(e + lane, angles[lane], sn[lane], cs[lane]);
+        }
+        for (; e < count; e++)
+        {
+            if (spinSpeed[e] == 0.0f)
+                continue;
+            float angle = spinSpeed[e] * time;
+            spinTo(e, angle, std::sin(angle * 0.5f), std::cos(angle * 0.5f));
+        }
+    }
+
+    void spinTo(int e, float angle, float s, float c)
+    {
+        if (spinSpeed[e] == 0.0f || angle == lastAngle[e])
+            return;
+        lastAngle[e] = angle;
+        rotX[e] = spinX[e] * s;
+        rotY[e] = spinY[e] * s;
+        rotZ[e] = spinZ[e] * s;
+        rotW[e] = c;
+        dirty[e] = 1;
+    }
+
+    // local TRS matrix and its inverse-transpose (R * S^-1) for every block of four
+    // entities that contains a dirty one. Roots write their result straight into world/normal.
+    void computeLocal(int count)
+    {
+        const f4 one = f4Set(1.0f), two = f4Set(2.0f);
+        int e = 0;
+        for (; e + 4 <= count; e += 4)
+        {
+            if (!(dirty[e] | dirty[e + 1] | dirty[e + 2] | dirty[e + 3]))
+                continue;
+
+            f4 x = f4Load(&rotX[e]), y = f4Load(&rotY[e]), z = f4Load(&rotZ[e]), w = f4Load(&rotW[e]);
+            f4 sx = f4Load(&scaleX[e]), sy = f4Load(&scaleY[e]), sz = f4Load(&scaleZ[e]);
+
+            f4 xx = f4Mul(x, x), yy = f4Mul(y, y), zz = f4Mul(z, z);
+            f4 xy = f4Mul(x, y), xz = f4Mul(x, z), yz = f4Mul(y, z);
+            f4 wx = f4Mul(w, x), wy = f4Mul(w, y), wz = f4Mul(w, z);
+
+            // rotation matrix, column major (r[column][row])
+            f4 r[3][3];
+            r[0][0] = f4Sub(one, f4Mul(two, f4Add(yy, zz)));
+            r[0][1] = f4Mul(two, f4Add(xy, wz));
+            r[0][2] = f4Mul(two, f4Sub(xz, wy));
+            r[1][0] = f4Mul(two, f4Sub(xy, wz));
+            r[1][1] = f4Sub(one, f4Mul(two, f4Add(xx, zz)));
+            r[1][2] = f4Mul(two, f4Add(yz, wx));
+            r[2][0] = f4Mul(two, f4Add(xz, wy));
+            r[2][1] = f4Mul(two, f4Sub(yz, wx));
+            r[2][2] = f4Sub(one, f4Mul(two, f4Add(xx, yy)));
+
+            f4 scale[3] = { sx, sy, sz };
+            float m[3][3][4], n[3][3][4];
+            for (int c = 0; c < 3; c++)
+            {
+                f4 inverse = f4Div(one, scale[c]);
+                for (int row = 0; row < 3; row++)
+                {
+                    f4Store(m[c][row], f4Mul(r[c][row], scale[c]));
+                    f4Store(n[c][row], f4Mul(r[c][row], inverse));
+                }
+            }
+
+            for (int lane = 0; lane < 4; lane++)
+            {
+                int i = e + lane;
+                if (!dirty[i])
+                    continue;
+                // entities without a parent need no second step, their local transform is the world one
+                glm::mat4 &local = parent[i] >= 0 ? localMatrix[i] : world[i];
+                glm::mat3 &localN = parent[i] >= 0 ? localNormal[i] : normal[i];
+                for (int c = 0; c < 3; c++)
+                {
+                    local[c] = glm::vec4(m[c][0][lane], m[c][1][lane], m[c][2][lane], 0.0f);
+                    localN[c] = glm::vec3(n[c][0][lane], n[c][1][lane], n[c][2][lane]);
+                }
+                local[3] = glm::vec4(posX[i], posY[i], posZ[i], 1.0f);
+            }
+        }
+        // tail
+        for (; e < count; e++)
+        {
+            if (!dirty[e])
+                continue;
+            glm::mat3 rotation = glm::mat3_cast(glm::quat(rotW[e], rotX[e], rotY[e], rotZ[e]));
+            glm::vec3 scale(scaleX[e], scaleY[e], scaleZ[e]);
+            glm::mat4 &local = parent[e] >= 0 ? localMatrix[e] : world[e];
+            glm::mat3 &localN = parent[e] >= 0 ? localNormal[e] : normal[e];
+            for (int c = 0; c < 3; c++)
+            {
+                local[c] = glm::vec4(rotation[c] * scale[c], 0.0f);
+                localN[c] = rotation[c] / scale[c];
+            }
+            local[3] = glm::vec4(posX[e], posY[e], posZ[e], 1.0f);
+        }
+    }
+};
+
+#endif
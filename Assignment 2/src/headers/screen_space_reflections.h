@@ -0,0 +1,377 @@
+#ifndef SCREEN_SPACE_REFLECTIONS_H
+#define SCREEN_SPACE_REFLECTIONS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "imgui.h"
+
+#include <shader.h>
+
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// Screen-space reflection and refraction on top of the cubemap lookups: what the glass
+// objects see of each other on screen comes from the rendered image, the cubemap sample from
+// object.frag stays wherever the ray misses.
+//
+// The scene is rendered into our own target with two color attachments: the color and, from
+// the object programs, the world normal plus the effect (object.frag, NormalOut). Then:
+//   HiZ      nearest depth pyramid of the depth buffer
+//   trace    half resolution, one of the four pixels below each texel per frame, HiZ march
+//   resolve  bilateral upsample, accumulated over frames with reprojection
+//   apply    the scene with the result laid over it, into the framebuffer that was bound
+// The targets keep some headroom and only a corner is rendered to, so a changing dynamic
+// resolution doesn't reallocate every frame.
+//
+// Per frame:  beginScene()  scene draws  endScene(view, projection, camera position)
+class ScreenSpaceReflections
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+    static constexpr int MAX_LEVELS = 7;
+
+    bool enabled = true;
+    float strength = 0.8f;
+    int maxSteps = 48;
+    float maxDistance = 10.0f;
+    float thickness = 0.3f;
+    float blend = 0.15f;        // weight of the new frame in the history
+    float ior = 1.52f;          // for the refracted rays
+
+    // GPU ms per pass, smoothed
+    struct Timings
+    {
+        float hiz = 0.0f, trace = 0.0f, resolve = 0.0f, apply = 0.0f;
+        float total() const { return hiz + trace + resolve + apply; }
+    };
+
+    ScreenSpaceReflections()
+        : hizShader("shaders/fullscreen.vert", "shaders/ssr_hiz.frag"),
+          traceShader("shaders/fullscreen.vert", "shaders/ssr_trace.frag"),
+          resolveShader("shaders/fullscreen.vert", "shaders/ssr_resolve.frag"),
+          applyShader("shaders/fullscreen.vert", "shaders/ssr_apply.frag")
+    {
+        glGenVertexArrays(1, &emptyVAO);
+        glGenFramebuffers(1, &sceneFBO);
+        glGenFramebuffers(1, &passFBO);
+        glGenQueries(FRAMES_IN_FLIGHT * 5, &queries[0][0]);
+    }
+
+    ~ScreenSpaceReflections()
+    {
+        release();
+        glDeleteQueries(FRAMES_IN_FLIGHT * 5, &queries[0][0]);
+        glDeleteFramebuffers(1, &sceneFBO);
+        glDeleteFramebuffers(1, &passFBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    ScreenSpaceReflections(const ScreenSpaceReflections&) = delete;
+    ScreenSpaceReflections& operator=(const ScreenSpaceReflections&) = delete;
+
+    // takes over from the bound framebuffer; clears with the current clear color
+    void beginScene()
+    {
+        readTimings();
+        active = enabled;
+        if (!active)
+        {
+            historyValid = false;
+            return;
+        }
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        outputFBO = (GLuint)framebuffer;
+        glGetIntegerv(GL_VIEWPORT, outputViewport);
+        width = std::max(1, (int)outputViewport[2]);
+        height = std::max(1, (int)outputViewport[3]);
+        reserve(width, height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glViewport(0, 0, width, height);
+        GLfloat clearColor[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        const GLfloat noSurface[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat farDepth = 1.0f;
+        glClearBufferfv(GL_COLOR, 0, clearColor);
+        glClearBufferfv(GL_COLOR, 1, noSurface);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    }
+
+    // runs the passes and leaves the finished image in the framebuffer bound at beginScene()
+    void endScene(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPosition)
+    {
+        if (!active)
+            return;
+        GLuint* frameQueries = queries[slot];
+        glQueryCounter(frameQueries[0], GL_TIMESTAMP);
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean blending = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glBindVertexArray(emptyVAO);
+        glBindFramebuffer(GL_FRAMEBUFFER, passFBO);
+
+        // --- HiZ ---
+        hizShader.use();
+        hizShader.setInt("source", 0);
+        glActiveTexture(GL_TEXTURE0);
+        int levels = hizLevels(width, height);
+        int sourceWidth = width, sourceHeight = height;
+        for (int level = 0; level < levels; level++)
+        {
+            int levelWidth = level == 0 ? width : std::max(1, sourceWidth / 2);
+            int levelHeight = level == 0 ? height : std::max(1, sourceHeight / 2);
+            if (level == 0)
+                glBindTexture(GL_TEXTURE_2D, depthTexture);
+            else
+            {
+                glBindTexture(GL_TEXTURE_2D, hizTexture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hizTexture, level);
+            glViewport(0, 0, levelWidth, levelHeight);
+            hizShader.setBool("copy", level == 0);
+            hizShader.setIVec2("sourceSize", sourceWidth, sourceHeight);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            sourceWidth = levelWidth;
+            sourceHeight = levelHeight;
+        }
+        glBindTexture(GL_TEXTURE_2D, hizTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MAX_LEVELS - 1);
+        glQueryCounter(frameQueries[1], GL_TIMESTAMP);
+
+        // --- trace ---
+        static const int offsets[4][2] = { { 0, 0 }, { 1, 1 }, { 1, 0 }, { 0, 1 } };
+        const int* pixelOffset = offsets[frame % 4];
+        int traceWidth = (width + 1) / 2, traceHeight = (height + 1) / 2;
+        glm::mat4 viewProjection = projection * view;
+        glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+        // near and far back out of the projection matrix
+        float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+        float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, traceTexture, 0);
+        glViewport(0, 0, traceWidth, traceHeight);
+        traceShader.use();
+        bind(traceShader, "depthTexture", 0, depthTexture);
+        bind(traceShader, "normalTexture", 1, normalTexture);
+        bind(traceShader, "sceneColor", 2, colorTexture);
+        bind(traceShader, "hiz", 3, hizTexture);
+        traceShader.setIVec2("renderSize", width, height);
+        traceShader.setIVec2("pixelOffset", pixelOffset[0], pixelOffset[1]);
+        traceShader.setInt("maxLevel", levels - 1);
+        traceShader.setInt("maxSteps", maxSteps);
+        traceShader.setFloat("maxDistance", maxDistance);
+        traceShader.setFloat("thickness", thickness);
+        traceShader.setFloat("ior", ior);
+        traceShader.setFloat("nearPlane", nearPlane);
+        traceShader.setFloat("farPlane", farPlane);
+        traceShader.setMat4("viewProjection", viewProjection);
+        traceShader.setMat4("inverseViewProjection", inverseViewProjection);
+        traceShader.setMat4("view", view);
+        traceShader.setVec3("cameraPos", cameraPosition);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glQueryCounter(frameQueries[2], GL_TIMESTAMP);
+
+        // --- resolve ---
+        int current = frame % 2, previous = 1 - current;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTextures[current], 0);
+        glViewport(0, 0, width, height);
+        resolveShader.use();
+        bind(resolveShader, "trace", 0, traceTexture);
+        bind(resolveShader, "depthTexture", 1, depthTexture);
+        bind(resolveShader, "normalTexture", 2, normalTexture);
+        bind(resolveShader, "history", 3, historyTextures[previous]);
+        resolveShader.setIVec2("renderSize", width, height);
+        resolveShader.setIVec2("traceSize", traceWidth, traceHeight);
+        resolveShader.setIVec2("pixelOffset", pixelOffset[0], pixelOffset[1]);
+        resolveShader.setVec2("historyScale", (float)previousWidth / capacityWidth, (float)previousHeight / capacityHeight);
+        resolveShader.setBool("historyValid", historyValid);
+        resolveShader.setFloat("blend", blend);
+        resolveShader.setFloat("nearPlane", nearPlane);
+        resolveShader.setFloat("farPlane", farPlane);
+        resolveShader.setMat4("inverseViewProjection", inverseViewProjection);
+        resolveShader.setMat4("previousViewProjection", previousViewProjection);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glQueryCounter(frameQueries[3], GL_TIMESTAMP);
+
+        // --- apply ---
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glViewport(outputViewport[0], outputViewport[1], outputViewport[2], outputViewport[3]);
+        applyShader.use();
+        bind(applyShader, "sceneColor", 0, colorTexture);
+        bind(applyShader, "resolved", 1, historyTextures[current]);
+        applyShader.setIVec2("viewportOrigin", outputViewport[0], outputViewport[1]);
+        applyShader.setFloat("strength", strength);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glQueryCounter(frameQueries[4], GL_TIMESTAMP);
+        if (pending[slot])
+            dropped++;
+        pending[slot] = true;
+        slot = (slot + 1) % FRAMES_IN_FLIGHT;
+
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (blending)
+            glEnable(GL_BLEND);
+
+        previousViewProjection = viewProjection;
+        previousWidth = width;
+        previousHeight = height;
+        historyValid = true;
+        frame++;
+    }
+
+    const Timings& last() const { return timings; }
+
+    void drawUI()
+    {
+        ImGui::Checkbox("Screen-space reflections", &enabled);
+        if (!enabled)
+            return;
+        ImGui::SliderFloat("SSR strength", &strength, 0.0f, 1.0f);
+        ImGui::SliderInt("SSR max steps", &maxSteps, 8, 128);
+        ImGui::SliderFloat("SSR ray length", &maxDistance, 1.0f, 50.0f);
+        ImGui::SliderFloat("SSR thickness", &thickness, 0.01f, 2.0f);
+        ImGui::SliderFloat("SSR history blend", &blend, 0.02f, 1.0f);
+        ImGui::Text("  %dx%d, trace %dx%d: %.3f ms GPU (HiZ %.3f, trace %.3f, resolve %.3f, apply %.3f)",
+                    width, height, (width + 1) / 2, (height + 1) / 2, timings.total(),
+                    timings.hiz, timings.trace, timings.resolve, timings.apply);
+    }
+
+private:
+    Shader hizShader, traceShader, resolveShader, applyShader;
+    unsigned int emptyVAO = 0;
+    unsigned int sceneFBO = 0, passFBO = 0;
+    unsigned int colorTexture = 0, normalTexture = 0, depthTexture = 0, hizTexture = 0, traceTexture = 0;
+    unsigned int historyTextures[2] = { 0, 0 };
+    int capacityWidth = 0, capacityHeight = 0;
+    int width = 0, height = 0;
+    GLuint outputFBO = 0;
+    GLint outputViewport[4] = { 0, 0, 0, 0 };
+    bool active = false;
+
+    long frame = 0;
+    bool historyValid = false;
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    int previousWidth = 0, previousHeight = 0;
+
+    GLuint queries[FRAMES_IN_FLIGHT][5] = {};
+    bool pending[FRAMES_IN_FLIGHT] = {};
+    int slot = 0;
+    long dropped = 0;
+    bool measured = false;
+    Timings timings;
+
+    static int hizLevels(int w, int h)
+    {
+        int levels = 1;
+        while (levels < MAX_LEVELS && (std::max(w, h) >> levels) > 0)
+            levels++;
+        return levels;
+    }
+
+    static void bind(Shader &shader, const char* name, int unit, unsigned int texture)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        shader.setInt(name, unit);
+    }
+
+    static unsigned int createTexture(GLint internalFormat, int w, int h, GLenum format, GLenum type, GLint filter, int levels = 1)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(1, w >> level), std::max(1, h >> level), 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        return texture;
+    }
+
+    // grows with a quarter of headroom, shrinks only when less than half is used
+    void reserve(int w, int h)
+    {
+        bool fits = w <= capacityWidth && h <= capacityHeight;
+        bool wasteful = w * 2 < capacityWidth && h * 2 < capacityHeight;
+        if (fits && !wasteful)
+            return;
+        release();
+        capacityWidth = w + w / 4;
+        capacityHeight = h + h / 4;
+        historyValid = false;
+
+        colorTexture = createTexture(GL_RGBA8, capacityWidth, capacityHeight, GL_RGBA, GL_UNSIGNED_BYTE, GL_LINEAR);
+        normalTexture = createTexture(GL_RGBA16F, capacityWidth, capacityHeight, GL_RGBA, GL_FLOAT, GL_NEAREST);
+        depthTexture = createTexture(GL_DEPTH_COMPONENT24, capacityWidth, capacityHeight, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, GL_NEAREST);
+        hizTexture = createTexture(GL_R32F, capacityWidth, capacityHeight, GL_RED, GL_FLOAT, GL_NEAREST, MAX_LEVELS);
+        traceTexture = createTexture(GL_RGBA16F, (capacityWidth + 1) / 2, (capacityHeight + 1) / 2, GL_RGBA, GL_FLOAT, GL_NEAREST);
+        for (unsigned int &history : historyTextures)
+            history = createTexture(GL_RGBA16F, capacityWidth, capacityHeight, GL_RGBA, GL_FLOAT, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SSR::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+    }
+
+    void release()
+    {
+        if (!colorTexture)
+            return;
+        unsigned int textures[] = { colorTexture, normalTexture, depthTexture, hizTexture, traceTexture, historyTextures[0], historyTextures[1] };
+        glDeleteTextures(7, textures);
+        colorTexture = normalTexture = depthTexture = hizTexture = traceTexture = 0;
+        historyTextures[0] = historyTextures[1] = 0;
+        capacityWidth = capacityHeight = 0;
+    }
+
+    void readTimings()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            int oldest = (slot + i) % FRAMES_IN_FLIGHT;
+            if (!pending[oldest])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[oldest][4], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 stamps[5];
+            for (int q = 0; q < 5; q++)
+                glGetQueryObjectui64v(queries[oldest][q], GL_QUERY_RESULT, &stamps[q]);
+            pending[oldest] = false;
+
+            float ms[4];
+            for (int q = 0; q < 4; q++)
+                ms[q] = (float)((stamps[q + 1] - stamps[q]) / 1e6);
+            float k = measured ? 0.1f : 1.0f;
+            timings.hiz = glm::mix(timings.hiz, ms[0], k);
+            timings.trace = glm::mix(timings.trace, ms[1], k);
+            timings.resolve = glm::mix(timings.resolve, ms[2], k);
+            timings.apply = glm::mix(timings.apply, ms[3], k);
+            measured = true;
+        }
+    }
+};
+
+#endif
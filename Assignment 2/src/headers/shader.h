@@ -8,93 +8,210 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+
+#include <gl_extensions.h>
+
+// an active vertex input of a linked program, as reported by the driver
+struct ShaderAttribute
+{
+    std::string name;
+    GLint location;
+    GLenum type;   // GL_FLOAT_VEC3, GL_INT_VEC4, GL_FLOAT_MAT4, ...
+    GLint size;    // array length, 1 for plain inputs
+};
+
+// binding points of the uniform blocks shared between programs; reflect() connects blocks
+// with these names, so no program has to be set up by hand
+enum UniformBlockBinding
+{
+    CAMERA_BLOCK_BINDING = 0   // "Camera", see CameraBlock in camera.h
+};
 
 class Shader
 {
 public:
-    unsigned int ID;
+    unsigned int ID = 0;
+    // human readable name used in logs and the UI ("object.vert + object.frag [INSTANCED]")
+    std::string name;
+    // set once the program is linked and its status has been checked
+    std::atomic<bool> ready{false};
+    // set once the program has been drawn with off-screen so the driver's deferred work is done
+    bool warmed = false;
+    // filled by reflect() right after linking
+    std::vector<ShaderAttribute> attributes;
+
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+        loadSources(vertexPath, fragmentPath, geometryPath, {});
+        submit();
+        finish();
+        ready = true;
+    }
+    // constructor for a permutation of a program: every entry in defines becomes a
+    // '#define' injected after the #version line. With deferred set the sources are only
+    // read here and compilation is left to a ShaderCompileQueue (see shader_queue.h).
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines, bool deferred)
+    {
+        loadSources(vertexPath, fragmentPath, nullptr, defines);
+        if (!deferred)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            submit();
+            finish();
+            ready = true;
         }
+    }
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    // hands the sources to the driver: compile + link without querying any status, so
+    // with GL_KHR_parallel_shader_compile this returns before the driver is done
+    // ------------------------------------------------------------------------
+    void submit()
+    {
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+        if(!geometryCode.empty())
         {
             const char * gShaderCode = geometryCode.c_str();
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
+        if(geometry != 0)
             glAttachShader(ID, geometry);
         glLinkProgram(ID);
+    }
+    // non-blocking check whether a submitted program has finished compiling and linking.
+    // Only meaningful when the context exposes GL_KHR_parallel_shader_compile.
+    // ------------------------------------------------------------------------
+    bool completionReady() const
+    {
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+    // reports compile/link errors (blocks until the driver is done) and releases the shader objects.
+    // The caller flags the program ready once it is safe to use from the render thread.
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        checkCompileErrors(vertex, "VERTEX");
+        checkCompileErrors(fragment, "FRAGMENT");
+        if(geometry != 0)
+            checkCompileErrors(geometry, "GEOMETRY");
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
+        glDetachShader(ID, vertex);
+        glDetachShader(ID, fragment);
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-        if(geometryPath != nullptr)
+        if(geometry != 0)
+        {
+            glDetachShader(ID, geometry);
             glDeleteShader(geometry);
+        }
+        vertex = fragment = geometry = 0;
+        reflect();
+    }
+    // queries the active attributes and uniforms of the linked program
+    // ------------------------------------------------------------------------
+    void reflect()
+    {
+        attributes.clear();
+        uniforms.clear();
+        GLint linked = GL_FALSE;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+        if(!linked)
+            return;
+
+        GLchar buffer[256];
+        GLint count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            ShaderAttribute attribute;
+            glGetActiveAttrib(ID, (GLuint)i, sizeof(buffer), &length, &attribute.size, &attribute.type, buffer);
+            attribute.name.assign(buffer, length);
+            attribute.location = glGetAttribLocation(ID, buffer);
+            // built-ins like gl_VertexID show up here too, they don't need a buffer
+            if(attribute.location >= 0)
+                attributes.push_back(attribute);
+        }
 
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, sizeof(buffer), &length, &size, &type, buffer);
+            std::string uniformName(buffer, length);
+            GLint location = glGetUniformLocation(ID, buffer);
+            uniforms[uniformName] = location;
+            // arrays of basic types are reported once as "name[0]", make "name" and every element resolvable
+            size_t bracket = uniformName.rfind("[0]");
+            if(bracket != std::string::npos && bracket + 3 == uniformName.size())
+            {
+                std::string base = uniformName.substr(0, bracket);
+                uniforms[base] = location;
+                for(GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniforms[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(ID, (GLuint)i, sizeof(buffer), &length, buffer);
+            std::string blockName(buffer, length);
+            if(blockName == "Camera")
+                glUniformBlockBinding(ID, (GLuint)i, CAMERA_BLOCK_BINDING);
+        }
+    }
+    // location of a uniform from the reflected table, -1 if the program doesn't use it
+    // ------------------------------------------------------------------------
+    GLint uniformLocation(const std::string &name) const
+    {
+        auto it = uniforms.find(name);
+        if(it != uniforms.end())
+            return it->second;
+        // not reflected (e.g. members of struct arrays), ask once and remember
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        uniforms[name] = location;
+        return location;
+    }
+    // the reflected vertex input with the given name, nullptr if the program doesn't consume it
+    // ------------------------------------------------------------------------
+    const ShaderAttribute* findAttribute(const std::string &name) const
+    {
+        for(const ShaderAttribute &attribute : attributes)
+            if(attribute.name == name)
+                return &attribute;
+        return nullptr;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -106,62 +223,144 @@ public:
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(uniformLocation(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(uniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(uniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(uniformLocation(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(uniformLocation(name), x, y); 
+    }
+    // ------------------------------------------------------------------------
+    void setIVec2(const std::string &name, int x, int y) const
+    { 
+        glUniform2i(uniformLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(uniformLocation(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(uniformLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(uniformLocation(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(uniformLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    mutable std::unordered_map<std::string, GLint> uniforms;
+    std::string vertexCode;
+    std::string fragmentCode;
+    std::string geometryCode;
+    unsigned int vertex = 0, fragment = 0, geometry = 0;
+
+    // reads the sources from disk and injects the permutation defines
+    // ------------------------------------------------------------------------
+    void loadSources(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const std::vector<std::string>& defines)
+    {
+        // 1. retrieve the vertex/fragment source code from filePath
+        std::ifstream vShaderFile;
+        std::ifstream fShaderFile;
+        std::ifstream gShaderFile;
+        // ensure ifstream objects can throw exceptions:
+        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try 
+        {
+            // open files
+            vShaderFile.open(vertexPath);
+            fShaderFile.open(fragmentPath);
+            std::stringstream vShaderStream, fShaderStream;
+            // read file's buffer contents into streams
+            vShaderStream << vShaderFile.rdbuf();
+            fShaderStream << fShaderFile.rdbuf();		
+            // close file handlers
+            vShaderFile.close();
+            fShaderFile.close();
+            // convert stream into string
+            vertexCode = vShaderStream.str();
+            fragmentCode = fShaderStream.str();			
+            // if geometry shader path is present, also load a geometry shader
+            if(geometryPath != nullptr)
+            {
+                gShaderFile.open(geometryPath);
+                std::stringstream gShaderStream;
+                gShaderStream << gShaderFile.rdbuf();
+                gShaderFile.close();
+                geometryCode = gShaderStream.str();
+            }
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        }
+
+        name = std::string(vertexPath) + " + " + fragmentPath;
+        if(!defines.empty())
+        {
+            std::string block;
+            name += " [";
+            for(size_t i = 0; i < defines.size(); i++)
+            {
+                block += "#define " + defines[i] + "\n";
+                name += (i ? " " : "") + defines[i];
+            }
+            name += "]";
+            // keep line numbers in driver error messages pointing at the file on disk
+            block += "#line 2\n";
+            injectDefines(vertexCode, block);
+            injectDefines(fragmentCode, block);
+            if(!geometryCode.empty())
+                injectDefines(geometryCode, block);
+        }
+    }
+    // ------------------------------------------------------------------------
+    static void injectDefines(std::string& code, const std::string& block)
+    {
+        // the #version directive has to stay the first line
+        size_t eol = code.find('\n');
+        if(code.compare(0, 8, "#version") == 0 && eol != std::string::npos)
+            code.insert(eol + 1, block);
+        else
+            code.insert(0, block);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -174,7 +373,7 @@ private:
             if(!success)
             {
                 glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << " (" << name << ")\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
         else
@@ -183,7 +382,7 @@ private:
             if(!success)
             {
                 glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << " (" << name << ")\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
     }
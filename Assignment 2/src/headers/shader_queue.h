@@ -0,0 +1,214 @@
+#ifndef SHADER_QUEUE_H
+#define SHADER_QUEUE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <shader.h>
+#include <gl_extensions.h>
+
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+// Compiles every program up front without stalling the render loop.
+//
+// If the driver exposes GL_KHR_parallel_shader_compile all programs are submitted on the
+// render thread and GL_COMPLETION_STATUS_KHR is polled once per frame. Otherwise a hidden
+// window sharing our context is handed to a worker thread which compiles and links there.
+// Until a program is ready (and warmed up) resolve() hands out the fallback program instead.
+class ShaderCompileQueue
+{
+public:
+    ShaderCompileQueue(Shader &fallback) : fallback(fallback)
+    {
+    }
+
+    ~ShaderCompileQueue()
+    {
+        if (worker.joinable())
+            worker.join();
+        if (workerContext)
+            glfwDestroyWindow(workerContext);
+        if (warmupFBO)
+        {
+            glDeleteFramebuffers(1, &warmupFBO);
+            glDeleteRenderbuffers(1, &warmupColor);
+            glDeleteRenderbuffers(1, &warmupDepth);
+            glDeleteVertexArrays(1, &warmupVAO);
+        }
+    }
+
+    // queue a program (constructed with deferred = true) for compilation. A program whose
+    // inputs differ from the default fallback's (e.g. instanced permutations) can name its own.
+    void add(Shader &shader, Shader* ownFallback = nullptr)
+    {
+        shaders.push_back(&shader);
+        if (ownFallback)
+            fallbacks[&shader] = ownFallback;
+    }
+
+    // kicks off compilation of everything added so far. Must be called from the thread
+    // that owns the window's context, since the worker context is created here.
+    void submitAll(GLFWwindow* window)
+    {
+        startTime = glfwGetTime();
+        useParallelExtension = glExt.parallelShaderCompile;
+        if (useParallelExtension)
+        {
+            // let the driver use as many threads as it likes
+            glExt.MaxShaderCompilerThreads(0xFFFFFFFFu);
+            for (Shader* shader : shaders)
+                shader->submit();
+            return;
+        }
+
+        // GLFW windows have to be created on the main thread, only the context moves over
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR));
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR));
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        workerContext = glfwCreateWindow(1, 1, "shader compiler", nullptr, window);
+        glfwDefaultWindowHints();
+
+        if (!workerContext)
+        {
+            // no second context available, compile serially right here as before
+            std::cout << "WARNING::SHADER_QUEUE:: could not create a shared context, compiling on the main thread" << std::endl;
+            for (Shader* shader : shaders)
+            {
+                shader->submit();
+                shader->finish();
+                shader->ready = true;
+            }
+            return;
+        }
+
+        std::vector<Shader*> jobs = shaders;
+        worker = std::thread([this, jobs]()
+        {
+            glfwMakeContextCurrent(workerContext);
+            for (Shader* shader : jobs)
+            {
+                shader->submit();
+                shader->finish();
+                // make sure the program is complete before the render thread may touch it
+                glFinish();
+                shader->ready = true;
+            }
+            glfwMakeContextCurrent(nullptr);
+        });
+    }
+
+    // call once per frame on the render thread: picks up finished programs and warms them up
+    void update()
+    {
+        for (Shader* shader : shaders)
+        {
+            if (!shader->ready && useParallelExtension && shader->completionReady())
+            {
+                shader->finish();
+                shader->ready = true;
+            }
+            if (shader->ready && !shader->warmed)
+                warmUp(*shader);
+        }
+        if (!finished && pending() == 0)
+        {
+            finished = true;
+            totalMs = (glfwGetTime() - startTime) * 1000.0;
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    // the program to draw with this frame
+    Shader& resolve(Shader &shader)
+    {
+        if (isReady(shader))
+            return shader;
+        auto it = fallbacks.find(&shader);
+        return it != fallbacks.end() ? *it->second : fallback;
+    }
+
+    bool isReady(const Shader &shader) const
+    {
+        return shader.ready && shader.warmed;
+    }
+
+    int pending() const
+    {
+        int count = 0;
+        for (const Shader* shader : shaders)
+            if (!isReady(*shader))
+                count++;
+        return count;
+    }
+
+    int size() const { return (int)shaders.size(); }
+    bool usesParallelExtension() const { return useParallelExtension; }
+    // wall time from submitAll() until the last program was warmed up, 0 while still compiling
+    double compileMs() const { return totalMs; }
+
+private:
+    Shader &fallback;
+    std::vector<Shader*> shaders;
+    std::map<const Shader*, Shader*> fallbacks;
+    bool useParallelExtension = false;
+    GLFWwindow* workerContext = nullptr;
+    std::thread worker;
+    double startTime = 0.0;
+    double totalMs = 0.0;
+    bool finished = false;
+
+    unsigned int warmupFBO = 0, warmupColor = 0, warmupDepth = 0, warmupVAO = 0;
+
+    // draws one triangle with the program into a tiny off-screen target. Most drivers finish
+    // the real code generation only at the first draw, this keeps that out of visible frames.
+    void warmUp(Shader &shader)
+    {
+        if (!warmupFBO)
+        {
+            glGenFramebuffers(1, &warmupFBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, warmupFBO);
+            glGenRenderbuffers(1, &warmupColor);
+            glBindRenderbuffer(GL_RENDERBUFFER, warmupColor);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 4, 4);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, warmupColor);
+            glGenRenderbuffers(1, &warmupDepth);
+            glBindRenderbuffer(GL_RENDERBUFFER, warmupDepth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 4, 4);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, warmupDepth);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glGenVertexArrays(1, &warmupVAO);
+        }
+
+        GLint previousFBO, previousProgram, previousVAO;
+        GLint viewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, warmupFBO);
+        glViewport(0, 0, 4, 4);
+        glUseProgram(shader.ID);
+        glBindVertexArray(warmupVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        glBindVertexArray(previousVAO);
+        glUseProgram(previousProgram);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        shader.warmed = true;
+    }
+};
+
+#endif
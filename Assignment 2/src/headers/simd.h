@@ -0,0 +1,109 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+// Minimal 4-wide float vector used by the batched CPU passes (scene transforms, culling, ...).
+// SSE on x86, NEON on ARM (Apple silicon), plain loops anywhere else.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+typedef __m128 f4;
+
+inline f4 f4Load(const float* p)           { return _mm_loadu_ps(p); }
+inline void f4Store(float* p, f4 a)        { _mm_storeu_ps(p, a); }
+inline f4 f4Set(float v)                   { return _mm_set1_ps(v); }
+inline f4 f4Add(f4 a, f4 b)                { return _mm_add_ps(a, b); }
+inline f4 f4Sub(f4 a, f4 b)                { return _mm_sub_ps(a, b); }
+inline f4 f4Mul(f4 a, f4 b)                { return _mm_mul_ps(a, b); }
+inline f4 f4Div(f4 a, f4 b)                { return _mm_div_ps(a, b); }
+inline f4 f4Min(f4 a, f4 b)                { return _mm_min_ps(a, b); }
+inline f4 f4Max(f4 a, f4 b)                { return _mm_max_ps(a, b); }
+inline f4 f4Round(f4 a)                    { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+// a > b ? ifTrue : ifFalse, per lane
+inline f4 f4SelectGreater(f4 a, f4 b, f4 ifTrue, f4 ifFalse)
+{
+    f4 mask = _mm_cmpgt_ps(a, b);
+    return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+}
+// bit i set when lane i of a > b
+inline int f4MaskGreater(f4 a, f4 b)       { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t f4;
+
+inline f4 f4Load(const float* p)           { return vld1q_f32(p); }
+inline void f4Store(float* p, f4 a)        { vst1q_f32(p, a); }
+inline f4 f4Set(float v)                   { return vdupq_n_f32(v); }
+inline f4 f4Add(f4 a, f4 b)                { return vaddq_f32(a, b); }
+inline f4 f4Sub(f4 a, f4 b)                { return vsubq_f32(a, b); }
+inline f4 f4Mul(f4 a, f4 b)                { return vmulq_f32(a, b); }
+inline f4 f4Div(f4 a, f4 b)                { return vdivq_f32(a, b); }
+inline f4 f4Min(f4 a, f4 b)                { return vminq_f32(a, b); }
+inline f4 f4Max(f4 a, f4 b)                { return vmaxq_f32(a, b); }
+inline f4 f4Round(f4 a)                    { return vrndnq_f32(a); }
+inline f4 f4SelectGreater(f4 a, f4 b, f4 ifTrue, f4 ifFalse)
+{
+    return vbslq_f32(vcgtq_f32(a, b), ifTrue, ifFalse);
+}
+inline int f4MaskGreater(f4 a, f4 b)
+{
+    static const int32_t weights[4] = { 1, 2, 4, 8 };
+    uint32x4_t mask = vcgtq_f32(a, b);
+    return (int)vaddvq_s32(vandq_s32(vreinterpretq_s32_u32(mask), vld1q_s32(weights)));
+}
+
+#else
+struct f4 { float v[4]; };
+
+inline f4 f4Load(const float* p)           { f4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+inline void f4Store(float* p, f4 a)        { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+inline f4 f4Set(float v)                   { f4 r; for (int i = 0; i < 4; i++) r.v[i] = v; return r; }
+inline f4 f4Add(f4 a, f4 b)                { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline f4 f4Sub(f4 a, f4 b)                { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline f4 f4Mul(f4 a, f4 b)                { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline f4 f4Div(f4 a, f4 b)                { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+inline f4 f4Min(f4 a, f4 b)                { for (int i = 0; i < 4; i++) a.v[i] = std::fmin(a.v[i], b.v[i]); return a; }
+inline f4 f4Max(f4 a, f4 b)                { for (int i = 0; i < 4; i++) a.v[i] = std::fmax(a.v[i], b.v[i]); return a; }
+inline f4 f4Round(f4 a)                    { for (int i = 0; i < 4; i++) a.v[i] = std::nearbyint(a.v[i]); return a; }
+inline f4 f4SelectGreater(f4 a, f4 b, f4 ifTrue, f4 ifFalse)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++) r.v[i] = a.v[i] > b.v[i] ? ifTrue.v[i] : ifFalse.v[i];
+    return r;
+}
+inline int f4MaskGreater(f4 a, f4 b)
+{
+    int mask = 0;
+    for (int i = 0; i < 4; i++) mask |= (a.v[i] > b.v[i]) << i;
+    return mask;
+}
+#endif
+
+// a * b + c
+inline f4 f4MulAdd(f4 a, f4 b, f4 c)      { return f4Add(f4Mul(a, b), c); }
+
+// sin of 4 angles (any range), max error around 4e-6: reduce to [-pi, pi], fold into
+// [-pi/2, pi/2] with sin(x) = sin(pi - x), then a degree 9 odd polynomial
+inline f4 f4Sin(f4 x)
+{
+    const f4 twoPi = f4Set(6.28318530718f), pi = f4Set(3.14159265359f), halfPi = f4Set(1.57079632679f);
+    x = f4Sub(x, f4Mul(twoPi, f4Round(f4Mul(x, f4Set(0.159154943092f)))));
+    x = f4SelectGreater(x, halfPi, f4Sub(pi, x), x);
+    x = f4SelectGreater(f4Sub(f4Set(0.0f), halfPi), x, f4Sub(f4Sub(f4Set(0.0f), pi), x), x);
+    f4 x2 = f4Mul(x, x);
+    f4 p = f4Set(2.7557319e-6f);
+    p = f4MulAdd(p, x2, f4Set(-1.98412698e-4f));
+    p = f4MulAdd(p, x2, f4Set(8.33333333e-3f));
+    p = f4MulAdd(p, x2, f4Set(-1.66666667e-1f));
+    p = f4MulAdd(p, x2, f4Set(1.0f));
+    return f4Mul(p, x);
+}
+
+inline f4 f4Cos(f4 x)
+{
+    return f4Sin(f4Add(x, f4Set(1.57079632679f)));
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef SPECTRAL_DISPERSION_H
+#define SPECTRAL_DISPERSION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "imgui.h"
+
+#include <shader.h>
+
+#include <cmath>
+#include <algorithm>
+
+// Spectral dispersion for the chromatic glass (effectType 2 in object.frag). Instead of three
+// refracted rays, one per colour channel, a handful of wavelengths are traced with an index of
+// refraction from Cauchy's equation, n = A + B / lambda^2, fitted so that n is ior at 550 nm and
+// spreads by 2 * dispersion between 450 and 650 nm like the RGB rays did. Each wavelength adds
+// to the channels it belongs to, so the rainbow is continuous instead of three bands.
+//
+// The wavelengths are stratified over the visible range and the whole set is rotated every
+// frame (and scrambled per pixel), so the TAA history averages many more wavelengths than one
+// frame pays for: with a history blend b it holds about (2 - b) / b frames' worth. Without TAA
+// the rotation stops and the pattern stays put, the samples of one frame are all there is.
+//
+// The cost is the GPU time of the chromatic glass draws alone, kept per sample count; they
+// need a submission of their own, nothing else may fall between the timestamps.
+//
+// Per frame:  beginFrame(accumulating, historyBlend),  setUniforms(program) for object programs,
+//             beginTiming() chromatic glass draws endTiming()
+class SpectralDispersion
+{
+public:
+    static constexpr int MAX_SAMPLES = 16;
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    bool enabled = true;        // false: the three RGB rays
+    int samples = 2;            // wavelengths per pixel per frame
+    bool rotate = true;         // only takes effect with TAA
+
+    struct Stats
+    {
+        bool accumulating = false;
+        float effectiveSamples = 0.0f;  // per pixel, through the TAA history
+        // GPU time of the chromatic glass draws, smoothed; [0] with the RGB rays, [n] with n wavelengths
+        float drawMs[MAX_SAMPLES + 1] = {};
+    };
+
+    SpectralDispersion()
+    {
+        glGenQueries(FRAMES_IN_FLIGHT * 2, &queries[0][0]);
+    }
+
+    ~SpectralDispersion()
+    {
+        glDeleteQueries(FRAMES_IN_FLIGHT * 2, &queries[0][0]);
+    }
+
+    SpectralDispersion(const SpectralDispersion&) = delete;
+    SpectralDispersion& operator=(const SpectralDispersion&) = delete;
+
+    // accumulating: whether a temporal history will average this frame with the last ones
+    void beginFrame(bool accumulating, float historyBlend)
+    {
+        samples = std::clamp(samples, 1, MAX_SAMPLES);
+        stats.accumulating = accumulating && rotate && enabled;
+        if (stats.accumulating)
+        {
+            // golden ratio steps, every rotation lands in the largest gap left by the others
+            frame++;
+            offset = (float)std::fmod(0.5 + frame * 0.6180339887498949, 1.0);
+            stats.effectiveSamples = samples * (2.0f - historyBlend) / std::max(historyBlend, 1e-3f);
+        }
+        else
+        {
+            offset = 0.5f;
+            stats.effectiveSamples = enabled ? (float)samples : 3.0f;
+        }
+    }
+
+    void setUniforms(Shader &program) const
+    {
+        program.setInt("spectralSamples", enabled ? samples : 0);
+        program.setFloat("spectralOffset", offset);
+        program.setBool("spectralNoise", stats.accumulating);
+    }
+
+    // around the chromatic glass draws and nothing else, once per frame
+    void beginTiming()
+    {
+        readTimings();
+        glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+    }
+
+    void endTiming()
+    {
+        glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+        slotSamples[slot] = enabled ? samples : 0;
+        slot = (slot + 1) % FRAMES_IN_FLIGHT;
+    }
+
+    const Stats& last() const { return stats; }
+
+    void drawUI()
+    {
+        ImGui::Checkbox("Spectral dispersion", &enabled);
+        if (!enabled)
+        {
+            ImGui::Text("  chromatic glass %.3f ms with the RGB rays", stats.drawMs[0]);
+            return;
+        }
+        ImGui::SliderInt("Wavelengths per frame", &samples, 1, MAX_SAMPLES);
+        ImGui::Checkbox("Rotate wavelengths (with TAA)", &rotate);
+        ImGui::Text("  about %.0f wavelengths per pixel%s", stats.effectiveSamples,
+                    stats.accumulating ? " through the TAA history" : ", switch to TAA to accumulate");
+        ImGui::Text("  chromatic glass %.3f ms with %d, %.3f ms with the RGB rays", stats.drawMs[samples], samples, stats.drawMs[0]);
+        // whatever has been measured so far, to compare budgets
+        for (int n = 1; n <= MAX_SAMPLES; n++)
+            if (stats.drawMs[n] > 0.0f && n != samples)
+                ImGui::Text("    %2d wavelengths: %.3f ms", n, stats.drawMs[n]);
+    }
+
+private:
+    Stats stats;
+    long frame = 0;
+    float offset = 0.5f;
+
+    GLuint queries[FRAMES_IN_FLIGHT][2] = {};
+    int slotSamples[FRAMES_IN_FLIGHT] = { -1, -1, -1, -1 };   // -1: nothing timed
+    int slot = 0;
+
+    // the slot about to be reused is FRAMES_IN_FLIGHT frames old
+    void readTimings()
+    {
+        if (slotSamples[slot] < 0)
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+            float ms = (float)((end - begin) / 1e6);
+            float &smoothed = stats.drawMs[slotSamples[slot]];
+            smoothed = smoothed == 0.0f ? ms : glm::mix(smoothed, ms, 0.1f);
+        }
+        slotSamples[slot] = -1;
+    }
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+// Persistent worker threads for the data parallel CPU passes (culling, draw list building, ...).
+// parallelFor() splits [0, count) into chunks that workers and the calling thread grab
+// until none are left, and returns once every chunk is done. One job runs at a time.
+class ThreadPool
+{
+public:
+    // fn(begin, end, worker): worker is 0 for the calling thread, 1..threads()-1 for the pool
+    typedef std::function<void(size_t, size_t, int)> Job;
+
+    explicit ThreadPool(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+            threadCount = (int)std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 1; i < threadCount; i++)
+            workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // threads taking part in a parallelFor, including the caller
+    int threads() const { return (int)workers.size() + 1; }
+
+    // at most maxThreads (0 = all) threads work on the chunks of `grain` items
+    void parallelFor(size_t count, size_t grain, const Job &fn, int maxThreads = 0)
+    {
+        if (count == 0)
+            return;
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (count + grain - 1) / grain;
+        int helpers = maxThreads > 0 ? std::min(maxThreads, threads()) - 1 : threads() - 1;
+        helpers = (int)std::min<size_t>(helpers, chunks - 1);
+        if (helpers <= 0)
+        {
+            fn(0, count, 0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            jobGrain = grain;
+            nextChunk = 0;
+            jobChunks = chunks;
+            jobHelpers = helpers;
+            activeHelpers = helpers;
+            generation++;
+        }
+        wake.notify_all();
+
+        runChunks(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return activeHelpers == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool quit = false;
+    unsigned long generation = 0;
+
+    const Job* job = nullptr;
+    size_t jobCount = 0, jobGrain = 1, jobChunks = 0;
+    std::atomic<size_t> nextChunk{0};
+    int jobHelpers = 0;
+    int activeHelpers = 0;
+
+    void runChunks(int worker)
+    {
+        for (;;)
+        {
+            size_t chunk = nextChunk.fetch_add(1);
+            if (chunk >= jobChunks)
+                return;
+            size_t begin = chunk * jobGrain;
+            (*job)(begin, std::min(begin + jobGrain, jobCount), worker);
+        }
+    }
+
+    void workerLoop(int index)
+    {
+        unsigned long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // only as many workers as the job asked for join in
+                wake.wait(lock, [&]() { return quit || (generation != seen && index <= jobHelpers); });
+                if (quit)
+                    return;
+                seen = generation;
+            }
+            runChunks(index);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                activeHelpers--;
+            }
+            done.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef VERTEX_BINDING_H
+#define VERTEX_BINDING_H
+
+#include <glad/glad.h>
+
+#include <shader.h>
+
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <set>
+#include <iostream>
+
+// One attribute a mesh can provide. Attributes are matched to program inputs by name,
+// so shaders are free to pick their own locations.
+struct VertexAttribute
+{
+    const char* name;    // shader input name, e.g. "aPos"
+    int stream;          // index into the buffers handed to VertexBindingCache::get
+    GLint components;    // per column for matrix inputs
+    GLenum type;         // GL_FLOAT or GL_INT
+    GLsizei stride;
+    size_t offset;
+    GLuint divisor;      // 0 per vertex, 1 per instance
+};
+
+// Builds (and caches) one VAO per program/mesh pair that enables only the attributes the
+// program actually consumes, and keeps per-frame vertex fetch statistics.
+class VertexBindingCache
+{
+public:
+    static constexpr int MAX_STREAMS = 4;
+    // buffers[i] is the buffer for stream i of a layout, 0 where there is none
+    typedef std::array<unsigned int, MAX_STREAMS> Streams;
+
+    struct Stats
+    {
+        int draws = 0;
+        // bytes of vertex attributes the bound VAOs make the GPU fetch this frame
+        size_t attributeBytes = 0;
+        // what the same draws would have fetched with every mesh attribute enabled
+        size_t fullLayoutBytes = 0;
+        int mismatches = 0;
+    };
+
+    // the VAO to draw `buffers` with `shader`. Called for every draw, so the lookup doesn't allocate.
+    unsigned int get(const Shader &shader, const Streams &buffers, unsigned int indexBuffer,
+                     const std::vector<VertexAttribute> &layout, const std::string &meshName = "mesh")
+    {
+        Key key = { shader.ID, buffers };
+        auto it = bindings.find(key);
+        if (it != bindings.end())
+            return it->second.vao;
+
+        Binding binding;
+        glGenVertexArrays(1, &binding.vao);
+        glBindVertexArray(binding.vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+        for (const ShaderAttribute &input : shader.attributes)
+        {
+            const VertexAttribute* source = nullptr;
+            for (const VertexAttribute &attribute : layout)
+                if (input.name == attribute.name)
+                    source = &attribute;
+
+            if (!source)
+            {
+                report(shader, meshName, "consumes '" + input.name + "' which the mesh does not provide, it reads a constant");
+                continue;
+            }
+
+            GLint components = 0, columns = 1;
+            bool integer = false;
+            describe(input.type, components, columns, integer);
+            if (components != source->components)
+                report(shader, meshName, "'" + input.name + "' expects " + std::to_string(components) + " components, mesh provides " + std::to_string(source->components));
+            if (integer != (source->type != GL_FLOAT))
+                report(shader, meshName, "'" + input.name + "' integer/float type differs between program and mesh");
+
+            if (source->stream >= MAX_STREAMS || buffers[source->stream] == 0)
+            {
+                report(shader, meshName, "consumes '" + input.name + "' but no buffer was given for its stream (instanced program drawn without instances?)");
+                continue;
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[source->stream]);
+            // matrices take one location per column
+            for (GLint column = 0; column < columns; column++)
+            {
+                GLuint location = (GLuint)(input.location + column);
+                size_t offset = source->offset + column * components * sizeof(float);
+                glEnableVertexAttribArray(location);
+                if (source->type == GL_FLOAT)
+                    glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, source->stride, (void*)offset);
+                else
+                    glVertexAttribIPointer(location, components, source->type, source->stride, (void*)offset);
+                glVertexAttribDivisor(location, source->divisor);
+                if (source->divisor != 0)
+                    binding.instanced.push_back({ location, components, source->type, source->stride, offset, buffers[source->stream] });
+            }
+            if (source->divisor == 0)
+                binding.bytesPerVertex += attributeSize(*source);
+        }
+        for (const VertexAttribute &attribute : layout)
+            if (attribute.divisor == 0)
+                binding.fullBytesPerVertex += attributeSize(attribute);
+
+        glBindVertexArray(0);
+        bindings[key] = binding;
+        byVAO[binding.vao] = binding;
+        return binding.vao;
+    }
+
+    // account one draw of `vertexCount` vertices made with a VAO from get()
+    void countDraw(unsigned int vao, size_t vertexCount, size_t instances = 1)
+    {
+        auto it = byVAO.find(vao);
+        if (it == byVAO.end())
+            return;
+        stats.draws++;
+        stats.attributeBytes += it->second.bytesPerVertex * vertexCount * instances;
+        stats.fullLayoutBytes += it->second.fullBytesPerVertex * vertexCount * instances;
+    }
+
+    // points the per-instance attributes of a VAO at `byteOffset` into their buffer, for
+    // drawing a sub-range of instances without base-instance support. The VAO must be bound.
+    void rebaseInstances(unsigned int vao, size_t byteOffset)
+    {
+        auto it = byVAO.find(vao);
+        if (it == byVAO.end() || it->second.instanced.empty())
+            return;
+        for (const InstancedAttribute &attribute : it->second.instanced)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+            if (attribute.type == GL_FLOAT)
+                glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE, attribute.stride, (void*)(attribute.offset + byteOffset));
+            else
+                glVertexAttribIPointer(attribute.location, attribute.components, attribute.type, attribute.stride, (void*)(attribute.offset + byteOffset));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // forget every VAO made for this program (call before deleting or relinking it)
+    void release(const Shader &shader)
+    {
+        for (auto it = bindings.begin(); it != bindings.end();)
+        {
+            if (it->first.program == shader.ID)
+            {
+                byVAO.erase(it->second.vao);
+                glDeleteVertexArrays(1, &it->second.vao);
+                it = bindings.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    // per-frame numbers; last() holds the previous complete frame for display
+    void beginFrame()
+    {
+        previous = stats;
+        stats = Stats();
+        stats.mismatches = (int)reported.size();
+    }
+    const Stats& last() const { return previous; }
+
+private:
+    struct InstancedAttribute
+    {
+        GLuint location;
+        GLint components;
+        GLenum type;
+        GLsizei stride;
+        size_t offset;
+        unsigned int buffer;
+    };
+    struct Binding
+    {
+        unsigned int vao = 0;
+        size_t bytesPerVertex = 0;
+        size_t fullBytesPerVertex = 0;
+        std::vector<InstancedAttribute> instanced;
+    };
+    // program and the exact buffers, so one mesh can pair with several instance buffers
+    struct Key
+    {
+        unsigned int program;
+        Streams buffers;
+
+        bool operator<(const Key &other) const
+        {
+            return program != other.program ? program < other.program : buffers < other.buffers;
+        }
+    };
+    std::map<Key, Binding> bindings;
+    std::map<unsigned int, Binding> byVAO;
+    std::set<std::string> reported;
+    Stats stats, previous;
+
+    static size_t attributeSize(const VertexAttribute &attribute)
+    {
+        return attribute.components * 4;
+    }
+
+    // splits a GLSL attribute type into components per column, number of columns and int-ness
+    static void describe(GLenum type, GLint &components, GLint &columns, bool &integer)
+    {
+        columns = 1;
+        integer = false;
+        switch (type)
+        {
+            case GL_FLOAT:        components = 1; break;
+            case GL_FLOAT_VEC2:   components = 2; break;
+            case GL_FLOAT_VEC3:   components = 3; break;
+            case GL_FLOAT_VEC4:   components = 4; break;
+            case GL_INT:          components = 1; integer = true; break;
+            case GL_INT_VEC2:     components = 2; integer = true; break;
+            case GL_INT_VEC3:     components = 3; integer = true; break;
+            case GL_INT_VEC4:     components = 4; integer = true; break;
+            case GL_UNSIGNED_INT: components = 1; integer = true; break;
+            case GL_FLOAT_MAT3:   components = 3; columns = 3; break;
+            case GL_FLOAT_MAT4:   components = 4; columns = 4; break;
+            default:              components = 4; break;
+        }
+    }
+
+    // layout problems are printed once per program/mesh/message
+    void report(const Shader &shader, const std::string &meshName, const std::string &message)
+    {
+        std::string line = shader.name + " x " + meshName + ": " + message;
+        if (reported.insert(line).second)
+            std::cout << "WARNING::VERTEX_BINDING:: " << line << std::endl;
+    }
+};
+
+inline VertexBindingCache vertexBindings;
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef WEIGHTED_OIT_H
+#define WEIGHTED_OIT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "imgui.h"
+
+#include <shader.h>
+#include <gl_extensions.h>
+
+#include <functional>
+#include <iostream>
+#include <algorithm>
+
+// Weighted blended order-independent transparency (McGuire and Bavoil 2013) for the glass.
+// Every transparent fragment is added into two targets, whatever order it comes in:
+//   accumulation  RGBA16F  sum of (colour * alpha, alpha) * weight, weight falling off with depth
+//   revealage     R8       product of (1 - alpha), how much of the opaque scene shows through
+// and one full screen pass blends their weighted average over the scene. Nothing is sorted,
+// intersecting surfaces are fine and any number of layers costs the same two passes.
+//
+// The transparent draws test against the scene's depth but mustn't write it, and the targets
+// are our own, so the depth is blitted into a buffer of ours first (same format as the
+// scene's, blits don't convert). Like the other passes the targets keep some headroom and
+// only the lower left corner is used.
+//
+// Without glBlendFunci (GL 3.3 contexts) both targets share one blend function; then the
+// revealage goes into accumulation.a and the sum of alpha * weight into a R16F second target.
+//
+// Per frame:  accumulate(drawTransparent) with the scene bound, after the opaque draws;
+//             composite() into the final image, the same size as the scene
+class WeightedBlendedOIT
+{
+public:
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    bool enabled = true;
+    float opacity = 0.5f;       // of every glass surface
+
+    struct Stats
+    {
+        int draws = 0;              // of the transparent queue, last frame
+        float accumulateMs = 0.0f;  // GPU, smoothed: depth copy and transparent draws
+        float compositeMs = 0.0f;
+    };
+
+    // draws every transparent object and returns the draw count; targets, blending and depth
+    // state are set up
+    using DrawTransparent = std::function<int()>;
+
+    WeightedBlendedOIT() : compositeShader("shaders/fullscreen.vert", "shaders/oit_composite.frag")
+    {
+        glGenVertexArrays(1, &emptyVAO);
+        glGenFramebuffers(1, &oitFBO);
+        glGenQueries(FRAMES_IN_FLIGHT * 4, &queries[0][0]);
+    }
+
+    ~WeightedBlendedOIT()
+    {
+        release();
+        glDeleteQueries(FRAMES_IN_FLIGHT * 4, &queries[0][0]);
+        glDeleteFramebuffers(1, &oitFBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    WeightedBlendedOIT(const WeightedBlendedOIT&) = delete;
+    WeightedBlendedOIT& operator=(const WeightedBlendedOIT&) = delete;
+
+    bool packedRevealage() const { return !glExt.drawBufferBlend; }
+
+    // for the OIT variant of object.frag
+    void setUniforms(Shader &program) const
+    {
+        program.setFloat("glassOpacity", opacity);
+        program.setBool("packedRevealage", packedRevealage());
+    }
+
+    void accumulate(const DrawTransparent &drawTransparent)
+    {
+        readTimings();
+        active = enabled;
+        if (!active)
+            return;
+        GLuint* frameQueries = queries[slot];
+        glQueryCounter(frameQueries[0], GL_TIMESTAMP);
+
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        targetFBO = (GLuint)framebuffer;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        int w = std::max(1, (int)viewport[2]), h = std::max(1, (int)viewport[3]);
+        reserve(w, h);
+
+        // the scene's depth, to test against
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, targetFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oitFBO);
+        glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + w, viewport[1] + h, 0, 0, w, h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, oitFBO);
+        glViewport(0, 0, w, h);
+        bool packed = packedRevealage();
+        const GLfloat accumulationClear[4] = { 0.0f, 0.0f, 0.0f, packed ? 1.0f : 0.0f };
+        const GLfloat revealageClear[4] = { packed ? 0.0f : 1.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, accumulationClear);
+        glClearBufferfv(GL_COLOR, 1, revealageClear);
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean blending = glIsEnabled(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        if (packed)
+            glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+        else
+        {
+            glBlendFunci(0, GL_ONE, GL_ONE);
+            glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+        }
+        stats.draws = drawTransparent();
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        if (!blending)
+            glDisable(GL_BLEND);
+        if (!depthTest)
+            glDisable(GL_DEPTH_TEST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glQueryCounter(frameQueries[1], GL_TIMESTAMP);
+    }
+
+    // over whatever is bound now, at its viewport
+    void composite()
+    {
+        if (!active)
+            return;
+        glQueryCounter(queries[slot][2], GL_TIMESTAMP);
+        GLint outputViewport[4];
+        glGetIntegerv(GL_VIEWPORT, outputViewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean blending = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+        glBindVertexArray(emptyVAO);
+        compositeShader.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumulationTexture);
+        compositeShader.setInt("accumulation", 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, revealageTexture);
+        compositeShader.setInt("revealage", 1);
+        compositeShader.setIVec2("viewportOrigin", outputViewport[0], outputViewport[1]);
+        compositeShader.setBool("packedRevealage", packedRevealage());
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        if (!blending)
+            glDisable(GL_BLEND);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+
+        glQueryCounter(queries[slot][3], GL_TIMESTAMP);
+        pending[slot] = true;
+        slot = (slot + 1) % FRAMES_IN_FLIGHT;
+    }
+
+    const Stats& last() const { return stats; }
+
+    void drawUI()
+    {
+        ImGui::Checkbox("Order-independent transparency", &enabled);
+        if (!enabled)
+            return;
+        ImGui::SliderFloat("Glass opacity", &opacity, 0.05f, 1.0f);
+        ImGui::Text("  %d transparent draws, accumulate %.3f ms, composite %.3f ms%s", stats.draws, stats.accumulateMs,
+                    stats.compositeMs, packedRevealage() ? " (packed revealage)" : "");
+    }
+
+private:
+    Shader compositeShader;
+    unsigned int emptyVAO = 0, oitFBO = 0;
+    unsigned int accumulationTexture = 0, revealageTexture = 0, depthRBO = 0;
+    int capacityWidth = 0, capacityHeight = 0;
+    GLenum depthFormat = GL_NONE;
+    bool active = false;
+    GLuint targetFBO = 0;
+    GLint viewport[4] = { 0, 0, 0, 0 };
+    Stats stats;
+
+    GLuint queries[FRAMES_IN_FLIGHT][4] = {};     // accumulate begin, end, composite begin, end
+    bool pending[FRAMES_IN_FLIGHT] = {};
+    int slot = 0;
+
+    static unsigned int createTexture(GLint internalFormat, int w, int h, GLenum format, GLenum type)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    // the depth format of the bound draw framebuffer, which the copy has to match
+    GLenum targetDepthFormat(bool &stencil) const
+    {
+        GLint depthBits = 24, stencilBits = 0, depthType = GL_UNSIGNED_NORMALIZED, stencilType = GL_NONE;
+        GLenum depthAttachment = targetFBO == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+        GLenum stencilAttachment = targetFBO == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+        glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+        glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &depthType);
+        glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &stencilType);
+        if (stencilType != GL_NONE)
+            glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+        stencil = stencilBits > 0;
+        if (stencil)
+            return depthType == GL_FLOAT ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+        return depthType == GL_FLOAT ? GL_DEPTH_COMPONENT32F : (depthBits > 24 ? GL_DEPTH_COMPONENT32 : GL_DEPTH_COMPONENT24);
+    }
+
+    // grows with a quarter of headroom, shrinks only when less than half is used; follows
+    // the target's depth format
+    void reserve(int w, int h)
+    {
+        bool stencil = false;
+        GLenum format = targetDepthFormat(stencil);
+        bool fits = w <= capacityWidth && h <= capacityHeight;
+        bool wasteful = w * 2 < capacityWidth && h * 2 < capacityHeight;
+        if (fits && !wasteful && format == depthFormat)
+            return;
+        release();
+        capacityWidth = w + w / 4;
+        capacityHeight = h + h / 4;
+        depthFormat = format;
+
+        accumulationTexture = createTexture(GL_RGBA16F, capacityWidth, capacityHeight, GL_RGBA, GL_FLOAT);
+        // the packed layout sums weights in here, which needs range
+        revealageTexture = packedRevealage() ? createTexture(GL_R16F, capacityWidth, capacityHeight, GL_RED, GL_FLOAT)
+                                             : createTexture(GL_R8, capacityWidth, capacityHeight, GL_RED, GL_UNSIGNED_BYTE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, capacityWidth, capacityHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, oitFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulationTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealageTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OIT::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    }
+
+    void release()
+    {
+        if (!accumulationTexture)
+            return;
+        unsigned int textures[] = { accumulationTexture, revealageTexture };
+        glDeleteTextures(2, textures);
+        glDeleteRenderbuffers(1, &depthRBO);
+        accumulationTexture = revealageTexture = depthRBO = 0;
+        capacityWidth = capacityHeight = 0;
+    }
+
+    static float smooth(float smoothed, GLuint64 ns)
+    {
+        float ms = (float)(ns / 1e6);
+        return smoothed == 0.0f ? ms : glm::mix(smoothed, ms, 0.1f);
+    }
+
+    // oldest first, stops at the first frame the GPU hasn't finished
+    void readTimings()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            int oldest = (slot + i) % FRAMES_IN_FLIGHT;
+            if (!pending[oldest])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[oldest][3], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 stamps[4];
+            for (int q = 0; q < 4; q++)
+                glGetQueryObjectui64v(queries[oldest][q], GL_QUERY_RESULT, &stamps[q]);
+            pending[oldest] = false;
+            stats.accumulateMs = smooth(stats.accumulateMs, stamps[1] - stamps[0]);
+            stats.compositeMs = smooth(stats.compositeMs, stamps[3] - stamps[2]);
+        }
+    }
+};
+
+#endif
@@ -14,10 +14,40 @@
 #include "headers/camera.h"
 #include "headers/shader.h"
 #include "headers/model.h" 
+#include "headers/gl_extensions.h"
+#include "headers/shader_queue.h"
+#include "headers/scene.h"
+#include "headers/render_queue.h"
+#include "headers/culling.h"
+#include "headers/thread_pool.h"
+#include "headers/occlusion.h"
+#include "headers/gpu_occlusion.h"
+#include "headers/ring_buffer.h"
+#include "headers/profiler.h"
+#include "headers/gl_capture.h"
+#include "headers/benchmark.h"
+#include "headers/camera_path.h"
+#include "headers/dynamic_resolution.h"
+#include "headers/reflection_probes.h"
+#include "headers/screen_space_reflections.h"
+#include "headers/depth_prepass.h"
+#include "headers/cascaded_shadows.h"
+#include "headers/anti_aliasing.h"
+#include "headers/fresnel_lut.h"
+#include "headers/weighted_oit.h"
+#include "headers/spectral_dispersion.h"
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <atomic>
 
 // Settings
 const unsigned int SCR_WIDTH  = 1500;
@@ -28,6 +58,9 @@ Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = (float)SCR_WIDTH  / 2.0f;
 float lastY = (float)SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+// --record logs every camera input, --play drives the camera from such a log
+CameraRecorder cameraRecorder;
+CameraPlayer cameraPlayer;
 
 // Timing
 float deltaTime = 0.0f;
@@ -38,6 +71,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+void resizeStressEntities(Scene& scene, int firstStressEntity, int count, int renderable, const Bounds& bounds);
 unsigned int loadCubemap(const std::vector<std::string>& faces);
 unsigned int loadTexture(char const * path);
 
@@ -46,23 +80,82 @@ int renderMode = 0;
 float uiIOR = 1.52f; // Using Glass Index of Refraction 
 float uiChromaticDispersion = 0.01f;
 float uiReflectivity = 0.5f;
+float uiRoughness = 0.0f; // picks blurrier mip levels of the reflection probes
 bool rotateModels = true;
+bool useInstancing = true;
+int stressEntities = 0; // extra animated entities, to measure the transform and culling passes
+bool drawStressEntities = false;
+bool glassStressEntities = false; // stress entities as Fresnel glass, for the transparency path
+bool useFrustumCulling = true;
+// occlusion culling, worth it for dense scenes only
+enum OcclusionMode { OCCLUSION_OFF = 0, OCCLUSION_SOFTWARE = 1, OCCLUSION_GPU_QUERIES = 2 };
+int occlusionMode = OCCLUSION_OFF;
+int workerThreads = 0; // threads for culling and draw list building, 0: every thread of the pool
+// the floor the sun shadows fall on, below the objects
+const float GROUND_HEIGHT = -1.0f;
+const float GROUND_SIZE = 60.0f;
+const int SHADOW_TEXTURE_UNIT = 5;
+const int FRESNEL_TEXTURE_UNIT = 6;
+// entities that haven't moved for this many frames count as static shadow casters
+const int STATIC_AFTER_FRAMES = 30;
 
 
 bool isGuiMode = false; 
-int main()
+int main(int argc, char** argv)
 {
+    // --capture file [--capture-frames N]: record the GL calls of the first N frames for GLReplay
+    // --record file / --play file [--play-spline]: camera input log, replayed on a fixed time step
+    std::string capturePath, recordPath, playPath;
+    int captureFrames = 100;
+    bool playSpline = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--capture" && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (arg == "--capture-frames" && i + 1 < argc)
+            captureFrames = std::max(2, std::atoi(argv[++i]));
+        else if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--play" && i + 1 < argc)
+            playPath = argv[++i];
+        else if (arg == "--play-spline")
+            playSpline = true;
+    }
+    if (!playPath.empty() && !cameraPlayer.load(playPath, playSpline))
+        return -1;
+    if (!recordPath.empty())
+        cameraRecorder.start(recordPath, camera);
+    // --bench [--bench-size WxH --bench-warmup N --bench-frames M --bench-out name --software]
+    BenchmarkSettings benchSettings = BenchmarkSettings::fromArguments(argc, argv);
+    // a recording is measured from start to end unless told otherwise
+    if (cameraPlayer.active() && !benchSettings.measuredFramesGiven)
+        benchSettings.measuredFrames = (int)std::ceil(cameraPlayer.duration() / Benchmark::TIME_STEP) + 1;
+
+    benchSettings.initHints();
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint( GLFW_RESIZABLE, GL_TRUE );
-    
+
+    // newest core context first (multi-draw indirect needs 4.3), 3.3 is the baseline
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    const int contextVersions[][2] = { { 4, 1 }, { 3, 3 } };
+#else
+    const int contextVersions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 3 }, { 3, 3 } };
 #endif
-
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Reflection, Refraction, Fresnel", nullptr, nullptr);
+    GLFWwindow* window = nullptr;
+    for (const auto& version : contextVersions)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint( GLFW_RESIZABLE, GL_TRUE );
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        benchSettings.windowHints();
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Reflection, Refraction, Fresnel", nullptr, nullptr);
+        if (window)
+            break;
+    }
     if (!window) { glfwTerminate(); return -1; }
     glfwMakeContextCurrent(window);
 
@@ -72,6 +165,15 @@ int main()
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) return -1;
+    glExt.load();
+    if (!capturePath.empty())
+    {
+        // writes through a persistent mapping are invisible to the capture, the ring orphans instead
+        glExt.bufferStorage = false;
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glCapture.start(capturePath, captureFrames, framebufferWidth, framebufferHeight);
+    }
 
     float xscale, yscale;
     glfwGetWindowContentScale(window, &xscale, &yscale);
@@ -90,14 +192,146 @@ int main()
     glEnable(GL_DEPTH_TEST);
 
     // Shaders
-    Shader skyboxShader("shaders/skybox.vert", "shaders/skybox.frag");
-    Shader objectShader("shaders/object.vert", "shaders/object.frag");
+    // The fallback is tiny and compiled right away, everything else goes through the
+    // compile queue so the driver works on it while the models are loading.
+    Shader fallbackShader("shaders/fallback.vert", "shaders/fallback.frag");
+    Shader fallbackInstancedShader("shaders/fallback.vert", "shaders/fallback.frag", { "INSTANCED" }, false);
+    Shader depthShader("shaders/depth.vert", "shaders/depth.frag");
+    Shader depthInstancedShader("shaders/depth.vert", "shaders/depth.frag", { "INSTANCED" }, false);
+    Shader skyboxShader("shaders/skybox.vert", "shaders/skybox.frag", {}, true);
+    Shader objectShader("shaders/object.vert", "shaders/object.frag", {}, true);
+    Shader objectInstancedShader("shaders/object.vert", "shaders/object.frag", { "INSTANCED" }, true);
+    // Fresnel from a lookup table instead of pow(), see fresnel_lut.h
+    Shader objectLutShader("shaders/object.vert", "shaders/object.frag", { "FRESNEL_LUT" }, true);
+    Shader objectInstancedLutShader("shaders/object.vert", "shaders/object.frag", { "INSTANCED", "FRESNEL_LUT" }, true);
+    // glass into the order-independent transparency targets, see weighted_oit.h
+    Shader objectOitShader("shaders/object.vert", "shaders/object.frag", { "OIT" }, true);
+    Shader objectInstancedOitShader("shaders/object.vert", "shaders/object.frag", { "INSTANCED", "OIT" }, true);
+    Shader objectLutOitShader("shaders/object.vert", "shaders/object.frag", { "FRESNEL_LUT", "OIT" }, true);
+    Shader objectInstancedLutOitShader("shaders/object.vert", "shaders/object.frag", { "INSTANCED", "FRESNEL_LUT", "OIT" }, true);
+    Shader groundShader("shaders/object.vert", "shaders/object.frag", { "GROUND" }, true);
+    Shader velocityShader("shaders/velocity.vert", "shaders/velocity.frag");
+
+    ShaderCompileQueue shaderQueue(fallbackShader);
+    shaderQueue.add(skyboxShader);
+    shaderQueue.add(objectShader);
+    shaderQueue.add(objectInstancedShader, &fallbackInstancedShader);
+    shaderQueue.add(objectLutShader);
+    shaderQueue.add(objectInstancedLutShader, &fallbackInstancedShader);
+    shaderQueue.add(objectOitShader);
+    shaderQueue.add(objectInstancedOitShader, &fallbackInstancedShader);
+    shaderQueue.add(objectLutOitShader);
+    shaderQueue.add(objectInstancedLutOitShader, &fallbackInstancedShader);
+    shaderQueue.add(groundShader);
+    shaderQueue.submitAll(window);
 
     // Load Model 
     Model myModel1("assets/teapot/moraccan_teapot.obj");
     Model myModel2("assets/ring/Torus.obj");
     Model myModel3("assets/sphere/sphere.obj");
 
+    // Scene: every object orbits the origin, so they hang off one spinning pivot
+    Scene scene;
+    int pivot = scene.create(glm::vec3(0.0f));
+    scene.setSpin(pivot, glm::vec3(0.0f, 1.0f, 0.0f), 0.4f);
+    int reflectSphere   = scene.create(glm::vec3( 1.5f, 1.0f, 0.0f), glm::vec3(0.1f),  pivot);
+    int refractRing     = scene.create(glm::vec3( 0.5f, 1.0f, 0.0f), glm::vec3(0.25f), pivot);
+    int chromaticRing   = scene.create(glm::vec3(-1.5f, 1.0f, 0.0f), glm::vec3(0.25f), pivot);
+    int fresnelSphere   = scene.create(glm::vec3(-3.0f, 1.0f, 0.0f), glm::vec3(0.1f),  pivot);
+    int firstStressEntity = scene.size();
+
+    // Low-poly occluder for the sphere, slightly inside it. The ring has too little solid
+    // area to hide anything, so it only gets tested.
+    OccluderMesh sphereOccluder = OccluderMesh::sphere(myModel3.bounds.center, myModel3.bounds.radius * 0.95f);
+
+    // What an entity draws as: a model with one of the effects, and the reflection probe it
+    // samples (-1: just the skybox). Stress entities are plain reflective spheres.
+    struct Renderable { Model* model; int effectType; const OccluderMesh* occluder; int probe; };
+    const Renderable renderables[] = {
+        { &myModel3, 0, &sphereOccluder, 0 },    // 1. REFLECTION ONLY (Sphere)
+        { &myModel2, 1, nullptr, 1 },            // 2. REFRACTION ONLY (Ring Donut thing)
+        { &myModel2, 2, nullptr, 2 },            // 3. CHROMATIC DIFFUSION (Ring Donut thing)
+        { &myModel3, 3, &sphereOccluder, 3 },    // 4. FRESNEL (Sphere again)
+        { &myModel3, 0, &sphereOccluder, -1 },   // stress entities
+    };
+    const int stressRenderable = 4;
+    // the effect an entity is drawn with this frame
+    auto effectOf = [&](int entity) -> int
+    {
+        return entity >= firstStressEntity && glassStressEntities ? 3 : renderables[scene.renderable[entity]].effectType;
+    };
+    const int objectEntities[] = { reflectSphere, refractRing, chromaticRing, fresnelSphere };
+    for (int i = 0; i < 4; i++)
+    {
+        const Bounds& bounds = renderables[i].model->bounds;
+        scene.setRenderable(objectEntities[i], i, bounds.center, bounds.radius);
+    }
+
+    ThreadPool threadPool;
+    // one draw list per thread recording into a render queue, no more than a queue holds;
+    // also the thread limit of those parallelFor calls, so every worker index has its list
+    auto drawListCount = [&]() -> int
+    {
+        int threads = workerThreads > 0 ? std::min(workerThreads, threadPool.threads()) : threadPool.threads();
+        return std::min(threads, RenderQueue::MAX_LISTS);
+    };
+    FrustumCuller culler;
+    SoftwareOcclusion occlusion;
+    OcclusionQueries occlusionQueries;
+    std::vector<int> visibleEntities;
+    std::vector<OccluderInstance> occluders;
+    std::vector<unsigned int> drawConditions;
+    double drawListMs = 0.0;
+
+    // camera block, instance data and indirect commands of a frame all go through one buffer
+    FrameRingBuffer frameRing;
+    Profiler profiler;
+    // the glass shaders are fill rate bound, the scene resolution follows a GPU time budget
+    DynamicResolution dynamicResolution;
+    // one probe per glass object, so they show each other instead of only the skybox
+    ReflectionProbes reflectionProbes(4);
+    // what the probes miss on screen, at half resolution with temporal reuse
+    ScreenSpaceReflections screenSpaceReflections;
+    RenderQueue renderQueue;
+    renderQueue.ring = &frameRing;
+    // objects whose shading is worth more than drawing them twice get their depth first
+    DepthPrepass depthPrepass;
+    // sun shadows; casters go through their own queue, depth only
+    CascadedShadows cascadedShadows;
+    RenderQueue shadowQueue;
+    shadowQueue.ring = &frameRing;
+    // FXAA, MSAA or TAA; TAA's motion vectors come from a velocity pass with its own queue
+    AntiAliasing antiAliasing;
+    RenderQueue velocityQueue;
+    velocityQueue.ring = &frameRing;
+    // baked on the first run, read from the cache after that
+    FresnelLUT fresnelLUT("fresnel_lut.bin");
+    // the glass blended in any order; its draws have their own queue that leaves depth alone
+    WeightedBlendedOIT oit;
+    // the chromatic glass traced at a few wavelengths per frame, TAA averages them over time
+    SpectralDispersion spectralDispersion;
+    // the chromatic glass on its own, so its timestamps hold nothing else; opaque or blended
+    // like the rest of the glass, see the transparency pass
+    RenderQueue chromaticQueue;
+    chromaticQueue.ring = &frameRing;
+    RenderQueue transparentQueue;
+    transparentQueue.ring = &frameRing;
+    transparentQueue.depthWrites = false;
+    // frames each entity has kept still, see STATIC_AFTER_FRAMES
+    std::vector<int> stillFrames;
+
+    // Ground: one quad, only a shadow receiver
+    std::vector<Vertex> groundVertices(4);
+    for (int i = 0; i < 4; i++)
+    {
+        Vertex vertex{};
+        vertex.Position = glm::vec3((i & 1 ? 0.5f : -0.5f) * GROUND_SIZE, GROUND_HEIGHT, (i & 2 ? 0.5f : -0.5f) * GROUND_SIZE);
+        vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        vertex.TexCoords = glm::vec2(i & 1 ? 1.0f : 0.0f, i & 2 ? 1.0f : 0.0f);
+        groundVertices[i] = vertex;
+    }
+    Mesh groundMesh(groundVertices, { 0, 2, 1, 1, 2, 3 }, {});
+
     // Skybox Geometry
     float skyboxVertices[] = {
         -1.0f,  1.0f, -1.0f, -1.0f, -1.0f, -1.0f,  1.0f, -1.0f, -1.0f,
@@ -129,26 +363,120 @@ int main()
         "assets/skybox/front.jpg", "assets/skybox/back.jpg"
     };
     unsigned int cubemapTexture = loadCubemap(faces);
-    
-    skyboxShader.use();
-    skyboxShader.setInt("skybox", 0);
 
+    // nothing sensible to fall back to here, the clear color stands in until it's compiled
+    auto drawSkybox = [&](const glm::mat4& view, const glm::mat4& projection)
+    {
+        if (!shaderQueue.isReady(skyboxShader))
+            return;
+        skyboxShader.use();
+
+        glm::mat4 skyboxModel = glm::mat4(1.0f);
+        skyboxModel = glm::scale(skyboxModel, glm::vec3(50.0f));
+
+        skyboxShader.setMat4("model", skyboxModel);
+        skyboxShader.setMat4("view", glm::mat4(glm::mat3(view)));
+        skyboxShader.setMat4("projection", projection);
+
+        glBindVertexArray(skyboxVAO);
+        glUniform1i(glGetUniformLocation(skyboxShader.ID, "skybox"), 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glBindVertexArray(0);
+    };
+
+    // what the object programs reflect: the probe once all its faces exist, else the skybox
+    auto bindEnvironment = [&](Shader& program, int probe)
+    {
+        bool useProbe = probe >= 0 && reflectionProbes.ready(probe);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, useProbe ? reflectionProbes.texture(probe) : cubemapTexture);
+        program.setFloat("environmentMaxLod", useProbe ? (float)reflectionProbes.maxLevel() : 0.0f);
+    };
+    auto setMaterialUniforms = [&](Shader& program)
+    {
+        program.setInt("environment", 0);
+        program.setFloat("ior", uiIOR);
+        program.setFloat("dispersion", uiChromaticDispersion);
+        program.setFloat("reflectivity", uiReflectivity);
+        program.setFloat("roughness", uiRoughness);
+        program.setVec3("sunDirection", cascadedShadows.sunDirection());
+        program.setVec3("sunColor", glm::vec3(1.0f, 0.95f, 0.85f));
+        cascadedShadows.bind(program, SHADOW_TEXTURE_UNIT);
+        fresnelLUT.bind(program, FRESNEL_TEXTURE_UNIT);
+        spectralDispersion.setUniforms(program);
+    };
+    // with whichever Camera block is bound; nothing until its program is compiled
+    auto drawGround = [&]()
+    {
+        if (!shaderQueue.isReady(groundShader))
+            return;
+        groundShader.use();
+        setMaterialUniforms(groundShader);
+        bindEnvironment(groundShader, -1);
+        groundShader.setMat4("model", glm::mat4(1.0f));
+        groundShader.setMat3("normalMatrix", glm::mat3(1.0f));
+        groundMesh.Draw(groundShader);
+    };
 
-    objectShader.setInt("skybox", 0);
+    // benchmark: offscreen, no vsync, fixed time step, and only once every program is ready so
+    // compile hitches never show up in the numbers
+    std::unique_ptr<Benchmark> benchmark;
+    long playedFrames = 0;
+    if (benchSettings.enabled)
+    {
+        glfwSwapInterval(0);
+        while (shaderQueue.pending() > 0)
+        {
+            shaderQueue.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        benchmark.reset(new Benchmark(benchSettings));
+        // same pixels every run
+        dynamicResolution.enabled = false;
+    }
     
     while (!glfwWindowShouldClose(window))
     {
         glfwPollEvents();
+        profiler.beginFrame();
+        profiler.begin("UI");
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        // fixed time step whenever the run has to be reproducible
         float currentFrame = (float)glfwGetTime();
+        if (benchmark)
+            currentFrame = benchmark->time();
+        else if (cameraPlayer.active())
+            currentFrame = playedFrames++ * CameraPlayer::TIME_STEP;
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        cameraRecorder.beginFrame(currentFrame);
+
+        if (cameraPlayer.active())
+        {
+            // the recording starts with the measured frames, warm-up holds the first pose
+            bool playing = cameraPlayer.update(camera, benchmark ? benchmark->measuredTime() : currentFrame);
+            if ((!playing && !benchmark) || glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+                glfwSetWindowShouldClose(window, true);
+        }
+        else if (benchmark)
+        {
+            // fixed path around the objects instead of the user's camera
+            camera.Position = benchmark->cameraPosition(glm::vec3(0.0f, 1.0f, 0.0f), 6.0f, 1.0f);
+            camera.LookAt(glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+        else
+            processInput(window);
+        cameraRecorder.endFrame(camera);
 
-        processInput(window);
+        shaderQueue.update();
+        vertexBindings.beginFrame();
+        frameRing.beginFrame();
 
         ImGui::SetNextWindowSize(ImVec2(600 * xscale, 800 * yscale), ImGuiCond_FirstUseEver);       
         ImGui::Begin("Glass Material Properties");
@@ -165,152 +493,526 @@ int main()
         ImGui::SliderFloat("Index of Refraction", &uiIOR, 1.0f, 2.5f);
         ImGui::SliderFloat("Chromatic Dispersion Slider", &uiChromaticDispersion, 0.0f, 1.0f);
         ImGui::SliderFloat("Reflectivity", &uiReflectivity, 0.0f, 1.0f);
+        ImGui::SliderFloat("Roughness", &uiRoughness, 0.0f, 1.0f);
         ImGui::Separator();
 
 
         ImGui::Checkbox("Rotate Models", &rotateModels);
+        ImGui::Checkbox("Hardware instancing", &useInstancing);
+        if (glExt.multiDrawIndirect)
+            ImGui::Checkbox("Multi-draw indirect", &renderQueue.multiDrawIndirect);
+        else
+            ImGui::TextDisabled("Multi-draw indirect: needs GL 4.3 (context is %d.%d)", glExt.major, glExt.minor);
+        ImGui::SliderInt("Stress entities", &stressEntities, 0, 1000000);
+        ImGui::Checkbox("Draw stress entities", &drawStressEntities);
+        ImGui::Checkbox("Glass stress entities", &glassStressEntities);
+        ImGui::Text("Scene update: %d entities, %d updated, %.3f ms", scene.size(), scene.updatedCount, scene.updateMs);
+        ImGui::Checkbox("Frustum culling", &useFrustumCulling);
+        ImGui::SliderInt("Worker threads (0 = all)", &workerThreads, 0, threadPool.threads());
+        if (useFrustumCulling)
+        {
+            const FrustumCuller::Stats& cull = culler.last();
+            ImGui::Text("Culling: %d/%d visible, %.3f ms on %d thread(s), %s", cull.visible, cull.tested, cull.ms,
+                        cull.threads, cull.avx2 ? "AVX2" : "4-wide");
+        }
+        ImGui::Text("Occlusion culling:");
+        ImGui::RadioButton("Off", &occlusionMode, OCCLUSION_OFF); ImGui::SameLine();
+        ImGui::RadioButton("Software HiZ", &occlusionMode, OCCLUSION_SOFTWARE); ImGui::SameLine();
+        ImGui::RadioButton("GPU queries", &occlusionMode, OCCLUSION_GPU_QUERIES);
+        if (occlusionMode == OCCLUSION_SOFTWARE)
+        {
+            const SoftwareOcclusion::Stats& occ = occlusion.last();
+            ImGui::Text("Occlusion: %d/%d culled (%.1f%%), %d occluders, %d triangles", occ.culled, occ.tested,
+                        occ.tested > 0 ? 100.0f * occ.culled / occ.tested : 0.0f, occ.occluders, occ.triangles);
+            ImGui::Text("  raster %.3f ms, HiZ %.3f ms, test %.3f ms", occ.rasterMs, occ.hizMs, occ.testMs);
+        }
+        else if (occlusionMode == OCCLUSION_GPU_QUERIES)
+        {
+            const OcclusionQueries::Stats& occ = occlusionQueries.last();
+            ImGui::Text("Queries: %d/%d hidden (%.1f%%), %d conditional, %d issued (%s)", occ.hidden, occ.tested,
+                        occ.tested > 0 ? 100.0f * occ.hidden / occ.tested : 0.0f, occ.conditional, occ.issued,
+                        occlusionQueries.conservative() ? "conservative" : "exact");
+            ImGui::Text("  result latency %.2f frames average, %d max", occ.averageLatency, occ.maxLatency);
+        }
         ImGui::Separator();
 
+        if (cameraPlayer.active())
+            ImGui::Text("Camera path: %.1f / %.1f s (%s)", currentFrame, cameraPlayer.duration(),
+                        cameraPlayer.playbackMode() == CameraPlayer::INPUT ? "input replay" : "spline");
+        else if (cameraRecorder.recording())
+            ImGui::Text("Recording camera: %.1f s", currentFrame);
+        if (shaderQueue.pending() > 0)
+            ImGui::Text("Compiling shaders: %d/%d ready (%s)", shaderQueue.size() - shaderQueue.pending(), shaderQueue.size(),
+                        shaderQueue.usesParallelExtension() ? "KHR_parallel_shader_compile" : "worker thread");
+        else
+            ImGui::Text("Shaders ready after %.1f ms (%s)", shaderQueue.compileMs(),
+                        shaderQueue.usesParallelExtension() ? "KHR_parallel_shader_compile" : "worker thread");
+
+        const VertexBindingCache::Stats& fetch = vertexBindings.last();
+        ImGui::Text("Vertex fetch: %d draws, %.1f KB (%.1f KB with all attributes)", fetch.draws,
+                    fetch.attributeBytes / 1024.0, fetch.fullLayoutBytes / 1024.0);
+        if (fetch.draws > 0)
+            ImGui::Text("  %.1f KB per draw", fetch.attributeBytes / 1024.0 / fetch.draws);
+        if (fetch.mismatches > 0)
+            ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "  %d vertex layout mismatches (see console)", fetch.mismatches);
+
+        const RenderQueue::Stats& queue = renderQueue.last();
+        ImGui::Text("Draw lists: built in %.3f ms", drawListMs);
+        ImGui::Text("Render queue: %d packets -> %d draws, sort %.3f ms (%d passes), submit %.3f ms",
+                    queue.packets, queue.draws, queue.sortMs, queue.sortPasses, queue.submitMs);
+        if (queue.depthPackets > 0)
+            ImGui::Text("  %d of the packets depth only (prepass)", queue.depthPackets);
+        ImGui::Text("  state changes: %d programs, %d materials, %d vertex arrays",
+                    queue.programChanges, queue.materialChanges, queue.vertexArrayChanges);
+        if (queue.multiDraws > 0)
+            ImGui::Text("  %d multi-draw calls for %d indirect commands", queue.multiDraws, queue.indirectCommands);
+
+        const FrameRingBuffer::Stats& ring = frameRing.last();
+        ImGui::Text("Frame ring buffer: %s, %.1f/%.0f MB used, %d allocations", ring.persistent ? "persistent mapped" : "orphaned",
+                    ring.used / (1024.0 * 1024.0), ring.segmentSize / (1024.0 * 1024.0), ring.allocations);
+        ImGui::Text("  fence stalls: %d this frame (%.3f ms), %ld total", ring.stalls, ring.stallMs, ring.totalStalls);
+        if (ring.failed > 0)
+            ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "  %d allocations did not fit%s", ring.failed,
+                               queue.ringInstances ? "" : ", instance data went through the queue's own buffer");
+
+        depthPrepass.drawUI();
+
+        ImGui::Separator();
+        cascadedShadows.drawUI();
+        ImGui::Separator();
+        antiAliasing.drawUI();
+        ImGui::Separator();
+        fresnelLUT.drawUI();
+        ImGui::Separator();
+        oit.drawUI();
+        ImGui::Separator();
+        spectralDispersion.drawUI();
+        ImGui::Separator();
+        dynamicResolution.drawUI();
+        reflectionProbes.drawUI();
+        screenSpaceReflections.drawUI();
+        ImGui::Separator();
+        profiler.drawUI();
+
         
         ImGui::End();
+        profiler.end();
+
+        if (benchmark)
+            benchmark->beginFrame();
+        dynamicResolution.beginScene();
+        antiAliasing.beginScene();
 
         glEnable(GL_DEPTH_TEST);
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        screenSpaceReflections.ior = uiIOR;
+        screenSpaceReflections.beginScene();
+        antiAliasing.beginSamples();
+        spectralDispersion.beginFrame(antiAliasing.motionVectors(), antiAliasing.blend);
 
         glDepthFunc(GL_LEQUAL); 
 
-        glm::mat4 model = glm::mat4(1.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-        
-
-        // --- MODELS ---
-
-
-        // 1. REFLECTION ONLY (
-        objectShader.use();
-        objectShader.setFloat("ior", uiIOR);
-        objectShader.setFloat("dispersion", uiChromaticDispersion);
-        objectShader.setFloat("reflectivity", uiReflectivity);
-        objectShader.setInt("effectType", renderMode);
-
-
-        //Take this out when you uncomment the skybox
-        
-        //Sphere
-        objectShader.setMat4("projection", projection);
-        objectShader.setMat4("view", view);
-        objectShader.setVec3("cameraPos", camera.Position);
-
-        glm::mat4 modelMatrix1 = glm::mat4(1.0f);
-        modelMatrix1 = glm::translate(modelMatrix1, glm::vec3(1.5f, 1.0f, 0.0f));
-
-        if (rotateModels) {
-            glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), (float)glfwGetTime() * 0.4f, glm::vec3(0, 1, 0));
-            modelMatrix1 = rotationMatrix * modelMatrix1;  
+        // everything drawn into the scene uses the jittered projection under TAA; shadows and
+        // motion vectors use the plain one
+        glm::mat4 unjitteredProjection = glm::perspective(glm::radians(camera.Zoom), benchmark ? benchmark->aspect() : (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = antiAliasing.jitter(unjitteredProjection);
+
+        // --- SCENE ---
+        // time is sampled once per frame; with rotation off everything goes back to its rest pose
+        profiler.begin("Scene update");
+        resizeStressEntities(scene, firstStressEntity, stressEntities, stressRenderable, renderables[stressRenderable].model->bounds);
+        scene.trackPrevious = antiAliasing.motionVectors();
+        scene.update(rotateModels ? currentFrame : 0.0f);
+        profiler.end();
+
+        // --- CULLING ---
+        profiler.begin("Culling");
+        // world space bounding spheres against the camera frustum, the survivors are drawn
+        if (useFrustumCulling)
+        {
+            Frustum frustum = Frustum::fromViewProjection(projection * view);
+            culler.cull(frustum, scene.worldBoundX.data(), scene.worldBoundY.data(), scene.worldBoundZ.data(),
+                        scene.worldBoundRadius.data(), scene.size(), visibleEntities, &threadPool, workerThreads);
+        }
+        else
+        {
+            visibleEntities.clear();
+            for (int e = 0; e < scene.size(); e++)
+                if (scene.renderable[e] >= 0)
+                    visibleEntities.push_back(e);
         }
 
-        modelMatrix1 = glm::scale(modelMatrix1, glm::vec3(0.1f));
-        
-
-        glm::mat3 normalMatrix1 = glm::transpose(glm::inverse(glm::mat3(modelMatrix1)));
-        objectShader.setMat4("model", modelMatrix1);
-        objectShader.setInt("effectType", 0);
-        objectShader.setMat3("normalMatrix", normalMatrix1);
-
-        myModel3.Draw(objectShader);
+        // the largest visible occluders go into a small CPU depth buffer, everything behind
+        // them is dropped before any draw is recorded
+        if (occlusionMode == OCCLUSION_SOFTWARE)
+        {
+            occluders.clear();
+            for (int entity : visibleEntities)
+            {
+                if (entity >= firstStressEntity && !drawStressEntities)
+                    break;
+                const Renderable& object = renderables[scene.renderable[entity]];
+                // see-through glass hides nothing
+                if (!object.occluder || (oit.enabled && effectOf(entity) != 0))
+                    continue;
+                float distance = glm::length(scene.worldPosition(entity) - camera.Position);
+                occluders.push_back({ object.occluder, scene.world[entity], scene.worldBoundRadius[entity] / glm::max(distance, 0.1f) });
+            }
+            occlusion.begin(view, projection);
+            occlusion.render(occluders, &threadPool);
+            occlusion.filter(scene.worldBoundX.data(), scene.worldBoundY.data(), scene.worldBoundZ.data(),
+                             scene.worldBoundRadius.data(), visibleEntities, &threadPool);
+        }
+        profiler.end();
 
+        // --- SHADOWS ---
+        // An entity counts as static once it has kept still for a while. Whenever one settles
+        // or starts moving again the cached static layers are out of date.
+        profiler.begin("Shadows");
+        int casterCount = drawStressEntities ? scene.size() : firstStressEntity;
+        {
+            if ((int)stillFrames.size() > scene.size())
+                cascadedShadows.invalidateStatic();
+            stillFrames.resize(scene.size(), 0);
+            std::atomic<bool> staticChanged(false);
+            threadPool.parallelFor(stillFrames.size(), 4096, [&](size_t begin, size_t end, int)
+            {
+                bool changed = false;
+                for (size_t e = begin; e < end; e++)
+                {
+                    if (scene.changed[e])
+                    {
+                        changed |= stillFrames[e] >= STATIC_AFTER_FRAMES;
+                        stillFrames[e] = 0;
+                    }
+                    else if (stillFrames[e] < STATIC_AFTER_FRAMES)
+                        changed |= ++stillFrames[e] == STATIC_AFTER_FRAMES;
+                }
+                if (changed)
+                    staticChanged = true;
+            });
+            if (staticChanged)
+                cascadedShadows.invalidateStatic();
+        }
+        cascadedShadows.update(view, unjitteredProjection);
+        cascadedShadows.render(frameRing, [&](int cascade, CascadedShadows::Casters casters) -> int
+        {
+            Shader& program = useInstancing ? depthInstancedShader : depthShader;
+            bool wantStatic = casters == CascadedShadows::STATIC_CASTERS;
+            int lists = drawListCount();
+            shadowQueue.begin(cascadedShadows.cascadeView(cascade), cascadedShadows.cascadeFar(cascade), lists);
+            threadPool.parallelFor(casterCount, 1024, [&](size_t begin, size_t end, int worker)
+            {
+                RenderQueue::DrawList& list = shadowQueue.list(worker);
+                for (size_t e = begin; e < end; e++)
+                {
+                    if (scene.renderable[e] < 0 || (stillFrames[e] >= STATIC_AFTER_FRAMES) != wantStatic)
+                        continue;
+                    glm::vec3 center(scene.worldBoundX[e], scene.worldBoundY[e], scene.worldBoundZ[e]);
+                    if (!cascadedShadows.casterVisible(cascade, casters, center, scene.worldBoundRadius[e]))
+                        continue;
+                    InstanceData instance;
+                    instance.model = scene.world[e];
+                    instance.normalMatrix = scene.normal[e];
+                    instance.params = glm::vec4(0.0f);
+                    for (Mesh& mesh : renderables[scene.renderable[e]].model->meshes)
+                        list.push(PASS_DEPTH, program, mesh, 0, instance);
+                }
+            }, lists);
+            shadowQueue.sort(&threadPool, workerThreads);
+            shadowQueue.submit();
+            return shadowQueue.last().draws;
+        });
+        profiler.end();
+
+        // --- REFLECTION PROBES ---
+        // a few cube faces per frame, as many as the budget allows. A probe sees the other glass
+        // objects, which sample their own probes as of the last update: one more bounce for free.
+        profiler.begin("Reflection probes");
+        for (int i = 0; i < 4; i++)
+            reflectionProbes.setPosition(i, scene.worldPosition(objectEntities[i]));
+        reflectionProbes.update(camera.Position, frameRing, [&](int probe, const glm::mat4& probeView, const glm::mat4& probeProjection)
+        {
+            Shader& program = shaderQueue.resolve(fresnelLUT.enabled ? objectLutShader : objectShader);
+            program.use();
+            setMaterialUniforms(program);
+            // no TAA averages the cube faces, per pixel wavelengths would stay as noise
+            program.setBool("spectralNoise", false);
+            for (int i = 0; i < 4; i++)
+            {
+                // never the object whose cubemap is being rendered
+                const Renderable& object = renderables[i];
+                if (object.probe == probe)
+                    continue;
+                int entity = objectEntities[i];
+                program.setInt("effectType", object.effectType);
+                bindEnvironment(program, object.probe);
+                program.setMat4("model", scene.world[entity]);
+                program.setMat3("normalMatrix", scene.normal[entity]);
+                object.model->Draw(program);
+            }
+            drawGround();
+            drawSkybox(probeView, probeProjection);
+        });
+        profiler.end();
+        // shadows and probes are done, the per-mode scene cost starts with the camera's draws
+        antiAliasing.beginSceneDraws();
 
-        // 2. REFRACTION ONLY 
-        //Ring Donut thing 
-        glm::mat4 modelMatrix2 = glm::mat4(1.0f);
-        modelMatrix2 = glm::translate(modelMatrix2, glm::vec3(0.5f, 1.0f, 0.0f));
+        // --- MODELS ---
 
-        modelMatrix2 = glm::scale(modelMatrix2, glm::vec3(0.25f)); 
+        // Every visible entity is one instance of a model with its own effect. Draws are recorded
+        // as packets and the render queue picks the order: reflective objects are opaque and go
+        // front to back, the see-through ones back to front after them.
 
+        // until the real program is compiled and warmed up this is the fallback
+        Shader& objectProgram = useInstancing ? shaderQueue.resolve(fresnelLUT.enabled ? objectInstancedLutShader : objectInstancedShader)
+                                              : shaderQueue.resolve(fresnelLUT.enabled ? objectLutShader : objectShader);
+        Shader& transparentProgram = useInstancing ? shaderQueue.resolve(fresnelLUT.enabled ? objectInstancedLutOitShader : objectInstancedOitShader)
+                                                   : shaderQueue.resolve(fresnelLUT.enabled ? objectLutOitShader : objectOitShader);
+        Shader& depthProgram = useInstancing ? depthInstancedShader : depthShader;
 
-        if (rotateModels) {
-            glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), (float)glfwGetTime() * 0.4f, glm::vec3(0, 1, 0));
-            modelMatrix2 = rotationMatrix * modelMatrix2;  
+        // camera data is the same for every program, one uniform block instead of per program uniforms
+        FrameRingBuffer::Allocation cameraAllocation = frameRing.allocateUniforms(sizeof(CameraBlock));
+        if (cameraAllocation)
+        {
+            CameraBlock* cameraBlock = (CameraBlock*)cameraAllocation.data;
+            cameraBlock->view = view;
+            cameraBlock->projection = projection;
+            cameraBlock->cameraPos = glm::vec4(camera.Position, 1.0f);
+            glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, frameRing.buffer(), cameraAllocation.offset, sizeof(CameraBlock));
         }
 
-    
-        glm::mat3 normalMatrix2 = glm::transpose(glm::inverse(glm::mat3(modelMatrix2)));
-        objectShader.setMat3("normalMatrix", normalMatrix2);
-        objectShader.setMat4("model", modelMatrix2);
-        objectShader.setInt("effectType", 1);
-        myModel2.Draw(objectShader);
-
-        // 3. CHROMATIC DIFFUSION
-        //Ring Donut thing 
-        glm::mat4 modelMatrix3 = glm::mat4(1.0f);
-        modelMatrix3 = glm::translate(modelMatrix3, glm::vec3(-1.5f, 1.0f, 0.0f));
-        
-        if (rotateModels) {
-            glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), (float)glfwGetTime() * 0.4f, glm::vec3(0, 1, 0));
-            modelMatrix3 = rotationMatrix * modelMatrix3;  
+        renderQueue.onProgram = setMaterialUniforms;
+        // the material is the effect plus the probe, effectType + 4 * (probe + 1); instanced
+        // programs read the effect from iParams, so their material is only the probe and
+        // objects with different effects still merge into one draw
+        renderQueue.onMaterial = [&](Shader& program, const DrawPacket& packet)
+        {
+            if (!useInstancing)
+                program.setInt("effectType", (int)(packet.material % 4));
+            bindEnvironment(program, (int)(packet.material / 4) - 1);
+        };
+        transparentQueue.onProgram = [&](Shader& program)
+        {
+            setMaterialUniforms(program);
+            oit.setUniforms(program);
+        };
+        transparentQueue.onMaterial = renderQueue.onMaterial;
+        chromaticQueue.onProgram = oit.enabled ? transparentQueue.onProgram : renderQueue.onProgram;
+        chromaticQueue.onMaterial = renderQueue.onMaterial;
+        chromaticQueue.depthWrites = !oit.enabled;
+
+        // only drawn stress entities take part from here on; the list is in ascending order
+        size_t drawCount = visibleEntities.size();
+        if (!drawStressEntities)
+            drawCount = std::lower_bound(visibleEntities.begin(), visibleEntities.end(), firstStressEntity) - visibleEntities.begin();
+
+        // query results can only be read on the context thread, so last frame's answers are
+        // picked up here first; uncertain entities are left to the GPU
+        profiler.begin("Draw lists");
+        bool gpuOcclusion = occlusionMode == OCCLUSION_GPU_QUERIES;
+        drawConditions.assign(drawCount, 0);
+        if (gpuOcclusion)
+        {
+            occlusionQueries.beginFrame(scene.size());
+            size_t kept = 0;
+            for (size_t i = 0; i < drawCount; i++)
+            {
+                int entity = visibleEntities[i];
+                glm::vec3 center(scene.worldBoundX[entity], scene.worldBoundY[entity], scene.worldBoundZ[entity]);
+                OcclusionQueries::Visibility visibility = occlusionQueries.classify(entity, center, scene.worldBoundRadius[entity], camera.Position);
+                if (visibility == OcclusionQueries::HIDDEN)
+                    continue;
+                drawConditions[kept] = visibility == OcclusionQueries::CONDITIONAL ? occlusionQueries.condition(entity) : 0;
+                visibleEntities[kept++] = entity;
+            }
+            drawCount = kept;
         }
 
-        modelMatrix3 = glm::scale(modelMatrix3, glm::vec3(0.25f)); 
-        
-
-        glm::mat3 normalMatrix3 = glm::transpose(glm::inverse(glm::mat3(modelMatrix3)));
-        objectShader.setMat3("normalMatrix", normalMatrix3);
-        objectShader.setMat4("model", modelMatrix3);
-        objectShader.setInt("effectType", 2);
-
-        myModel2.Draw(objectShader);
-
-        // 3. FRESNEL 
-        //Sphere again 
-        glm::mat4 modelMatrix4 = glm::mat4(1.0f);
-        modelMatrix4 = glm::translate(modelMatrix4, glm::vec3(-3.0f, 1.0f, 0.0f));
-        
-        if(rotateModels) {
-            glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), (float)glfwGetTime() * 0.4f, glm::vec3(0, 1, 0));
-            modelMatrix4 = rotationMatrix * modelMatrix4;  
-        } 
-
-        modelMatrix4 = glm::scale(modelMatrix4, glm::vec3(0.1f)); 
-        
+        // draw packets are plain data, every worker records its share into its own list
+        auto buildStart = std::chrono::high_resolution_clock::now();
+        int drawLists = drawListCount();
+        renderQueue.begin(view, 100.0f, drawLists);
+        transparentQueue.begin(view, 100.0f, drawLists);
+        chromaticQueue.begin(view, 100.0f, drawLists);
+        depthPrepass.beginFrame(view, projection, drawLists);
+        threadPool.parallelFor(drawCount, 1024, [&](size_t begin, size_t end, int worker)
+        {
+            RenderQueue::DrawList& list = renderQueue.list(worker);
+            for (size_t i = begin; i < end; i++)
+            {
+                int entity = visibleEntities[i];
+                const Renderable& object = renderables[scene.renderable[entity]];
+                int effectType = effectOf(entity);
+                unsigned int material = (unsigned int)((useInstancing ? 0 : effectType) + 4 * (object.probe + 1));
+                InstanceData instance;
+                instance.model = scene.world[entity];
+                instance.normalMatrix = scene.normal[entity];
+                instance.params = glm::vec4((float)effectType, uiIOR, uiChromaticDispersion, uiReflectivity);
+                // blended glass needs no order, so it is grouped by state like the opaque pass
+                if (oit.enabled && effectType == 2)
+                {
+                    RenderQueue::DrawList& chromaticList = chromaticQueue.list(worker);
+                    for (Mesh& mesh : object.model->meshes)
+                        chromaticList.push(PASS_OPAQUE, transparentProgram, mesh, material, instance, drawConditions[i]);
+                    continue;
+                }
+                if (oit.enabled && effectType != 0)
+                {
+                    RenderQueue::DrawList& transparentList = transparentQueue.list(worker);
+                    for (Mesh& mesh : object.model->meshes)
+                        transparentList.push(PASS_OPAQUE, transparentProgram, mesh, material, instance, drawConditions[i]);
+                    continue;
+                }
+                RenderPass pass = effectType == 0 ? PASS_OPAQUE : PASS_REFRACTIVE;
+                int vertexCount = 0;
+                for (const Mesh& mesh : object.model->meshes)
+                    vertexCount += mesh.range.vertexCount;
+                glm::vec3 center(scene.worldBoundX[entity], scene.worldBoundY[entity], scene.worldBoundZ[entity]);
+                if (depthPrepass.prepass(worker, effectType, center, scene.worldBoundRadius[entity], vertexCount, pass == PASS_OPAQUE))
+                {
+                    for (Mesh& mesh : object.model->meshes)
+                        list.push(PASS_DEPTH, depthProgram, mesh, 0, instance, drawConditions[i]);
+                    pass = PASS_PREPASSED;
+                }
+                // its depth, if any, still goes out with the rest of the prepass
+                RenderQueue::DrawList& shadingList = effectType == 2 ? chromaticQueue.list(worker) : list;
+                for (Mesh& mesh : object.model->meshes)
+                    shadingList.push(pass, objectProgram, mesh, material, instance, drawConditions[i]);
+            }
+        }, drawLists);
+        drawListMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+        profiler.end();
+        profiler.begin("Objects");
+        renderQueue.sort(&threadPool, workerThreads);
+        transparentQueue.sort(&threadPool, workerThreads);
+        chromaticQueue.sort(&threadPool, workerThreads);
+        fresnelLUT.beginTiming();
+        renderQueue.submit();
+        // the chromatic glass goes last, unless it is blended, see the transparency pass
+        if (!oit.enabled)
+        {
+            spectralDispersion.beginTiming();
+            chromaticQueue.submit();
+            spectralDispersion.endTiming();
+        }
+        fresnelLUT.endTiming();
+        depthPrepass.endFrame();
+        drawGround();
+        profiler.end();
 
-        glm::mat3 normalMatrix4 = glm::transpose(glm::inverse(glm::mat3(modelMatrix4)));
-        objectShader.setMat3("normalMatrix", normalMatrix4);
-        objectShader.setMat4("model", modelMatrix4);
-        objectShader.setInt("effectType", 3);
+        // bounding boxes against the finished depth buffer, read back next frame (or later)
+        profiler.begin("Occlusion queries");
+        if (gpuOcclusion)
+            occlusionQueries.issue(projection * view, scene.worldBoundX.data(), scene.worldBoundY.data(),
+                                   scene.worldBoundZ.data(), scene.worldBoundRadius.data());
 
-        myModel3.Draw(objectShader);
+        profiler.end();
 
         // --- SKYBOX ---
-        skyboxShader.use();
-
-        glm::mat4 skyboxModel = glm::mat4(1.0f);
-        skyboxModel = glm::scale(skyboxModel, glm::vec3(50.0f));
-
-        skyboxShader.setMat4("model", skyboxModel);
-        skyboxShader.setMat4("view", glm::mat4(glm::mat3(view)));
-        skyboxShader.setMat4("projection", projection);
-   
-    
-        glBindVertexArray(skyboxVAO);
-        glUniform1i(glGetUniformLocation(skyboxShader.ID, "skybox"), 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        profiler.begin("Skybox");
+        drawSkybox(view, projection);
         
         glDepthFunc(GL_LESS); // set depth function b
+        profiler.end();
 
+        profiler.begin("MSAA resolve");
+        antiAliasing.resolveSamples();
+        profiler.end();
 
+        // the glass over the finished opaque scene; the reflections below only see the opaque
+        // surfaces, the composite goes on top of them
+        profiler.begin("Transparency");
+        oit.accumulate([&]() -> int
+        {
+            transparentQueue.submit();
+            spectralDispersion.beginTiming();
+            chromaticQueue.submit();
+            spectralDispersion.endTiming();
+            return transparentQueue.last().draws + chromaticQueue.last().draws;
+        });
+        profiler.end();
+
+        profiler.begin("Screen-space reflections");
+        screenSpaceReflections.endScene(view, projection, camera.Position);
+        profiler.end();
+
+        profiler.begin("Transparency composite");
+        oit.composite();
+        profiler.end();
+
+        // the velocity program is always instanced: the previous model matrix rides in the
+        // normal matrix and params slots, see velocity.vert
+        profiler.begin("Anti-aliasing");
+        antiAliasing.endScene(view, unjitteredProjection, [&]()
+        {
+            if (cameraAllocation)
+                glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, frameRing.buffer(), cameraAllocation.offset, sizeof(CameraBlock));
+            velocityQueue.onProgram = [&](Shader& program) { antiAliasing.setVelocityUniforms(program); };
+            velocityQueue.begin(view, 100.0f, drawLists);
+            threadPool.parallelFor(drawCount, 1024, [&](size_t begin, size_t end, int worker)
+            {
+                RenderQueue::DrawList& list = velocityQueue.list(worker);
+                for (size_t i = begin; i < end; i++)
+                {
+                    int entity = visibleEntities[i];
+                    const glm::mat4& previous = scene.previousWorld[entity];
+                    InstanceData instance;
+                    instance.model = scene.world[entity];
+                    instance.normalMatrix = glm::mat3(previous);
+                    instance.params = glm::vec4(glm::vec3(previous[3]), 0.0f);
+                    for (Mesh& mesh : renderables[scene.renderable[entity]].model->meshes)
+                        list.push(PASS_OPAQUE, velocityShader, mesh, 0, instance);
+                }
+            }, drawLists);
+            InstanceData ground;
+            ground.model = glm::mat4(1.0f);
+            ground.normalMatrix = glm::mat3(1.0f);
+            ground.params = glm::vec4(0.0f);
+            velocityQueue.list(0).push(PASS_OPAQUE, velocityShader, groundMesh, 0, ground);
+            velocityQueue.sort(&threadPool, workerThreads);
+            velocityQueue.submit();
+        });
+        profiler.end();
+
+        // back to the window, ImGui stays at native resolution
+        profiler.begin("Upscale");
+        dynamicResolution.endScene();
+        profiler.end();
+
+
+        profiler.begin("ImGui");
         ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (!benchmark)
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler.end();
+        profiler.endFrame();
+
+        if (benchmark)
+        {
+            // queue draws plus the skybox
+            benchmark->endFrame(renderQueue.last().draws + chromaticQueue.last().draws + (oit.enabled ? transparentQueue.last().draws : 0) +
+                                (shaderQueue.isReady(skyboxShader) ? 1 : 0));
+            if (benchmark->done())
+                glfwSetWindowShouldClose(window, true);
+        }
+
+        // fences this frame's part of the ring, the draws reading it are all issued
+        frameRing.endFrame();
+        glCapture.endFrame();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    if (benchmark)
+    {
+        benchmark->finish();
+        benchmark.reset();
+    }
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -327,30 +1029,63 @@ void processInput(GLFWwindow *window)
 
     // --- Standard WASD ---
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        cameraRecorder.keyboard(camera, FORWARD, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        cameraRecorder.keyboard(camera, BACKWARD, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        cameraRecorder.keyboard(camera, LEFT, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        cameraRecorder.keyboard(camera, RIGHT, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-        camera.ProcessKeyboard(UP, deltaTime);
+        cameraRecorder.keyboard(camera, UP, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
-        camera.ProcessKeyboard(DOWN, deltaTime);
+        cameraRecorder.keyboard(camera, DOWN, deltaTime);
 
 
     //This works 
     if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-        camera.Position += camera.Up * camera.MovementSpeed * deltaTime;
+        cameraRecorder.keyboard(camera, UP, deltaTime);
     
     
     if (glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS)
-        camera.Position -= camera.Up * camera.MovementSpeed * deltaTime;
+        cameraRecorder.keyboard(camera, DOWN, deltaTime);
 
 }
 
 
+// keeps `count` extra spinning entities (in groups of eight under a moving parent) after
+// the real scene objects, so the transform update and culling can be measured at scale
+void resizeStressEntities(Scene& scene, int firstStressEntity, int count, int renderable, const Bounds& bounds)
+{
+    int current = scene.size() - firstStressEntity;
+    if (count == current)
+        return;
+    if (count < current)
+    {
+        scene.truncate(firstStressEntity + count);
+        return;
+    }
+
+    std::mt19937 rng(1234 + current);
+    std::uniform_real_distribution<float> position(-40.0f, 40.0f), speed(-2.0f, 2.0f), size(0.05f, 0.3f);
+    int groupParent = -1;
+    for (int i = current; i < count; i++)
+    {
+        int e;
+        if (i % 8 == 0)
+        {
+            e = scene.create(glm::vec3(position(rng), position(rng) * 0.25f, position(rng)), glm::vec3(1.0f));
+            groupParent = e;
+        }
+        else
+            e = scene.create(glm::vec3(speed(rng), speed(rng), speed(rng)), glm::vec3(size(rng)), groupParent);
+        scene.setSpin(e, glm::vec3(speed(rng), 1.0f, speed(rng)), speed(rng));
+        // the group parents are only pivots
+        if (i % 8 != 0)
+            scene.setRenderable(e, renderable, bounds.center, bounds.radius);
+    }
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
@@ -359,7 +1094,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 {
     ImGuiIO& io = ImGui::GetIO();
-    if (io.WantCaptureMouse)  
+    if (io.WantCaptureMouse || cameraPlayer.active())  
         return;
 
     if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) != GLFW_PRESS)
@@ -384,12 +1119,14 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    cameraRecorder.mouseMovement(camera, xoffset, yoffset);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    if (cameraPlayer.active())
+        return;
+    cameraRecorder.mouseScroll(camera, static_cast<float>(yoffset));
 }
 
 unsigned int loadTexture(char const * path)
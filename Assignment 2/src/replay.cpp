@@ -0,0 +1,907 @@
+// GLReplay: re-issues a capture written with the application's --capture option (see
+// headers/gl_capture.h) as fast as the driver takes it and reports per-frame submit and GPU time.
+//
+//   GLReplay capture.glcap [--loop N] [--warmup N] [--csv file] [--software]
+//
+// The first --warmup frames (default 1, the first frame also holds all the loading) are
+// replayed once to build the resources, the remaining ones are timed, --loop times over.
+// --software asks Mesa for its llvmpipe rasterizer, so it also runs on machines without a GPU.
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "headers/gl_extensions.h"
+#include "headers/gl_capture.h"
+
+#include <zlib.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+class Replayer
+{
+public:
+    GLCaptureHeader header;
+
+    bool load(const std::string &path)
+    {
+        gzFile file = gzopen(path.c_str(), "rb");
+        if (!file)
+        {
+            std::cout << "ERROR::REPLAY::FILE_NOT_OPENED " << path << std::endl;
+            return false;
+        }
+        if (gzread(file, &header, sizeof(header)) != (int)sizeof(header) ||
+            std::memcmp(header.magic, GL_CAPTURE_MAGIC, sizeof(header.magic)) != 0)
+        {
+            std::cout << "ERROR::REPLAY::NOT_A_CAPTURE " << path << std::endl;
+            gzclose(file);
+            return false;
+        }
+        unsigned char chunk[1 << 16];
+        int read;
+        while ((read = gzread(file, chunk, sizeof(chunk))) > 0)
+            data.insert(data.end(), chunk, chunk + read);
+        gzclose(file);
+
+        // index the calls, a frame ends after its CALL_FRAME_END
+        frameStarts.push_back(0);
+        size_t offset = 0;
+        while (offset + 6 <= data.size())
+        {
+            Call call;
+            uint16_t id;
+            std::memcpy(&id, &data[offset], 2);
+            std::memcpy(&call.size, &data[offset + 2], 4);
+            call.id = (GLCaptureCall)id;
+            call.offset = offset + 6;
+            if (call.id >= CALL_COUNT || call.offset + call.size > data.size())
+            {
+                std::cout << "WARNING::REPLAY::TRUNCATED capture ends after " << frames() << " frames" << std::endl;
+                break;
+            }
+            calls.push_back(call);
+            if (call.id == CALL_FRAME_END)
+                frameStarts.push_back(calls.size());
+            offset = call.offset + call.size;
+        }
+        return true;
+    }
+
+    int frames() const { return (int)frameStarts.size() - 1; }
+    size_t callCount(int frame) const { return frameStarts[frame + 1] - frameStarts[frame]; }
+
+    // issues the calls of frames [first, last)
+    void replay(int first, int last)
+    {
+        for (size_t i = frameStarts[first]; i < frameStarts[last]; i++)
+            execute(calls[i]);
+    }
+
+private:
+    struct Call
+    {
+        GLCaptureCall id;
+        uint32_t size;
+        size_t offset;
+    };
+    typedef std::unordered_map<GLuint, GLuint> NameMap;
+
+    std::vector<unsigned char> data;
+    std::vector<Call> calls;
+    std::vector<size_t> frameStarts;
+
+    // captured name -> name in this context; programs and shaders share one namespace
+    NameMap buffers, textures, vertexArrays, queries, framebuffers, renderbuffers, objects;
+    std::unordered_map<uint64_t, GLsync> syncs;
+    // per captured program: captured location -> location in this context
+    std::map<GLuint, std::unordered_map<GLint, GLint>> uniformLocations, attributeLocations;
+    GLuint currentProgram = 0;   // captured name
+    bool warnedIndirect = false, warnedBlendFunci = false;
+
+    static GLuint name(const NameMap &map, GLuint captured)
+    {
+        auto it = map.find(captured);
+        return it != map.end() ? it->second : captured;
+    }
+
+    GLint uniform(GLint location) const
+    {
+        auto program = uniformLocations.find(currentProgram);
+        if (location < 0 || program == uniformLocations.end())
+            return location;
+        auto it = program->second.find(location);
+        return it != program->second.end() ? it->second : location;
+    }
+
+    // VAOs are set up with their program bound, so its locations apply
+    GLuint attribute(GLuint index) const
+    {
+        auto program = attributeLocations.find(currentProgram);
+        if (program == attributeLocations.end())
+            return index;
+        auto it = program->second.find((GLint)index);
+        return it != program->second.end() && it->second >= 0 ? (GLuint)it->second : index;
+    }
+
+    // the profiler's queries are the replayer's business here, only occlusion queries are kept
+    static bool occlusionTarget(GLenum target)
+    {
+        return target == GL_SAMPLES_PASSED || target == GL_ANY_SAMPLES_PASSED || target == GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+    }
+
+    static GLenum occlusionTargetHere(GLenum target)
+    {
+        return target == GL_ANY_SAMPLES_PASSED_CONSERVATIVE && !glExt.conservativeOcclusion ? GL_ANY_SAMPLES_PASSED : target;
+    }
+
+    void generate(const unsigned char* p, NameMap &map, PFNGLGENBUFFERSPROC gen)
+    {
+        GLsizei n = captureGet<GLsizei>(p);
+        for (GLsizei i = 0; i < n; i++)
+        {
+            GLuint captured = captureGet<GLuint>(p);
+            GLuint created = 0;
+            gen(1, &created);
+            map[captured] = created;
+        }
+    }
+
+    void remove(const unsigned char* p, NameMap &map, PFNGLDELETEBUFFERSPROC del)
+    {
+        GLsizei n = captureGet<GLsizei>(p);
+        for (GLsizei i = 0; i < n; i++)
+        {
+            GLuint captured = captureGet<GLuint>(p);
+            GLuint replayed = name(map, captured);
+            del(1, &replayed);
+            map.erase(captured);
+        }
+    }
+
+    void location(const unsigned char* p, std::map<GLuint, std::unordered_map<GLint, GLint>> &locations,
+                  PFNGLGETUNIFORMLOCATIONPROC query)
+    {
+        GLuint program = captureGet<GLuint>(p);
+        size_t length;
+        const unsigned char* text = captureGetBytes(p, length);
+        GLint captured = captureGet<GLint>(p);
+        if (captured < 0)
+            return;
+        std::string uniformName((const char*)text, length);
+        locations[program][captured] = query(name(objects, program), uniformName.c_str());
+    }
+
+    void execute(const Call &call)
+    {
+        const unsigned char* p = data.data() + call.offset;
+        switch (call.id)
+        {
+        case CALL_FRAME_END:
+            break;
+        case CALL_ActiveTexture:
+            glActiveTexture(captureGet<GLenum>(p));
+            break;
+        case CALL_AttachShader:
+        case CALL_DetachShader:
+        {
+            GLuint program = name(objects, captureGet<GLuint>(p));
+            GLuint shader = name(objects, captureGet<GLuint>(p));
+            if (call.id == CALL_AttachShader)
+                glAttachShader(program, shader);
+            else
+                glDetachShader(program, shader);
+            break;
+        }
+        case CALL_BeginConditionalRender:
+        {
+            GLuint query = name(queries, captureGet<GLuint>(p));
+            GLenum mode = captureGet<GLenum>(p);
+            glBeginConditionalRender(query, mode);
+            break;
+        }
+        case CALL_EndConditionalRender:
+            glEndConditionalRender();
+            break;
+        case CALL_BeginQuery:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLuint query = name(queries, captureGet<GLuint>(p));
+            if (occlusionTarget(target))
+                glBeginQuery(occlusionTargetHere(target), query);
+            break;
+        }
+        case CALL_EndQuery:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            if (occlusionTarget(target))
+                glEndQuery(occlusionTargetHere(target));
+            break;
+        }
+        case CALL_BindBuffer:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            glBindBuffer(target, name(buffers, captureGet<GLuint>(p)));
+            break;
+        }
+        case CALL_BindBufferRange:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLuint index = captureGet<GLuint>(p);
+            GLuint buffer = name(buffers, captureGet<GLuint>(p));
+            GLintptr offset = captureGet<GLintptr>(p);
+            GLsizeiptr size = captureGet<GLsizeiptr>(p);
+            glBindBufferRange(target, index, buffer, offset, size);
+            break;
+        }
+        case CALL_BindFramebuffer:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            glBindFramebuffer(target, name(framebuffers, captureGet<GLuint>(p)));
+            break;
+        }
+        case CALL_BindRenderbuffer:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            glBindRenderbuffer(target, name(renderbuffers, captureGet<GLuint>(p)));
+            break;
+        }
+        case CALL_BindTexture:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            glBindTexture(target, name(textures, captureGet<GLuint>(p)));
+            break;
+        }
+        case CALL_BindVertexArray:
+            glBindVertexArray(name(vertexArrays, captureGet<GLuint>(p)));
+            break;
+        case CALL_BlendEquation:
+            glBlendEquation(captureGet<GLenum>(p));
+            break;
+        case CALL_BlendFunc:
+        {
+            GLenum source = captureGet<GLenum>(p);
+            GLenum destination = captureGet<GLenum>(p);
+            glBlendFunc(source, destination);
+            break;
+        }
+        case CALL_BlendFuncSeparate:
+        {
+            GLenum sourceColor = captureGet<GLenum>(p);
+            GLenum destinationColor = captureGet<GLenum>(p);
+            GLenum sourceAlpha = captureGet<GLenum>(p);
+            GLenum destinationAlpha = captureGet<GLenum>(p);
+            glBlendFuncSeparate(sourceColor, destinationColor, sourceAlpha, destinationAlpha);
+            break;
+        }
+        case CALL_BlendFunci:
+        {
+            GLuint buffer = captureGet<GLuint>(p);
+            GLenum source = captureGet<GLenum>(p);
+            GLenum destination = captureGet<GLenum>(p);
+            if (glBlendFunci)
+                glBlendFunci(buffer, source, destination);
+            else if (!warnedBlendFunci)
+            {
+                std::cout << "WARNING::REPLAY::NO_BLEND_FUNC_I per-buffer blending is skipped" << std::endl;
+                warnedBlendFunci = true;
+            }
+            break;
+        }
+        case CALL_BlitFramebuffer:
+        {
+            GLint source[4], destination[4];
+            for (GLint &v : source)
+                v = captureGet<GLint>(p);
+            for (GLint &v : destination)
+                v = captureGet<GLint>(p);
+            GLbitfield mask = captureGet<GLbitfield>(p);
+            GLenum filter = captureGet<GLenum>(p);
+            glBlitFramebuffer(source[0], source[1], source[2], source[3],
+                              destination[0], destination[1], destination[2], destination[3], mask, filter);
+            break;
+        }
+        case CALL_BufferData:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLsizeiptr size = captureGet<GLsizeiptr>(p);
+            GLenum usage = captureGet<GLenum>(p);
+            size_t bytes;
+            const unsigned char* content = captureGetBytes(p, bytes);
+            glBufferData(target, size, bytes ? content : nullptr, usage);
+            break;
+        }
+        case CALL_BufferSubData:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLintptr offset = captureGet<GLintptr>(p);
+            size_t bytes;
+            const unsigned char* content = captureGetBytes(p, bytes);
+            glBufferSubData(target, offset, (GLsizeiptr)bytes, content);
+            break;
+        }
+        case CALL_Clear:
+            glClear(captureGet<GLbitfield>(p));
+            break;
+        case CALL_ClearBufferfv:
+        {
+            GLenum buffer = captureGet<GLenum>(p);
+            GLint drawBuffer = captureGet<GLint>(p);
+            size_t bytes;
+            const unsigned char* value = captureGetBytes(p, bytes);
+            glClearBufferfv(buffer, drawBuffer, (const GLfloat*)value);
+            break;
+        }
+        case CALL_ClearColor:
+        {
+            GLfloat r = captureGet<GLfloat>(p), g = captureGet<GLfloat>(p);
+            GLfloat b = captureGet<GLfloat>(p), a = captureGet<GLfloat>(p);
+            glClearColor(r, g, b, a);
+            break;
+        }
+        case CALL_ColorMask:
+        {
+            GLboolean r = captureGet<GLboolean>(p), g = captureGet<GLboolean>(p);
+            GLboolean b = captureGet<GLboolean>(p), a = captureGet<GLboolean>(p);
+            glColorMask(r, g, b, a);
+            break;
+        }
+        case CALL_CompileShader:
+            glCompileShader(name(objects, captureGet<GLuint>(p)));
+            break;
+        case CALL_CreateProgram:
+            objects[captureGet<GLuint>(p)] = glCreateProgram();
+            break;
+        case CALL_CreateShader:
+        {
+            GLenum type = captureGet<GLenum>(p);
+            objects[captureGet<GLuint>(p)] = glCreateShader(type);
+            break;
+        }
+        case CALL_CullFace:
+            glCullFace(captureGet<GLenum>(p));
+            break;
+        case CALL_DeleteBuffers:       remove(p, buffers, glDeleteBuffers); break;
+        case CALL_DeleteFramebuffers:  remove(p, framebuffers, glDeleteFramebuffers); break;
+        case CALL_DeleteQueries:       remove(p, queries, glDeleteQueries); break;
+        case CALL_DeleteRenderbuffers: remove(p, renderbuffers, glDeleteRenderbuffers); break;
+        case CALL_DeleteTextures:      remove(p, textures, glDeleteTextures); break;
+        case CALL_DeleteVertexArrays:  remove(p, vertexArrays, glDeleteVertexArrays); break;
+        case CALL_DeleteProgram:
+        case CALL_DeleteShader:
+        {
+            GLuint captured = captureGet<GLuint>(p);
+            if (call.id == CALL_DeleteProgram)
+                glDeleteProgram(name(objects, captured));
+            else
+                glDeleteShader(name(objects, captured));
+            objects.erase(captured);
+            break;
+        }
+        case CALL_DeleteSync:
+        {
+            auto it = syncs.find(captureGet<uint64_t>(p));
+            if (it != syncs.end())
+            {
+                glDeleteSync(it->second);
+                syncs.erase(it);
+            }
+            break;
+        }
+        case CALL_DepthFunc:
+            glDepthFunc(captureGet<GLenum>(p));
+            break;
+        case CALL_DepthMask:
+            glDepthMask(captureGet<GLboolean>(p));
+            break;
+        case CALL_Disable:
+            glDisable(captureGet<GLenum>(p));
+            break;
+        case CALL_Enable:
+            glEnable(captureGet<GLenum>(p));
+            break;
+        case CALL_DrawArrays:
+        {
+            GLenum mode = captureGet<GLenum>(p);
+            GLint first = captureGet<GLint>(p);
+            GLsizei count = captureGet<GLsizei>(p);
+            glDrawArrays(mode, first, count);
+            break;
+        }
+        case CALL_DrawBuffer:
+            glDrawBuffer(captureGet<GLenum>(p));
+            break;
+        case CALL_DrawBuffers:
+        {
+            GLsizei n = captureGet<GLsizei>(p);
+            std::vector<GLenum> buffers(n);
+            for (GLenum &buffer : buffers)
+                buffer = captureGet<GLenum>(p);
+            glDrawBuffers(n, buffers.data());
+            break;
+        }
+        case CALL_DrawElements:
+        {
+            GLenum mode = captureGet<GLenum>(p);
+            GLsizei count = captureGet<GLsizei>(p);
+            GLenum type = captureGet<GLenum>(p);
+            const void* indices = captureGet<const void*>(p);
+            glDrawElements(mode, count, type, indices);
+            break;
+        }
+        case CALL_DrawElementsBaseVertex:
+        {
+            GLenum mode = captureGet<GLenum>(p);
+            GLsizei count = captureGet<GLsizei>(p);
+            GLenum type = captureGet<GLenum>(p);
+            const void* indices = captureGet<const void*>(p);
+            GLint baseVertex = captureGet<GLint>(p);
+            glDrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+            break;
+        }
+        case CALL_DrawElementsInstancedBaseVertex:
+        {
+            GLenum mode = captureGet<GLenum>(p);
+            GLsizei count = captureGet<GLsizei>(p);
+            GLenum type = captureGet<GLenum>(p);
+            const void* indices = captureGet<const void*>(p);
+            GLsizei instances = captureGet<GLsizei>(p);
+            GLint baseVertex = captureGet<GLint>(p);
+            glDrawElementsInstancedBaseVertex(mode, count, type, indices, instances, baseVertex);
+            break;
+        }
+        case CALL_EnableVertexAttribArray:
+            glEnableVertexAttribArray(attribute(captureGet<GLuint>(p)));
+            break;
+        case CALL_FenceSync:
+        {
+            GLenum condition = captureGet<GLenum>(p);
+            GLbitfield flags = captureGet<GLbitfield>(p);
+            syncs[captureGet<uint64_t>(p)] = glFenceSync(condition, flags);
+            break;
+        }
+        case CALL_Finish:
+            glFinish();
+            break;
+        case CALL_Flush:
+            glFlush();
+            break;
+        case CALL_FramebufferRenderbuffer:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLenum attachment = captureGet<GLenum>(p);
+            GLenum renderbufferTarget = captureGet<GLenum>(p);
+            GLuint renderbuffer = name(renderbuffers, captureGet<GLuint>(p));
+            glFramebufferRenderbuffer(target, attachment, renderbufferTarget, renderbuffer);
+            break;
+        }
+        case CALL_FramebufferTexture2D:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLenum attachment = captureGet<GLenum>(p);
+            GLenum textureTarget = captureGet<GLenum>(p);
+            GLuint texture = name(textures, captureGet<GLuint>(p));
+            GLint level = captureGet<GLint>(p);
+            glFramebufferTexture2D(target, attachment, textureTarget, texture, level);
+            break;
+        }
+        case CALL_FramebufferTextureLayer:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLenum attachment = captureGet<GLenum>(p);
+            GLuint texture = name(textures, captureGet<GLuint>(p));
+            GLint level = captureGet<GLint>(p);
+            GLint layer = captureGet<GLint>(p);
+            glFramebufferTextureLayer(target, attachment, texture, level, layer);
+            break;
+        }
+        case CALL_GenBuffers:       generate(p, buffers, glGenBuffers); break;
+        case CALL_GenFramebuffers:  generate(p, framebuffers, glGenFramebuffers); break;
+        case CALL_GenQueries:       generate(p, queries, glGenQueries); break;
+        case CALL_GenRenderbuffers: generate(p, renderbuffers, glGenRenderbuffers); break;
+        case CALL_GenTextures:      generate(p, textures, glGenTextures); break;
+        case CALL_GenVertexArrays:  generate(p, vertexArrays, glGenVertexArrays); break;
+        case CALL_GenerateMipmap:
+            glGenerateMipmap(captureGet<GLenum>(p));
+            break;
+        case CALL_GetAttribLocation:
+            location(p, attributeLocations, glGetAttribLocation);
+            break;
+        case CALL_GetUniformLocation:
+            location(p, uniformLocations, glGetUniformLocation);
+            break;
+        case CALL_LinkProgram:
+            glLinkProgram(name(objects, captureGet<GLuint>(p)));
+            break;
+        case CALL_MultiDrawElementsIndirect:
+        {
+            GLenum mode = captureGet<GLenum>(p);
+            GLenum type = captureGet<GLenum>(p);
+            const void* indirect = captureGet<const void*>(p);
+            GLsizei drawCount = captureGet<GLsizei>(p);
+            GLsizei stride = captureGet<GLsizei>(p);
+            if (glExt.MultiDrawElementsIndirect)
+                glExt.MultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+            else if (!warnedIndirect)
+            {
+                std::cout << "WARNING::REPLAY::NO_MULTI_DRAW_INDIRECT those draws are skipped" << std::endl;
+                warnedIndirect = true;
+            }
+            break;
+        }
+        case CALL_PixelStorei:
+        {
+            GLenum pname = captureGet<GLenum>(p);
+            glPixelStorei(pname, captureGet<GLint>(p));
+            break;
+        }
+        case CALL_PolygonOffset:
+        {
+            GLfloat factor = captureGet<GLfloat>(p);
+            glPolygonOffset(factor, captureGet<GLfloat>(p));
+            break;
+        }
+        case CALL_ReadBuffer:
+            glReadBuffer(captureGet<GLenum>(p));
+            break;
+        case CALL_RenderbufferStorage:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLenum format = captureGet<GLenum>(p);
+            GLsizei width = captureGet<GLsizei>(p);
+            GLsizei height = captureGet<GLsizei>(p);
+            glRenderbufferStorage(target, format, width, height);
+            break;
+        }
+        case CALL_RenderbufferStorageMultisample:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLsizei samples = captureGet<GLsizei>(p);
+            GLenum format = captureGet<GLenum>(p);
+            GLsizei width = captureGet<GLsizei>(p);
+            GLsizei height = captureGet<GLsizei>(p);
+            glRenderbufferStorageMultisample(target, samples, format, width, height);
+            break;
+        }
+        case CALL_ShaderSource:
+        {
+            GLuint shader = name(objects, captureGet<GLuint>(p));
+            GLsizei count = captureGet<GLsizei>(p);
+            std::vector<const GLchar*> strings(count);
+            std::vector<GLint> lengths(count);
+            for (GLsizei i = 0; i < count; i++)
+            {
+                size_t length;
+                strings[i] = (const GLchar*)captureGetBytes(p, length);
+                lengths[i] = (GLint)length;
+            }
+            glShaderSource(shader, count, strings.data(), lengths.data());
+            break;
+        }
+        case CALL_TexImage2D:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLint level = captureGet<GLint>(p);
+            GLint internalFormat = captureGet<GLint>(p);
+            GLsizei width = captureGet<GLsizei>(p);
+            GLsizei height = captureGet<GLsizei>(p);
+            GLint border = captureGet<GLint>(p);
+            GLenum format = captureGet<GLenum>(p);
+            GLenum type = captureGet<GLenum>(p);
+            size_t bytes;
+            const unsigned char* pixels = captureGetBytes(p, bytes);
+            glTexImage2D(target, level, internalFormat, width, height, border, format, type, bytes ? pixels : nullptr);
+            break;
+        }
+        case CALL_TexImage3D:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLint level = captureGet<GLint>(p);
+            GLint internalFormat = captureGet<GLint>(p);
+            GLsizei width = captureGet<GLsizei>(p);
+            GLsizei height = captureGet<GLsizei>(p);
+            GLsizei depth = captureGet<GLsizei>(p);
+            GLint border = captureGet<GLint>(p);
+            GLenum format = captureGet<GLenum>(p);
+            GLenum type = captureGet<GLenum>(p);
+            size_t bytes;
+            const unsigned char* pixels = captureGetBytes(p, bytes);
+            glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, bytes ? pixels : nullptr);
+            break;
+        }
+        case CALL_TexParameteri:
+        {
+            GLenum target = captureGet<GLenum>(p);
+            GLenum pname = captureGet<GLenum>(p);
+            glTexParameteri(target, pname, captureGet<GLint>(p));
+            break;
+        }
+        case CALL_Uniform1f:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            glUniform1f(location, captureGet<GLfloat>(p));
+            break;
+        }
+        case CALL_Uniform1i:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            glUniform1i(location, captureGet<GLint>(p));
+            break;
+        }
+        case CALL_Uniform2f:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            GLfloat x = captureGet<GLfloat>(p), y = captureGet<GLfloat>(p);
+            glUniform2f(location, x, y);
+            break;
+        }
+        case CALL_Uniform2i:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            GLint x = captureGet<GLint>(p), y = captureGet<GLint>(p);
+            glUniform2i(location, x, y);
+            break;
+        }
+        case CALL_Uniform3f:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            GLfloat x = captureGet<GLfloat>(p), y = captureGet<GLfloat>(p), z = captureGet<GLfloat>(p);
+            glUniform3f(location, x, y, z);
+            break;
+        }
+        case CALL_Uniform4f:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            GLfloat x = captureGet<GLfloat>(p), y = captureGet<GLfloat>(p);
+            GLfloat z = captureGet<GLfloat>(p), w = captureGet<GLfloat>(p);
+            glUniform4f(location, x, y, z, w);
+            break;
+        }
+        case CALL_Uniform2fv:
+        case CALL_Uniform3fv:
+        case CALL_Uniform4fv:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            GLsizei count = captureGet<GLsizei>(p);
+            size_t bytes;
+            const GLfloat* value = (const GLfloat*)captureGetBytes(p, bytes);
+            if (call.id == CALL_Uniform2fv)
+                glUniform2fv(location, count, value);
+            else if (call.id == CALL_Uniform3fv)
+                glUniform3fv(location, count, value);
+            else
+                glUniform4fv(location, count, value);
+            break;
+        }
+        case CALL_UniformMatrix2fv:
+        case CALL_UniformMatrix3fv:
+        case CALL_UniformMatrix4fv:
+        {
+            GLint location = uniform(captureGet<GLint>(p));
+            GLsizei count = captureGet<GLsizei>(p);
+            GLboolean transpose = captureGet<GLboolean>(p);
+            size_t bytes;
+            const GLfloat* value = (const GLfloat*)captureGetBytes(p, bytes);
+            if (call.id == CALL_UniformMatrix2fv)
+                glUniformMatrix2fv(location, count, transpose, value);
+            else if (call.id == CALL_UniformMatrix3fv)
+                glUniformMatrix3fv(location, count, transpose, value);
+            else
+                glUniformMatrix4fv(location, count, transpose, value);
+            break;
+        }
+        case CALL_UniformBlockBinding:
+        {
+            GLuint program = name(objects, captureGet<GLuint>(p));
+            size_t length;
+            const unsigned char* text = captureGetBytes(p, length);
+            GLuint binding = captureGet<GLuint>(p);
+            std::string blockName((const char*)text, length);
+            GLuint index = glGetUniformBlockIndex(program, blockName.c_str());
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(program, index, binding);
+            break;
+        }
+        case CALL_UseProgram:
+            currentProgram = captureGet<GLuint>(p);
+            glUseProgram(name(objects, currentProgram));
+            break;
+        case CALL_VertexAttribDivisor:
+        {
+            GLuint index = attribute(captureGet<GLuint>(p));
+            glVertexAttribDivisor(index, captureGet<GLuint>(p));
+            break;
+        }
+        case CALL_VertexAttribIPointer:
+        {
+            GLuint index = attribute(captureGet<GLuint>(p));
+            GLint size = captureGet<GLint>(p);
+            GLenum type = captureGet<GLenum>(p);
+            GLsizei stride = captureGet<GLsizei>(p);
+            const void* pointer = captureGet<const void*>(p);
+            glVertexAttribIPointer(index, size, type, stride, pointer);
+            break;
+        }
+        case CALL_VertexAttribPointer:
+        {
+            GLuint index = attribute(captureGet<GLuint>(p));
+            GLint size = captureGet<GLint>(p);
+            GLenum type = captureGet<GLenum>(p);
+            GLboolean normalized = captureGet<GLboolean>(p);
+            GLsizei stride = captureGet<GLsizei>(p);
+            const void* pointer = captureGet<const void*>(p);
+            glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+            break;
+        }
+        case CALL_Viewport:
+        {
+            GLint x = captureGet<GLint>(p), y = captureGet<GLint>(p);
+            GLsizei width = captureGet<GLsizei>(p), height = captureGet<GLsizei>(p);
+            glViewport(x, y, width, height);
+            break;
+        }
+        case CALL_COUNT:
+            break;
+        }
+    }
+};
+
+struct Summary
+{
+    double min = 0.0, avg = 0.0, p99 = 0.0;
+};
+
+static Summary summarize(std::vector<double> values)
+{
+    Summary s;
+    if (values.empty())
+        return s;
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (double v : values)
+        sum += v;
+    s.min = values.front();
+    s.avg = sum / values.size();
+    s.p99 = values[std::min(values.size() - 1, (size_t)(values.size() * 0.99))];
+    return s;
+}
+
+int main(int argc, char** argv)
+{
+    std::string path, csvPath;
+    int loops = 1, warmup = 1;
+    bool software = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--loop" && i + 1 < argc)
+            loops = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--csv" && i + 1 < argc)
+            csvPath = argv[++i];
+        else if (arg == "--software")
+            software = true;
+        else if (path.empty() && arg[0] != '-')
+            path = arg;
+        else
+        {
+            std::cout << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (path.empty())
+    {
+        std::cout << "usage: GLReplay capture.glcap [--loop N] [--warmup N] [--csv file] [--software]" << std::endl;
+        return 1;
+    }
+
+    Replayer replayer;
+    if (!replayer.load(path))
+        return 1;
+    if (replayer.frames() <= warmup)
+    {
+        std::cout << "ERROR::REPLAY::TOO_FEW_FRAMES " << replayer.frames() << " frames, " << warmup << " for warmup" << std::endl;
+        return 1;
+    }
+
+    // Mesa's switch for llvmpipe; must be set before the context is created
+    if (software)
+    {
+#ifdef _WIN32
+        _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+#else
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+#endif
+    }
+
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    // the capture's version first, then whatever this machine can do
+    const int contextVersions[][2] = { { replayer.header.major, replayer.header.minor }, { 4, 6 }, { 4, 5 }, { 4, 3 }, { 4, 1 }, { 3, 3 } };
+    GLFWwindow* window = nullptr;
+    for (const auto &version : contextVersions)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        window = glfwCreateWindow(replayer.header.width, replayer.header.height, "GLReplay", nullptr, nullptr);
+        if (window)
+            break;
+    }
+    if (!window)
+    {
+        std::cout << "ERROR::REPLAY::NO_CONTEXT" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        return 1;
+    glExt.load();
+    glfwSwapInterval(0);
+    std::cout << "Replaying " << path << ": " << replayer.frames() << " frames captured on GL " << replayer.header.major << "."
+              << replayer.header.minor << ", replaying on GL " << glExt.major << "." << glExt.minor << " (" << glExt.renderer << ")" << std::endl;
+
+    // resources first, untimed
+    replayer.replay(0, warmup);
+    glFinish();
+
+    // one timer per replayed frame, read after the run so the GPU is never waited for in between
+    int timed = replayer.frames() - warmup;
+    std::vector<GLuint> timers((size_t)timed * loops);
+    glGenQueries((GLsizei)timers.size(), timers.data());
+    std::vector<double> submitMs(timers.size()), gpuMs(timers.size());
+
+    auto runStart = std::chrono::high_resolution_clock::now();
+    size_t index = 0;
+    for (int loop = 0; loop < loops; loop++)
+        for (int frame = warmup; frame < replayer.frames(); frame++, index++)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, timers[index]);
+            auto start = std::chrono::high_resolution_clock::now();
+            replayer.replay(frame, frame + 1);
+            submitMs[index] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            glEndQuery(GL_TIME_ELAPSED);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    glFinish();
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - runStart).count();
+
+    for (size_t i = 0; i < timers.size(); i++)
+    {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(timers[i], GL_QUERY_RESULT, &ns);
+        gpuMs[i] = ns / 1e6;
+    }
+    glDeleteQueries((GLsizei)timers.size(), timers.data());
+
+    if (!csvPath.empty())
+    {
+        std::ofstream csv(csvPath);
+        csv << "loop,frame,calls,submit_ms,gpu_ms\n";
+        index = 0;
+        for (int loop = 0; loop < loops; loop++)
+            for (int frame = warmup; frame < replayer.frames(); frame++, index++)
+                csv << loop << "," << frame << "," << replayer.callCount(frame) << "," << submitMs[index] << "," << gpuMs[index] << "\n";
+    }
+
+    Summary submit = summarize(submitMs), gpu = summarize(gpuMs);
+    std::cout << timers.size() << " frames in " << totalMs << " ms (" << timers.size() * 1000.0 / totalMs << " fps)" << std::endl;
+    std::cout << "  submit ms: min " << submit.min << ", avg " << submit.avg << ", p99 " << submit.p99 << std::endl;
+    std::cout << "  GPU ms:    min " << gpu.min << ", avg " << gpu.avg << ", p99 " << gpu.p99 << std::endl;
+
+    glfwTerminate();
+    return 0;
+}
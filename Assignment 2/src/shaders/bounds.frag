@@ -0,0 +1,10 @@
+#version 330 core
+
+// Color writes are masked off while querying, only the depth test matters.
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(1.0);
+}
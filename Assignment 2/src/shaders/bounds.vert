@@ -0,0 +1,14 @@
+#version 330 core
+
+// Unit cube stretched around a bounding sphere, drawn for occlusion queries.
+
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 viewProjection;
+// xyz: world space center, w: radius
+uniform vec4 sphere;
+
+void main()
+{
+    gl_Position = viewProjection * vec4(sphere.xyz + aPos * sphere.w, 1.0);
+}
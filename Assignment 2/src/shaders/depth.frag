@@ -0,0 +1,7 @@
+#version 330 core
+
+// Depth prepass, color writes are masked off.
+
+void main()
+{
+}
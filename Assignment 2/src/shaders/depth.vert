@@ -0,0 +1,35 @@
+#version 330 core
+
+// Depth prepass and shadow casters: positions only, so its VAO fetches nothing but the packed
+// position stream.
+
+layout (location = 0) in vec3 aPos;
+
+#ifdef INSTANCED
+in mat4 iModel;
+#else
+uniform mat4 model;
+#endif
+
+// shared by every program that draws the scene, see CameraBlock in camera.h
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+// the shaded pass tests GL_EQUAL against this, so the position has to come out bit for bit
+// the same as in object.vert: same expression, and invariant in both
+invariant gl_Position;
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 model = iModel;
+#endif
+
+    vec4 worldPos4 = model * vec4(aPos, 1.0);
+
+    gl_Position = projection * view * worldPos4;
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+// Drawn while the real program for an object is still compiling.
+
+in vec3 normal;
+
+layout (location = 0) out vec4 FragColor;
+// nothing for screen-space reflections here, see object.frag
+layout (location = 1) out vec4 NormalOut;
+
+void main()
+{
+    vec3 N = normalize(normal);
+    float light = 0.35 + 0.65 * max(dot(N, normalize(vec3(0.3, 1.0, 0.5))), 0.0);
+
+    FragColor = vec4(vec3(0.6) * light, 1.0);
+    NormalOut = vec4(0.0);
+}
@@ -0,0 +1,39 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+#ifdef INSTANCED
+in mat4 iModel;
+in mat3 iNormalMatrix;
+#else
+uniform mat4 model;
+uniform mat3 normalMatrix;
+#endif
+
+// shared by every program that draws the scene, see CameraBlock in camera.h
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+out vec3 normal;
+
+// stands in for object.vert, also against depth.vert's depth
+invariant gl_Position;
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 model = iModel;
+    mat3 normalMatrix = iNormalMatrix;
+#endif
+
+    normal = normalize(normalMatrix * aNormal);
+
+    vec4 worldPos4 = model * vec4(aPos, 1.0);
+
+    gl_Position = projection * view * worldPos4;
+}
@@ -0,0 +1,123 @@
+#version 330 core
+
+// Fast approximate anti-aliasing (after Lottes' FXAA 3.11, quality version) on the finished
+// image: where the local luma contrast is high enough, find the edge's orientation, walk
+// along it to both of its ends and blend across it by how far this pixel is from the
+// nearer end. Thin lines also get a sub-pixel blend with their neighbourhood.
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+uniform ivec2 renderSize;       // the lower left part of the texture that was rendered
+uniform vec2 textureSize;
+uniform ivec2 viewportOrigin;
+uniform float subpixel;         // 0..1, how much thin features are smoothed
+uniform float edgeThreshold;    // contrast needed, relative to the brightest neighbour
+
+const float EDGE_THRESHOLD_MIN = 0.0312;
+const int SEARCH_STEPS = 10;
+const float SEARCH_STRIDE[SEARCH_STEPS] = float[](1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 4.0);
+
+vec3 fetch(vec2 position)
+{
+    position = clamp(position, vec2(0.5), vec2(renderSize) - 0.5);
+    return texture(scene, position / textureSize).rgb;
+}
+
+float luma(vec2 position)
+{
+    return dot(fetch(position), vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec2 position = gl_FragCoord.xy - vec2(viewportOrigin);
+    vec3 color = fetch(position);
+    float lumaCenter = dot(color, vec3(0.299, 0.587, 0.114));
+    float lumaDown = luma(position + vec2(0.0, -1.0));
+    float lumaUp = luma(position + vec2(0.0, 1.0));
+    float lumaLeft = luma(position + vec2(-1.0, 0.0));
+    float lumaRight = luma(position + vec2(1.0, 0.0));
+
+    float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+    float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+    float range = lumaMax - lumaMin;
+    if (range < max(EDGE_THRESHOLD_MIN, lumaMax * edgeThreshold))
+    {
+        FragColor = vec4(color, 1.0);
+        return;
+    }
+
+    float lumaDownLeft = luma(position + vec2(-1.0, -1.0));
+    float lumaUpRight = luma(position + vec2(1.0, 1.0));
+    float lumaUpLeft = luma(position + vec2(-1.0, 1.0));
+    float lumaDownRight = luma(position + vec2(1.0, -1.0));
+
+    float lumaDownUp = lumaDown + lumaUp;
+    float lumaLeftRight = lumaLeft + lumaRight;
+    float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+    float lumaDownCorners = lumaDownLeft + lumaDownRight;
+    float lumaRightCorners = lumaDownRight + lumaUpRight;
+    float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+    float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) + abs(-2.0 * lumaCenter + lumaDownUp) * 2.0
+                         + abs(-2.0 * lumaRight + lumaRightCorners);
+    float edgeVertical = abs(-2.0 * lumaUp + lumaUpCorners) + abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0
+                       + abs(-2.0 * lumaDown + lumaDownCorners);
+    bool horizontal = edgeHorizontal >= edgeVertical;
+
+    // which side of the pixel the edge is on
+    float luma1 = horizontal ? lumaDown : lumaLeft;
+    float luma2 = horizontal ? lumaUp : lumaRight;
+    float gradient1 = luma1 - lumaCenter;
+    float gradient2 = luma2 - lumaCenter;
+    bool steepest1 = abs(gradient1) >= abs(gradient2);
+    float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+    float stepLength = steepest1 ? -1.0 : 1.0;
+    float lumaLocalAverage = 0.5 * ((steepest1 ? luma1 : luma2) + lumaCenter);
+
+    // walk along the edge, half a pixel towards it, until the luma leaves the edge's
+    vec2 edgePosition = position + (horizontal ? vec2(0.0, stepLength * 0.5) : vec2(stepLength * 0.5, 0.0));
+    vec2 direction = horizontal ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
+    vec2 position1 = edgePosition - direction;
+    vec2 position2 = edgePosition + direction;
+    float lumaEnd1 = luma(position1) - lumaLocalAverage;
+    float lumaEnd2 = luma(position2) - lumaLocalAverage;
+    bool reached1 = abs(lumaEnd1) >= gradientScaled;
+    bool reached2 = abs(lumaEnd2) >= gradientScaled;
+    for (int i = 0; i < SEARCH_STEPS && !(reached1 && reached2); i++)
+    {
+        if (!reached1)
+        {
+            position1 -= direction * SEARCH_STRIDE[i];
+            lumaEnd1 = luma(position1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+        }
+        if (!reached2)
+        {
+            position2 += direction * SEARCH_STRIDE[i];
+            lumaEnd2 = luma(position2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+        }
+    }
+
+    float distance1 = horizontal ? position.x - position1.x : position.y - position1.y;
+    float distance2 = horizontal ? position2.x - position.x : position2.y - position.y;
+    bool nearer1 = distance1 < distance2;
+    float edgeLength = distance1 + distance2;
+    float pixelOffset = -min(distance1, distance2) / edgeLength + 0.5;
+    // only blend when the nearer end goes the other way than the center
+    bool centerSmaller = lumaCenter < lumaLocalAverage;
+    bool correctVariation = ((nearer1 ? lumaEnd1 : lumaEnd2) < 0.0) != centerSmaller;
+    float offset = correctVariation ? pixelOffset : 0.0;
+
+    float lumaAverage = (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners) / 12.0;
+    float subpixel1 = clamp(abs(lumaAverage - lumaCenter) / range, 0.0, 1.0);
+    float subpixel2 = (-2.0 * subpixel1 + 3.0) * subpixel1 * subpixel1;
+    offset = max(offset, subpixel2 * subpixel2 * subpixel);
+
+    vec2 finalPosition = position + (horizontal ? vec2(0.0, offset * stepLength) : vec2(offset * stepLength, 0.0));
+    FragColor = vec4(fetch(finalPosition), 1.0);
+}
@@ -3,25 +3,176 @@
 in vec3 worldPos;
 in vec3 normal;
 
-out vec4 FragColor;
+#ifdef OIT
+// weighted blended order-independent transparency, see weighted_oit.h: the glass goes into
+// two blended targets, no order needed
+layout (location = 0) out vec4 Accumulation;
+layout (location = 1) out vec4 Revealage;
+uniform float glassOpacity;
+uniform bool packedRevealage;       // see oit_composite.frag
+#else
+layout (location = 0) out vec4 FragColor;
+// world space normal and which effect (effectType + 1) / 8, for screen-space reflections;
+// discarded when the target has no second attachment
+layout (location = 1) out vec4 NormalOut;
+#endif
 
-uniform samplerCube skybox;
-uniform vec3 cameraPos;
+// the skybox, or the object's reflection probe once it has one
+uniform samplerCube environment;
+// blurrier mip levels for rougher surfaces; environmentMaxLod is 0 without a mip chain
+uniform float roughness;
+uniform float environmentMaxLod;
+// shared by every program that draws the scene, see CameraBlock in camera.h
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+// the sun: direction towards it and its colour
+uniform vec3 sunDirection;
+uniform vec3 sunColor;
+
+// cascaded shadow maps, see cascaded_shadows.h
+uniform sampler2DArrayShadow shadowMap;
+uniform int shadowCascades;         // 0: no shadows
+uniform mat4 shadowMatrices[4];     // world to shadow map texture coordinates and depth
+uniform vec4 shadowSplits;          // view depth where each cascade ends
+uniform vec4 shadowTexelSizes;      // world units per texel of each cascade
+uniform int shadowPcfRadius;
+uniform float shadowNormalBias;     // in texels
 
+#ifdef INSTANCED
+// x: effectType, y: ior, z: dispersion, w: reflectivity
+flat in vec4 instanceParams;
+#else
 uniform float ior;
 uniform float dispersion;
 uniform float reflectivity;
 uniform int effectType; // 0: Reflection, 1: Refraction, 2: Chromatic, 3: Fresnel
+#endif
+
+// spectral dispersion for effectType 2, see spectral_dispersion.h; 0 samples: the RGB rays
+uniform int spectralSamples;
+uniform float spectralOffset;       // rotates the stratified wavelengths, 0..1
+uniform bool spectralNoise;         // a different rotation per pixel, for the TAA history to average
+
+#ifdef FRESNEL_LUT
+// Schlick's term baked over (cos theta, F0), see fresnel_lut.h; texel centers on the grid points
+uniform sampler2D fresnelLUT;
+const vec2 FRESNEL_LUT_SIZE = vec2(256.0, 16.0);
 
+float fresnelSchlick(vec3 I, vec3 N, float F0)
+{
+    vec2 lutPos = vec2(max(dot(-I, N), 0.0), clamp(F0, 0.0, 1.0));
+    return texture(fresnelLUT, (lutPos * (FRESNEL_LUT_SIZE - 1.0) + 0.5) / FRESNEL_LUT_SIZE).r;
+}
+#else
 float fresnelSchlick(vec3 I, vec3 N, float F0)
 {
     return F0 + (1.0 - F0) * pow(1.0 - max(dot(-I, N), 0.0), 5.0);
 }
+#endif
+
+vec3 sampleEnvironment(vec3 direction)
+{
+    return textureLod(environment, direction, roughness * environmentMaxLod).rgb;
+}
+
+// Visible range in nm and the channel each wavelength counts for: one parabolic lobe per
+// channel, centered at LOBE_CENTERS with half width LOBE_WIDTH, all inside the range. A lobe
+// integrates to 4/3 of its half width, which keeps white light white.
+const float SPECTRUM_START = 380.0;
+const float SPECTRUM_END = 680.0;
+const vec3 LOBE_CENTERS = vec3(610.0, 540.0, 450.0);
+const float LOBE_WIDTH = 70.0;
+
+vec3 channelWeights(float wavelength)
+{
+    vec3 x = (wavelength - LOBE_CENTERS) / LOBE_WIDTH;
+    return max(1.0 - x * x, 0.0);
+}
+
+// Cauchy's n = A + B / lambda^2 (lambda in micrometers), n(550 nm) = ior and
+// n(450 nm) - n(650 nm) = 2 * dispersion, as far apart as the RGB rays
+vec3 spectralRefraction(vec3 I, vec3 N, float ior, float dispersion)
+{
+    float B = 2.0 * dispersion / (1.0 / (0.45 * 0.45) - 1.0 / (0.65 * 0.65));
+    float A = ior - B / (0.55 * 0.55);
+    // interleaved gradient noise, so neighbouring pixels trace different wavelengths
+    float noise = spectralNoise ? fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715)))) : 0.0;
+    float rotation = fract(spectralOffset + noise);
+
+    vec3 sum = vec3(0.0);
+    for (int i = 0; i < spectralSamples; i++)
+    {
+        float wavelength = mix(SPECTRUM_START, SPECTRUM_END, (float(i) + rotation) / float(spectralSamples));
+        float micrometers = wavelength * 0.001;
+        float n = A + B / (micrometers * micrometers);
+        // every channel keeps its own part of what the ray sees, by how much this wavelength counts for it
+        vec3 T = refract(I, N, 1.0 / n);
+        sum += sampleEnvironment(T) * channelWeights(wavelength);
+    }
+    // Monte Carlo over the range against the lobe integrals
+    float stratum = (SPECTRUM_END - SPECTRUM_START) / float(spectralSamples);
+    return sum * stratum / (LOBE_WIDTH * 4.0 / 3.0);
+}
+
+// how much of the sun reaches worldPos, filtered over (2r + 1)^2 hardware compared taps
+float sunShadow(vec3 N, vec3 L)
+{
+    if (shadowCascades == 0)
+        return 1.0;
+    float viewDepth = -(view * vec4(worldPos, 1.0)).z;
+    if (viewDepth > shadowSplits[shadowCascades - 1])
+        return 1.0;
+    int cascade = 0;
+    for (int i = 0; i < shadowCascades - 1; i++)
+        if (viewDepth > shadowSplits[i])
+            cascade = i + 1;
+
+    // the lookup moves out along the normal, further where the surface turns from the sun
+    float slope = 1.0 - max(dot(N, L), 0.0);
+    vec3 offsetPos = worldPos + N * shadowTexelSizes[cascade] * shadowNormalBias * (0.5 + slope);
+    vec3 coord = (shadowMatrices[cascade] * vec4(offsetPos, 1.0)).xyz;
+    if (any(lessThan(coord, vec3(0.0))) || any(greaterThan(coord, vec3(1.0))))
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -shadowPcfRadius; y <= shadowPcfRadius; y++)
+        for (int x = -shadowPcfRadius; x <= shadowPcfRadius; x++)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+    float taps = float(2 * shadowPcfRadius + 1);
+    return lit / (taps * taps);
+}
 
 void main()
 {
+#ifdef GROUND
+    // a checkered floor catching the shadows, with the environment straight above as ambient
+    vec3 groundN = normalize(normal);
+    vec3 sunL = normalize(sunDirection);
+    vec2 cell = floor(worldPos.xz);
+    vec3 albedo = mix(vec3(0.30), vec3(0.45), mod(cell.x + cell.y, 2.0));
+    vec3 ambient = 0.35 * textureLod(environment, groundN, environmentMaxLod).rgb;
+    vec3 sunLight = sunColor * max(dot(groundN, sunL), 0.0) * sunShadow(groundN, sunL);
+    FragColor = vec4(albedo * (ambient + sunLight), 1.0);
+    // no reflections off the floor
+    NormalOut = vec4(0.0);
+    return;
+#endif
+
+#ifdef INSTANCED
+    int effectType = int(instanceParams.x + 0.5);
+    float ior = instanceParams.y;
+    float dispersion = instanceParams.z;
+    float reflectivity = instanceParams.w;
+#endif
+
     vec3 N = normalize(normal);
-    vec3 I = normalize(worldPos - cameraPos); 
+    vec3 I = normalize(worldPos - cameraPos.xyz); 
 
     // Calculate fresnel term (used for multiple effects)
     float eta = 1.0 / ior;
@@ -32,13 +183,17 @@ void main()
     {
         // Pure Reflection
         vec3 R = reflect(I, N);
-        finalColor = texture(skybox, R).rgb;
+        finalColor = sampleEnvironment(R);
     }
     else if (effectType == 1) 
     {
         // Pure Refraction 
         vec3 T = refract(I, N, eta); // Use green channel eta as base
-        finalColor = texture(skybox, T).rgb;
+        finalColor = sampleEnvironment(T);
+    }
+    else if (effectType == 2 && spectralSamples > 0)
+    {
+        finalColor = spectralRefraction(I, N, ior, dispersion);
     }
     else if (effectType == 2) 
     {
@@ -52,9 +207,9 @@ void main()
         vec3 T_B = refract(I, N, ratioB);
 
         vec3 refrColor;
-        refrColor.r = texture(skybox, T_R).r;
-        refrColor.g = texture(skybox, T_G).g;
-        refrColor.b = texture(skybox, T_B).b;
+        refrColor.r = sampleEnvironment(T_R).r;
+        refrColor.g = sampleEnvironment(T_G).g;
+        refrColor.b = sampleEnvironment(T_B).b;
 
         finalColor = refrColor;
     }
@@ -64,8 +219,8 @@ void main()
         vec3 R = reflect(I, N);
         vec3 T = refract(I, N, eta); 
 
-        vec3 reflColor = texture(skybox, R).rgb;
-        vec3 refrColor = texture(skybox, T).rgb;
+        vec3 reflColor = sampleEnvironment(R);
+        vec3 refrColor = sampleEnvironment(T);
 
         float F = fresnelSchlick(I, N, reflectivity);
         
@@ -73,5 +228,30 @@ void main()
         
     }
 
+    // sun highlight, gone where the object is in shadow
+    vec3 L = normalize(sunDirection);
+    float highlight = pow(max(dot(N, normalize(L - I)), 0.0), 256.0);
+    if (highlight > 0.0)
+        finalColor += sunColor * highlight * sunShadow(N, L);
+
+#ifdef OIT
+    // nearer layers weigh more, so the front one dominates where several overlap
+    // (McGuire and Bavoil's depth weight, equation 7)
+    float alpha = glassOpacity;
+    float viewDepth = -(view * vec4(worldPos, 1.0)).z;
+    float weight = alpha * clamp(10.0 / (1e-5 + pow(viewDepth / 5.0, 2.0) + pow(viewDepth / 200.0, 6.0)), 1e-2, 3e3);
+    if (packedRevealage)
+    {
+        Accumulation = vec4(finalColor * alpha * weight, alpha);
+        Revealage = vec4(alpha * weight);
+    }
+    else
+    {
+        Accumulation = vec4(finalColor * alpha, alpha) * weight;
+        Revealage = vec4(alpha);
+    }
+#else
     FragColor = vec4(finalColor, 1.0);
+    NormalOut = vec4(N, float(effectType + 1) / 8.0);
+#endif
 }
\ No newline at end of file
@@ -3,17 +3,41 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 
+#ifdef INSTANCED
+// per instance, see InstanceData in mesh.h
+in mat4 iModel;
+in mat3 iNormalMatrix;
+in vec4 iParams;
+
+flat out vec4 instanceParams;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 uniform mat3 normalMatrix;
+#endif
+
+// shared by every program that draws the scene, see CameraBlock in camera.h
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
 
 out vec3 worldPos;
 out vec3 normal;
 out vec3 crntPos;
 
+// depth.vert lays down the depth for GL_EQUAL with the same expression
+invariant gl_Position;
+
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = iModel;
+    mat3 normalMatrix = iNormalMatrix;
+    instanceParams = iParams;
+#endif
+
     vec4 worldPos4 = model * vec4(aPos, 1.0);
 
     worldPos = worldPos4.xyz;
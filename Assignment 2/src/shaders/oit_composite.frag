@@ -0,0 +1,33 @@
+#version 330 core
+
+// Weighted blended order-independent transparency, second half: the weighted average colour
+// of every transparent layer of the pixel, over the opaque scene by how much of it they let
+// through. Blended with (ONE_MINUS_SRC_ALPHA, SRC_ALPHA), so alpha is what stays visible.
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D accumulation;     // sum of (colour * alpha, alpha) * weight
+uniform sampler2D revealage;        // product of (1 - alpha)
+uniform ivec2 viewportOrigin;
+// without per draw buffer blending (GL 3.3) the revealage lives in accumulation.a and the
+// sum of alpha * weight in revealage.r instead
+uniform bool packedRevealage;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy) - viewportOrigin;
+    vec4 accum = texelFetch(accumulation, pixel, 0);
+    float other = texelFetch(revealage, pixel, 0).r;
+    float revealed = packedRevealage ? accum.a : other;
+    float weights = packedRevealage ? other : accum.a;
+    // no transparent surface here
+    if (revealed >= 1.0)
+        discard;
+
+    // many bright layers can overflow half floats; fall back to the weight sum as colour
+    if (any(isinf(accum.rgb)))
+        accum.rgb = vec3(weights);
+    FragColor = vec4(accum.rgb / max(weights, 1e-5), revealed);
+}
@@ -1,6 +1,8 @@
 #version 330 core 
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+// nothing for screen-space reflections here, see object.frag
+layout (location = 1) out vec4 NormalOut;
 
 in vec3 TexCoords;
 
@@ -9,6 +11,5 @@ uniform samplerCube skybox;
 void main()
 {
     FragColor = texture(skybox, TexCoords);
-   
+    NormalOut = vec4(0.0);
 }
-
@@ -0,0 +1,19 @@
+#version 330 core
+
+// Writes the scene to the real target, with the screen-space result laid over the surfaces
+// that had a hit. Misses keep the cubemap sample from object.frag.
+
+out vec4 FragColor;
+
+uniform sampler2D sceneColor;
+uniform sampler2D resolved;
+uniform ivec2 viewportOrigin;
+uniform float strength;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy) - viewportOrigin;
+    vec3 scene = texelFetch(sceneColor, pixel, 0).rgb;
+    vec4 reflection = texelFetch(resolved, pixel, 0);
+    FragColor = vec4(mix(scene, reflection.rgb, clamp(reflection.a, 0.0, 1.0) * strength), 1.0);
+}
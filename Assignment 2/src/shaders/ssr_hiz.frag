@@ -0,0 +1,40 @@
+#version 330 core
+
+// One level of the HiZ pyramid: every texel keeps the nearest depth of the texels it covers
+// one level below (level 0 copies the depth buffer). Only the rendered corner is reduced.
+
+out float Depth;
+
+// the depth buffer, or the HiZ texture with base and max level set to the level below, so
+// reading it while writing the next level is no feedback loop
+uniform sampler2D source;
+uniform ivec2 sourceSize;     // rendered size of the level below
+uniform bool copy;
+
+float fetchDepth(ivec2 texel)
+{
+    return texelFetch(source, min(texel, sourceSize - 1), 0).r;
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (copy)
+    {
+        Depth = fetchDepth(texel);
+        return;
+    }
+    ivec2 base = texel * 2;
+    float nearest = min(min(fetchDepth(base), fetchDepth(base + ivec2(1, 0))),
+                        min(fetchDepth(base + ivec2(0, 1)), fetchDepth(base + ivec2(1, 1))));
+    // odd sizes: the last column/row also covers the texel that has no partner
+    bool oddX = (sourceSize.x & 1) == 1 && base.x + 2 == sourceSize.x - 1;
+    bool oddY = (sourceSize.y & 1) == 1 && base.y + 2 == sourceSize.y - 1;
+    if (oddX)
+        nearest = min(nearest, min(fetchDepth(base + ivec2(2, 0)), fetchDepth(base + ivec2(2, 1))));
+    if (oddY)
+        nearest = min(nearest, min(fetchDepth(base + ivec2(0, 2)), fetchDepth(base + ivec2(1, 2))));
+    if (oddX && oddY)
+        nearest = min(nearest, fetchDepth(base + ivec2(2, 2)));
+    Depth = nearest;
+}
@@ -0,0 +1,83 @@
+#version 330 core
+
+// Full resolution resolve of the half resolution trace: a bilateral upsample (neighbours
+// that lie on a different surface don't count) accumulated over frames with reprojection.
+
+out vec4 Result;
+
+uniform sampler2D trace;
+uniform sampler2D depthTexture;
+uniform sampler2D normalTexture;
+uniform sampler2D history;
+
+uniform ivec2 renderSize;
+uniform ivec2 traceSize;
+uniform ivec2 pixelOffset;
+uniform vec2 historyScale;       // history texture coordinates per previous frame uv
+uniform bool historyValid;
+uniform float blend;             // weight of the new frame
+uniform float nearPlane;
+uniform float farPlane;
+uniform mat4 inverseViewProjection;
+uniform mat4 previousViewProjection;
+
+float linearDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 normalEffect = texelFetch(normalTexture, pixel, 0);
+    if (normalEffect.w <= 0.0)
+    {
+        Result = vec4(0.0);
+        return;
+    }
+    float depth = texelFetch(depthTexture, pixel, 0).r;
+    float distance = linearDepth(depth);
+    vec3 N = normalize(normalEffect.xyz);
+
+    // the four half resolution samples around us, each traced from pixel * 2 + pixelOffset
+    vec2 position = (vec2(pixel - pixelOffset)) * 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    vec4 sum = vec4(0.0);
+    float weights = 0.0;
+    vec4 low = vec4(1e9), high = vec4(-1e9);
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 sampleTexel = clamp(base + offset, ivec2(0), traceSize - 1);
+        ivec2 source = min(sampleTexel * 2 + pixelOffset, renderSize - 1);
+        vec4 sourceNormal = texelFetch(normalTexture, source, 0);
+        float bilinear = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+        float depthWeight = exp(-abs(linearDepth(texelFetch(depthTexture, source, 0).r) - distance) * 4.0);
+        float normalWeight = pow(max(dot(normalize(sourceNormal.xyz + 1e-5), N), 0.0), 8.0);
+        float sameEffect = abs(sourceNormal.w - normalEffect.w) < 0.01 ? 1.0 : 0.0;
+        float weight = (bilinear + 1e-3) * depthWeight * normalWeight * sameEffect;
+        vec4 value = texelFetch(trace, sampleTexel, 0);
+        sum += value * weight;
+        weights += weight;
+        low = min(low, value);
+        high = max(high, value);
+    }
+    vec4 current = weights > 1e-4 ? sum / weights : vec4(0.0);
+
+    // where this surface point was last frame
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(renderSize);
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec4 previousClip = previousViewProjection * vec4(world.xyz / world.w, 1.0);
+    vec2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5;
+    bool onScreen = all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThanEqual(previousUV, vec2(1.0)));
+    if (!historyValid || !onScreen || weights <= 1e-4)
+    {
+        Result = current;
+        return;
+    }
+    // clamped to what the neighbourhood saw this frame, so stale reflections can't linger
+    vec4 previous = clamp(texture(history, previousUV * historyScale), low, high);
+    Result = mix(previous, current, blend);
+}
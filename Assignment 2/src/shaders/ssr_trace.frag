@@ -0,0 +1,159 @@
+#version 330 core
+
+// Half resolution ray march for screen-space reflections and refraction. Each half resolution
+// pixel traces for one of the four full resolution pixels below it, a different one every
+// frame (pixelOffset); the resolve pass gathers them back.
+//
+// The ray runs in screen space, where both the pixel position and the depth buffer value are
+// linear along it. The HiZ pyramid holds the nearest depth per cell: if the ray stays in front
+// of that over a whole cell it can skip the cell and go one level coarser, otherwise it goes
+// one level finer, down to single pixels where the actual hit test happens.
+//
+// Output: rgb the color seen, a confidence (0: missed, keep the cubemap sample).
+
+out vec4 Result;
+
+uniform sampler2D depthTexture;
+uniform sampler2D normalTexture;   // xyz world normal, w (effectType + 1) / 8
+uniform sampler2D sceneColor;
+uniform sampler2D hiz;
+
+uniform ivec2 renderSize;
+uniform ivec2 pixelOffset;
+uniform int maxLevel;
+uniform int maxSteps;
+uniform float maxDistance;         // world units
+uniform float thickness;           // world units a surface is assumed to extend backwards
+uniform float ior;
+uniform float nearPlane;
+uniform float farPlane;
+
+uniform mat4 viewProjection;
+uniform mat4 inverseViewProjection;
+uniform mat4 view;
+uniform vec3 cameraPos;
+
+float linearDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+// pixels + depth buffer value
+vec3 toScreen(vec3 world)
+{
+    vec4 clip = viewProjection * vec4(world, 1.0);
+    vec3 ndc = clip.xyz / clip.w;
+    return vec3((ndc.xy * 0.5 + 0.5) * vec2(renderSize), ndc.z * 0.5 + 0.5);
+}
+
+int effectAt(ivec2 pixel)
+{
+    return int(texelFetch(normalTexture, pixel, 0).w * 8.0 + 0.5) - 1;
+}
+
+void main()
+{
+    ivec2 pixel = min(ivec2(gl_FragCoord.xy) * 2 + pixelOffset, renderSize - 1);
+    Result = vec4(0.0);
+
+    vec4 normalEffect = texelFetch(normalTexture, pixel, 0);
+    int effect = int(normalEffect.w * 8.0 + 0.5) - 1;
+    if (effect < 0)
+        return;
+
+    float depth = texelFetch(depthTexture, pixel, 0).r;
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(renderSize);
+    vec4 world4 = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 world = world4.xyz / world4.w;
+
+    vec3 N = normalize(normalEffect.xyz);
+    vec3 I = normalize(world - cameraPos);
+    // reflection for the mirror and the Fresnel blend, refraction for the two glass effects
+    bool refraction = effect == 1 || effect == 2;
+    vec3 direction = refraction ? refract(I, N, 1.0 / ior) : reflect(I, N);
+    if (dot(direction, direction) < 0.5)
+        return;   // total internal reflection
+
+    // stop in front of the near plane, rays towards the camera would flip over otherwise
+    float rayLength = maxDistance;
+    float viewZ = (view * vec4(world, 1.0)).z;
+    float viewDirZ = (view * vec4(direction, 0.0)).z;
+    if (viewDirZ > 0.0)
+        rayLength = min(rayLength, (-nearPlane - viewZ) / viewDirZ * 0.99);
+    if (rayLength <= 0.0)
+        return;
+
+    vec3 start = toScreen(world);
+    vec3 end = toScreen(world + direction * rayLength);
+    vec3 delta = end - start;
+
+    // clip the ray to the rendered rectangle
+    float tMax = 1.0;
+    if (delta.x > 0.0) tMax = min(tMax, (float(renderSize.x) - start.x) / delta.x);
+    if (delta.x < 0.0) tMax = min(tMax, -start.x / delta.x);
+    if (delta.y > 0.0) tMax = min(tMax, (float(renderSize.y) - start.y) / delta.y);
+    if (delta.y < 0.0) tMax = min(tMax, -start.y / delta.y);
+    float pixels = length(delta.xy);
+    if (pixels < 1.0)
+        return;
+
+    // a pixel and a half away from the start, clear of the surface we leave from
+    float t = 1.5 / pixels;
+    float epsilon = 0.01 / pixels;
+    vec2 stepSign = vec2(delta.x >= 0.0 ? 1.0 : 0.0, delta.y >= 0.0 ? 1.0 : 0.0);
+    vec2 inverseDelta = vec2(abs(delta.x) > 1e-5 ? 1.0 / delta.x : 1e9, abs(delta.y) > 1e-5 ? 1.0 / delta.y : 1e9);
+
+    int level = 0;
+    bool hit = false;
+    ivec2 hitPixel = ivec2(0);
+    for (int i = 0; i < maxSteps && t < tMax; i++)
+    {
+        vec3 position = start + delta * t;
+        float cellSize = float(1 << level);
+        vec2 cell = floor(position.xy / cellSize);
+        // where the ray leaves this cell
+        vec2 boundary = (cell + stepSign) * cellSize;
+        vec2 tBoundary = (boundary - start.xy) * inverseDelta;
+        float tExit = min(min(tBoundary.x, tBoundary.y) + epsilon, tMax);
+
+        float entryDepth = position.z;
+        float exitDepth = start.z + delta.z * tExit;
+        // the last row/column of a level also covers the odd texel left over below it
+        ivec2 levelSize = max(renderSize >> level, ivec2(1));
+        float cellDepth = texelFetch(hiz, min(ivec2(cell), levelSize - 1), level).r;
+
+        // in front of everything in the cell: skip it and take bigger steps
+        if (max(entryDepth, exitDepth) < cellDepth)
+        {
+            t = tExit;
+            level = min(level + 1, maxLevel);
+            continue;
+        }
+        if (level > 0)
+        {
+            level--;
+            continue;
+        }
+
+        // a single pixel the ray passes behind: a hit if it's not much behind, not our own
+        // surface when refracting (that is where the ray came in)
+        ivec2 candidate = ivec2(cell);
+        bool behindThin = linearDepth(min(entryDepth, exitDepth)) - linearDepth(cellDepth) < thickness;
+        if (behindThin && !(refraction && effectAt(candidate) == effect))
+        {
+            hit = true;
+            hitPixel = candidate;
+            break;
+        }
+        t = tExit;
+    }
+    if (!hit)
+        return;
+
+    // fade out towards the screen border and the end of the ray
+    vec2 hitUV = (vec2(hitPixel) + 0.5) / vec2(renderSize);
+    vec2 border = min(hitUV, 1.0 - hitUV);
+    float confidence = clamp(min(border.x, border.y) * 10.0, 0.0, 1.0) * (1.0 - t * t);
+    Result = vec4(texelFetch(sceneColor, hitPixel, 0).rgb, confidence);
+}
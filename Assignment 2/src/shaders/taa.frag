@@ -0,0 +1,128 @@
+#version 330 core
+
+// Temporal anti-aliasing resolve. Every frame is rendered with a different sub-pixel jitter;
+// blending them over time integrates many samples per pixel.
+//   reprojection  the history is fetched where this pixel was last frame: the motion vector
+//                 of the nearest surface in the 3x3 neighbourhood, or the camera motion alone
+//                 for the sky. Catmull-Rom filtered, bilinear would blur a little every frame.
+//   clipping      the history is clipped towards the neighbourhood's mean, into a box of
+//                 clipGamma standard deviations in YCoCg, which removes most ghosting
+//   rejection     where last frame's motion vector at that spot disagrees with this one, the
+//                 history belongs to another surface (disocclusion): the new frame takes over
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D current;          // the jittered scene, lower left renderSize pixels
+uniform sampler2D velocityTexture;  // from velocity.frag
+uniform sampler2D depthTexture;     // of the velocity pass, 1 where no object was drawn
+uniform sampler2D history;
+uniform sampler2D previousVelocity;
+uniform ivec2 renderSize;
+uniform vec2 textureSize;           // allocated size of every texture here
+uniform ivec2 previousSize;         // render size of the history
+uniform bool historyValid;
+uniform float blend;                // weight of the new frame
+uniform float clipGamma;
+uniform float motionRejection;      // blend added per pixel of motion disagreement
+uniform mat4 reprojection;          // clip space now to clip space last frame, without jitter
+
+vec3 toYCoCg(vec3 c)
+{
+    return vec3(dot(c, vec3(0.25, 0.5, 0.25)), dot(c, vec3(0.5, 0.0, -0.5)), dot(c, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 fromYCoCg(vec3 c)
+{
+    return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+}
+
+// Catmull-Rom from five bilinear taps, the four corner ones carry almost no weight
+vec3 sampleHistory(vec2 uv)
+{
+    vec2 size = vec2(previousSize);
+    vec2 position = uv * size;
+    vec2 center = floor(position - 0.5) + 0.5;
+    vec2 f = position - center;
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+
+    // stay inside the part of the history that was rendered
+    vec2 low = vec2(0.5) / textureSize, high = (size - 0.5) / textureSize;
+    vec2 tc0 = clamp((center - 1.0) / textureSize, low, high);
+    vec2 tc3 = clamp((center + 2.0) / textureSize, low, high);
+    vec2 tc12 = clamp((center + w2 / w12) / textureSize, low, high);
+
+    vec3 result = texture(history, vec2(tc12.x, tc0.y)).rgb * (w12.x * w0.y)
+                + texture(history, vec2(tc0.x, tc12.y)).rgb * (w0.x * w12.y)
+                + texture(history, tc12).rgb * (w12.x * w12.y)
+                + texture(history, vec2(tc3.x, tc12.y)).rgb * (w3.x * w12.y)
+                + texture(history, vec2(tc12.x, tc3.y)).rgb * (w12.x * w3.y);
+    float weight = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+    return max(result / weight, vec3(0.0));
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    vec3 center = vec3(0.0), sum = vec3(0.0), sumSquares = vec3(0.0);
+    float closest = 1.0;
+    ivec2 closestPixel = pixel;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+        {
+            ivec2 p = clamp(pixel + ivec2(x, y), ivec2(0), renderSize - 1);
+            vec3 c = toYCoCg(texelFetch(current, p, 0).rgb);
+            if (x == 0 && y == 0)
+                center = c;
+            sum += c;
+            sumSquares += c * c;
+            float depth = texelFetch(depthTexture, p, 0).r;
+            if (depth < closest)
+            {
+                closest = depth;
+                closestPixel = p;
+            }
+        }
+
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(renderSize);
+    vec2 motion;
+    bool surface = closest < 1.0;
+    if (surface)
+        motion = texelFetch(velocityTexture, closestPixel, 0).xy;
+    else
+    {
+        vec4 previousClip = reprojection * vec4(uv * 2.0 - 1.0, 1.0, 1.0);
+        motion = uv - (previousClip.xy / previousClip.w * 0.5 + 0.5);
+    }
+    vec2 previousUV = uv - motion;
+    if (!historyValid || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0))))
+    {
+        FragColor = vec4(fromYCoCg(center), 1.0);
+        return;
+    }
+
+    vec3 mean = sum / 9.0;
+    vec3 extent = max(clipGamma * sqrt(max(sumSquares / 9.0 - mean * mean, 0.0)), vec3(1e-4));
+    vec3 previous = toYCoCg(sampleHistory(previousUV));
+    vec3 offset = previous - mean;
+    vec3 units = abs(offset / extent);
+    float outside = max(units.x, max(units.y, units.z));
+    if (outside > 1.0)
+        previous = mean + offset / outside;
+
+    float alpha = blend;
+    if (surface)
+    {
+        ivec2 previousPixel = clamp(ivec2(previousUV * vec2(previousSize)), ivec2(0), previousSize - 1);
+        vec2 previousMotion = texelFetch(previousVelocity, previousPixel, 0).xy;
+        float disagreement = length((motion - previousMotion) * vec2(renderSize));
+        alpha = clamp(blend + disagreement * motionRejection, blend, 1.0);
+    }
+    FragColor = vec4(fromYCoCg(mix(previous, center, alpha)), 1.0);
+}
@@ -0,0 +1,50 @@
+#version 330 core
+
+// Stretches the scaled down scene over the window. Only the lower left renderSize pixels of
+// the scene texture were rendered to.
+//   filterMode 0: bilinear
+//   filterMode 1: contrast adaptive sharpening (after AMD's CAS): the bilinear sample is pushed
+//                 away from its four neighbours, less so where the neighbourhood already has
+//                 a lot of contrast, so edges get crisper without ringing
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+uniform vec2 renderSize;    // pixels rendered this frame
+uniform vec2 textureSize;   // pixels allocated
+uniform int filterMode;
+uniform float sharpness;    // 0..1
+
+vec3 fetch(vec2 pixel)
+{
+    // stay inside the rendered part, the rest holds stale pixels
+    pixel = clamp(pixel, vec2(0.5), renderSize - 0.5);
+    return texture(scene, pixel / textureSize).rgb;
+}
+
+void main()
+{
+    vec2 pixel = TexCoords * renderSize;
+    vec3 center = fetch(pixel);
+    if (filterMode == 0)
+    {
+        FragColor = vec4(center, 1.0);
+        return;
+    }
+
+    vec3 north = fetch(pixel + vec2(0.0, 1.0));
+    vec3 south = fetch(pixel - vec2(0.0, 1.0));
+    vec3 east  = fetch(pixel + vec2(1.0, 0.0));
+    vec3 west  = fetch(pixel - vec2(1.0, 0.0));
+
+    vec3 minimum = min(center, min(min(north, south), min(east, west)));
+    vec3 maximum = max(center, max(max(north, south), max(east, west)));
+    // headroom to black and white decides how hard we may sharpen
+    vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, vec3(1e-4)), 0.0, 1.0));
+    vec3 weight = -amount / mix(8.0, 5.0, sharpness);
+
+    vec3 color = (center + (north + south + east + west) * weight) / (1.0 + 4.0 * weight);
+    FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+// screen motion since the last frame, in texture coordinates of the rendered area
+layout (location = 0) out vec2 Velocity;
+
+in vec4 currentClip;
+in vec4 previousClip;
+
+void main()
+{
+    Velocity = (currentClip.xy / currentClip.w - previousClip.xy / previousClip.w) * 0.5;
+}
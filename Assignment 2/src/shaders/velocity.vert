@@ -0,0 +1,38 @@
+#version 330 core
+
+// Motion vectors for temporal anti-aliasing, always drawn instanced through the render queue.
+// The pass has no use for normals or material parameters, so those instance slots carry the
+// previous model matrix instead: iNormalMatrix its upper 3x3, iParams.xyz its translation.
+
+layout (location = 0) in vec3 aPos;
+
+in mat4 iModel;
+in mat3 iNormalMatrix;
+in vec4 iParams;
+
+// shared by every program that draws the scene, see CameraBlock in camera.h
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+// both without the sub-pixel jitter, so only real motion ends up in the vectors
+uniform mat4 currentViewProjection;
+uniform mat4 previousViewProjection;
+
+out vec4 currentClip;
+out vec4 previousClip;
+
+void main()
+{
+    mat4 previousModel = mat4(vec4(iNormalMatrix[0], 0.0), vec4(iNormalMatrix[1], 0.0),
+                              vec4(iNormalMatrix[2], 0.0), vec4(iParams.xyz, 1.0));
+    vec4 worldPos4 = iModel * vec4(aPos, 1.0);
+
+    currentClip = currentViewProjection * worldPos4;
+    previousClip = previousViewProjection * previousModel * vec4(aPos, 1.0);
+
+    gl_Position = projection * view * worldPos4;
+}
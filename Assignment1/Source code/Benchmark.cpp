@@ -0,0 +1,364 @@
+//
+//  Benchmark.cpp
+//
+
+#include"Benchmark.h"
+
+#include<GLFW/glfw3.h>
+
+#include<iostream>
+#include<fstream>
+#include<algorithm>
+#include<cmath>
+#include<cstdlib>
+#include<cstring>
+
+#if defined(__linux__)
+#include<unistd.h>
+#elif defined(__APPLE__)
+#include<mach/mach.h>
+#endif
+
+
+//Helpers for the report
+namespace
+{
+    bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLubyte* extension = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+            if (extension && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte* value = glGetString(name);
+        std::string text = value ? reinterpret_cast<const char*>(value) : "unknown";
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    //Nearest rank on sorted values
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    std::string statistics(std::vector<double> values)
+    {
+        if (values.empty())
+            return "null";
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+        return "{ \"min\": " + std::to_string(values.front()) +
+               ", \"avg\": " + std::to_string(sum / static_cast<double>(values.size())) +
+               ", \"p50\": " + std::to_string(percentile(values, 50)) +
+               ", \"p95\": " + std::to_string(percentile(values, 95)) +
+               ", \"p99\": " + std::to_string(percentile(values, 99)) +
+               ", \"max\": " + std::to_string(values.back()) + " }";
+    }
+
+    long residentKB()
+    {
+#if defined(__linux__)
+        long pages = 0, resident = 0;
+        std::ifstream statm("/proc/self/statm");
+        if (!(statm >> pages >> resident))
+            return 0;
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#elif defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+            return 0;
+        return static_cast<long>(info.resident_size / 1024);
+#else
+        return 0;
+#endif
+    }
+}
+
+
+BenchmarkSettings BenchmarkSettings::fromArguments(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--bench")
+            settings.enabled = true;
+        else if (arg == "--software")
+            settings.software = true;
+        else if (arg == "--analytic-lighting")
+            settings.analyticLighting = true;
+        else if (arg == "--bench-size" && hasValue)
+        {
+            std::string size = argv[++i];
+            size_t x = size.find('x');
+            if (x != std::string::npos)
+            {
+                settings.width = std::max(16, std::atoi(size.substr(0, x).c_str()));
+                settings.height = std::max(16, std::atoi(size.substr(x + 1).c_str()));
+            }
+        }
+        else if (arg == "--bench-warmup" && hasValue)
+            settings.warmupFrames = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--bench-frames" && hasValue)
+            settings.measuredFrames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--bench-out" && hasValue)
+            settings.output = argv[++i];
+        else if (arg == "--lights" && hasValue)
+            settings.lights = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--bench-lights" && hasValue)
+        {
+            std::string list = argv[++i];
+            for (size_t begin = 0; begin < list.size();)
+            {
+                size_t comma = std::min(list.find(',', begin), list.size());
+                settings.lightSweep.push_back(std::max(0, std::atoi(list.substr(begin, comma - begin).c_str())));
+                begin = comma + 1;
+            }
+        }
+    }
+    return settings;
+}
+
+void BenchmarkSettings::initHints() const
+{
+    if (!software)
+        return;
+#ifdef _WIN32
+    _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+#else
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+#endif
+    if (headless())
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+}
+
+void BenchmarkSettings::windowHints() const
+{
+    if (!enabled)
+        return;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (software && headless())
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+}
+
+bool BenchmarkSettings::headless()
+{
+#if defined(__linux__)
+    return !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY");
+#else
+    return false;
+#endif
+}
+
+
+Benchmark::Benchmark(const BenchmarkSettings& benchSettings) : settings(benchSettings)
+{
+    glGenFramebuffers(1, &FBO);
+    glGenTextures(1, &colorTexture);
+    glGenRenderbuffers(1, &depthRBO);
+
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, settings.width, settings.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, settings.width, settings.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Benchmark framebuffer is incomplete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    //GL_TIME_ELAPSED is core in 3.3, we only ask for 3.2
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    timerQueries = major * 10 + minor >= 33 || hasExtension("GL_ARB_timer_query");
+    if (timerQueries)
+    {
+        timers.resize(static_cast<size_t>(settings.measuredFrames));
+        glGenQueries(static_cast<GLsizei>(timers.size()), timers.data());
+    }
+    gpuMemory = hasExtension("GL_NVX_gpu_memory_info");
+
+    std::cout << "Benchmark: " << settings.warmupFrames << " warm-up + " << settings.measuredFrames << " measured frames at "
+              << settings.width << "x" << settings.height << " on " << glString(GL_RENDERER) << std::endl;
+}
+
+Benchmark::~Benchmark()
+{
+    if (!timers.empty())
+        glDeleteQueries(static_cast<GLsizei>(timers.size()), timers.data());
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteRenderbuffers(1, &depthRBO);
+}
+
+
+bool Benchmark::done() const
+{
+    return frame >= settings.warmupFrames + settings.measuredFrames;
+}
+
+float Benchmark::time() const
+{
+    return static_cast<float>(frame) * TIME_STEP;
+}
+
+float Benchmark::aspect() const
+{
+    return static_cast<float>(settings.width) / static_cast<float>(settings.height);
+}
+
+glm::vec3 Benchmark::cameraPosition(const glm::vec3& center, float radius, float height, float period) const
+{
+    float angle = time() / period * 6.2831853f;
+    return center + glm::vec3(std::cos(angle) * radius, height + std::sin(angle * 2.0f) * radius * 0.15f, std::sin(angle) * radius);
+}
+
+bool Benchmark::measuring() const
+{
+    return frame >= settings.warmupFrames && !done();
+}
+
+
+void Benchmark::beginFrame()
+{
+    //CPU time of a frame runs from its beginFrame() to the next one
+    auto now = std::chrono::high_resolution_clock::now();
+    if (measuring())
+        lastStart = now;
+    size_t previous = static_cast<size_t>(frame - settings.warmupFrames - 1);
+    if (frame > settings.warmupFrames && previous < samples.size())
+        samples[previous].cpuMs = std::chrono::duration<double, std::milli>(now - previousStart).count();
+    previousStart = now;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, settings.width, settings.height);
+    if (measuring() && timerQueries)
+        glBeginQuery(GL_TIME_ELAPSED, timers[static_cast<size_t>(frame - settings.warmupFrames)]);
+}
+
+void Benchmark::endFrame(int drawCalls, int lights, double lightMs)
+{
+    if (measuring())
+    {
+        if (timerQueries)
+            glEndQuery(GL_TIME_ELAPSED);
+        Sample sample;
+        sample.drawCalls = drawCalls;
+        sample.lights = lights;
+        sample.lightMs = lightMs;
+        sample.residentKB = residentKB();
+        sample.gpuMemoryKB = gpuMemoryUsedKB();
+        samples.push_back(sample);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    frame++;
+}
+
+long Benchmark::gpuMemoryUsedKB() const
+{
+    if (!gpuMemory)
+        return -1;
+    GLint total = 0, available = 0;
+    glGetIntegerv(0x9048, &total);       //GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+    glGetIntegerv(0x9049, &available);   //GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+    return static_cast<long>(total) - static_cast<long>(available);
+}
+
+
+Benchmark::Summary Benchmark::finish()
+{
+    if (!samples.empty())
+        samples.back().cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - lastStart).count();
+    glFinish();
+    //Queries are only read now so waiting for them never shows up in the frame times
+    if (timerQueries)
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(timers[i], GL_QUERY_RESULT, &ns);
+            samples[i].gpuMs = static_cast<double>(ns) / 1e6;
+        }
+
+    std::ofstream csv(settings.output + ".csv");
+    csv << "frame,cpu_ms,gpu_ms,draw_calls,lights,light_ms,rss_kb,gpu_memory_kb\n";
+    for (size_t i = 0; i < samples.size(); i++)
+        csv << i << "," << samples[i].cpuMs << "," << samples[i].gpuMs << "," << samples[i].drawCalls << ","
+            << samples[i].lights << "," << samples[i].lightMs << "," << samples[i].residentKB << "," << samples[i].gpuMemoryKB << "\n";
+
+    std::vector<double> cpu, gpu, draws, lightMs;
+    long peakResident = 0, peakGpuMemory = -1;
+    for (const Sample& sample : samples)
+    {
+        cpu.push_back(sample.cpuMs);
+        if (timerQueries)
+            gpu.push_back(sample.gpuMs);
+        draws.push_back(sample.drawCalls);
+        lightMs.push_back(sample.lightMs);
+        peakResident = std::max(peakResident, sample.residentKB);
+        peakGpuMemory = std::max(peakGpuMemory, sample.gpuMemoryKB);
+    }
+
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    std::ofstream json(settings.output + ".json");
+    json << "{\n"
+         << "  \"app\": \"RTR_Assignment1\",\n"
+         << "  \"renderer\": \"" << glString(GL_RENDERER) << "\",\n"
+         << "  \"gl_version\": \"" << major << "." << minor << "\",\n"
+         << "  \"width\": " << settings.width << ",\n"
+         << "  \"height\": " << settings.height << ",\n"
+         << "  \"warmup_frames\": " << settings.warmupFrames << ",\n"
+         << "  \"measured_frames\": " << samples.size() << ",\n"
+         << "  \"cpu_ms\": " << statistics(cpu) << ",\n"
+         << "  \"gpu_ms\": " << statistics(gpu) << ",\n"
+         << "  \"draw_calls\": " << statistics(draws) << ",\n"
+         << "  \"lights\": " << (samples.empty() ? 0 : samples.back().lights) << ",\n"
+         << "  \"light_ms\": " << statistics(lightMs) << ",\n"
+         << "  \"peak_rss_kb\": " << peakResident << ",\n"
+         << "  \"peak_gpu_memory_kb\": " << (peakGpuMemory >= 0 ? std::to_string(peakGpuMemory) : "null") << "\n"
+         << "}\n";
+
+    std::sort(cpu.begin(), cpu.end());
+    std::sort(gpu.begin(), gpu.end());
+    std::cout << "Benchmark: CPU ms p50 " << percentile(cpu, 50) << ", p95 " << percentile(cpu, 95) << ", p99 " << percentile(cpu, 99);
+    if (timerQueries)
+        std::cout << " | GPU ms p50 " << percentile(gpu, 50) << ", p95 " << percentile(gpu, 95) << ", p99 " << percentile(gpu, 99);
+    std::cout << " -> " << settings.output << ".csv/.json" << std::endl;
+
+    std::sort(lightMs.begin(), lightMs.end());
+    Summary summary;
+    summary.cpuMs = percentile(cpu, 50);
+    summary.gpuMs = timerQueries ? percentile(gpu, 50) : -1.0;
+    summary.lightMs = percentile(lightMs, 50);
+    return summary;
+}
@@ -0,0 +1,303 @@
+//
+//  CascadedShadows.cpp
+//
+
+#include"CascadedShadows.h"
+
+#include<glm/gtc/matrix_transform.hpp>
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+#include<iostream>
+#include<string>
+
+
+namespace
+{
+    //Rounds down to a multiple of step, negative values too
+    int floorStep(int value, int step)
+    {
+        return (value >= 0 ? value / step : (value - step + 1) / step) * step;
+    }
+
+    bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLubyte* extension = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+            if (extension && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+
+CascadedShadows::CascadedShadows(int size) : resolution(size), staticBorder(size / 8)
+{
+    glGenFramebuffers(1, &shadowFBO);
+    glGenFramebuffers(1, &staticFBO);
+    for (GLuint framebuffer : { shadowFBO, staticFBO })
+    {
+        //Depth only
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    shadowMap = createLayers(resolution, true);
+
+    //Same check as the benchmark, timer queries are core in 3.3 and we ask for 3.2. Timestamps
+    //rather than GL_TIME_ELAPSED, which can't nest inside the benchmark's frame query
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    timerQueries = major * 10 + minor >= 33 || hasExtension("GL_ARB_timer_query");
+    if (timerQueries)
+        glGenQueries(FRAMES_IN_FLIGHT * (MAX_CASCADES + 1), &queries[0][0]);
+}
+
+CascadedShadows::~CascadedShadows()
+{
+    if (timerQueries)
+        glDeleteQueries(FRAMES_IN_FLIGHT * (MAX_CASCADES + 1), &queries[0][0]);
+    glDeleteTextures(1, &shadowMap);
+    if (staticMap)
+        glDeleteTextures(1, &staticMap);
+    glDeleteFramebuffers(1, &shadowFBO);
+    glDeleteFramebuffers(1, &staticFBO);
+}
+
+
+void CascadedShadows::update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& direction)
+{
+    readTimings();
+    cascadeCount = std::clamp(cascadeCount, 2, MAX_CASCADES);
+
+    glm::vec3 light = glm::normalize(direction);
+    if (light != lightDirection)
+    {
+        lightDirection = light;
+        invalidateStatic();
+    }
+
+    float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    float tanX = 1.0f / projection[0][0];
+    float tanY = 1.0f / projection[1][1];
+    float farPlane = std::max(shadowDistance, nearPlane * 2.0f);
+    glm::mat4 inverseView = glm::inverse(view);
+
+    glm::vec3 up = std::abs(light.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), -light, up);
+
+    float splitNear = nearPlane;
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        //Blend of logarithmic and uniform splits
+        float t = static_cast<float>(i + 1) / static_cast<float>(cascadeCount);
+        float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+        float uniform = nearPlane + (farPlane - nearPlane) * t;
+        float splitFar = uniform + (logarithmic - uniform) * splitLambda;
+
+        //Bounding sphere of the slice's corners, in view space so it is the same wherever the camera is
+        glm::vec3 corners[8];
+        glm::vec3 viewCenter(0.0f);
+        for (int c = 0; c < 8; c++)
+        {
+            float z = c < 4 ? splitNear : splitFar;
+            corners[c] = glm::vec3((c & 1 ? 1.0f : -1.0f) * z * tanX, (c & 2 ? 1.0f : -1.0f) * z * tanY, -z);
+            viewCenter += corners[c] / 8.0f;
+        }
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners)
+            radius = std::max(radius, glm::length(corner - viewCenter));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+        glm::vec3 center = glm::vec3(inverseView * glm::vec4(viewCenter, 1.0f));
+
+        //Snapped to whole texels across and quarter radii along the light. The map reaches a
+        //texel past the sphere, snapping moves the center by less than that.
+        float texel = 2.0f * radius / static_cast<float>(resolution - 2);
+        float extent = radius + texel;
+        float depthStep = radius * 0.25f;
+        glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+        glm::ivec2 texelCenter(static_cast<int>(std::floor(lightCenter.x / texel)), static_cast<int>(std::floor(lightCenter.y / texel)));
+        lightCenter.x = static_cast<float>(texelCenter.x) * texel;
+        lightCenter.y = static_cast<float>(texelCenter.y) * texel;
+        lightCenter.z = std::floor(lightCenter.z / depthStep) * depthStep;
+
+        float towardsLight = radius + casterMargin;
+        float farPlane = towardsLight + radius + depthStep;
+        glm::mat4 lightView = glm::translate(glm::mat4(1.0f), -(lightCenter + glm::vec3(0.0f, 0.0f, towardsLight))) * lightRotation;
+        glm::mat4 lightProjection = glm::ortho(-extent, extent, -extent, extent, 0.0f, farPlane);
+
+        Cascade& cascade = cascades[i];
+        cascade.viewProjection = lightProjection * lightView;
+
+        //Static layer: same depth range, centered on the border step below the cascade's center,
+        //so the cascade sits 0..staticBorder - 1 texels into the border. Only changes in border steps.
+        glm::ivec2 staticCenter(floorStep(texelCenter.x, staticBorder), floorStep(texelCenter.y, staticBorder));
+        float staticExtent = extent + static_cast<float>(staticBorder) * texel;
+        glm::vec3 staticLightCenter(static_cast<float>(staticCenter.x) * texel, static_cast<float>(staticCenter.y) * texel, lightCenter.z);
+        glm::mat4 staticView = glm::translate(glm::mat4(1.0f), -(staticLightCenter + glm::vec3(0.0f, 0.0f, towardsLight))) * lightRotation;
+        glm::mat4 staticViewProjection = glm::ortho(-staticExtent, staticExtent, -staticExtent, staticExtent, 0.0f, farPlane) * staticView;
+        if (staticViewProjection != cascade.staticViewProjection)
+        {
+            cascade.staticViewProjection = staticViewProjection;
+            cascade.staticValid = false;
+        }
+        cascade.staticOffset = texelCenter - staticCenter + glm::ivec2(staticBorder);
+        cascade.stats.splitFar = splitFar;
+        cascade.stats.texelSize = texel;
+        splitNear = splitFar;
+    }
+}
+
+
+void CascadedShadows::render(const DrawCasters& draw)
+{
+    if (cacheStatic && !staticMap)
+    {
+        staticMap = createLayers(resolution + 2 * staticBorder, false);
+        invalidateStatic();
+    }
+
+    GLint previousFBO = 0, viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, resolution, resolution);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(slopeBias, constantBias);
+
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        Cascade& cascade = cascades[i];
+        CascadeStats& stats = cascade.stats;
+        stats.staticDraws = stats.dynamicDraws = 0;
+        stats.staticRendered = false;
+        if (timerQueries)
+            glQueryCounter(queries[slot][i], GL_TIMESTAMP);
+
+        if (cacheStatic)
+        {
+            if (!cascade.staticValid)
+            {
+                int staticSize = resolution + 2 * staticBorder;
+                attach(staticFBO, staticMap, i);
+                glViewport(0, 0, staticSize, staticSize);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                stats.staticDraws = draw(cascade.staticViewProjection, STATIC_CASTERS);
+                stats.staticRendered = true;
+                cascade.staticValid = true;
+                rebuilds++;
+                glViewport(0, 0, resolution, resolution);
+            }
+            //The cascade's window of the cached layer is the starting point, dynamic casters go on top
+            attach(shadowFBO, shadowMap, i);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMap, 0, i);
+            glm::ivec2 offset = cascade.staticOffset;
+            glBlitFramebuffer(offset.x, offset.y, offset.x + resolution, offset.y + resolution, 0, 0, resolution, resolution,
+                              GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, shadowFBO);
+        }
+        else
+        {
+            attach(shadowFBO, shadowMap, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            stats.staticDraws = draw(cascade.viewProjection, STATIC_CASTERS);
+        }
+        stats.dynamicDraws = draw(cascade.viewProjection, DYNAMIC_CASTERS);
+    }
+    if (timerQueries)
+        glQueryCounter(queries[slot][cascadeCount], GL_TIMESTAMP);
+    slotCascades[slot] = cascadeCount;
+    slot = (slot + 1) % FRAMES_IN_FLIGHT;
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFBO));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+
+void CascadedShadows::invalidateStatic()
+{
+    for (Cascade& cascade : cascades)
+        cascade.staticValid = false;
+}
+
+
+void CascadedShadows::bind(Shader& shader, int unit) const
+{
+    glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + unit));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap);
+    glActiveTexture(GL_TEXTURE0);
+    shader.setInt("shadowMap", unit);
+    shader.setInt("shadowCascades", cascadeCount);
+
+    //xy to texture coordinates, depth to [0, 1]
+    glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+    glm::vec4 splits(0.0f), texels(0.0f);
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        shader.setMat4("shadowMatrices[" + std::to_string(i) + "]", bias * cascades[i].viewProjection);
+        splits[i] = cascades[i].stats.splitFar;
+        texels[i] = cascades[i].stats.texelSize;
+    }
+    shader.setVec4("shadowSplits", splits);
+    shader.setVec4("shadowTexelSizes", texels);
+    shader.setInt("shadowPcfRadius", pcfRadius);
+    shader.setFloat("shadowNormalBias", normalBias);
+}
+
+
+//One depth layer per cascade, the shadow map compares and the static cache is only copied from
+GLuint CascadedShadows::createLayers(int size, bool compare) const
+{
+    GLuint texture;
+    GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, size, size, MAX_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (compare)
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return texture;
+}
+
+
+void CascadedShadows::attach(GLuint framebuffer, GLuint texture, int layer) const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Shadow framebuffer is incomplete" << std::endl;
+}
+
+
+//The slot about to be reused is FRAMES_IN_FLIGHT frames old, its results are normally there
+void CascadedShadows::readTimings()
+{
+    if (!timerQueries || slotCascades[slot] == 0)
+        return;
+    GLuint64 start = 0;
+    glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+    for (int i = 0; i < slotCascades[slot]; i++)
+    {
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(queries[slot][i + 1], GL_QUERY_RESULT, &end);
+        double ms = static_cast<double>(end - start) / 1e6;
+        start = end;
+        cascades[i].stats.ms += (ms - cascades[i].stats.ms) * 0.1;
+    }
+    slotCascades[slot] = 0;
+}
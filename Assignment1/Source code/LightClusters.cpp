@@ -0,0 +1,264 @@
+//
+//  LightClusters.cpp
+//
+
+#include"LightClusters.h"
+
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<thread>
+
+#if defined(__SSE2__)
+#include<emmintrin.h>
+#endif
+
+
+LightClusters::LightClusters()
+{
+    GLuint* buffers[3] = { &lightBuffer, &clusterBuffer, &indexBuffer };
+    GLuint* textures[3] = { &lightTexture, &clusterTexture, &indexTexture };
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+    for (int i = 0; i < 3; i++)
+    {
+        glGenBuffers(1, buffers[i]);
+        glBindBuffer(GL_TEXTURE_BUFFER, *buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        //The texture keeps pointing at the buffer when its storage is replaced
+        glGenTextures(1, textures[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, *textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], *buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    clusters.resize(CLUSTERS);
+}
+
+LightClusters::~LightClusters()
+{
+    GLuint textures[3] = { lightTexture, clusterTexture, indexTexture };
+    GLuint buffers[3] = { lightBuffer, clusterBuffer, indexBuffer };
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+
+void LightClusters::update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float nearZ, float farZ)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t count = std::min(lights.size(), MAX_LIGHTS);
+    nearPlane = nearZ;
+    farPlane = farZ;
+    sliceScale = static_cast<float>(SLICES) / std::log(farPlane / nearPlane);
+    projectionScale = glm::vec2(projection[0][0], projection[1][1]);
+
+    toViewSpace(lights, view, count);
+    stats.lights = static_cast<int>(count);
+    stats.visibleLights = 0;
+    for (size_t i = 0; i < count; i++)
+        if (depth[i] + radius[i] >= nearPlane && depth[i] - radius[i] <= farPlane)
+            stats.visibleLights++;
+
+    //A few hundred lights are done before a thread would have started
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    int threads = static_cast<int>(std::min<size_t>({ hardware, static_cast<size_t>(SLICES), count / 256 + 1 }));
+    workers.resize(static_cast<size_t>(threads));
+    for (int t = 0; t < threads; t++)
+    {
+        workers[static_cast<size_t>(t)].firstSlice = SLICES * t / threads;
+        workers[static_cast<size_t>(t)].endSlice = SLICES * (t + 1) / threads;
+    }
+    if (threads == 1)
+        assignSlices(workers[0], count);
+    else
+    {
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < workers.size(); t++)
+            pool.emplace_back(&LightClusters::assignSlices, this, std::ref(workers[t]), count);
+        assignSlices(workers[0], count);
+        for (std::thread& thread : pool)
+            thread.join();
+    }
+
+    //Every worker wrote offsets into its own slices' lists, move them behind the previous ones
+    indices.clear();
+    stats.maxPerCluster = 0;
+    for (const Worker& worker : workers)
+    {
+        GLuint base = static_cast<GLuint>(indices.size());
+        size_t first = static_cast<size_t>(worker.firstSlice * TILES_X * TILES_Y);
+        size_t end = static_cast<size_t>(worker.endSlice * TILES_X * TILES_Y);
+        for (size_t c = first; c < end; c++)
+        {
+            clusters[c].x += base;
+            stats.maxPerCluster = std::max(stats.maxPerCluster, static_cast<int>(clusters[c].y));
+        }
+        indices.insert(indices.end(), worker.indices.begin(), worker.indices.end());
+    }
+    stats.indices = static_cast<int>(indices.size());
+    stats.threads = threads;
+
+    lightData.resize(count * 2);
+    for (size_t i = 0; i < count; i++)
+    {
+        lightData[2 * i] = glm::vec4(lights[i].position, lights[i].radius);
+        lightData[2 * i + 1] = glm::vec4(lights[i].color, 0.0f);
+    }
+    auto assigned = std::chrono::high_resolution_clock::now();
+    stats.assignMs = std::chrono::duration<double, std::milli>(assigned - start).count();
+
+    upload();
+    stats.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - assigned).count();
+}
+
+void LightClusters::bind(Shader& shader, int firstUnit, int viewportWidth, int viewportHeight) const
+{
+    const GLuint textures[3] = { lightTexture, clusterTexture, indexTexture };
+    const char* names[3] = { "clusterLights", "clusterGrid", "clusterIndices" };
+    for (int i = 0; i < 3; i++)
+    {
+        glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + firstUnit + i));
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        shader.setInt(names[i], firstUnit + i);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    shader.setVec2("clusterScreen", static_cast<float>(viewportWidth), static_cast<float>(viewportHeight));
+    shader.setFloat("clusterNear", nearPlane);
+    shader.setFloat("clusterFar", farPlane);
+    shader.setFloat("clusterSliceScale", sliceScale);
+}
+
+
+void LightClusters::toViewSpace(const std::vector<PointLight>& lights, const glm::mat4& view, size_t count)
+{
+    viewX.resize(count);
+    viewY.resize(count);
+    depth.resize(count);
+    radius.resize(count);
+    size_t i = 0;
+#if defined(__SSE2__)
+    //Four lights per step, one matrix row per output
+    const __m128 m00 = _mm_set1_ps(view[0][0]), m10 = _mm_set1_ps(view[1][0]), m20 = _mm_set1_ps(view[2][0]), m30 = _mm_set1_ps(view[3][0]);
+    const __m128 m01 = _mm_set1_ps(view[0][1]), m11 = _mm_set1_ps(view[1][1]), m21 = _mm_set1_ps(view[2][1]), m31 = _mm_set1_ps(view[3][1]);
+    const __m128 m02 = _mm_set1_ps(view[0][2]), m12 = _mm_set1_ps(view[1][2]), m22 = _mm_set1_ps(view[2][2]), m32 = _mm_set1_ps(view[3][2]);
+    for (; i + 4 <= count; i += 4)
+    {
+        const PointLight* l = &lights[i];
+        __m128 x = _mm_set_ps(l[3].position.x, l[2].position.x, l[1].position.x, l[0].position.x);
+        __m128 y = _mm_set_ps(l[3].position.y, l[2].position.y, l[1].position.y, l[0].position.y);
+        __m128 z = _mm_set_ps(l[3].position.z, l[2].position.z, l[1].position.z, l[0].position.z);
+        __m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_add_ps(_mm_mul_ps(m20, z), m30));
+        __m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m21, z), m31));
+        __m128 vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_add_ps(_mm_mul_ps(m22, z), m32));
+        _mm_storeu_ps(&viewX[i], vx);
+        _mm_storeu_ps(&viewY[i], vy);
+        //In front of the camera view space z is negative
+        _mm_storeu_ps(&depth[i], _mm_sub_ps(_mm_setzero_ps(), vz));
+        _mm_storeu_ps(&radius[i], _mm_set_ps(l[3].radius, l[2].radius, l[1].radius, l[0].radius));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        glm::vec4 position = view * glm::vec4(lights[i].position, 1.0f);
+        viewX[i] = position.x;
+        viewY[i] = position.y;
+        depth[i] = -position.z;
+        radius[i] = lights[i].radius;
+    }
+}
+
+float LightClusters::sliceDepth(int slice) const
+{
+    return nearPlane * std::exp(static_cast<float>(slice) / sliceScale);
+}
+
+void LightClusters::assignSlices(Worker& worker, size_t count)
+{
+    worker.spans.clear();
+    auto sliceOf = [&](float z)
+    {
+        return std::clamp(static_cast<int>(std::floor(std::log(z / nearPlane) * sliceScale)), 0, SLICES - 1);
+    };
+    auto tileOf = [](float ndc, int tiles)
+    {
+        return std::clamp(static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * static_cast<float>(tiles))), 0, tiles - 1);
+    };
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float d = depth[i], r = radius[i];
+        if (d + r < nearPlane || d - r > farPlane)
+            continue;
+        int first = std::max(sliceOf(std::max(d - r, nearPlane)), worker.firstSlice);
+        int last = std::min(sliceOf(std::min(d + r, farPlane)), worker.endSlice - 1);
+        for (int s = first; s <= last; s++)
+        {
+            //The part of the sphere inside this slice: its widest cross section, over the slice's depth range
+            float z0 = std::max({ sliceDepth(s), d - r, nearPlane });
+            float z1 = std::max(std::min(sliceDepth(s + 1), d + r), z0);
+            float closest = std::clamp(d, z0, z1);
+            float rr = std::sqrt(std::max(r * r - (d - closest) * (d - closest), 0.0f));
+
+            float xMin = std::min((viewX[i] - rr) / z0, (viewX[i] - rr) / z1) * projectionScale.x;
+            float xMax = std::max((viewX[i] + rr) / z0, (viewX[i] + rr) / z1) * projectionScale.x;
+            float yMin = std::min((viewY[i] - rr) / z0, (viewY[i] - rr) / z1) * projectionScale.y;
+            float yMax = std::max((viewY[i] + rr) / z0, (viewY[i] + rr) / z1) * projectionScale.y;
+            if (xMax < -1.0f || xMin > 1.0f || yMax < -1.0f || yMin > 1.0f)
+                continue;
+
+            Span span;
+            span.light = static_cast<uint16_t>(i);
+            span.slice = static_cast<uint8_t>(s);
+            span.x0 = static_cast<uint8_t>(tileOf(xMin, TILES_X));
+            span.x1 = static_cast<uint8_t>(tileOf(xMax, TILES_X));
+            span.y0 = static_cast<uint8_t>(tileOf(yMin, TILES_Y));
+            span.y1 = static_cast<uint8_t>(tileOf(yMax, TILES_Y));
+            worker.spans.push_back(span);
+        }
+    }
+
+    //Count, offsets, then fill; offsets are relative to this worker's list
+    size_t first = static_cast<size_t>(worker.firstSlice * TILES_X * TILES_Y);
+    size_t end = static_cast<size_t>(worker.endSlice * TILES_X * TILES_Y);
+    for (size_t c = first; c < end; c++)
+        clusters[c] = glm::uvec2(0);
+    auto clusterIndex = [](int slice, int y, int x)
+    {
+        return static_cast<size_t>((slice * TILES_Y + y) * TILES_X + x);
+    };
+    for (const Span& span : worker.spans)
+        for (int y = span.y0; y <= span.y1; y++)
+            for (int x = span.x0; x <= span.x1; x++)
+                clusters[clusterIndex(span.slice, y, x)].y++;
+    GLuint offset = 0;
+    for (size_t c = first; c < end; c++)
+    {
+        clusters[c].x = offset;
+        offset += clusters[c].y;
+        clusters[c].y = 0;
+    }
+    worker.indices.resize(offset);
+    for (const Span& span : worker.spans)
+        for (int y = span.y0; y <= span.y1; y++)
+            for (int x = span.x0; x <= span.x1; x++)
+            {
+                glm::uvec2& cluster = clusters[clusterIndex(span.slice, y, x)];
+                worker.indices[cluster.x + cluster.y++] = span.light;
+            }
+}
+
+void LightClusters::upload()
+{
+    //Orphaned every frame so we never wait for the previous frame's draws
+    auto fill = [](GLuint buffer, const void* data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(bytes, 16)), nullptr, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(bytes), data);
+    };
+    fill(lightBuffer, lightData.data(), lightData.size() * sizeof(glm::vec4));
+    fill(clusterBuffer, clusters.data(), clusters.size() * sizeof(glm::uvec2));
+    fill(indexBuffer, indices.data(), indices.size() * sizeof(uint16_t));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
@@ -0,0 +1,342 @@
+//
+//  LightingLUTs.cpp
+//
+
+#include"LightingLUTs.h"
+
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdint>
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<random>
+
+#if defined(__SSE2__)
+#include<emmintrin.h>
+#endif
+
+
+namespace
+{
+    //Bumped whenever the baked functions or the layout change, older caches are ignored
+    const uint32_t CACHE_VERSION = 1;
+
+    struct CacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t cosines;
+        uint32_t roughness;
+        uint32_t toonSize;
+    };
+
+    bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLubyte* extension = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+            if (extension && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    //Oren-Nayar's roughness terms for sigma
+    void orenNayarAB(float sigma, float& a, float& b)
+    {
+        float sigma2 = sigma * sigma;
+        a = 1.0f - 0.5f * (sigma2 / (sigma2 + 0.33f));
+        b = 0.45f * (sigma2 / (sigma2 + 0.09f));
+    }
+
+    //The table's two channels for one pair of cosines. alpha = max(thetaI, thetaR) has the smaller
+    //cosine, beta the larger, so sin(alpha) * tan(beta) needs no trigonometry at all
+    void orenNayarTexel(float cosI, float cosR, float a, float b, float& r, float& g)
+    {
+        float cosAlpha = std::min(cosI, cosR), cosBeta = std::max(cosI, cosR);
+        float sinAlpha = std::sqrt(std::max(1.0f - cosAlpha * cosAlpha, 0.0f));
+        float tanBeta = std::sqrt(std::max(1.0f - cosBeta * cosBeta, 0.0f)) / std::max(cosBeta, 1e-4f);
+        r = cosI * a;
+        g = cosI * b * sinAlpha * tanBeta;
+    }
+
+    //basic.frag's analytic term, word for word
+    double orenNayarAnalytic(double cosI, double cosR, double cosPhi, double sigma)
+    {
+        double thetaI = std::acos(cosI), thetaR = std::acos(cosR);
+        double alpha = std::max(thetaI, thetaR), beta = std::min(thetaI, thetaR);
+        double sigma2 = sigma * sigma;
+        double a = 1.0 - 0.5 * (sigma2 / (sigma2 + 0.33));
+        double b = 0.45 * (sigma2 / (sigma2 + 0.09));
+        return cosI * (a + b * cosPhi * std::sin(alpha) * std::tan(beta));
+    }
+
+    double toonAnalytic(double intensity)
+    {
+        return std::max(std::floor(intensity * 4.0) / 4.0, 0.0);
+    }
+
+    //What the GPU holds for an RG16F / R16F texel: 11 significant bits, fixed steps of 2^-24 below
+    //the smallest normal half. The tables stay far from the largest one
+    float toHalf(float v)
+    {
+        if (std::abs(v) < 6.103515625e-5f)
+            return std::round(v * 16777216.0f) / 16777216.0f;
+        int exponent = 0;
+        float mantissa = std::frexp(v, &exponent);
+        return std::ldexp(std::round(mantissa * 2048.0f) / 2048.0f, exponent);
+    }
+}
+
+
+LightingLUTs::LightingLUTs(const std::string& cachePath)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    current.fromCache = load(cachePath);
+    if (!current.fromCache)
+    {
+        bake();
+        save(cachePath);
+    }
+    current.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    upload();
+    measureError();
+    std::cout << "Lighting LUTs " << (current.fromCache ? "read from " + cachePath : std::string("baked")) << " in "
+              << current.bakeMs << " ms; Oren-Nayar error max " << current.orenNayarMaxError << " mean "
+              << current.orenNayarMeanError << ", toon ramp error max " << current.toonMaxError << std::endl;
+
+    //Same check as the benchmark, timer queries are core in 3.3 and we ask for 3.2
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    timerQueries = major * 10 + minor >= 33 || hasExtension("GL_ARB_timer_query");
+    if (timerQueries)
+        glGenQueries(FRAMES_IN_FLIGHT * 2, &queries[0][0]);
+}
+
+LightingLUTs::~LightingLUTs()
+{
+    if (timerQueries)
+        glDeleteQueries(FRAMES_IN_FLIGHT * 2, &queries[0][0]);
+    glDeleteTextures(1, &orenNayarTexture);
+    glDeleteTextures(1, &toonTexture);
+}
+
+
+void LightingLUTs::bake()
+{
+    const int n = OREN_NAYAR_COSINES;
+    orenNayar.assign(static_cast<size_t>(2 * n * n * OREN_NAYAR_ROUGHNESS), 0.0f);
+    const float step = 1.0f / static_cast<float>(n - 1);
+
+    for (int z = 0; z < OREN_NAYAR_ROUGHNESS; z++)
+    {
+        float a, b;
+        orenNayarAB(static_cast<float>(z) / static_cast<float>(OREN_NAYAR_ROUGHNESS - 1), a, b);
+        for (int y = 0; y < n; y++)
+        {
+            float cosR = static_cast<float>(y) * step;
+            float* row = &orenNayar[static_cast<size_t>(2 * n * (y + n * z))];
+            int x = 0;
+#if defined(__SSE2__)
+            //Four NdotL per step, interleaved into RG pairs on the way out
+            const __m128 vCosR = _mm_set1_ps(cosR), vA = _mm_set1_ps(a), vB = _mm_set1_ps(b);
+            const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps(), tiny = _mm_set1_ps(1e-4f);
+            for (; x + 4 <= n; x += 4)
+            {
+                __m128 cosI = _mm_mul_ps(_mm_set_ps(static_cast<float>(x + 3), static_cast<float>(x + 2), static_cast<float>(x + 1),
+                                                    static_cast<float>(x)), _mm_set1_ps(step));
+                __m128 cosAlpha = _mm_min_ps(cosI, vCosR), cosBeta = _mm_max_ps(cosI, vCosR);
+                __m128 sinAlpha = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(cosAlpha, cosAlpha)), zero));
+                __m128 sinBeta = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(cosBeta, cosBeta)), zero));
+                __m128 tanBeta = _mm_div_ps(sinBeta, _mm_max_ps(cosBeta, tiny));
+                __m128 r = _mm_mul_ps(cosI, vA);
+                __m128 g = _mm_mul_ps(_mm_mul_ps(cosI, vB), _mm_mul_ps(sinAlpha, tanBeta));
+                _mm_storeu_ps(row + 2 * x, _mm_unpacklo_ps(r, g));
+                _mm_storeu_ps(row + 2 * x + 4, _mm_unpackhi_ps(r, g));
+            }
+#endif
+            for (; x < n; x++)
+                orenNayarTexel(static_cast<float>(x) * step, cosR, a, b, row[2 * x], row[2 * x + 1]);
+        }
+    }
+
+    //Texel i covers NdotL from i / 128 - 1 to (i + 1) / 128 - 1, sampled at its center.
+    //Truncating instead of flooring only differs below zero, where the ramp is 0 anyway
+    toonRamp.assign(static_cast<size_t>(TOON_RAMP_SIZE), 0.0f);
+    const float texel = 2.0f / static_cast<float>(TOON_RAMP_SIZE);
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for (; i + 4 <= TOON_RAMP_SIZE; i += 4)
+    {
+        __m128 index = _mm_set_ps(static_cast<float>(i + 3), static_cast<float>(i + 2), static_cast<float>(i + 1), static_cast<float>(i));
+        __m128 intensity = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(index, _mm_set1_ps(0.5f)), _mm_set1_ps(texel)), _mm_set1_ps(1.0f));
+        __m128 steps = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(intensity, _mm_set1_ps(4.0f))));
+        _mm_storeu_ps(&toonRamp[static_cast<size_t>(i)], _mm_max_ps(_mm_mul_ps(steps, quarter), _mm_setzero_ps()));
+    }
+#endif
+    for (; i < TOON_RAMP_SIZE; i++)
+        toonRamp[static_cast<size_t>(i)] = static_cast<float>(toonAnalytic((static_cast<double>(i) + 0.5) * texel - 1.0));
+}
+
+
+bool LightingLUTs::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    CacheHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "LLUT", 4) != 0 || header.version != CACHE_VERSION ||
+        header.cosines != OREN_NAYAR_COSINES || header.roughness != OREN_NAYAR_ROUGHNESS || header.toonSize != TOON_RAMP_SIZE)
+        return false;
+
+    orenNayar.resize(static_cast<size_t>(2 * OREN_NAYAR_COSINES * OREN_NAYAR_COSINES * OREN_NAYAR_ROUGHNESS));
+    toonRamp.resize(static_cast<size_t>(TOON_RAMP_SIZE));
+    file.read(reinterpret_cast<char*>(orenNayar.data()), static_cast<std::streamsize>(orenNayar.size() * sizeof(float)));
+    file.read(reinterpret_cast<char*>(toonRamp.data()), static_cast<std::streamsize>(toonRamp.size() * sizeof(float)));
+    return static_cast<bool>(file);
+}
+
+void LightingLUTs::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::LIGHTING_LUTS::CACHE_NOT_WRITTEN: " << path << std::endl;
+        return;
+    }
+    CacheHeader header = { { 'L', 'L', 'U', 'T' }, CACHE_VERSION, OREN_NAYAR_COSINES, OREN_NAYAR_ROUGHNESS, TOON_RAMP_SIZE };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(orenNayar.data()), static_cast<std::streamsize>(orenNayar.size() * sizeof(float)));
+    file.write(reinterpret_cast<const char*>(toonRamp.data()), static_cast<std::streamsize>(toonRamp.size() * sizeof(float)));
+}
+
+
+void LightingLUTs::upload()
+{
+    glGenTextures(1, &orenNayarTexture);
+    glBindTexture(GL_TEXTURE_3D, orenNayarTexture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RG16F, OREN_NAYAR_COSINES, OREN_NAYAR_COSINES, OREN_NAYAR_ROUGHNESS, 0, GL_RG, GL_FLOAT, orenNayar.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    glGenTextures(1, &toonTexture);
+    glBindTexture(GL_TEXTURE_1D, toonTexture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_R16F, TOON_RAMP_SIZE, 0, GL_RED, GL_FLOAT, toonRamp.data());
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+
+//Filters the stored tables like the GPU does (trilinear, texel centers on the grid points, nearest
+//for the ramp) and compares with the analytic terms at random points, same seed every run
+void LightingLUTs::measureError()
+{
+    const int n = OREN_NAYAR_COSINES;
+    auto texel = [&](int x, int y, int z, int channel)
+    {
+        return toHalf(orenNayar[static_cast<size_t>(2 * (x + n * (y + n * z)) + channel)]);
+    };
+    auto lookup = [&](float cosI, float cosR, float sigma, int channel)
+    {
+        float p[3] = { cosI * static_cast<float>(n - 1), cosR * static_cast<float>(n - 1), sigma * static_cast<float>(OREN_NAYAR_ROUGHNESS - 1) };
+        int last[3] = { n - 1, n - 1, OREN_NAYAR_ROUGHNESS - 1 };
+        int i0[3], i1[3];
+        float f[3];
+        for (int k = 0; k < 3; k++)
+        {
+            i0[k] = std::min(static_cast<int>(p[k]), last[k]);
+            i1[k] = std::min(i0[k] + 1, last[k]);
+            f[k] = p[k] - static_cast<float>(i0[k]);
+        }
+        float result = 0.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float weight = (corner & 1 ? f[0] : 1.0f - f[0]) * (corner & 2 ? f[1] : 1.0f - f[1]) * (corner & 4 ? f[2] : 1.0f - f[2]);
+            result += weight * texel(corner & 1 ? i1[0] : i0[0], corner & 2 ? i1[1] : i0[1], corner & 4 ? i1[2] : i0[2], channel);
+        }
+        return result;
+    };
+
+    std::mt19937 random(4321);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const int samples = 100000;
+    double maxError = 0.0, sumError = 0.0;
+    for (int s = 0; s < samples; s++)
+    {
+        float cosI = unit(random), cosR = unit(random), cosPhi = unit(random), sigma = unit(random);
+        double lut = lookup(cosI, cosR, sigma, 0) + lookup(cosI, cosR, sigma, 1) * cosPhi;
+        double error = std::abs(lut - orenNayarAnalytic(cosI, cosR, cosPhi, sigma));
+        maxError = std::max(maxError, error);
+        sumError += error;
+    }
+    current.orenNayarMaxError = static_cast<float>(maxError);
+    current.orenNayarMeanError = static_cast<float>(sumError / samples);
+
+    //Up to but not including NdotL = 1, where the last texel still holds the 0.75 step
+    maxError = 0.0;
+    for (int s = 0; s < samples; s++)
+    {
+        float intensity = -1.0f + 2.0f * static_cast<float>(s) / static_cast<float>(samples);
+        int i = std::clamp(static_cast<int>((intensity * 0.5f + 0.5f) * static_cast<float>(TOON_RAMP_SIZE)), 0, TOON_RAMP_SIZE - 1);
+        maxError = std::max(maxError, std::abs(toHalf(toonRamp[static_cast<size_t>(i)]) - toonAnalytic(intensity)));
+    }
+    current.toonMaxError = static_cast<float>(maxError);
+}
+
+
+void LightingLUTs::bind(Shader& shader, int unit) const
+{
+    glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + unit));
+    glBindTexture(GL_TEXTURE_3D, orenNayarTexture);
+    glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + unit + 1));
+    glBindTexture(GL_TEXTURE_1D, toonTexture);
+    glActiveTexture(GL_TEXTURE0);
+    shader.setInt("orenNayarLUT", unit);
+    shader.setInt("toonRamp", unit + 1);
+    shader.setBool("lightingLUTs", enabled);
+}
+
+
+void LightingLUTs::beginTiming()
+{
+    if (!timerQueries)
+        return;
+    readTimings();
+    glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+}
+
+void LightingLUTs::endTiming()
+{
+    if (!timerQueries)
+        return;
+    glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+    slotPath[slot] = enabled ? 2 : 1;
+    slot = (slot + 1) % FRAMES_IN_FLIGHT;
+}
+
+//The slot about to be reused is FRAMES_IN_FLIGHT frames old, its result is there or nearly
+void LightingLUTs::readTimings()
+{
+    if (slotPath[slot] == 0)
+        return;
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+    double ms = static_cast<double>(end - start) / 1e6;
+    double& smoothed = slotPath[slot] == 2 ? current.lutMs : current.analyticMs;
+    smoothed = smoothed == 0.0 ? ms : smoothed + (ms - smoothed) * 0.1;
+    slotPath[slot] = 0;
+}
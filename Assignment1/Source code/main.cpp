@@ -4,6 +4,9 @@
 #include <fstream>
 #include <vector>
 #include<algorithm>
+#include<random>
+#include<string>
+#include<cmath>
 
 #include<glad/glad.h>
 #include<GLFW/glfw3.h>
@@ -19,11 +22,34 @@
 #include "Camera.h"
 #include "Model.h"
 #include"shader.h"
+#include"Benchmark.h"
+#include"LightClusters.h"
+#include"CascadedShadows.h"
+#include"LightingLUTs.h"
 
 //Window Settings
 const unsigned int SCR_WIDTH = 1500;
 const unsigned int SCR_HEIGHT = 1000;
 
+//Draw all three snoks with one instanced call per mesh
+const bool USE_INSTANCING = true;
+
+//Same planes for the projection and the light clusters
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 1000.0f;
+//Mesh textures start at unit 0, the cluster buffers sit above them
+const int CLUSTER_TEXTURE_UNIT = 4;
+//Above the three cluster buffers
+const int SHADOW_TEXTURE_UNIT = 7;
+//Oren-Nayar table, the toon ramp on the unit after it
+const int LIGHTING_LUT_TEXTURE_UNIT = 8;
+
+//The key light is directional, this is where it comes from
+const glm::vec3 KEY_LIGHT_DIRECTION = glm::vec3(20.0f, 40.0f, 50.0f);
+//Floor under the snoks, it catches their shadows
+const float GROUND_HEIGHT = 0.0f;
+const float GROUND_SIZE = 300.0f;
+
 //Calling Camera object
 Camera camera(glm::vec3(15.0f, 15.0f, 70.0f));
 float lastX = SCR_WIDTH/2.0f;
@@ -35,11 +61,15 @@ float lastFrame = 0.0f;
 //Function Prototypes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
+void makeLights(int count, std::vector<PointLight>& lights, std::vector<float>& phases);
 
-int main()
+int main(int argc, char** argv)
 {
+    //--bench renders a fixed camera path offscreen and writes the timings
+    BenchmarkSettings benchSettings = BenchmarkSettings::fromArguments(argc, argv);
 
     // 1. Initializing GLFW
+    benchSettings.initHints();
     if(!glfwInit()){
         std::cerr << "Failed to initialize GLFW" << std ::endl;
         return -1;
@@ -50,6 +80,7 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    benchSettings.windowHints();
     
     // 2. Creating the Window and Glad loading
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Assignment 1", NULL, NULL);
@@ -83,6 +114,9 @@ int main()
     
     //Setting up the shader
     Shader defaultShader("/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/basic.vert", "/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/basic.frag");
+    Shader instancedShader("/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/basic_instanced.vert", "/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/basic.frag");
+    Shader shadowShader("/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/shadow_depth.vert", "/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/shadow_depth.frag");
+    Shader shadowInstancedShader("/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/shadow_depth_instanced.vert", "/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/shaders/shadow_depth.frag");
 
     //Loading the model HEREEEEE
 
@@ -90,64 +124,247 @@ int main()
     
     std::cout << "Model loaded successfully. Ready to enter." << std::endl;
 
+    //Ground quad around the snoks, positions at location 0 and normals at 2 like the model
+    GLfloat groundPositions[] = {
+        12.5f - GROUND_SIZE * 0.5f, GROUND_HEIGHT, -GROUND_SIZE * 0.5f,
+        12.5f + GROUND_SIZE * 0.5f, GROUND_HEIGHT, -GROUND_SIZE * 0.5f,
+        12.5f - GROUND_SIZE * 0.5f, GROUND_HEIGHT,  GROUND_SIZE * 0.5f,
+        12.5f + GROUND_SIZE * 0.5f, GROUND_HEIGHT,  GROUND_SIZE * 0.5f
+    };
+    GLfloat groundNormals[] = {
+        0.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f
+    };
+    GLuint groundIndices[] = { 0, 2, 1, 1, 2, 3 };
+    VAO groundVAO;
+    groundVAO.Bind();
+    VBO groundPositionVBO(groundPositions, sizeof(groundPositions));
+    VBO groundNormalVBO(groundNormals, sizeof(groundNormals));
+    EBO groundEBO(groundIndices, sizeof(groundIndices));
+    groundVAO.LinkVBO(groundPositionVBO, 0);
+    groundVAO.LinkVBO(groundNormalVBO, 2);
+    groundVAO.Unbind();
+    groundEBO.Unbind();
+    auto drawGround = [&]()
+    {
+        groundVAO.Bind();
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        groundVAO.Unbind();
+    };
+
+    //The ground is the static caster, cached; the spinning snoks are drawn into every cascade each frame
+    CascadedShadows shadows;
+
+    //Oren-Nayar and toon terms from tables, baked once and then read from the cache; L switches
+    //back to the analytic versions to compare
+    LightingLUTs lightingLUTs("/Users/dchottani/Desktop/Real-Time-Rendering-/Assignment1/lighting_luts.bin");
+    lightingLUTs.enabled = !benchSettings.analyticLighting;
+    bool lutKeyDown = false;
+
+    //Point lights bobbing around the snoks, sorted into clusters every frame
+    LightClusters lightClusters;
+    std::vector<PointLight> lights;
+    std::vector<float> lightPhases;
+    std::vector<float> lightHeights;
+
+    //--bench-lights runs the benchmark once per light count, plus a summary over all of them
+    std::vector<int> lightCounts = benchSettings.lightSweep;
+    if (lightCounts.empty() || !benchSettings.enabled)
+        lightCounts = { benchSettings.lights };
+    size_t lightRun = 0;
+    std::ofstream sweepReport;
+    auto startLightRun = [&]()
+    {
+        makeLights(lightCounts[lightRun], lights, lightPhases);
+        lightHeights.resize(lights.size());
+        for (size_t i = 0; i < lights.size(); i++)
+            lightHeights[i] = lights[i].position.y;
+    };
+    startLightRun();
+
+    //Benchmark without vsync
+    Benchmark* benchmark = nullptr;
+    auto startBenchmark = [&]()
+    {
+        BenchmarkSettings runSettings = benchSettings;
+        if (lightCounts.size() > 1)
+            runSettings.output += "_lights" + std::to_string(lightCounts[lightRun]);
+        benchmark = new Benchmark(runSettings);
+    };
+    if (benchSettings.enabled)
+    {
+        glfwSwapInterval(0);
+        startBenchmark();
+        if (lightCounts.size() > 1)
+        {
+            sweepReport.open(benchSettings.output + "_lights.csv");
+            sweepReport << "lights,cpu_ms_p50,gpu_ms_p50,light_ms_p50\n";
+        }
+    }
+    float titleTime = 0.0f;
+
     // 5. Main Render Loop
     while(!glfwWindowShouldClose(window))
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
+        float currentFrame = benchmark ? benchmark->time() : static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        if (benchmark)
+        {
+            //Fixed path around the middle snok
+            camera.Position = benchmark->cameraPosition(glm::vec3(15.0f, 10.0f, 0.0f), 70.0f, 15.0f);
+            camera.lookAt(glm::vec3(15.0f, 10.0f, 0.0f));
+            benchmark->beginFrame();
+        }
+
+        bool lutKey = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+        if (lutKey && !lutKeyDown && !benchmark)
+            lightingLUTs.enabled = !lightingLUTs.enabled;
+        lutKeyDown = lutKey;
+
         //render heree
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
-        //Other shaders to load othe models 
-        defaultShader.use();
-
-        defaultShader.setVec3("lightPos" , glm::vec3(20.0f, 40.0f, 50.0f));
-        defaultShader.setVec3("viewPos", camera.Position);
-        defaultShader.setVec3("objectColor", glm::vec3(1.0f, 1.0f, 1.0f));
-        
         int width, height;
         glfwGetFramebufferSize(window, &width, &height);
+        float aspect = benchmark ? benchmark->aspect() : (float)width / (float)height;
 
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 1000.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, NEAR_PLANE, FAR_PLANE);
         glm::mat4 view = camera.getViewMatrix();
 
-        defaultShader.setMat4("projection", projection);
-        defaultShader.setMat4("view", view);
-
-        //Loading the model once 
-        glm::mat4 model1Matrix = glm::mat4(1.0f);
-        model1Matrix = glm::translate(model1Matrix, glm::vec3(-20.0f, 10.0f, 0.0f));
-        model1Matrix = glm::rotate(model1Matrix, (float)glfwGetTime() * 1.5f, glm::vec3(0.0f, 1.0f, 0.0f));
-        model1Matrix = glm::scale(model1Matrix, glm::vec3(5.0f));
-
-        defaultShader.setMat4("model", model1Matrix);
-        defaultShader.setInt("modelType", 0);
-        myModel.Draw(defaultShader);
-
-
-        // Second
-        glm::mat4 model2Matrix = glm::mat4(1.0f);
-        model2Matrix = glm::translate(model2Matrix, glm::vec3(15.0f, 10.0f, 0.0f));
-        model2Matrix = glm::rotate(model2Matrix, (float)glfwGetTime() * 1.5f, glm::vec3(0.0f, 1.0f, 0.0f));
-        model2Matrix = glm::scale(model2Matrix, glm::vec3(5.0f));
-        defaultShader.setMat4("model", model2Matrix);
-        defaultShader.setInt("modelType", 1);
-        myModel.Draw(defaultShader);
-
-
-        //Third 
-        glm::mat4 model3Matrix = glm::mat4(1.0f);
-        model3Matrix = glm::translate(model3Matrix, glm::vec3(45.0f, 10.0f, 0.0f));
-        model3Matrix = glm::rotate(model3Matrix, (float)glfwGetTime() * 1.5f, glm::vec3(0.0f, 1.0f, 0.0f));
-        model3Matrix = glm::scale(model3Matrix, glm::vec3(5.0f));
-        defaultShader.setMat4("model", model3Matrix);
+        for (size_t i = 0; i < lights.size(); i++)
+            lights[i].position.y = lightHeights[i] + 3.0f * std::sin(currentFrame * 0.8f + lightPhases[i]);
+        lightClusters.update(lights, view, projection, NEAR_PLANE, FAR_PLANE);
+        const LightClusters::Stats& lightStats = lightClusters.last();
+
+        //The three snoks only differ in position and shading model
+        const glm::vec3 positions[3] = { glm::vec3(-20.0f, 10.0f, 0.0f), glm::vec3(15.0f, 10.0f, 0.0f), glm::vec3(45.0f, 10.0f, 0.0f) };
+        std::vector<InstanceData> instances;
+        for (int i = 0; i < 3; i++)
+        {
+            InstanceData instance;
+            instance.model = glm::mat4(1.0f);
+            instance.model = glm::translate(instance.model, positions[i]);
+            instance.model = glm::rotate(instance.model, currentFrame * 1.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+            instance.model = glm::scale(instance.model, glm::vec3(5.0f));
+            instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+            instance.modelType = (float)i;
+            instances.push_back(instance);
+        }
+
+        shadows.update(view, projection, KEY_LIGHT_DIRECTION);
+        shadows.render([&](const glm::mat4& lightViewProjection, CascadedShadows::Casters casters)
+        {
+            if (casters == CascadedShadows::STATIC_CASTERS)
+            {
+                shadowShader.use();
+                shadowShader.setMat4("lightViewProjection", lightViewProjection);
+                shadowShader.setMat4("model", glm::mat4(1.0f));
+                drawGround();
+                return 1;
+            }
+            if (USE_INSTANCING)
+            {
+                shadowInstancedShader.use();
+                shadowInstancedShader.setMat4("lightViewProjection", lightViewProjection);
+                myModel.DrawInstanced(shadowInstancedShader, instances);
+                return static_cast<int>(myModel.meshes.size());
+            }
+            shadowShader.use();
+            shadowShader.setMat4("lightViewProjection", lightViewProjection);
+            for (const InstanceData& instance : instances)
+            {
+                shadowShader.setMat4("model", instance.model);
+                myModel.Draw(shadowShader);
+            }
+            return static_cast<int>(myModel.meshes.size() * instances.size());
+        });
+
+        auto setSceneUniforms = [&](Shader& shader)
+        {
+            shader.use();
+            shader.setVec3("lightPos" , KEY_LIGHT_DIRECTION);
+            shader.setVec3("viewPos", camera.Position);
+            shader.setVec3("objectColor", glm::vec3(1.0f, 1.0f, 1.0f));
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", view);
+            lightClusters.bind(shader, CLUSTER_TEXTURE_UNIT, benchmark ? benchSettings.width : width, benchmark ? benchSettings.height : height);
+            shadows.bind(shader, SHADOW_TEXTURE_UNIT);
+            lightingLUTs.bind(shader, LIGHTING_LUT_TEXTURE_UNIT);
+        };
+
+        //Everything shaded by basic.frag is timed, for the LUTs against the analytic terms
+        lightingLUTs.beginTiming();
+
+        //Ground first, Oren-Nayar
+        setSceneUniforms(defaultShader);
+        defaultShader.setMat4("model", glm::mat4(1.0f));
         defaultShader.setInt("modelType", 2);
-        myModel.Draw(defaultShader);
+        drawGround();
+
+        Shader& activeShader = USE_INSTANCING ? instancedShader : defaultShader;
+        setSceneUniforms(activeShader);
+
+        if (USE_INSTANCING)
+        {
+            //One draw per mesh for all three
+            myModel.DrawInstanced(instancedShader, instances);
+        }
+        else
+        {
+            for (const InstanceData& instance : instances)
+            {
+                defaultShader.setMat4("model", instance.model);
+                defaultShader.setInt("modelType", (int)instance.modelType);
+                myModel.Draw(defaultShader);
+            }
+        }
+        lightingLUTs.endTiming();
+
+        if (benchmark)
+        {
+            //One draw per mesh, or per mesh and snok without instancing, plus the ground and the shadow casters
+            int drawCalls = static_cast<int>(myModel.meshes.size()) * (USE_INSTANCING ? 1 : 3) + 1;
+            for (int i = 0; i < shadows.cascadeCount; i++)
+                drawCalls += shadows.stats(i).staticDraws + shadows.stats(i).dynamicDraws;
+            benchmark->endFrame(drawCalls, lightStats.lights, lightStats.assignMs + lightStats.uploadMs);
+            if (benchmark->done())
+            {
+                Benchmark::Summary summary = benchmark->finish();
+                delete benchmark;
+                benchmark = nullptr;
+                if (sweepReport.is_open())
+                    sweepReport << lightCounts[lightRun] << "," << summary.cpuMs << "," << summary.gpuMs << "," << summary.lightMs << std::endl;
+                if (++lightRun < lightCounts.size())
+                {
+                    startLightRun();
+                    startBenchmark();
+                }
+                else
+                    glfwSetWindowShouldClose(window, true);
+            }
+        }
+        else if (currentFrame - titleTime > 1.0f)
+        {
+            //Cheap way to see the light cost without any UI
+            titleTime = currentFrame;
+            std::string title = "Assignment 1 - " + std::to_string(lightStats.lights) + " lights, " + std::to_string(lightStats.indices) +
+                                " cluster entries (max " + std::to_string(lightStats.maxPerCluster) + "), assign " +
+                                std::to_string(lightStats.assignMs) + " ms on " + std::to_string(lightStats.threads) + " thread(s) - shadows";
+            for (int i = 0; i < shadows.cascadeCount; i++)
+            {
+                const CascadedShadows::CascadeStats& cascade = shadows.stats(i);
+                title += " C" + std::to_string(i) + ": " + std::to_string(cascade.dynamicDraws) + "+" + std::to_string(cascade.staticDraws) +
+                         " draws " + std::to_string(cascade.ms) + " ms";
+            }
+            title += ", " + std::to_string(shadows.staticRebuilds()) + " static renders";
+            const LightingLUTs::Stats& lutStats = lightingLUTs.stats();
+            title += " - lighting " + std::string(lightingLUTs.enabled ? "LUTs" : "analytic") + " (L): shading " +
+                     std::to_string(lutStats.lutMs) + " ms with LUTs, " + std::to_string(lutStats.analyticMs) + " ms analytic";
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         // 5.4 Swapping the buffers
         glfwSwapBuffers(window);
@@ -156,6 +373,11 @@ int main()
     }
 
     // 6. Cleanup
+    if (benchmark)
+    {
+        benchmark->finish();
+        delete benchmark;
+    }
 
     glfwTerminate();
     return 0;
@@ -172,4 +394,23 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yOffset));
+}
+
+
+//Same lights on every run: fixed seed, spread over the box around the three snoks
+void makeLights(int count, std::vector<PointLight>& lights, std::vector<float>& phases)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    lights.resize(static_cast<size_t>(count));
+    phases.resize(static_cast<size_t>(count));
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        lights[i].position = glm::vec3(-40.0f + 110.0f * unit(random), -5.0f + 35.0f * unit(random), -30.0f + 60.0f * unit(random));
+        lights[i].radius = 6.0f + 6.0f * unit(random);
+        //Saturated colors, brighter ones reach further
+        glm::vec3 color(unit(random), unit(random), unit(random));
+        lights[i].color = color / std::max({ color.r, color.g, color.b, 0.01f }) * lights[i].radius * 0.5f;
+        phases[i] = 6.2831853f * unit(random);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+//
+//  Benchmark.h
+//  Headless benchmark: renders a fixed camera path into an offscreen framebuffer
+//  and writes per frame timings (CSV) and a p50/p95/p99 summary (JSON)
+
+#ifndef BENCHMARK_CLASS_H
+#define BENCHMARK_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<string>
+#include<vector>
+#include<chrono>
+
+//Command line switches, nothing happens without --bench
+//  --bench-size WxH, --bench-warmup N, --bench-frames M, --bench-out name, --software
+//  --lights N point lights, --bench-lights N,M,... one run per light count
+//  --analytic-lighting Oren-Nayar and toon computed instead of looked up (LightingLUTs.h)
+struct BenchmarkSettings
+{
+    bool enabled = false;
+    int width = 1280;
+    int height = 720;
+    int warmupFrames = 60;
+    int measuredFrames = 300;
+    bool software = false;
+    std::string output = "benchmark";
+    int lights = 256;
+    std::vector<int> lightSweep;
+    bool analyticLighting = false;
+
+    static BenchmarkSettings fromArguments(int argc, char** argv);
+
+    //Before glfwInit(): Mesa llvmpipe, and GLFW's null platform when there is no display
+    void initHints() const;
+    //Before glfwCreateWindow(): hidden window, OSMesa context when there is no display
+    void windowHints() const;
+
+    static bool headless();
+};
+
+class Benchmark
+{
+public:
+    //Seconds of animation per frame, so every run renders the same frames
+    static constexpr float TIME_STEP = 1.0f / 60.0f;
+
+    Benchmark(const BenchmarkSettings& settings);
+    ~Benchmark();
+
+    bool done() const;
+    float time() const;
+    float aspect() const;
+
+    //One orbit around center every period seconds
+    glm::vec3 cameraPosition(const glm::vec3& center, float radius, float height, float period = 12.0f) const;
+
+    //Binds the offscreen framebuffer, everything until endFrame() is measured
+    void beginFrame();
+    void endFrame(int drawCalls, int lights = 0, double lightMs = 0.0);
+
+    //Medians of the measured frames, gpuMs is -1 without timer queries
+    struct Summary
+    {
+        double cpuMs = 0.0;
+        double gpuMs = -1.0;
+        double lightMs = 0.0;
+    };
+
+    //Reads the GPU timers and writes <output>.csv and <output>.json
+    Summary finish();
+
+private:
+    struct Sample
+    {
+        double cpuMs = 0.0;
+        double gpuMs = -1.0;
+        int drawCalls = 0;
+        int lights = 0;
+        double lightMs = 0.0;    //CPU light assignment and upload
+        long residentKB = 0;
+        long gpuMemoryKB = -1;
+    };
+
+    BenchmarkSettings settings;
+    GLuint FBO = 0, colorTexture = 0, depthRBO = 0;
+    std::vector<GLuint> timers;
+    std::vector<Sample> samples;
+    int frame = 0;
+    bool timerQueries = false;
+    bool gpuMemory = false;
+    std::chrono::high_resolution_clock::time_point previousStart, lastStart;
+
+    bool measuring() const;
+    long gpuMemoryUsedKB() const;
+};
+
+#endif
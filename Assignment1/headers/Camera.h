@@ -122,6 +122,15 @@ public:
             Zoom = 45.0f;
     }
 
+    //Turning the camera towards a point by recalculating Yaw and Pitch
+    void lookAt(const glm::vec3& target)
+    {
+        glm::vec3 direction = glm::normalize(target - Position);
+        Yaw = glm::degrees(glm::atan(direction.z, direction.x));
+        Pitch = glm::degrees(glm::asin(glm::clamp(direction.y, -1.0f, 1.0f)));
+        updateCameraVectors();
+    }
+
 private:
     //Calculating the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
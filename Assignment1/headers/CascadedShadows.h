@@ -0,0 +1,102 @@
+//
+//  CascadedShadows.h
+//  Shadows of the key light, treated as a directional light: 2-4 cascades over the first
+//  shadowDistance units of the view frustum, filtered with PCF in basic.frag
+
+#ifndef CASCADED_SHADOWS_CLASS_H
+#define CASCADED_SHADOWS_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<functional>
+
+#include"shader.h"
+
+//Every cascade is the bounding sphere of its slice of the frustum, measured in view space so its
+//size only depends on the projection, and its center is snapped to whole texels in light space:
+//no shimmering edges.
+//
+//Static casters have their own depth layer per cascade, with the cascade's texel size and a
+//border of resolution / 8 texels around it. Its center scrolls in steps of that border, so the
+//cascade always lies inside it and is blitted out at an offset, with the dynamic casters drawn
+//on top. A layer is rendered again only when it scrolls (the camera moved an eighth of the
+//cascade), the cascade's size or the light changes, or invalidateStatic().
+class CascadedShadows
+{
+public:
+    static constexpr int MAX_CASCADES = 4;
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    enum Casters { STATIC_CASTERS, DYNAMIC_CASTERS };
+    //Draws one kind of caster with the light's view-projection, returns the number of draw calls
+    using DrawCasters = std::function<int(const glm::mat4& lightViewProjection, Casters casters)>;
+
+    struct CascadeStats
+    {
+        float splitFar = 0.0f;      //View depth where the cascade ends
+        float texelSize = 0.0f;     //World units per shadow map texel
+        int staticDraws = 0;        //0 unless the static layer was rendered this frame
+        int dynamicDraws = 0;
+        bool staticRendered = false;
+        double ms = 0.0;            //GPU, smoothed; stays 0 without timer queries
+    };
+
+    int cascadeCount = 3;
+    float shadowDistance = 200.0f;
+    float splitLambda = 0.75f;      //1: logarithmic splits, 0: uniform
+    float casterMargin = 100.0f;    //How far towards the light casters outside a cascade still count
+    int pcfRadius = 1;              //(2r + 1)^2 taps
+    float slopeBias = 2.0f;
+    float constantBias = 4.0f;
+    float normalBias = 1.5f;        //Texels
+    bool cacheStatic = true;
+
+    CascadedShadows(int resolution = 2048);
+    ~CascadedShadows();
+
+    //lightDirection points towards the light; near, far and field of view come from the projection
+    void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection);
+
+    //Renders every cascade, keeps the caller's framebuffer and viewport
+    void render(const DrawCasters& draw);
+
+    //The static casters changed, every cached layer is rendered again
+    void invalidateStatic();
+
+    //Shadow map on texture unit `unit` and basic.frag's shadow uniforms
+    void bind(Shader& shader, int unit) const;
+
+    const CascadeStats& stats(int cascade) const { return cascades[cascade].stats; }
+    long staticRebuilds() const { return rebuilds; }
+
+private:
+    struct Cascade
+    {
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+        CascadeStats stats;
+        //The static layer, where the cascade lies in it and whether it is up to date
+        glm::mat4 staticViewProjection = glm::mat4(1.0f);
+        glm::ivec2 staticOffset = glm::ivec2(0);
+        bool staticValid = false;
+    };
+
+    int resolution;
+    int staticBorder;               //Texels the static layers reach past the cascades on each side
+    Cascade cascades[MAX_CASCADES];
+    GLuint shadowMap = 0, staticMap = 0;
+    GLuint shadowFBO = 0, staticFBO = 0;
+    glm::vec3 lightDirection = glm::vec3(0.0f);
+    long rebuilds = 0;
+
+    bool timerQueries = false;
+    GLuint queries[FRAMES_IN_FLIGHT][MAX_CASCADES + 1] = {};     //Timestamps before each cascade and after the last
+    int slotCascades[FRAMES_IN_FLIGHT] = {};
+    int slot = 0;
+
+    GLuint createLayers(int size, bool compare) const;
+    void attach(GLuint framebuffer, GLuint texture, int layer) const;
+    void readTimings();
+};
+
+#endif
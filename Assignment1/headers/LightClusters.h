@@ -0,0 +1,101 @@
+//
+//  LightClusters.h
+//  Clustered forward lighting: the view frustum is cut into 16x9x24 clusters (screen tiles
+//  times exponential depth slices), every point light is assigned to the clusters its sphere
+//  touches, and basic.frag only loops over the lights of its own cluster
+
+#ifndef LIGHT_CLUSTERS_CLASS_H
+#define LIGHT_CLUSTERS_CLASS_H
+
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+
+#include<vector>
+#include<cstdint>
+
+#include"shader.h"
+
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;       //No light at all past this distance
+    glm::vec3 color;
+};
+
+//Assignment runs on the CPU, GL 3.2 has no compute shaders. Lights go to view space four at a
+//time (SSE when available), then the depth slices are split over worker threads, each one
+//filling the lists of its own slices.
+//
+//All data reaches the shader through texture buffers (core since 3.1):
+//  lightData      RGBA32F, two texels per light: position + radius, color
+//  clusterGrid    RG32UI, per cluster the offset into lightIndices and the light count
+//  lightIndices   R16UI, the compact per cluster lists
+class LightClusters
+{
+public:
+    static constexpr int TILES_X = 16;
+    static constexpr int TILES_Y = 9;
+    static constexpr int SLICES = 24;
+    static constexpr int CLUSTERS = TILES_X * TILES_Y * SLICES;
+    //Indices are 16 bit
+    static constexpr size_t MAX_LIGHTS = 65535;
+
+    struct Stats
+    {
+        int lights = 0;
+        int visibleLights = 0;
+        int indices = 0;            //Total of all cluster lists
+        int maxPerCluster = 0;
+        int threads = 0;
+        double assignMs = 0.0;
+        double uploadMs = 0.0;
+    };
+
+    LightClusters();
+    ~LightClusters();
+
+    //Same near and far as the projection, depth slices are spaced exponentially between them
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+
+    //Binds the buffers to texture units firstUnit..firstUnit+2 and sets basic.frag's cluster uniforms
+    void bind(Shader& shader, int firstUnit, int viewportWidth, int viewportHeight) const;
+
+    const Stats& last() const { return stats; }
+
+private:
+    //Light a worker touches in one of its slices, with the tile rectangle covered there
+    struct Span
+    {
+        uint16_t light;
+        uint8_t slice, x0, x1, y0, y1;
+    };
+
+    struct Worker
+    {
+        std::vector<Span> spans;
+        std::vector<uint16_t> indices;
+        int firstSlice = 0, endSlice = 0;
+    };
+
+    GLuint lightBuffer = 0, clusterBuffer = 0, indexBuffer = 0;
+    GLuint lightTexture = 0, clusterTexture = 0, indexTexture = 0;
+
+    //View space lights, structure of arrays for the SIMD transform
+    std::vector<float> viewX, viewY, depth, radius;
+    std::vector<glm::vec4> lightData;
+    std::vector<glm::uvec2> clusters;
+    std::vector<uint16_t> indices;
+    std::vector<Worker> workers;
+
+    float nearPlane = 0.1f, farPlane = 1000.0f;
+    float sliceScale = 1.0f;
+    glm::vec2 projectionScale = glm::vec2(1.0f);
+    Stats stats;
+
+    void toViewSpace(const std::vector<PointLight>& lights, const glm::mat4& view, size_t count);
+    void assignSlices(Worker& worker, size_t count);
+    float sliceDepth(int slice) const;
+    void upload();
+};
+
+#endif
@@ -0,0 +1,81 @@
+//
+//  LightingLUTs.h
+//  Lookup tables for basic.frag's lighting models: Oren-Nayar's A and B terms over
+//  (NdotL, NdotV, roughness) and the toon ramp, baked on the CPU and cached on disk
+
+#ifndef LIGHTING_LUTS_CLASS_H
+#define LIGHTING_LUTS_CLASS_H
+
+#include<glad/glad.h>
+
+#include<string>
+#include<vector>
+
+#include"shader.h"
+
+//Oren-Nayar per light is NdotL * (A + B * cosPhi * sin(alpha) * tan(beta)). Everything but
+//cosPhi only depends on the two cosines and the roughness, so the table holds
+//  R: NdotL * A    G: NdotL * B * sin(alpha) * tan(beta)
+//and the shader does R + G * cosPhi: one texture fetch instead of two acos, a sin and a tan.
+//With NdotL folded in G stays within 0..1, tan(beta) alone goes to infinity at grazing angles.
+//
+//The toon ramp is the same four steps as before, sampled with GL_NEAREST; the steps fall on
+//texel edges so it is exact. Swapping in another ramp only means baking another table.
+//
+//Both are compared against the analytic versions once they exist: the error on the CPU over
+//random directions, the cost as GPU time of the shaded draws with either path.
+class LightingLUTs
+{
+public:
+    static constexpr int OREN_NAYAR_COSINES = 64;      //NdotL and NdotV over 0..1
+    static constexpr int OREN_NAYAR_ROUGHNESS = 16;    //Sigma over 0..1
+    static constexpr int TOON_RAMP_SIZE = 256;         //NdotL over -1..1
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+
+    struct Stats
+    {
+        bool fromCache = false;
+        double bakeMs = 0.0;                //Baking, or reading the cache
+        float orenNayarMaxError = 0.0f;     //Against the analytic term, as stored on the GPU (half floats)
+        float orenNayarMeanError = 0.0f;
+        float toonMaxError = 0.0f;
+        double analyticMs = 0.0;            //GPU time of the draws between beginTiming and endTiming,
+        double lutMs = 0.0;                 //smoothed, per path; stays 0 without timer queries
+    };
+
+    //basic.frag samples the tables instead of doing the math
+    bool enabled = true;
+
+    //Reads the tables from cachePath if it holds the current version, else bakes and writes them
+    explicit LightingLUTs(const std::string& cachePath);
+    ~LightingLUTs();
+
+    //Oren-Nayar on texture unit `unit`, the toon ramp on unit + 1, and the switch
+    void bind(Shader& shader, int unit) const;
+
+    //Around the draws shaded by basic.frag
+    void beginTiming();
+    void endTiming();
+
+    const Stats& stats() const { return current; }
+
+private:
+    std::vector<float> orenNayar;   //RG pairs, NdotL fastest, then NdotV, then roughness
+    std::vector<float> toonRamp;
+    GLuint orenNayarTexture = 0, toonTexture = 0;
+    Stats current;
+
+    bool timerQueries = false;
+    GLuint queries[FRAMES_IN_FLIGHT][2] = {};
+    int slotPath[FRAMES_IN_FLIGHT] = {};    //0: nothing measured, 1: analytic, 2: LUT
+    int slot = 0;
+
+    void bake();
+    bool load(const std::string& path);
+    void save(const std::string& path) const;
+    void measureError();
+    void upload();
+    void readTimings();
+};
+
+#endif
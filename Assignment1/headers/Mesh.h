@@ -13,6 +13,8 @@
 
 #include<string>
 #include<vector>
+#include<iostream>
+#include<cstddef>
 #include"shader.h"
 
 
@@ -30,19 +32,36 @@ struct Vertex {
 };
 
 
+//Per instance data for instanced draws
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    float modelType;
+};
+
+
 struct Texture{
     unsigned int id;
     std::string type;
     std::string path;
 };
 
+//One input a mesh can feed to a vertex shader, matched by name so the shader picks the location
+struct MeshInput {
+    const char* name;
+    GLenum type;          //as glGetActiveAttrib reports it
+    GLint components;     //per column
+    GLint columns;
+    size_t offset;
+    bool perInstance;     //from the instance buffer instead of the vertices
+};
+
 //Mesh Class
 class Mesh{
 public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
-    unsigned int VAO;
     
 //Constructor
 Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
@@ -86,7 +105,7 @@ void Draw(Shader& shader)
 
     }
 
-    glBindVertexArray(VAO);
+    glBindVertexArray(vertexArrayFor(shader));
     glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);   
 
@@ -94,51 +113,135 @@ void Draw(Shader& shader)
 
 }
 
+//Giving the mesh the model's instance buffer, the VAOs are rebuilt to read from it
+void setupInstancing(unsigned int instanceBuffer)
+{
+    instanceVBO = instanceBuffer;
+    for(const ProgramBinding& binding : bindings)
+        glDeleteVertexArrays(1, &binding.vao);
+    bindings.clear();
+}
+
+//Drawing all instances in one call
+void DrawInstanced(Shader& shader, unsigned int count)
+{
+    glBindVertexArray(vertexArrayFor(shader));
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0, static_cast<GLsizei>(count));
+    glBindVertexArray(0);
+}
+
+//The VAO for drawing with this program, made on first use. It only enables the inputs the
+//program reads, found by name, so shaders can use any locations and unused attributes aren't fetched
+unsigned int vertexArrayFor(const Shader& shader)
+{
+    for(const ProgramBinding& binding : bindings)
+        if(binding.program == shader.ID)
+            return binding.vao;
+
+    ProgramBinding binding = { shader.ID, 0 };
+    glGenVertexArrays(1, &binding.vao);
+    glBindVertexArray(binding.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    GLint count = 0;
+    glGetProgramiv(shader.ID, GL_ACTIVE_ATTRIBUTES, &count);
+    for(GLint i = 0; i < count; i++)
+    {
+        char name[64];
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveAttrib(shader.ID, static_cast<GLuint>(i), sizeof(name), nullptr, &size, &type, name);
+        GLint location = glGetAttribLocation(shader.ID, name);
+        //built in inputs (gl_VertexID, ...) have no location
+        if(location < 0)
+            continue;
+        bindInput(name, type, static_cast<GLuint>(location));
+    }
+
+    glBindVertexArray(0);
+    bindings.push_back(binding);
+    return binding.vao;
+}
+
 private:
 
+    struct ProgramBinding {
+        unsigned int program;
+        unsigned int vao;
+    };
+
     unsigned int VBO, EBO;
+    unsigned int instanceVBO = 0;
+    std::vector<ProgramBinding> bindings;
+
+    //Everything the mesh can provide
+    static const std::vector<MeshInput>& inputs()
+    {
+        static const std::vector<MeshInput> table = {
+            { "aPos",          GL_FLOAT_VEC3, 3, 1, offsetof(Vertex, Position),  false },
+            { "aColor",        GL_FLOAT_VEC3, 3, 1, offsetof(Vertex, Color),     false },
+            { "aNormal",       GL_FLOAT_VEC3, 3, 1, offsetof(Vertex, Normal),    false },
+            { "aTexCoords",    GL_FLOAT_VEC2, 2, 1, offsetof(Vertex, TexCoords), false },
+            { "aTangent",      GL_FLOAT_VEC3, 3, 1, offsetof(Vertex, Tangent),   false },
+            { "aBitangent",    GL_FLOAT_VEC3, 3, 1, offsetof(Vertex, Bitangent), false },
+            { "iModel",        GL_FLOAT_MAT4, 4, 4, offsetof(InstanceData, model),        true },
+            { "iNormalMatrix", GL_FLOAT_MAT3, 3, 3, offsetof(InstanceData, normalMatrix), true },
+            { "iModelType",    GL_FLOAT,      1, 1, offsetof(InstanceData, modelType),    true },
+        };
+        return table;
+    }
+
+    //Points one program input at the mesh data, or says why it can't
+    void bindInput(const std::string& name, GLenum type, GLuint location)
+    {
+        const MeshInput* input = nullptr;
+        for(const MeshInput& candidate : inputs())
+            if(name == candidate.name)
+                input = &candidate;
+
+        if(input == nullptr)
+        {
+            std::cout << "WARNING::MESH::INPUT_NOT_PROVIDED " << name << " reads a constant" << std::endl;
+            return;
+        }
+        if(input->type != type)
+        {
+            std::cout << "WARNING::MESH::INPUT_TYPE_MISMATCH " << name << " is declared with another type than the mesh provides" << std::endl;
+            return;
+        }
+        if(input->perInstance && instanceVBO == 0)
+        {
+            std::cout << "WARNING::MESH::NO_INSTANCE_BUFFER " << name << " is read by a program drawn without instances" << std::endl;
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, input->perInstance ? instanceVBO : VBO);
+        GLsizei stride = input->perInstance ? sizeof(InstanceData) : sizeof(Vertex);
+        //matrices take one location per column
+        for(GLint column = 0; column < input->columns; column++)
+        {
+            GLuint columnLocation = location + static_cast<GLuint>(column);
+            size_t offset = input->offset + static_cast<size_t>(column * input->components) * sizeof(float);
+            glEnableVertexAttribArray(columnLocation);
+            glVertexAttribPointer(columnLocation, input->components, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+            glVertexAttribDivisor(columnLocation, input->perInstance ? 1 : 0);
+        }
+    }
 
     void setupMesh()
     {
-        //creating bufferss
-        glGenVertexArrays(1, &VAO);
+        //creating bufferss, the VAOs are made per program in vertexArrayFor
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
-
         //Loading data in VBO
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);  
-
-        //POSITION
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
-        //Color
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Color));
-
-        //Vertex Normals
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        
-        //Vertex Texture Coords
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-        //Vertex Tangents
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-
-        //Vertex Bitangents
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));   
-
-        glBindVertexArray(0);
+        //the element binding belongs to a VAO, so the indices go in through GL_ARRAY_BUFFER
+        glBindBuffer(GL_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     }
     
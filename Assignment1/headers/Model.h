@@ -38,6 +38,7 @@ class Model
     std::vector<Mesh> meshes;
     std::string directory;
     bool gammaCorrection;
+    unsigned int instanceVBO = 0;
 
     //Constructor 
     //My model will be loaded using this
@@ -54,6 +55,29 @@ class Model
             meshes[i].Draw(shader);
     }  
 
+    //Draws every instance with one call per mesh
+    void DrawInstanced(Shader &shader, const std::vector<InstanceData> &instances)
+    {
+        if(instances.empty())
+            return;
+
+        if(instanceVBO == 0)
+        {
+            glGenBuffers(1, &instanceVBO);
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].setupInstancing(instanceVBO);
+        }
+
+        //Orphaning the old data so we don't wait for last frame's draws
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(instances.size() * sizeof(InstanceData)), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(instances.size() * sizeof(InstanceData)), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, static_cast<unsigned int>(instances.size()));
+    }
+
     private:
     //Loads model with assimp
     void loadModel(std::string const &path)
@@ -3,81 +3,184 @@ out vec4 FragColor;
 
 in vec3 Normal;
 in vec3 FragPos;
+flat in int ModelType;
 
-uniform vec3 lightPos;
+uniform vec3 lightPos;                  //Directional: where the key light comes from
 uniform vec3 viewPos;
 uniform vec3 objectColor;
-uniform int modelType; 
 
-
-void main()
+//Point lights, assigned to clusters on the CPU (LightClusters.h)
+uniform samplerBuffer clusterLights;    //Two texels per light: position + radius, color
+uniform usamplerBuffer clusterGrid;     //Per cluster: offset into clusterIndices, light count
+uniform usamplerBuffer clusterIndices;
+uniform vec2 clusterScreen;             //Viewport size in pixels
+uniform float clusterNear;
+uniform float clusterFar;
+uniform float clusterSliceScale;        //Slices per log unit of depth
+
+//Key light shadows, cascaded shadow maps (CascadedShadows.h)
+uniform sampler2DArrayShadow shadowMap;
+uniform int shadowCascades;
+uniform mat4 shadowMatrices[4];         //World to shadow map coordinates and depth
+uniform vec4 shadowSplits;              //View depth where each cascade ends
+uniform vec4 shadowTexelSizes;          //World units per texel of each cascade
+uniform int shadowPcfRadius;
+uniform float shadowNormalBias;         //Texels
+
+//Lighting lookup tables (LightingLUTs.h) instead of the analytic Oren-Nayar and toon terms
+uniform bool lightingLUTs;
+uniform sampler3D orenNayarLUT;         //Over (NdotL, NdotV, roughness) R: NdotL * A, G: NdotL * B * sin(alpha) * tan(beta)
+uniform sampler1D toonRamp;             //Over NdotL -1..1
+
+const int TILES_X = 16;
+const int TILES_Y = 9;
+const int SLICES = 24;
+
+const float roughness = 0.5;
+
+//Must match LightingLUTs::OREN_NAYAR_COSINES and OREN_NAYAR_ROUGHNESS
+const vec3 OREN_NAYAR_LUT_SIZE = vec3(64.0, 64.0, 16.0);
+
+
+//How much of one light the surface sends to the viewer, without the object color
+float lightResponse(int modelType, vec3 norm, vec3 viewDir, vec3 lightDir)
 {
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 result = vec3(0.0);
-
-    //Declaring the variables here 
-    float diff = 0.0;
-    float spec = 0.0;
-    float intensity = 0.0;
-    float roughness = 0.5;
-    float sigma2 = 0.0;
-    float A = 0.0;
-    float B = 0.0;
-
     //Blinn - Phong
     if(modelType == 0)
     {
         vec3 halfwayDir = normalize(lightDir + viewDir);
-        diff = max(dot(norm, lightDir), 0.0);
-        spec = pow(max(dot(norm, halfwayDir), 0.0), 32.0);
-        result = (diff + spec) * objectColor; 
+        float diff = max(dot(norm, lightDir), 0.0);
+        float spec = pow(max(dot(norm, halfwayDir), 0.0), 32.0);
+        return diff + spec;
     }
 
     // Toon Shading 
     else if(modelType == 1)
     {
-        intensity = dot(lightDir, norm);
-        float level = floor(intensity * 4.0) / 4.0;
-        result = max(level, 0.1) * objectColor; 
+        float intensity = dot(lightDir, norm);
+        if(lightingLUTs)
+            return texture(toonRamp, intensity * 0.5 + 0.5).r;
+        return max(floor(intensity * 4.0) / 4.0, 0.0);
     }
 
     //Oren-Nayar 
-    else if(modelType == 2)
+    float LdotN = dot(lightDir, norm);
+    float VdotN = dot(viewDir, norm);
+
+    //One fetch for everything but the azimuth; cosPhi straight from the dot products, the
+    //projections onto the surface have lengths sqrt(1 - cos^2)
+    if(lightingLUTs)
     {
-        float LdotN = dot(lightDir, norm);
-        float VdotN = dot(viewDir, norm);
+        vec3 lutPos = vec3(clamp(LdotN, 0.0, 1.0), clamp(VdotN, 0.0, 1.0), roughness);
+        vec2 terms = texture(orenNayarLUT, (lutPos * (OREN_NAYAR_LUT_SIZE - 1.0) + 0.5) / OREN_NAYAR_LUT_SIZE).rg;
+        float projected = (1.0 - LdotN * LdotN) * (1.0 - VdotN * VdotN);
+        float cosPhi = projected > 1e-6 ? max(0.0, (dot(lightDir, viewDir) - LdotN * VdotN) * inversesqrt(projected)) : 0.0;
+        return terms.r + terms.g * cosPhi;
+    }
+
+    float cosThetaI = clamp(LdotN, 0.0, 1.0);
+    float cosThetaR = clamp(VdotN, 0.0, 1.0);
+
+    float thetaI = acos(cosThetaI);
+    float thetaR = acos(cosThetaR);
 
-        float cosThetaI = clamp(LdotN, 0.0, 1.0);
-        float cosThetaR = clamp(VdotN, 0.0, 1.0);
+    float alpha = max(thetaI, thetaR);
+    float beta = min(thetaI, thetaR);
 
-        float thetaI = acos(cosThetaI);
-        float thetaR = acos(cosThetaR);
+    float sigma2 = roughness * roughness; 
 
-        float alpha = max(thetaI, thetaR);
-        float beta = min(thetaI, thetaR);
+    float A = 1.0 - 0.5 * (sigma2/ (sigma2 + 0.33));
+    float B = 0.45 * (sigma2/ (sigma2 + 0.09));
 
-        sigma2 = roughness * roughness; 
+    vec3 lightProj = lightDir - norm * LdotN;
+    vec3 viewProj = viewDir - norm * VdotN;
 
-        A = 1.0 - 0.5 * (sigma2/ (sigma2 + 0.33));
-        B = 0.45 * (sigma2/ (sigma2 + 0.09));
+    float cosPhiDiff = 0.0;
+    if(length(lightProj) > 0.001 && length(viewProj) > 0.001)
+    {
+        cosPhiDiff = max(0.0, dot(normalize(lightProj), normalize(viewProj)));
+    }
 
-        vec3 lightProj = lightDir - norm * LdotN;
-        vec3 viewProj = viewDir - norm * VdotN;
+    float direct = (A + B * cosPhiDiff * sin(alpha) * tan(beta));
 
-        float cosPhiDiff = 0.0;
-        if(length(lightProj) > 0.001 && length(viewProj) > 0.001)
-        {
-            cosPhiDiff = max(0.0, dot(normalize(lightProj), normalize(viewProj)));
-        }
+    return cosThetaI * direct;
+}
 
-        float direct = (A + B * cosPhiDiff * sin(alpha) * tan(beta));
+//Linear view depth back from the depth buffer value
+float viewDepth()
+{
+    float ndcZ = gl_FragCoord.z * 2.0 - 1.0;
+    return 2.0 * clusterNear * clusterFar / (clusterFar + clusterNear - ndcZ * (clusterFar - clusterNear));
+}
 
-        result = objectColor * cosThetaI * direct; 
+//Index of the cluster this fragment falls into, same slicing as LightClusters::assignSlices
+int clusterIndex()
+{
+    float depth = viewDepth();
+    int slice = clamp(int(floor(log(depth / clusterNear) * clusterSliceScale)), 0, SLICES - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterScreen * vec2(TILES_X, TILES_Y)), ivec2(0), ivec2(TILES_X - 1, TILES_Y - 1));
+    return (slice * TILES_Y + tile.y) * TILES_X + tile.x;
+}
+
+//How much of the key light reaches the fragment, PCF over hardware compared taps
+float keyShadow(vec3 norm, vec3 lightDir)
+{
+    float depth = viewDepth();
+    if(shadowCascades == 0 || depth > shadowSplits[shadowCascades - 1])
+        return 1.0;
+    int cascade = 0;
+    for(int i = 0; i < shadowCascades - 1; i++)
+        if(depth > shadowSplits[i])
+            cascade = i + 1;
+
+    //Moved out along the normal, further where the surface turns away from the light
+    float slope = 1.0 - max(dot(norm, lightDir), 0.0);
+    vec3 offsetPos = FragPos + norm * shadowTexelSizes[cascade] * shadowNormalBias * (0.5 + slope);
+    vec3 coord = (shadowMatrices[cascade] * vec4(offsetPos, 1.0)).xyz;
+    if(any(lessThan(coord, vec3(0.0))) || any(greaterThan(coord, vec3(1.0))))
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int y = -shadowPcfRadius; y <= shadowPcfRadius; y++)
+        for(int x = -shadowPcfRadius; x <= shadowPcfRadius; x++)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+    float taps = float(2 * shadowPcfRadius + 1);
+    return lit / (taps * taps);
+}
+
+
+void main()
+{
+    int modelType = ModelType;
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(viewPos - FragPos);
+
+    //The key light, shadowed; toon keeps its 0.1 floor
+    vec3 keyDir = normalize(lightPos);
+    float key = lightResponse(modelType, norm, viewDir, keyDir) * keyShadow(norm, keyDir);
+    if(modelType == 1)
+        key = max(key, 0.1);
+    vec3 result = key * objectColor;
+
+    //Only the lights of this cluster
+    uvec2 cluster = texelFetch(clusterGrid, clusterIndex()).xy;
+    for(uint i = 0u; i < cluster.y; i++)
+    {
+        int light = int(texelFetch(clusterIndices, int(cluster.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+        vec3 color = texelFetch(clusterLights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - FragPos;
+        float distance = length(toLight);
+        if(distance >= positionRadius.w)
+            continue;
+        //Inverse square, windowed to reach zero at the radius
+        float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance * distance + 1.0);
+
+        result += lightResponse(modelType, norm, viewDir, toLight / distance) * attenuation * color * objectColor;
     }
 
     FragColor = vec4(result, 1.0);
-
-    
-}
\ No newline at end of file
+}
@@ -5,15 +5,18 @@ layout (location = 2) in vec3 aNormal;
 
 out vec3 Normal;
 out vec3 FragPos;
+flat out int ModelType;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform int modelType;
 
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;
+    ModelType = modelType;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 
 }
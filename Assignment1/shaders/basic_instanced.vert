@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec3 aNormal;
+
+//Per instance data (InstanceData in Mesh.h)
+layout (location = 6) in mat4 iModel;
+layout (location = 10) in mat3 iNormalMatrix;
+layout (location = 13) in float iModelType;
+
+out vec3 Normal;
+out vec3 FragPos;
+flat out int ModelType;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    FragPos = vec3(iModel * vec4(aPos, 1.0));
+    Normal = iNormalMatrix * aNormal;
+    ModelType = int(iModelType + 0.5);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+
+}
@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+//Per instance data (InstanceData in Mesh.h), only the model matrix is needed here
+layout (location = 6) in mat4 iModel;
+
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * iModel * vec4(aPos, 1.0);
+}